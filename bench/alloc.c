@@ -0,0 +1,83 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Compares creating instructions out of an ordinary ralloc context with
+ * creating them out of a linear context.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <time.h>
+#include "nir.h"
+
+#define NUM_INSTRS 1000000
+
+static double
+now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+create_instrs(const char *name, void *mem_ctx, void *free_ctx)
+{
+   double start = now();
+
+   for (unsigned i = 0; i < NUM_INSTRS; i++) {
+      switch (i % 3) {
+      case 0:
+	 nir_alu_instr_create(mem_ctx, nir_op_fadd);
+	 break;
+      case 1:
+	 nir_alu_instr_create(mem_ctx, nir_op_fneg);
+	 break;
+      default:
+	 nir_load_const_instr_create(mem_ctx);
+	 break;
+      }
+   }
+
+   double created = now();
+   ralloc_free(free_ctx);
+   double elapsed = now() - start;
+
+   printf("{\"bench\": \"%s\", \"ops\": %u, \"seconds\": %f, "
+	  "\"free_seconds\": %f, \"ops_per_sec\": %.0f}\n",
+	  name, NUM_INSTRS, elapsed, now() - created, NUM_INSTRS / elapsed);
+}
+
+int main(void)
+{
+   void *ctx = ralloc_context(NULL);
+   create_instrs("instr_create_ralloc", ctx, ctx);
+
+   ctx = ralloc_context(NULL);
+   create_instrs("instr_create_linear", ralloc_linear_context(ctx), ctx);
+
+   return 0;
+}
@@ -0,0 +1,294 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Compares main/hash_table.c against the prime-sized, double-hashing table
+ * it replaced, a copy of which is kept below, and against main/set.c.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "main/hash_table.h"
+#include "main/set.h"
+#include "ralloc.h"
+
+#define NUM_KEYS (1 << 16)
+#define ROUNDS 20
+
+/*
+ * The old implementation
+ */
+
+static const uint32_t old_deleted_key_value;
+
+static const struct {
+   uint32_t max_entries, size, rehash;
+} old_hash_sizes[] = {
+   { 2,			5,		3	  },
+   { 4,			7,		5	  },
+   { 8,			13,		11	  },
+   { 16,		19,		17	  },
+   { 32,		43,		41        },
+   { 64,		73,		71        },
+   { 128,		151,		149       },
+   { 256,		283,		281       },
+   { 512,		571,		569       },
+   { 1024,		1153,		1151      },
+   { 2048,		2269,		2267      },
+   { 4096,		4519,		4517      },
+   { 8192,		9013,		9011      },
+   { 16384,		18043,		18041     },
+   { 32768,		36109,		36107     },
+   { 65536,		72091,		72089     },
+   { 131072,		144409,		144407    },
+};
+
+struct old_hash_table {
+   struct hash_entry *table;
+   bool (*key_equals_function)(const void *a, const void *b);
+   const void *deleted_key;
+   uint32_t size;
+   uint32_t rehash;
+   uint32_t max_entries;
+   uint32_t size_index;
+   uint32_t entries;
+   uint32_t deleted_entries;
+};
+
+static int
+old_entry_is_free(const struct hash_entry *entry)
+{
+   return entry->key == NULL;
+}
+
+static int
+old_entry_is_present(const struct old_hash_table *ht, struct hash_entry *entry)
+{
+   return entry->key != NULL && entry->key != ht->deleted_key;
+}
+
+static struct old_hash_table *
+old_create(void *mem_ctx, bool (*key_equals_function)(const void *a,
+						      const void *b))
+{
+   struct old_hash_table *ht = ralloc(mem_ctx, struct old_hash_table);
+
+   ht->size_index = 0;
+   ht->size = old_hash_sizes[ht->size_index].size;
+   ht->rehash = old_hash_sizes[ht->size_index].rehash;
+   ht->max_entries = old_hash_sizes[ht->size_index].max_entries;
+   ht->key_equals_function = key_equals_function;
+   ht->table = rzalloc_array(ht, struct hash_entry, ht->size);
+   ht->entries = 0;
+   ht->deleted_entries = 0;
+   ht->deleted_key = &old_deleted_key_value;
+
+   return ht;
+}
+
+static struct hash_entry *
+old_search(struct old_hash_table *ht, uint32_t hash, const void *key)
+{
+   uint32_t start_hash_address = hash % ht->size;
+   uint32_t hash_address = start_hash_address;
+
+   do {
+      uint32_t double_hash;
+
+      struct hash_entry *entry = ht->table + hash_address;
+
+      if (old_entry_is_free(entry)) {
+	 return NULL;
+      } else if (old_entry_is_present(ht, entry) && entry->hash == hash) {
+	 if (ht->key_equals_function(key, entry->key)) {
+	    return entry;
+	 }
+      }
+
+      double_hash = 1 + hash % ht->rehash;
+
+      hash_address = (hash_address + double_hash) % ht->size;
+   } while (hash_address != start_hash_address);
+
+   return NULL;
+}
+
+static struct hash_entry *old_insert(struct old_hash_table *ht, uint32_t hash,
+				     const void *key, void *data);
+
+static void
+old_rehash(struct old_hash_table *ht, unsigned new_size_index)
+{
+   struct old_hash_table old_ht = *ht;
+
+   ht->table = rzalloc_array(ht, struct hash_entry,
+			     old_hash_sizes[new_size_index].size);
+   ht->size_index = new_size_index;
+   ht->size = old_hash_sizes[ht->size_index].size;
+   ht->rehash = old_hash_sizes[ht->size_index].rehash;
+   ht->max_entries = old_hash_sizes[ht->size_index].max_entries;
+   ht->entries = 0;
+   ht->deleted_entries = 0;
+
+   for (unsigned i = 0; i < old_ht.size; i++) {
+      struct hash_entry *entry = old_ht.table + i;
+      if (old_entry_is_present(&old_ht, entry))
+	 old_insert(ht, entry->hash, entry->key, entry->data);
+   }
+
+   ralloc_free(old_ht.table);
+}
+
+static struct hash_entry *
+old_insert(struct old_hash_table *ht, uint32_t hash, const void *key,
+	   void *data)
+{
+   uint32_t start_hash_address, hash_address;
+
+   if (ht->entries >= ht->max_entries) {
+      old_rehash(ht, ht->size_index + 1);
+   } else if (ht->deleted_entries + ht->entries >= ht->max_entries) {
+      old_rehash(ht, ht->size_index);
+   }
+
+   start_hash_address = hash % ht->size;
+   hash_address = start_hash_address;
+   do {
+      struct hash_entry *entry = ht->table + hash_address;
+      uint32_t double_hash;
+
+      if (!old_entry_is_present(ht, entry)) {
+	 if (entry->key == ht->deleted_key)
+	    ht->deleted_entries--;
+	 entry->hash = hash;
+	 entry->key = key;
+	 entry->data = data;
+	 ht->entries++;
+	 return entry;
+      }
+
+      if (entry->hash == hash &&
+	  ht->key_equals_function(key, entry->key)) {
+	 entry->key = key;
+	 entry->data = data;
+	 return entry;
+      }
+
+      double_hash = 1 + hash % ht->rehash;
+
+      hash_address = (hash_address + double_hash) % ht->size;
+   } while (hash_address != start_hash_address);
+
+   return NULL;
+}
+
+static void
+old_remove(struct old_hash_table *ht, struct hash_entry *entry)
+{
+   entry->key = ht->deleted_key;
+   ht->entries--;
+   ht->deleted_entries++;
+}
+
+/*
+ * The benchmark
+ */
+
+static int keys[2 * NUM_KEYS];
+static uint32_t hashes[2 * NUM_KEYS];
+
+static double
+now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+report(const char *engine, const char *op, unsigned ops, double seconds)
+{
+   printf("{\"bench\": \"hash_table_%s\", \"engine\": \"%s\", \"ops\": %u, "
+	  "\"seconds\": %f, \"ops_per_sec\": %.0f}\n",
+	  op, engine, ops, seconds, ops / seconds);
+}
+
+/* Keeps the compiler from throwing away lookups. */
+static volatile unsigned found;
+
+#define RUN_BENCH(engine, create, insert, search, remove)		\
+   do {									\
+      double t_insert = 0, t_hit = 0, t_miss = 0, t_remove = 0;		\
+      unsigned hits = 0;						\
+      for (unsigned r = 0; r < ROUNDS; r++) {				\
+	 void *mem_ctx = ralloc_context(NULL);				\
+	 __typeof__(create(mem_ctx, _mesa_key_pointer_equal)) ht =	\
+	    create(mem_ctx, _mesa_key_pointer_equal);			\
+	 double start = now();						\
+	 for (unsigned i = 0; i < NUM_KEYS; i++)			\
+	    insert(ht, hashes[i], &keys[i], &keys[i]);			\
+	 double t0 = now();						\
+	 for (unsigned i = 0; i < NUM_KEYS; i++)			\
+	    hits += search(ht, hashes[i], &keys[i]) != NULL;		\
+	 double t1 = now();						\
+	 for (unsigned i = NUM_KEYS; i < 2 * NUM_KEYS; i++)		\
+	    hits += search(ht, hashes[i], &keys[i]) != NULL;		\
+	 double t2 = now();						\
+	 for (unsigned i = 0; i < NUM_KEYS; i += 2)			\
+	    remove(ht, search(ht, hashes[i], &keys[i]));		\
+	 double t3 = now();						\
+	 t_insert += t0 - start;					\
+	 t_hit += t1 - t0;						\
+	 t_miss += t2 - t1;						\
+	 t_remove += t3 - t2;						\
+	 ralloc_free(mem_ctx);						\
+      }									\
+      found = hits;							\
+      report(engine, "insert", NUM_KEYS * ROUNDS, t_insert);		\
+      report(engine, "search_hit", NUM_KEYS * ROUNDS, t_hit);		\
+      report(engine, "search_miss", NUM_KEYS * ROUNDS, t_miss);	\
+      report(engine, "remove", NUM_KEYS / 2 * ROUNDS, t_remove);	\
+   } while (0)
+
+/* sets have no data to insert */
+#define set_add(set, hash, key, data) _mesa_set_add(set, hash, key)
+
+int main(void)
+{
+   for (unsigned i = 0; i < 2 * NUM_KEYS; i++)
+      hashes[i] = _mesa_hash_pointer(&keys[i]);
+
+   RUN_BENCH("prime_double_hashing", old_create, old_insert, old_search,
+	     old_remove);
+   RUN_BENCH("group_probing", _mesa_hash_table_create,
+	     _mesa_hash_table_insert, _mesa_hash_table_search,
+	     _mesa_hash_table_remove);
+   RUN_BENCH("set", _mesa_set_create, set_add, _mesa_set_search,
+	     _mesa_set_remove);
+
+   return 0;
+}
@@ -0,0 +1,564 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Builds large synthetic shaders and times the core IR operations on them:
+ * building, validating, printing, removing and reinserting instructions and
+ * control flow, and freeing. The shaders come from a seeded generator, so
+ * runs with the same seed are comparable; every size is run so that
+ * scaling problems show up as a drop in ops/sec between sizes.
+ *
+ * Usage: ir.bench [seed]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "nir_builder.h"
+
+#define NUM_FUNCTIONS 4
+#define NUM_GLOBAL_REGS 64
+#define MAX_DEPTH 6
+#define REPEAT 5
+
+#define MIN2(a, b) ((a) < (b) ? (a) : (b))
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+/* statements and registers per function at scale 1 */
+#define BASE_STATEMENTS 600
+#define BASE_REGS 512
+
+static const unsigned scales[] = { 1, 4, 16 };
+
+static double
+now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long
+peak_rss_kb(void)
+{
+   struct rusage usage;
+   getrusage(RUSAGE_SELF, &usage);
+   return usage.ru_maxrss;
+}
+
+static void
+report(const char *name, unsigned seed, unsigned scale, unsigned instrs,
+       double ops, double seconds)
+{
+   printf("{\"bench\": \"%s\", \"seed\": %u, \"scale\": %u, "
+	  "\"instrs\": %u, \"ops\": %.0f, \"seconds\": %f, "
+	  "\"ops_per_sec\": %.0f, \"peak_rss_kb\": %ld}\n",
+	  name, seed, scale, instrs, ops, seconds, ops / seconds,
+	  peak_rss_kb());
+}
+
+typedef struct {
+   uint32_t rng;
+
+   nir_shader *shader;
+   nir_function_impl *impl;
+   nir_builder b;
+
+   nir_register **regs;
+   unsigned num_regs;
+   nir_register *global_regs[NUM_GLOBAL_REGS];
+   nir_variable *var;
+
+   /* SSA values that dominate the cursor */
+   nir_ssa_def **ssa;
+   unsigned num_ssa, ssa_size;
+
+   unsigned num_instrs, num_cf_nodes;
+} generator;
+
+/* xorshift32 */
+static unsigned
+rand_below(generator *gen, unsigned n)
+{
+   gen->rng ^= gen->rng << 13;
+   gen->rng ^= gen->rng >> 17;
+   gen->rng ^= gen->rng << 5;
+   return gen->rng % n;
+}
+
+static nir_register *
+random_reg(generator *gen)
+{
+   if (rand_below(gen, 10) == 0)
+      return gen->global_regs[rand_below(gen, NUM_GLOBAL_REGS)];
+
+   return gen->regs[rand_below(gen, gen->num_regs)];
+}
+
+static void
+add_ssa(generator *gen, nir_ssa_def *def)
+{
+   if (gen->num_ssa == gen->ssa_size) {
+      gen->ssa_size = gen->ssa_size ? 2 * gen->ssa_size : 64;
+      gen->ssa = realloc(gen->ssa, gen->ssa_size * sizeof(nir_ssa_def *));
+   }
+
+   gen->ssa[gen->num_ssa++] = def;
+}
+
+static void
+insert(generator *gen, nir_instr *instr)
+{
+   nir_builder_instr_insert(&gen->b, instr);
+   gen->num_instrs++;
+}
+
+static void
+set_reg_src(nir_src *src, nir_register *reg)
+{
+   src->is_ssa = false;
+   src->reg.reg = reg;
+}
+
+static void
+set_ssa_src(nir_src *src, nir_ssa_def *def)
+{
+   src->is_ssa = true;
+   src->ssa = def;
+}
+
+/* reads a register into an SSA value */
+static nir_ssa_def *
+emit_read_reg(generator *gen)
+{
+   nir_alu_instr *mov = nir_alu_instr_create(gen->shader, nir_op_mov);
+   set_reg_src(&mov->src[0].src, random_reg(gen));
+   nir_ssa_dest_init(gen->impl, &mov->instr, &mov->dest.dest, 4, NULL);
+   mov->dest.write_mask = 0xf;
+   insert(gen, &mov->instr);
+   return &mov->dest.dest.ssa;
+}
+
+static nir_ssa_def *
+random_ssa(generator *gen)
+{
+   if (gen->num_ssa == 0 || rand_below(gen, 4) == 0)
+      return emit_read_reg(gen);
+
+   unsigned window = MIN2(gen->num_ssa, 16);
+   return gen->ssa[gen->num_ssa - 1 - rand_below(gen, window)];
+}
+
+static void
+emit_reg_alu(generator *gen)
+{
+   static const nir_op ops[] = { nir_op_fadd, nir_op_fmul, nir_op_fmin,
+				 nir_op_fmax, nir_op_ffma, nir_op_fneg };
+   nir_op op = ops[rand_below(gen, ARRAY_SIZE(ops))];
+
+   nir_alu_instr *alu = nir_alu_instr_create(gen->shader, op);
+   for (unsigned i = 0; i < nir_op_infos[op].num_inputs; i++)
+      set_reg_src(&alu->src[i].src, random_reg(gen));
+   alu->dest.dest.reg.reg = random_reg(gen);
+   alu->dest.write_mask = 0xf;
+   insert(gen, &alu->instr);
+}
+
+static void
+emit_load_const(generator *gen)
+{
+   nir_load_const_instr *load_const = nir_load_const_instr_create(gen->shader);
+   load_const->dest.reg.reg = random_reg(gen);
+   for (unsigned i = 0; i < 4; i++)
+      load_const->value.f[i] = rand_below(gen, 1000) * 0.25f;
+   insert(gen, &load_const->instr);
+}
+
+/* a chain of SSA arithmetic ending in a register write */
+static void
+emit_ssa_chain(generator *gen)
+{
+   unsigned length = 2 + rand_below(gen, 8);
+   nir_ssa_def *value = random_ssa(gen);
+
+   for (unsigned i = 0; i < length; i++) {
+      switch (rand_below(gen, 4)) {
+	 case 0:
+	    value = nir_fadd(&gen->b, value, random_ssa(gen));
+	    break;
+	 case 1:
+	    value = nir_fmul(&gen->b, value, random_ssa(gen));
+	    break;
+	 case 2:
+	    value = nir_ffma(&gen->b, value, random_ssa(gen), random_ssa(gen));
+	    break;
+	 default:
+	    value = nir_fneg(&gen->b, value);
+	    break;
+      }
+
+      gen->num_instrs++;
+      add_ssa(gen, value);
+   }
+
+   nir_alu_instr *mov = nir_alu_instr_create(gen->shader, nir_op_mov);
+   set_ssa_src(&mov->src[0].src, value);
+   mov->dest.dest.reg.reg = random_reg(gen);
+   mov->dest.write_mask = 0xf;
+   insert(gen, &mov->instr);
+}
+
+static void
+emit_tex(generator *gen)
+{
+   nir_tex_instr *tex = nir_tex_instr_create(gen->shader, 2);
+   tex->op = rand_below(gen, 2) ? nir_texop_tex : nir_texop_txl;
+   set_ssa_src(&tex->src[0], random_ssa(gen));
+   tex->src_type[0] = nir_tex_src_coord;
+   set_reg_src(&tex->src[1], random_reg(gen));
+   tex->src_type[1] = tex->op == nir_texop_tex ? nir_tex_src_bias
+					       : nir_tex_src_ms_index;
+   tex->coord_components = 2;
+   tex->sampler_index = rand_below(gen, 16);
+   tex->dest.reg.reg = random_reg(gen);
+   insert(gen, &tex->instr);
+}
+
+static void
+emit_var_access(generator *gen)
+{
+   nir_intrinsic_instr *intrin;
+
+   if (rand_below(gen, 2)) {
+      intrin = nir_intrinsic_instr_create(gen->shader,
+					  nir_intrinsic_load_var_vec4);
+      nir_ssa_dest_init(gen->impl, &intrin->instr, &intrin->dest, 4, NULL);
+   } else {
+      intrin = nir_intrinsic_instr_create(gen->shader,
+					  nir_intrinsic_store_var_vec4);
+      set_reg_src(&intrin->src[0], random_reg(gen));
+   }
+
+   intrin->variables[0] = nir_deref_var_create(gen->shader, gen->var);
+   insert(gen, &intrin->instr);
+
+   if (intrin->intrinsic == nir_intrinsic_load_var_vec4)
+      add_ssa(gen, &intrin->dest.ssa);
+}
+
+static void
+emit_straight_line(generator *gen)
+{
+   unsigned count = 4 + rand_below(gen, 8);
+
+   for (unsigned i = 0; i < count; i++) {
+      switch (rand_below(gen, 8)) {
+	 case 0:
+	 case 1:
+	 case 2:
+	    emit_reg_alu(gen);
+	    break;
+	 case 3:
+	    emit_load_const(gen);
+	    break;
+	 case 4:
+	 case 5:
+	    emit_ssa_chain(gen);
+	    break;
+	 case 6:
+	    emit_tex(gen);
+	    break;
+	 default:
+	    emit_var_access(gen);
+	    break;
+      }
+   }
+}
+
+static void gen_cf_list(generator *gen, struct exec_list *list, unsigned depth,
+			unsigned statements);
+
+static nir_if *
+gen_if(generator *gen, struct exec_list *list)
+{
+   nir_if *if_stmt = nir_if_create(gen->shader);
+   if (rand_below(gen, 2))
+      set_reg_src(&if_stmt->condition, random_reg(gen));
+   else
+      set_ssa_src(&if_stmt->condition, random_ssa(gen));
+
+   nir_cf_node_insert_end(list, &if_stmt->cf_node);
+   gen->num_cf_nodes++;
+
+   return if_stmt;
+}
+
+static void
+gen_cf_list(generator *gen, struct exec_list *list, unsigned depth,
+	    unsigned statements)
+{
+   while (statements > 0) {
+      gen->b.cursor = nir_after_cf_list(list);
+
+      unsigned choice = depth < MAX_DEPTH ? rand_below(gen, 10) : 0;
+      unsigned budget = 1 + rand_below(gen, 40);
+      budget = MIN2(budget, statements);
+      unsigned num_ssa = gen->num_ssa;
+
+      if (choice < 6 || budget < 4) {
+	 emit_straight_line(gen);
+	 statements--;
+	 continue;
+      }
+
+      if (choice < 8) {
+	 nir_if *if_stmt = gen_if(gen, list);
+	 gen_cf_list(gen, &if_stmt->then_list, depth + 1, budget / 2);
+	 gen->num_ssa = num_ssa;
+	 gen_cf_list(gen, &if_stmt->else_list, depth + 1, budget / 2);
+      } else {
+	 nir_loop *loop = nir_loop_create(gen->shader);
+	 nir_cf_node_insert_end(list, &loop->cf_node);
+	 gen->num_cf_nodes++;
+
+	 /* if (cond) break; */
+	 gen->b.cursor = nir_after_cf_list(&loop->body);
+	 nir_if *exit = gen_if(gen, &loop->body);
+	 nir_jump_instr *jump = nir_jump_instr_create(gen->shader,
+						      nir_jump_break);
+	 nir_instr_insert_after_cf_list(&exit->then_list, &jump->instr);
+	 gen->num_instrs++;
+
+	 gen_cf_list(gen, &loop->body, depth + 1, budget);
+      }
+
+      /* values defined inside the if or loop don't dominate what follows */
+      gen->num_ssa = num_ssa;
+      statements -= budget;
+   }
+}
+
+static nir_shader *
+generate_shader(unsigned seed, unsigned scale, unsigned *num_instrs,
+		unsigned *num_cf_nodes)
+{
+   generator gen;
+   gen.rng = seed * 2654435761u + 1;
+   gen.shader = nir_shader_create(NULL);
+   gen.num_regs = BASE_REGS * scale;
+   gen.regs = malloc(gen.num_regs * sizeof(nir_register *));
+   gen.ssa = NULL;
+   gen.ssa_size = 0;
+   gen.num_instrs = 0;
+   gen.num_cf_nodes = 0;
+
+   for (unsigned i = 0; i < NUM_GLOBAL_REGS; i++) {
+      gen.global_regs[i] = nir_global_reg_create(gen.shader);
+      gen.global_regs[i]->num_components = 4;
+   }
+
+   for (unsigned f = 0; f < NUM_FUNCTIONS; f++) {
+      char *name = ralloc_asprintf(gen.shader, "func%u", f);
+      nir_function *func = nir_function_create(gen.shader, name);
+      nir_function_overload *overload = nir_function_overload_create(func);
+      gen.impl = nir_function_impl_create(overload);
+      nir_builder_init(&gen.b, gen.shader, gen.impl);
+
+      for (unsigned i = 0; i < gen.num_regs; i++) {
+	 gen.regs[i] = nir_local_reg_create(gen.impl);
+	 gen.regs[i]->num_components = 4;
+      }
+
+      gen.var = rzalloc(gen.shader, nir_variable);
+      gen.var->type = glsl_vec4_type();
+      gen.var->name = "v";
+      gen.var->data.mode = nir_var_local;
+      exec_list_push_tail(&gen.impl->locals, &gen.var->node);
+
+      gen.num_ssa = 0;
+      gen_cf_list(&gen, &gen.impl->body, 0, BASE_STATEMENTS * scale);
+   }
+
+   free(gen.regs);
+   free(gen.ssa);
+
+   *num_instrs = gen.num_instrs;
+   *num_cf_nodes = gen.num_cf_nodes;
+   return gen.shader;
+}
+
+static void
+mark_all_dirty(nir_shader *shader)
+{
+   shader->globals_dirty = true;
+}
+
+/*
+ * Removes every instruction other than jumps, then puts them back where
+ * they were.
+ */
+static void
+bench_instr_remove_insert(nir_shader *shader, unsigned seed, unsigned scale,
+			  unsigned num_instrs)
+{
+   nir_instr **instrs = malloc(num_instrs * sizeof(nir_instr *));
+   nir_block **blocks = malloc(num_instrs * sizeof(nir_block *));
+   unsigned count = 0;
+
+   foreach_list_typed(nir_function, func, node, &shader->functions) {
+      foreach_list_typed(nir_function_overload, overload, node,
+			 &func->overload_list) {
+	 nir_foreach_block_in_order(overload->impl, block) {
+	    nir_foreach_instr(block, instr) {
+	       if (instr->type == nir_instr_type_jump)
+		  continue;
+	       blocks[count] = block;
+	       instrs[count++] = instr;
+	    }
+	 }
+      }
+   }
+
+   double start = now();
+   for (unsigned i = 0; i < count; i++)
+      nir_instr_remove(instrs[i]);
+   report("ir_instr_remove", seed, scale, num_instrs, count, now() - start);
+
+   start = now();
+   for (unsigned i = 0; i < count; i++) {
+      nir_cursor cursor = i > 0 && blocks[i - 1] == blocks[i] ?
+			  nir_after_instr(instrs[i - 1]) :
+			  nir_before_block(blocks[i]);
+      nir_instr_insert(cursor, instrs[i]);
+   }
+   report("ir_instr_insert", seed, scale, num_instrs, count, now() - start);
+
+   free(instrs);
+   free(blocks);
+}
+
+/* puts an empty if after every if and loop, then removes them again */
+static void
+bench_cf_insert_remove(nir_shader *shader, unsigned seed, unsigned scale,
+		       unsigned num_instrs, unsigned num_cf_nodes)
+{
+   nir_cf_node **nodes = malloc(num_cf_nodes * sizeof(nir_cf_node *));
+   nir_if **new_ifs = malloc(num_cf_nodes * sizeof(nir_if *));
+   unsigned count = 0;
+
+   nir_register *condition = nir_global_reg_create(shader);
+   condition->num_components = 1;
+
+   foreach_list_typed(nir_function, func, node, &shader->functions) {
+      foreach_list_typed(nir_function_overload, overload, node,
+			 &func->overload_list) {
+	 nir_foreach_block_in_order(overload->impl, block) {
+	    if (block == overload->impl->end_block)
+	       continue;
+
+	    nir_cf_node *next = nir_cf_node_next(&block->cf_node);
+	    if (!exec_node_is_tail_sentinel(&next->node))
+	       nodes[count++] = next;
+	 }
+      }
+   }
+
+   for (unsigned i = 0; i < count; i++) {
+      new_ifs[i] = nir_if_create(shader);
+      new_ifs[i]->condition.reg.reg = condition;
+   }
+
+   double start = now();
+   for (unsigned i = 0; i < count; i++)
+      nir_cf_node_insert_after(nodes[i], &new_ifs[i]->cf_node);
+   report("ir_cf_insert", seed, scale, num_instrs, count, now() - start);
+
+   start = now();
+   for (unsigned i = 0; i < count; i++)
+      nir_cf_node_remove(&new_ifs[i]->cf_node);
+   report("ir_cf_remove", seed, scale, num_instrs, count, now() - start);
+
+   free(nodes);
+   free(new_ifs);
+}
+
+static void
+run(unsigned seed, unsigned scale)
+{
+   unsigned num_instrs, num_cf_nodes;
+
+   double start = now();
+   nir_shader *shader = generate_shader(seed, scale, &num_instrs,
+					&num_cf_nodes);
+   report("ir_build", seed, scale, num_instrs, num_instrs + num_cf_nodes,
+	  now() - start);
+
+   start = now();
+   for (unsigned i = 0; i < REPEAT; i++) {
+      mark_all_dirty(shader);
+      nir_validate_shader(shader);
+   }
+   report("ir_validate", seed, scale, num_instrs, REPEAT * num_instrs,
+	  now() - start);
+
+   start = now();
+   for (unsigned i = 0; i < REPEAT; i++) {
+      mark_all_dirty(shader);
+      nir_validate_shader_fast(shader);
+   }
+   report("ir_validate_fast", seed, scale, num_instrs, REPEAT * num_instrs,
+	  now() - start);
+
+   FILE *fp = fopen("/dev/null", "w");
+   start = now();
+   for (unsigned i = 0; i < REPEAT; i++)
+      nir_print_shader(shader, fp);
+   report("ir_print", seed, scale, num_instrs, REPEAT * num_instrs,
+	  now() - start);
+   fclose(fp);
+
+   bench_instr_remove_insert(shader, seed, scale, num_instrs);
+   bench_cf_insert_remove(shader, seed, scale, num_instrs, num_cf_nodes);
+
+   /* make sure the benchmarks above left a valid shader behind */
+   mark_all_dirty(shader);
+   nir_validate_shader(shader);
+
+   start = now();
+   ralloc_free(shader);
+   report("ir_free", seed, scale, num_instrs, num_instrs, now() - start);
+}
+
+int main(int argc, char **argv)
+{
+   unsigned seed = argc > 1 ? strtoul(argv[1], NULL, 0) : 1;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(scales); i++)
+      run(seed, scales[i]);
+
+   return 0;
+}
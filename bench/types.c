@@ -0,0 +1,148 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Multi-threaded stress test for glsl_type interning. Every thread asks for
+ * the same set of (nested) array types in a different order; at the end, all
+ * threads must have gotten back identical pointers for identical types.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "nir_types.h"
+
+#define MAX_THREADS 64
+#define NUM_LENGTHS 64
+#define NUM_BASES 3
+#define NUM_KEYS (NUM_BASES * NUM_LENGTHS)
+#define ITERATIONS 200000
+
+static const struct glsl_type *bases[NUM_BASES];
+
+typedef struct {
+   unsigned id;
+   const struct glsl_type *results[NUM_KEYS];
+} thread_state;
+
+static void *
+intern_types(void *data)
+{
+   thread_state *state = (thread_state *) data;
+
+   for (unsigned i = 0; i < ITERATIONS; i++) {
+      /* walk the key space with a per-thread stride, so that threads race
+       * on creating new types at the beginning and on looking up existing
+       * ones afterwards. The stride is coprime to NUM_KEYS, so every thread
+       * visits every key.
+       */
+      unsigned key = (i * (6 * state->id + 1) + state->id) % NUM_KEYS;
+      const struct glsl_type *base = bases[key % NUM_BASES];
+      unsigned length = key / NUM_BASES + 1;
+
+      const struct glsl_type *type = glsl_array_type(base, length);
+      type = glsl_array_type(type, length % 4 + 1);
+
+      if (state->results[key] == NULL)
+	 state->results[key] = type;
+      else if (state->results[key] != type)
+	 abort();
+   }
+
+   return NULL;
+}
+
+static double
+now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool
+run(unsigned num_threads)
+{
+   static thread_state states[MAX_THREADS];
+   pthread_t threads[MAX_THREADS];
+
+   for (unsigned i = 0; i < num_threads; i++) {
+      states[i].id = i;
+      for (unsigned j = 0; j < NUM_KEYS; j++)
+	 states[i].results[j] = NULL;
+   }
+
+   double start = now();
+
+   for (unsigned i = 0; i < num_threads; i++)
+      pthread_create(&threads[i], NULL, intern_types, &states[i]);
+
+   for (unsigned i = 0; i < num_threads; i++)
+      pthread_join(threads[i], NULL);
+
+   double elapsed = now() - start;
+
+   for (unsigned i = 1; i < num_threads; i++) {
+      for (unsigned j = 0; j < NUM_KEYS; j++) {
+	 if (states[i].results[j] != states[0].results[j]) {
+	    fprintf(stderr, "thread %u got a different type for key %u\n",
+		    i, j);
+	    return false;
+	 }
+      }
+   }
+
+   /* two lookups per iteration */
+   double ops = 2.0 * ITERATIONS * num_threads;
+   printf("{\"bench\": \"type_intern\", \"threads\": %u, \"ops\": %.0f, "
+	  "\"seconds\": %f, \"ops_per_sec\": %.0f}\n",
+	  num_threads, ops, elapsed, ops / elapsed);
+
+   return true;
+}
+
+int main(void)
+{
+   bases[0] = glsl_float_type();
+   bases[1] = glsl_vec4_type();
+   bases[2] = glsl_int_type();
+
+   long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+   if (num_cpus < 1)
+      num_cpus = 1;
+   if (num_cpus > MAX_THREADS)
+      num_cpus = MAX_THREADS;
+
+   for (unsigned threads = 1; threads < num_cpus; threads *= 2) {
+      if (!run(threads))
+	 return 1;
+   }
+
+   return run(num_cpus) ? 0 : 1;
+}
@@ -24,18 +24,116 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "glsl_types.h"
-extern "C" {
-#include "program/hash_table.h"
-}
+#include "main/hash_table.h"
 
 #ifndef MAX2
 #define MAX2(a, b) ((a) > (b) ? (a) : (b))
 #endif
 
-hash_table *glsl_type::array_types = NULL;
-hash_table *glsl_type::record_types = NULL;
-hash_table *glsl_type::interface_types = NULL;
+glsl_type_table *glsl_type::array_types = NULL;
+glsl_type_table *glsl_type::record_types = NULL;
+glsl_type_table *glsl_type::interface_types = NULL;
 void *glsl_type::mem_ctx = NULL;
+pthread_mutex_t glsl_type::mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Insert-only open-addressing hash table of interned types.
+ *
+ * Entries are never removed or moved, so readers can probe the table without
+ * holding \c glsl_type::mutex: a slot's hash is written before its type is
+ * published with a release store, and readers load the type with an acquire.
+ * Inserting and growing are done with the mutex held.  Growing builds a new
+ * slot array and publishes it as a whole; the old table is kept around
+ * (parented to the new one) since a concurrent reader may still be walking
+ * it.  A reader that misses on an old table simply retries with the lock.
+ */
+struct glsl_type_table_slot {
+   uint32_t hash;
+   const glsl_type *type;  /**< \c NULL for free slots. */
+};
+
+struct glsl_type_table {
+   unsigned size;     /**< Number of slots, a power of two. */
+   unsigned entries;  /**< Number of used slots. */
+   glsl_type_table_slot *slots;
+};
+
+static glsl_type_table *
+type_table_create(void *mem_ctx, unsigned size)
+{
+   glsl_type_table *table = ralloc(mem_ctx, glsl_type_table);
+   table->size = size;
+   table->entries = 0;
+   table->slots = rzalloc_array(table, glsl_type_table_slot, size);
+   return table;
+}
+
+/**
+ * Looks up a type; \c match is called on every type with a matching hash.
+ * Safe to call without the mutex.
+ */
+static const glsl_type *
+type_table_search(glsl_type_table *const *table_ptr, uint32_t hash,
+		  bool (*match)(const glsl_type *type, const void *key),
+		  const void *key)
+{
+   const glsl_type_table *table = __atomic_load_n(table_ptr, __ATOMIC_ACQUIRE);
+   if (table == NULL)
+      return NULL;
+
+   const unsigned mask = table->size - 1;
+   for (unsigned i = hash & mask; ; i = (i + 1) & mask) {
+      const glsl_type *type =
+	 __atomic_load_n(&table->slots[i].type, __ATOMIC_ACQUIRE);
+      if (type == NULL)
+	 return NULL;
+      if (table->slots[i].hash == hash && match(type, key))
+	 return type;
+   }
+}
+
+static void
+type_table_add_slot(glsl_type_table *table, uint32_t hash,
+		    const glsl_type *type)
+{
+   const unsigned mask = table->size - 1;
+   unsigned i = hash & mask;
+   while (table->slots[i].type != NULL)
+      i = (i + 1) & mask;
+
+   table->slots[i].hash = hash;
+   __atomic_store_n(&table->slots[i].type, type, __ATOMIC_RELEASE);
+   table->entries++;
+}
+
+/**
+ * Adds a type that is known not to be in the table yet.  Must be called with
+ * \c glsl_type::mutex held.
+ */
+static void
+type_table_insert(void *mem_ctx, glsl_type_table **table_ptr, uint32_t hash,
+		  const glsl_type *type)
+{
+   glsl_type_table *table = *table_ptr;
+
+   if (table == NULL) {
+      table = type_table_create(mem_ctx, 64);
+      __atomic_store_n(table_ptr, table, __ATOMIC_RELEASE);
+   } else if (2 * (table->entries + 1) > table->size) {
+      glsl_type_table *old = table;
+
+      table = type_table_create(mem_ctx, old->size * 2);
+      for (unsigned i = 0; i < old->size; i++) {
+	 if (old->slots[i].type != NULL)
+	    type_table_add_slot(table, old->slots[i].hash, old->slots[i].type);
+      }
+
+      ralloc_steal(table, old);
+      __atomic_store_n(table_ptr, table, __ATOMIC_RELEASE);
+   }
+
+   type_table_add_slot(table, hash, type);
+}
 
 void
 glsl_type::init_ralloc_type_ctx(void)
@@ -54,7 +152,7 @@ glsl_type::glsl_type(GLenum gl_type,
    sampler_dimensionality(0), sampler_shadow(0), sampler_array(0),
    sampler_type(0), interface_packing(0),
    vector_elements(vector_elements), matrix_columns(matrix_columns),
-   length(0)
+   length(0), array_cache(NULL)
 {
    init_ralloc_type_ctx();
    assert(name != NULL);
@@ -72,7 +170,7 @@ glsl_type::glsl_type(GLenum gl_type, glsl_base_type base_type,
    base_type(base_type),
    sampler_dimensionality(dim), sampler_shadow(shadow),
    sampler_array(array), sampler_type(type), interface_packing(0),
-   length(0)
+   length(0), array_cache(NULL)
 {
    init_ralloc_type_ctx();
    assert(name != NULL);
@@ -94,7 +192,7 @@ glsl_type::glsl_type(const glsl_struct_field *fields, unsigned num_fields,
    sampler_dimensionality(0), sampler_shadow(0), sampler_array(0),
    sampler_type(0), interface_packing(0),
    vector_elements(0), matrix_columns(0),
-   length(num_fields)
+   length(num_fields), array_cache(NULL)
 {
    unsigned int i;
 
@@ -122,7 +220,7 @@ glsl_type::glsl_type(const glsl_struct_field *fields, unsigned num_fields,
    sampler_dimensionality(0), sampler_shadow(0), sampler_array(0),
    sampler_type(0), interface_packing((unsigned) packing),
    vector_elements(0), matrix_columns(0),
-   length(num_fields)
+   length(num_fields), array_cache(NULL)
 {
    unsigned int i;
 
@@ -288,15 +386,29 @@ const glsl_type *glsl_type::get_scalar_type() const
 void
 _mesa_glsl_release_types(void)
 {
+   pthread_mutex_lock(&glsl_type::mutex);
+
    if (glsl_type::array_types != NULL) {
-      hash_table_dtor(glsl_type::array_types);
+      /* The element types may outlive the table, so don't leave them
+       * pointing at array types that a later lookup won't find.
+       */
+      glsl_type_table *table = glsl_type::array_types;
+      for (unsigned i = 0; i < table->size; i++) {
+	 if (table->slots[i].type != NULL)
+	    table->slots[i].type->fields.array->array_cache = NULL;
+      }
+
+      ralloc_free(table);
       glsl_type::array_types = NULL;
    }
 
-   if (glsl_type::record_types != NULL) {
-      hash_table_dtor(glsl_type::record_types);
-      glsl_type::record_types = NULL;
-   }
+   ralloc_free(glsl_type::record_types);
+   glsl_type::record_types = NULL;
+
+   ralloc_free(glsl_type::interface_types);
+   glsl_type::interface_types = NULL;
+
+   pthread_mutex_unlock(&glsl_type::mutex);
 }
 
 
@@ -305,7 +417,7 @@ glsl_type::glsl_type(const glsl_type *array, unsigned length) :
    sampler_dimensionality(0), sampler_shadow(0), sampler_array(0),
    sampler_type(0), interface_packing(0),
    vector_elements(0), matrix_columns(0),
-   name(NULL), length(length)
+   name(NULL), length(length), array_cache(NULL)
 {
    this->fields.array = array;
    /* Inherit the gl type of the base. The GL type is used for
@@ -452,30 +564,55 @@ glsl_type::get_instance(unsigned base_type, unsigned rows, unsigned columns)
 }
 
 
+struct array_key {
+   const glsl_type *base;
+   unsigned length;
+};
+
+static uint32_t
+array_key_hash(const glsl_type *base, unsigned length)
+{
+   uint64_t h = (uint64_t) (uintptr_t) base * 0x9e3779b97f4a7c15ull;
+   h ^= (h >> 29) + length * 0xc2b2ae3d27d4eb4full;
+   return (uint32_t) (h ^ (h >> 32));
+}
+
+static bool
+array_key_match(const glsl_type *type, const void *data)
+{
+   const array_key *key = (const array_key *) data;
+   return type->fields.array == key->base && type->length == key->length;
+}
+
 const glsl_type *
 glsl_type::get_array_instance(const glsl_type *base, unsigned array_size)
 {
+   const glsl_type *t = __atomic_load_n(&base->array_cache, __ATOMIC_ACQUIRE);
+   if (t != NULL && t->length == array_size)
+      return t;
 
-   if (array_types == NULL) {
-      array_types = hash_table_ctor(64, hash_table_string_hash,
-				    hash_table_string_compare);
-   }
-
-   /* Generate a name using the base type pointer in the key.  This is
-    * done because the name of the base type may not be unique across
-    * shaders.  For example, two shaders may have different record types
-    * named 'foo'.
+   /* The key uses the base type pointer rather than its name, since the
+    * name of the base type may not be unique across shaders.  For example,
+    * two shaders may have different record types named 'foo'.
     */
-   char key[128];
-   snprintf(key, sizeof(key), "%p[%u]", (void *) base, array_size);
+   const array_key key = { base, array_size };
+   const uint32_t hash = array_key_hash(base, array_size);
 
-   const glsl_type *t = (glsl_type *) hash_table_find(array_types, key);
+   t = type_table_search(&array_types, hash, array_key_match, &key);
    if (t == NULL) {
-      t = new glsl_type(base, array_size);
+      pthread_mutex_lock(&glsl_type::mutex);
+
+      t = type_table_search(&array_types, hash, array_key_match, &key);
+      if (t == NULL) {
+	 t = new glsl_type(base, array_size);
+	 type_table_insert(mem_ctx, &array_types, hash, t);
+      }
 
-      hash_table_insert(array_types, (void *) t, ralloc_strdup(mem_ctx, key));
+      pthread_mutex_unlock(&glsl_type::mutex);
    }
 
+   __atomic_store_n(&base->array_cache, t, __ATOMIC_RELEASE);
+
    assert(t->base_type == GLSL_TYPE_ARRAY);
    assert(t->length == array_size);
    assert(t->fields.array == base);
@@ -484,98 +621,123 @@ glsl_type::get_array_instance(const glsl_type *base, unsigned array_size)
 }
 
 
-bool
-glsl_type::record_compare(const glsl_type *b) const
+/**
+ * Compares the fields of two record or interface types.
+ */
+static bool
+record_fields_equal(const glsl_struct_field *a, const glsl_struct_field *b,
+		    unsigned length)
 {
-   if (this->length != b->length)
-      return false;
-
-   if (this->interface_packing != b->interface_packing)
-      return false;
-
-   for (unsigned i = 0; i < this->length; i++) {
-      if (this->fields.structure[i].type != b->fields.structure[i].type)
+   for (unsigned i = 0; i < length; i++) {
+      if (a[i].type != b[i].type)
+	 return false;
+      if (strcmp(a[i].name, b[i].name) != 0)
+	 return false;
+      if (a[i].row_major != b[i].row_major)
+	 return false;
+      if (a[i].location != b[i].location)
 	 return false;
-      if (strcmp(this->fields.structure[i].name,
-		 b->fields.structure[i].name) != 0)
+      if (a[i].interpolation != b[i].interpolation)
+	 return false;
+      if (a[i].centroid != b[i].centroid)
+	 return false;
+      if (a[i].sample != b[i].sample)
 	 return false;
-      if (this->fields.structure[i].row_major
-         != b->fields.structure[i].row_major)
-        return false;
-      if (this->fields.structure[i].location
-          != b->fields.structure[i].location)
-         return false;
-      if (this->fields.structure[i].interpolation
-          != b->fields.structure[i].interpolation)
-         return false;
-      if (this->fields.structure[i].centroid
-          != b->fields.structure[i].centroid)
-         return false;
-      if (this->fields.structure[i].sample
-          != b->fields.structure[i].sample)
-         return false;
    }
 
    return true;
 }
 
 
-int
-glsl_type::record_key_compare(const void *a, const void *b)
+bool
+glsl_type::record_compare(const glsl_type *b) const
 {
-   const glsl_type *const key1 = (glsl_type *) a;
-   const glsl_type *const key2 = (glsl_type *) b;
+   if (this->length != b->length)
+      return false;
 
-   /* Return zero is the types match (there is zero difference) or non-zero
-    * otherwise.
-    */
-   if (strcmp(key1->name, key2->name) != 0)
-      return 1;
+   if (this->interface_packing != b->interface_packing)
+      return false;
 
-   return !key1->record_compare(key2);
+   return record_fields_equal(this->fields.structure, b->fields.structure,
+			      this->length);
 }
 
 
-unsigned
-glsl_type::record_key_hash(const void *a)
-{
-   const glsl_type *const key = (glsl_type *) a;
-   char hash_key[128];
-   unsigned size = 0;
-
-   size = snprintf(hash_key, sizeof(hash_key), "%08x", key->length);
+struct record_key {
+   const glsl_struct_field *fields;
+   unsigned num_fields;
+   unsigned packing;
+   const char *name;
+};
 
-   for (unsigned i = 0; i < key->length; i++) {
-      if (size >= sizeof(hash_key))
-	 break;
+/**
+ * Hashes the name, packing and field types of a record or interface type.
+ * Field names are left out: they rarely tell apart types that have the same
+ * name and field types, and hashing them would mean walking every string on
+ * every lookup.
+ */
+static uint32_t
+record_key_hash(const record_key *key)
+{
+   uint64_t h = _mesa_hash_string(key->name);
+   h ^= (uint64_t) key->num_fields << 32 | key->packing;
 
-      size += snprintf(& hash_key[size], sizeof(hash_key) - size,
-		       "%p", (void *) key->fields.structure[i].type);
+   for (unsigned i = 0; i < key->num_fields; i++) {
+      h = (h ^ (uintptr_t) key->fields[i].type) * 0x9e3779b97f4a7c15ull;
+      h ^= h >> 29;
    }
 
-   return hash_table_string_hash(& hash_key);
+   return (uint32_t) (h ^ (h >> 32));
 }
 
+static bool
+record_key_match(const glsl_type *type, const void *data)
+{
+   const record_key *key = (const record_key *) data;
+
+   return type->length == key->num_fields &&
+	  type->interface_packing == key->packing &&
+	  strcmp(type->name, key->name) == 0 &&
+	  record_fields_equal(type->fields.structure, key->fields,
+			      key->num_fields);
+}
 
+/**
+ * Looks up or creates a record or interface type in the given table.  The
+ * caller's fields are hashed and compared directly, without building a
+ * temporary type (and copying every field name) first.
+ */
 const glsl_type *
-glsl_type::get_record_instance(const glsl_struct_field *fields,
+glsl_type::get_struct_instance(glsl_type_table **table_ptr,
+			       glsl_base_type base_type,
+			       const glsl_struct_field *fields,
 			       unsigned num_fields,
+			       unsigned packing,
 			       const char *name)
 {
-   const glsl_type key(fields, num_fields, name);
+   const record_key key = { fields, num_fields, packing, name };
+   const uint32_t hash = record_key_hash(&key);
 
-   if (record_types == NULL) {
-      record_types = hash_table_ctor(64, record_key_hash, record_key_compare);
-   }
-
-   const glsl_type *t = (glsl_type *) hash_table_find(record_types, & key);
+   const glsl_type *t = type_table_search(table_ptr, hash, record_key_match,
+					  &key);
    if (t == NULL) {
-      t = new glsl_type(fields, num_fields, name);
+      pthread_mutex_lock(&glsl_type::mutex);
+
+      t = type_table_search(table_ptr, hash, record_key_match, &key);
+      if (t == NULL) {
+	 if (base_type == GLSL_TYPE_STRUCT) {
+	    t = new glsl_type(fields, num_fields, name);
+	 } else {
+	    t = new glsl_type(fields, num_fields,
+			      (enum glsl_interface_packing) packing, name);
+	 }
+	 type_table_insert(mem_ctx, table_ptr, hash, t);
+      }
 
-      hash_table_insert(record_types, (void *) t, t);
+      pthread_mutex_unlock(&glsl_type::mutex);
    }
 
-   assert(t->base_type == GLSL_TYPE_STRUCT);
+   assert(t->base_type == base_type);
    assert(t->length == num_fields);
    assert(strcmp(t->name, name) == 0);
 
@@ -583,30 +745,24 @@ glsl_type::get_record_instance(const glsl_struct_field *fields,
 }
 
 
+const glsl_type *
+glsl_type::get_record_instance(const glsl_struct_field *fields,
+			       unsigned num_fields,
+			       const char *name)
+{
+   return get_struct_instance(&record_types, GLSL_TYPE_STRUCT, fields,
+			      num_fields, 0, name);
+}
+
+
 const glsl_type *
 glsl_type::get_interface_instance(const glsl_struct_field *fields,
 				  unsigned num_fields,
 				  enum glsl_interface_packing packing,
 				  const char *block_name)
 {
-   const glsl_type key(fields, num_fields, packing, block_name);
-
-   if (interface_types == NULL) {
-      interface_types = hash_table_ctor(64, record_key_hash, record_key_compare);
-   }
-
-   const glsl_type *t = (glsl_type *) hash_table_find(interface_types, & key);
-   if (t == NULL) {
-      t = new glsl_type(fields, num_fields, packing, block_name);
-
-      hash_table_insert(interface_types, (void *) t, t);
-   }
-
-   assert(t->base_type == GLSL_TYPE_INTERFACE);
-   assert(t->length == num_fields);
-   assert(strcmp(t->name, block_name) == 0);
-
-   return t;
+   return get_struct_instance(&interface_types, GLSL_TYPE_INTERFACE, fields,
+			      num_fields, packing, block_name);
 }
 
 
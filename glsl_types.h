@@ -78,6 +78,7 @@ enum glsl_interface_packing {
 };
 
 #ifdef __cplusplus
+#include <pthread.h>
 #include "GL/gl.h"
 #include "ralloc.h"
 
@@ -96,7 +97,11 @@ struct glsl_type {
    unsigned interface_packing:2;
 
    /* Callers of this ralloc-based new need not call delete. It's
-    * easier to just ralloc_free 'mem_ctx' (or any of its ancestors). */
+    * easier to just ralloc_free 'mem_ctx' (or any of its ancestors).
+    *
+    * Must be called with \c glsl_type::mutex held, since \c mem_ctx is
+    * shared between all threads.
+    */
    static void* operator new(size_t size)
    {
       if (glsl_type::mem_ctx == NULL) {
@@ -154,6 +159,16 @@ struct glsl_type {
       struct glsl_struct_field *structure;      /**< List of struct fields. */
    } fields;
 
+   /**
+    * The array type most recently returned by \c get_array_instance with
+    * this type as the element type, or \c NULL.
+    *
+    * Checked before the array type table, since code tends to ask for the
+    * same array of the same type over and over again.  Only ever read and
+    * written atomically, and only ever points at an interned type.
+    */
+   mutable const glsl_type *array_cache;
+
    /**
     * \name Pointers to various public type singletons
     */
@@ -572,6 +587,16 @@ private:
     */
    static void *mem_ctx;
 
+   /**
+    * Protects \c mem_ctx and the array, record and interface type tables.
+    *
+    * Types are interned, so two threads asking for the same type must get
+    * the same pointer back; the insertion and the lookup that precedes it
+    * therefore happen in a single critical section.  Types that already
+    * exist can also be found without the lock, see \c glsl_type_table.
+    */
+   static pthread_mutex_t mutex;
+
    void init_ralloc_type_ctx(void);
 
    /** Constructor for vector and matrix types */
@@ -595,17 +620,21 @@ private:
    /** Constructor for array types */
    glsl_type(const glsl_type *array, unsigned length);
 
-   /** Hash table containing the known array types. */
-   static struct hash_table *array_types;
+   /** Open-addressing table containing the known array types. */
+   static struct glsl_type_table *array_types;
 
-   /** Hash table containing the known record types. */
-   static struct hash_table *record_types;
+   /** Open-addressing table containing the known record types. */
+   static struct glsl_type_table *record_types;
 
-   /** Hash table containing the known interface types. */
-   static struct hash_table *interface_types;
+   /** Open-addressing table containing the known interface types. */
+   static struct glsl_type_table *interface_types;
 
-   static int record_key_compare(const void *a, const void *b);
-   static unsigned record_key_hash(const void *key);
+   static const glsl_type *get_struct_instance(glsl_type_table **table_ptr,
+					       glsl_base_type base_type,
+					       const glsl_struct_field *fields,
+					       unsigned num_fields,
+					       unsigned packing,
+					       const char *name);
 
    /**
     * \name Built-in type flyweights
@@ -0,0 +1,195 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/**
+ * \file hash_group.h
+ *
+ * Control bytes for open-addressing hash tables with a power-of-two number
+ * of slots, probed 16 slots at a time.
+ *
+ * Every slot has a control byte: either HASH_CTRL_EMPTY, HASH_CTRL_DELETED,
+ * or, for slots in use, a 7-bit tag taken from the key's hash.  A lookup
+ * compares the tag against a whole group of control bytes at once and only
+ * looks at the entries whose tag matches, so it rarely touches more than one
+ * entry.  The first HASH_GROUP_WIDTH - 1 control bytes are cloned after the
+ * last one, so that a group can start at any slot without wrapping.
+ *
+ * This is internal to the hash table and set implementations.
+ */
+
+#ifndef _HASH_GROUP_H
+#define _HASH_GROUP_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define HASH_GROUP_WIDTH 16
+
+#define HASH_CTRL_EMPTY   ((uint8_t) 0x80)
+#define HASH_CTRL_DELETED ((uint8_t) 0xfe)
+
+/* the number of control bytes to allocate for a table with size slots */
+#define HASH_CTRL_BYTES(size) ((size) + HASH_GROUP_WIDTH - 1)
+
+static inline bool
+hash_ctrl_is_full(uint8_t ctrl)
+{
+   return ctrl < 0x80;
+}
+
+/**
+ * Spreads the bits of a caller-provided hash over the whole word.
+ *
+ * Tags and start slots are taken from different bits of the hash, and
+ * callers' hashes (FNV of a pointer, say) often vary in only a few of them.
+ */
+static inline uint32_t
+hash_ctrl_mix(uint32_t hash)
+{
+   hash ^= hash >> 16;
+   hash *= 0x85ebca6b;
+   hash ^= hash >> 13;
+   return hash;
+}
+
+static inline uint8_t
+hash_ctrl_tag(uint32_t hash)
+{
+   return hash_ctrl_mix(hash) >> 25;
+}
+
+/* the slot where probing for the given hash starts */
+static inline uint32_t
+hash_ctrl_start(uint32_t hash, uint32_t size)
+{
+   return hash_ctrl_mix(hash) & (size - 1);
+}
+
+/**
+ * Returns how many entries a table with size slots may hold (counting
+ * deleted ones) before it needs to grow.  At least one slot always stays
+ * empty, which is what stops lookups.
+ */
+static inline uint32_t
+hash_ctrl_max_load(uint32_t size)
+{
+   return size < 8 ? size - 1 : size - size / 8;
+}
+
+/**
+ * Returns a bitmask with bit i set if the control byte of slot pos + i is
+ * equal to value.
+ */
+static inline unsigned
+hash_group_match(const uint8_t *ctrl, uint32_t pos, uint8_t value)
+{
+#ifdef __SSE2__
+   __m128i group = _mm_loadu_si128((const __m128i *) (ctrl + pos));
+   return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(value)));
+#else
+   unsigned mask = 0;
+   for (unsigned i = 0; i < HASH_GROUP_WIDTH; i++) {
+      if (ctrl[pos + i] == value)
+         mask |= 1u << i;
+   }
+   return mask;
+#endif
+}
+
+/** Like hash_group_match(), matching both empty and deleted slots. */
+static inline unsigned
+hash_group_match_free(const uint8_t *ctrl, uint32_t pos)
+{
+#ifdef __SSE2__
+   __m128i group = _mm_loadu_si128((const __m128i *) (ctrl + pos));
+   return _mm_movemask_epi8(group);
+#else
+   unsigned mask = 0;
+   for (unsigned i = 0; i < HASH_GROUP_WIDTH; i++) {
+      if (!hash_ctrl_is_full(ctrl[pos + i]))
+         mask |= 1u << i;
+   }
+   return mask;
+#endif
+}
+
+/** Returns the index of the lowest set bit of a non-zero mask. */
+static inline unsigned
+hash_group_first(unsigned mask)
+{
+   return __builtin_ctz(mask);
+}
+
+static inline void
+hash_ctrl_init(uint8_t *ctrl, uint32_t size)
+{
+   memset(ctrl, HASH_CTRL_EMPTY, HASH_CTRL_BYTES(size));
+}
+
+/** Sets the control byte of slot i, keeping its clone in sync. */
+static inline void
+hash_ctrl_set(uint8_t *ctrl, uint32_t size, uint32_t i, uint8_t value)
+{
+   ctrl[i] = value;
+   if (i < HASH_GROUP_WIDTH - 1)
+      ctrl[size + i] = value;
+}
+
+/**
+ * Returns the control byte a slot should get when its entry is deleted.
+ *
+ * Lookups stop at the first group with an empty slot, so a slot can only be
+ * made empty again if no lookup could have gone past it, that is, if every
+ * group containing it has had an empty slot since it was filled.  That is
+ * the case when the runs of full or deleted slots immediately before and
+ * after it are shorter than a group.  Otherwise, it has to become a
+ * tombstone until the next rehash.
+ */
+static inline uint8_t
+hash_ctrl_deleted_value(const uint8_t *ctrl, uint32_t size, uint32_t i)
+{
+   /* a single group covers the whole table */
+   if (size < HASH_GROUP_WIDTH)
+      return HASH_CTRL_EMPTY;
+
+   uint32_t before = (i - HASH_GROUP_WIDTH) & (size - 1);
+   unsigned empty_after = hash_group_match(ctrl, i, HASH_CTRL_EMPTY);
+   unsigned empty_before = hash_group_match(ctrl, before, HASH_CTRL_EMPTY);
+
+   if (empty_after == 0 || empty_before == 0)
+      return HASH_CTRL_DELETED;
+
+   /* full slots right after i, and right before it */
+   unsigned run_after = __builtin_ctz(empty_after);
+   unsigned run_before = __builtin_clz(empty_before << (32 - HASH_GROUP_WIDTH));
+
+   return run_after + run_before < HASH_GROUP_WIDTH ?
+          HASH_CTRL_EMPTY : HASH_CTRL_DELETED;
+}
+
+#endif /* _HASH_GROUP_H */
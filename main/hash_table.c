@@ -33,78 +33,48 @@
  */
 
 /**
- * Implements an open-addressing, linear-reprobing hash table.
+ * Implements an open-addressing hash table with a power-of-two number of
+ * slots and a byte of control information per slot, probed a group of 16
+ * slots at a time (see main/hash_group.h).
  *
- * For more information, see:
- *
- * http://cgit.freedesktop.org/~anholt/hash_table/tree/README
+ * The control bytes live in their own array after the entries, so a lookup
+ * usually only touches one cache line of control bytes and the single entry
+ * whose tag matches.  Deleting an entry only tombstones its slot when a
+ * lookup could have probed past it, and entries never move except when the
+ * table is rehashed on insertion.
  */
 
 #include <stdlib.h>
 #include <string.h>
 
 #include "main/hash_table.h"
+#include "main/hash_group.h"
 #include "ralloc.h"
 
-static const uint32_t deleted_key_value;
+#define MIN_SIZE 4
 
-/**
- * From Knuth -- a good choice for hash/rehash values is p, p-2 where
- * p and p-2 are both prime.  These tables are sized to have an extra 10%
- * free to avoid exponential performance degradation as the hash table fills
+/*
+ * Allocates the entries and control bytes for a table of the given size,
+ * in a single block.
  */
-static const struct {
-   uint32_t max_entries, size, rehash;
-} hash_sizes[] = {
-   { 2,			5,		3	  },
-   { 4,			7,		5	  },
-   { 8,			13,		11	  },
-   { 16,		19,		17	  },
-   { 32,		43,		41        },
-   { 64,		73,		71        },
-   { 128,		151,		149       },
-   { 256,		283,		281       },
-   { 512,		571,		569       },
-   { 1024,		1153,		1151      },
-   { 2048,		2269,		2267      },
-   { 4096,		4519,		4517      },
-   { 8192,		9013,		9011      },
-   { 16384,		18043,		18041     },
-   { 32768,		36109,		36107     },
-   { 65536,		72091,		72089     },
-   { 131072,		144409,		144407    },
-   { 262144,		288361,		288359    },
-   { 524288,		576883,		576881    },
-   { 1048576,		1153459,	1153457   },
-   { 2097152,		2307163,	2307161   },
-   { 4194304,		4613893,	4613891   },
-   { 8388608,		9227641,	9227639   },
-   { 16777216,		18455029,	18455027  },
-   { 33554432,		36911011,	36911009  },
-   { 67108864,		73819861,	73819859  },
-   { 134217728,		147639589,	147639587 },
-   { 268435456,		295279081,	295279079 },
-   { 536870912,		590559793,	590559791 },
-   { 1073741824,	1181116273,	1181116271},
-   { 2147483648ul,	2362232233ul,	2362232231ul}
-};
-
-static int
-entry_is_free(const struct hash_entry *entry)
+static bool
+alloc_table(struct hash_table *ht, uint32_t size)
 {
-   return entry->key == NULL;
-}
+   struct hash_entry *table =
+      ralloc_size(ht, size * sizeof(struct hash_entry) +
+                      HASH_CTRL_BYTES(size));
+   if (table == NULL)
+      return false;
 
-static int
-entry_is_deleted(const struct hash_table *ht, struct hash_entry *entry)
-{
-   return entry->key == ht->deleted_key;
-}
+   ht->table = table;
+   ht->ctrl = (uint8_t *) (table + size);
+   ht->size = size;
+   ht->entries = 0;
+   ht->deleted_entries = 0;
+   ht->growth_left = hash_ctrl_max_load(size);
+   hash_ctrl_init(ht->ctrl, size);
 
-static int
-entry_is_present(const struct hash_table *ht, struct hash_entry *entry)
-{
-   return entry->key != NULL && entry->key != ht->deleted_key;
+   return true;
 }
 
 struct hash_table *
@@ -118,17 +88,9 @@ _mesa_hash_table_create(void *mem_ctx,
    if (ht == NULL)
       return NULL;
 
-   ht->size_index = 0;
-   ht->size = hash_sizes[ht->size_index].size;
-   ht->rehash = hash_sizes[ht->size_index].rehash;
-   ht->max_entries = hash_sizes[ht->size_index].max_entries;
    ht->key_equals_function = key_equals_function;
-   ht->table = rzalloc_array(ht, struct hash_entry, ht->size);
-   ht->entries = 0;
-   ht->deleted_entries = 0;
-   ht->deleted_key = &deleted_key_value;
 
-   if (ht->table == NULL) {
+   if (!alloc_table(ht, MIN_SIZE)) {
       ralloc_free(ht);
       return NULL;
    }
@@ -159,20 +121,44 @@ _mesa_hash_table_destroy(struct hash_table *ht,
    ralloc_free(ht);
 }
 
-/** Sets the value of the key pointer used for deleted entries in the table.
+/**
+ * Deletes all entries of the given hash table without freeing the table
+ * itself or shrinking it, so it can be reused for a similar set of keys.
  *
- * The assumption is that usually keys are actual pointers, so we use a
- * default value of a pointer to an arbitrary piece of storage in the library.
- * But in some cases a consumer wants to store some other sort of value in the
- * table, like a uint32_t, in which case that pointer may conflict with one of
- * their valid keys.  This lets that user select a safe value.
+ * If delete_function is passed, it gets called on each entry present.
+ */
+void
+_mesa_hash_table_clear(struct hash_table *ht,
+                       void (*delete_function)(struct hash_entry *entry))
+{
+   if (ht->entries == 0 && ht->deleted_entries == 0)
+      return;
+
+   if (delete_function) {
+      struct hash_entry *entry;
+
+      hash_table_foreach(ht, entry) {
+         delete_function(entry);
+      }
+   }
+
+   hash_ctrl_init(ht->ctrl, ht->size);
+   ht->entries = 0;
+   ht->deleted_entries = 0;
+   ht->growth_left = hash_ctrl_max_load(ht->size);
+}
+
+/**
+ * Used to set the value of the key pointer used for deleted entries.
  *
- * This must be called before any keys are actually deleted from the table.
+ * Deleted entries are now tracked separately from the keys, so any key can
+ * be stored in the table and this does nothing.
  */
 void
 _mesa_hash_table_set_deleted_key(struct hash_table *ht, const void *deleted_key)
 {
-   ht->deleted_key = deleted_key;
+   (void) ht;
+   (void) deleted_key;
 }
 
 /**
@@ -185,59 +171,72 @@ struct hash_entry *
 _mesa_hash_table_search(struct hash_table *ht, uint32_t hash,
                         const void *key)
 {
-   uint32_t start_hash_address = hash % ht->size;
-   uint32_t hash_address = start_hash_address;
-
-   do {
-      uint32_t double_hash;
+   const uint32_t mask = ht->size - 1;
+   const uint8_t tag = hash_ctrl_tag(hash);
+   uint32_t pos = hash_ctrl_start(hash, ht->size);
+   uint32_t stride = 0;
+
+   for (;;) {
+      unsigned match = hash_group_match(ht->ctrl, pos, tag);
+      while (match != 0) {
+         struct hash_entry *entry =
+            ht->table + ((pos + hash_group_first(match)) & mask);
+
+         if (entry->hash == hash &&
+             ht->key_equals_function(key, entry->key))
+            return entry;
 
-      struct hash_entry *entry = ht->table + hash_address;
+         match &= match - 1;
+      }
 
-      if (entry_is_free(entry)) {
+      if (hash_group_match(ht->ctrl, pos, HASH_CTRL_EMPTY) != 0)
          return NULL;
-      } else if (entry_is_present(ht, entry) && entry->hash == hash) {
-         if (ht->key_equals_function(key, entry->key)) {
-            return entry;
-         }
-      }
 
-      double_hash = 1 + hash % ht->rehash;
+      stride += HASH_GROUP_WIDTH;
+      pos = (pos + stride) & mask;
+   }
+}
 
-      hash_address = (hash_address + double_hash) % ht->size;
-   } while (hash_address != start_hash_address);
+/* Returns the first empty or deleted slot on the probe sequence of hash. */
+static uint32_t
+find_free_slot(const struct hash_table *ht, uint32_t hash)
+{
+   const uint32_t mask = ht->size - 1;
+   uint32_t pos = hash_ctrl_start(hash, ht->size);
+   uint32_t stride = 0;
 
-   return NULL;
+   for (;;) {
+      unsigned match = hash_group_match_free(ht->ctrl, pos);
+      if (match != 0)
+         return (pos + hash_group_first(match)) & mask;
+
+      stride += HASH_GROUP_WIDTH;
+      pos = (pos + stride) & mask;
+   }
 }
 
 static void
-_mesa_hash_table_rehash(struct hash_table *ht, int new_size_index)
+_mesa_hash_table_rehash(struct hash_table *ht, uint32_t new_size)
 {
    struct hash_table old_ht;
-   struct hash_entry *table, *entry;
-
-   if (new_size_index >= Elements(hash_sizes))
-      return;
-
-   table = rzalloc_array(ht, struct hash_entry,
-                         hash_sizes[new_size_index].size);
-   if (table == NULL)
-      return;
+   struct hash_entry *entry;
 
    old_ht = *ht;
 
-   ht->table = table;
-   ht->size_index = new_size_index;
-   ht->size = hash_sizes[ht->size_index].size;
-   ht->rehash = hash_sizes[ht->size_index].rehash;
-   ht->max_entries = hash_sizes[ht->size_index].max_entries;
-   ht->entries = 0;
-   ht->deleted_entries = 0;
+   if (!alloc_table(ht, new_size)) {
+      *ht = old_ht;
+      return;
+   }
 
    hash_table_foreach(&old_ht, entry) {
-      _mesa_hash_table_insert(ht, entry->hash,
-                              entry->key, entry->data);
+      uint32_t i = find_free_slot(ht, entry->hash);
+      hash_ctrl_set(ht->ctrl, ht->size, i, hash_ctrl_tag(entry->hash));
+      ht->table[i] = *entry;
    }
 
+   ht->entries = old_ht.entries;
+   ht->growth_left -= old_ht.entries;
+
    ralloc_free(old_ht.table);
 }
 
@@ -251,58 +250,62 @@ struct hash_entry *
 _mesa_hash_table_insert(struct hash_table *ht, uint32_t hash,
                         const void *key, void *data)
 {
-   uint32_t start_hash_address, hash_address;
-
-   if (ht->entries >= ht->max_entries) {
-      _mesa_hash_table_rehash(ht, ht->size_index + 1);
-   } else if (ht->deleted_entries + ht->entries >= ht->max_entries) {
-      _mesa_hash_table_rehash(ht, ht->size_index);
+   struct hash_entry *entry;
+   uint32_t i;
+
+   /* Implement replacement when another insert happens
+    * with a matching key.  This is a relatively common
+    * feature of hash tables, with the alternative
+    * generally being "insert the new value as well, and
+    * return it first when the key is searched for".
+    *
+    * Note that the hash table doesn't have a delete
+    * callback.  If freeing of old data pointers is
+    * required to avoid memory leaks, perform a search
+    * before inserting.
+    */
+   entry = _mesa_hash_table_search(ht, hash, key);
+   if (entry != NULL) {
+      entry->key = key;
+      entry->data = data;
+      return entry;
    }
 
-   start_hash_address = hash % ht->size;
-   hash_address = start_hash_address;
-   do {
-      struct hash_entry *entry = ht->table + hash_address;
-      uint32_t double_hash;
-
-      if (!entry_is_present(ht, entry)) {
-         if (entry_is_deleted(ht, entry))
-            ht->deleted_entries--;
-         entry->hash = hash;
-         entry->key = key;
-         entry->data = data;
-         ht->entries++;
-         return entry;
-      }
+   i = find_free_slot(ht, hash);
 
-      /* Implement replacement when another insert happens
-       * with a matching key.  This is a relatively common
-       * feature of hash tables, with the alternative
-       * generally being "insert the new value as well, and
-       * return it first when the key is searched for".
-       *
-       * Note that the hash table doesn't have a delete
-       * callback.  If freeing of old data pointers is
-       * required to avoid memory leaks, perform a search
-       * before inserting.
+   /* Reusing a deleted slot is free, but an empty one uses up room. */
+   if (ht->ctrl[i] == HASH_CTRL_EMPTY && ht->growth_left == 0) {
+      /* Only grow if the table is really full of live entries; otherwise
+       * just rehash to get rid of the tombstones.
        */
-      if (entry->hash == hash &&
-          ht->key_equals_function(key, entry->key)) {
-         entry->key = key;
-         entry->data = data;
-         return entry;
-      }
+      if (ht->entries >= hash_ctrl_max_load(ht->size) / 2)
+         _mesa_hash_table_rehash(ht, ht->size * 2);
+      else
+         _mesa_hash_table_rehash(ht, ht->size);
 
+      /* We could hit here if a required resize failed. An unchecked-malloc
+       * application could ignore this result.
+       */
+      if (ht->growth_left == 0)
+         return NULL;
 
-      double_hash = 1 + hash % ht->rehash;
+      i = find_free_slot(ht, hash);
+   }
 
-      hash_address = (hash_address + double_hash) % ht->size;
-   } while (hash_address != start_hash_address);
+   if (ht->ctrl[i] == HASH_CTRL_EMPTY)
+      ht->growth_left--;
+   else
+      ht->deleted_entries--;
 
-   /* We could hit here if a required resize failed. An unchecked-malloc
-    * application could ignore this result.
-    */
-   return NULL;
+   hash_ctrl_set(ht->ctrl, ht->size, i, hash_ctrl_tag(hash));
+
+   entry = ht->table + i;
+   entry->hash = hash;
+   entry->key = key;
+   entry->data = data;
+   ht->entries++;
+
+   return entry;
 }
 
 /**
@@ -315,12 +318,22 @@ void
 _mesa_hash_table_remove(struct hash_table *ht,
                         struct hash_entry *entry)
 {
+   uint32_t i;
+   uint8_t value;
+
    if (!entry)
       return;
 
-   entry->key = ht->deleted_key;
+   i = entry - ht->table;
+   value = hash_ctrl_deleted_value(ht->ctrl, ht->size, i);
+   hash_ctrl_set(ht->ctrl, ht->size, i, value);
+
+   if (value == HASH_CTRL_EMPTY)
+      ht->growth_left++;
+   else
+      ht->deleted_entries++;
+
    ht->entries--;
-   ht->deleted_entries++;
 }
 
 /**
@@ -333,15 +346,11 @@ struct hash_entry *
 _mesa_hash_table_next_entry(struct hash_table *ht,
                             struct hash_entry *entry)
 {
-   if (entry == NULL)
-      entry = ht->table;
-   else
-      entry = entry + 1;
+   uint32_t i = entry == NULL ? 0 : entry - ht->table + 1;
 
-   for (; entry != ht->table + ht->size; entry++) {
-      if (entry_is_present(ht, entry)) {
-         return entry;
-      }
+   for (; i < ht->size; i++) {
+      if (hash_ctrl_is_full(ht->ctrl[i]))
+         return ht->table + i;
    }
 
    return NULL;
@@ -359,21 +368,16 @@ struct hash_entry *
 _mesa_hash_table_random_entry(struct hash_table *ht,
                               bool (*predicate)(struct hash_entry *entry))
 {
-   struct hash_entry *entry;
-   uint32_t i = rand() % ht->size;
+   uint32_t start = rand() & (ht->size - 1);
 
    if (ht->entries == 0)
       return NULL;
 
-   for (entry = ht->table + i; entry != ht->table + ht->size; entry++) {
-      if (entry_is_present(ht, entry) &&
-          (!predicate || predicate(entry))) {
-         return entry;
-      }
-   }
+   for (uint32_t n = 0; n < ht->size; n++) {
+      uint32_t i = (start + n) & (ht->size - 1);
+      struct hash_entry *entry = ht->table + i;
 
-   for (entry = ht->table; entry != ht->table + i; entry++) {
-      if (entry_is_present(ht, entry) &&
+      if (hash_ctrl_is_full(ht->ctrl[i]) &&
           (!predicate || predicate(entry))) {
          return entry;
       }
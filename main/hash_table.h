@@ -45,14 +45,12 @@ struct hash_entry {
 
 struct hash_table {
    struct hash_entry *table;
+   uint8_t *ctrl; /* control byte of each slot, see main/hash_group.h */
    bool (*key_equals_function)(const void *a, const void *b);
-   const void *deleted_key;
-   uint32_t size;
-   uint32_t rehash;
-   uint32_t max_entries;
-   uint32_t size_index;
+   uint32_t size; /* number of slots, a power of two */
    uint32_t entries;
    uint32_t deleted_entries;
+   uint32_t growth_left; /* empty slots that can be used before rehashing */
 };
 
 struct hash_table *
@@ -61,6 +59,8 @@ _mesa_hash_table_create(void *mem_ctx,
                                                     const void *b));
 void _mesa_hash_table_destroy(struct hash_table *ht,
                               void (*delete_function)(struct hash_entry *entry));
+void _mesa_hash_table_clear(struct hash_table *ht,
+                            void (*delete_function)(struct hash_entry *entry));
 void _mesa_hash_table_set_deleted_key(struct hash_table *ht,
                                       const void *deleted_key);
 
@@ -84,15 +84,21 @@ uint32_t _mesa_hash_string(const char *key);
 bool _mesa_key_string_equal(const void *a, const void *b);
 bool _mesa_key_pointer_equal(const void *a, const void *b);
 
+/**
+ * Hashes a pointer value, without going through _mesa_hash_data() a byte at
+ * a time.  Multiplying by 2^64 / phi moves the bits that differ between
+ * nearby allocations into the upper half of the product, which is kept.
+ */
 static inline uint32_t _mesa_hash_pointer(const void *pointer)
 {
-   return _mesa_hash_data(&pointer, sizeof(pointer));
+   uint64_t num = (uintptr_t) pointer;
+   return (uint32_t) ((num * 0x9e3779b97f4a7c15ull) >> 32);
 }
 
 /**
- * This foreach function is safe against deletion (which just replaces
- * an entry's data with the deleted marker), but not against insertion
- * (which may rehash the table, making entry a dangling pointer).
+ * This foreach function is safe against deletion (which never moves
+ * entries), but not against insertion (which may rehash the table, making
+ * entry a dangling pointer).
  */
 #define hash_table_foreach(ht, entry)                   \
    for (entry = _mesa_hash_table_next_entry(ht, NULL);  \
@@ -0,0 +1,318 @@
+/*
+ * Copyright © 2009,2012 Intel Corporation
+ * Copyright © 1988-2004 Keith Packard and Bart Massey.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the names of the authors
+ * or their institutions shall not be used in advertising or
+ * otherwise to promote the sale, use or other dealings in this
+ * Software without prior written authorization from the
+ * authors.
+ *
+ * Authors:
+ *    Eric Anholt <eric@anholt.net>
+ *    Keith Packard <keithp@keithp.com>
+ */
+
+/**
+ * Implements a set of keys, with the same open-addressing scheme as
+ * main/hash_table.c (see main/hash_group.h), for the many cases where a
+ * hash table would only map keys to themselves.  Entries are two words
+ * instead of three.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "main/set.h"
+#include "main/hash_group.h"
+#include "ralloc.h"
+
+#define MIN_SIZE 4
+
+/*
+ * Allocates the entries and control bytes for a set of the given size, in a
+ * single block.
+ */
+static bool
+alloc_table(struct set *set, uint32_t size)
+{
+   struct set_entry *table =
+      ralloc_size(set, size * sizeof(struct set_entry) +
+                       HASH_CTRL_BYTES(size));
+   if (table == NULL)
+      return false;
+
+   set->table = table;
+   set->ctrl = (uint8_t *) (table + size);
+   set->size = size;
+   set->entries = 0;
+   set->deleted_entries = 0;
+   set->growth_left = hash_ctrl_max_load(size);
+   hash_ctrl_init(set->ctrl, size);
+
+   return true;
+}
+
+struct set *
+_mesa_set_create(void *mem_ctx,
+                 bool (*key_equals_function)(const void *a,
+                                             const void *b))
+{
+   struct set *set;
+
+   set = ralloc(mem_ctx, struct set);
+   if (set == NULL)
+      return NULL;
+
+   set->key_equals_function = key_equals_function;
+
+   if (!alloc_table(set, MIN_SIZE)) {
+      ralloc_free(set);
+      return NULL;
+   }
+
+   return set;
+}
+
+/**
+ * Frees the given set.
+ *
+ * If delete_function is passed, it gets called on each entry present before
+ * freeing.
+ */
+void
+_mesa_set_destroy(struct set *set,
+                  void (*delete_function)(struct set_entry *entry))
+{
+   if (!set)
+      return;
+
+   if (delete_function) {
+      struct set_entry *entry;
+
+      set_foreach(set, entry) {
+         delete_function(entry);
+      }
+   }
+   ralloc_free(set);
+}
+
+/**
+ * Deletes all entries of the given set without freeing the set itself or
+ * shrinking it.
+ *
+ * If delete_function is passed, it gets called on each entry present.
+ */
+void
+_mesa_set_clear(struct set *set,
+                void (*delete_function)(struct set_entry *entry))
+{
+   if (set->entries == 0 && set->deleted_entries == 0)
+      return;
+
+   if (delete_function) {
+      struct set_entry *entry;
+
+      set_foreach(set, entry) {
+         delete_function(entry);
+      }
+   }
+
+   hash_ctrl_init(set->ctrl, set->size);
+   set->entries = 0;
+   set->deleted_entries = 0;
+   set->growth_left = hash_ctrl_max_load(set->size);
+}
+
+/**
+ * Finds a set entry with the given key and hash of that key.
+ *
+ * Returns NULL if no entry is found.
+ */
+struct set_entry *
+_mesa_set_search(const struct set *set, uint32_t hash, const void *key)
+{
+   const uint32_t mask = set->size - 1;
+   const uint8_t tag = hash_ctrl_tag(hash);
+   uint32_t pos = hash_ctrl_start(hash, set->size);
+   uint32_t stride = 0;
+
+   for (;;) {
+      unsigned match = hash_group_match(set->ctrl, pos, tag);
+      while (match != 0) {
+         struct set_entry *entry =
+            set->table + ((pos + hash_group_first(match)) & mask);
+
+         if (entry->hash == hash &&
+             set->key_equals_function(key, entry->key))
+            return entry;
+
+         match &= match - 1;
+      }
+
+      if (hash_group_match(set->ctrl, pos, HASH_CTRL_EMPTY) != 0)
+         return NULL;
+
+      stride += HASH_GROUP_WIDTH;
+      pos = (pos + stride) & mask;
+   }
+}
+
+/* Returns the first empty or deleted slot on the probe sequence of hash. */
+static uint32_t
+find_free_slot(const struct set *set, uint32_t hash)
+{
+   const uint32_t mask = set->size - 1;
+   uint32_t pos = hash_ctrl_start(hash, set->size);
+   uint32_t stride = 0;
+
+   for (;;) {
+      unsigned match = hash_group_match_free(set->ctrl, pos);
+      if (match != 0)
+         return (pos + hash_group_first(match)) & mask;
+
+      stride += HASH_GROUP_WIDTH;
+      pos = (pos + stride) & mask;
+   }
+}
+
+static void
+set_rehash(struct set *set, uint32_t new_size)
+{
+   struct set old_set;
+   struct set_entry *entry;
+
+   old_set = *set;
+
+   if (!alloc_table(set, new_size)) {
+      *set = old_set;
+      return;
+   }
+
+   set_foreach(&old_set, entry) {
+      uint32_t i = find_free_slot(set, entry->hash);
+      hash_ctrl_set(set->ctrl, set->size, i, hash_ctrl_tag(entry->hash));
+      set->table[i] = *entry;
+   }
+
+   set->entries = old_set.entries;
+   set->growth_left -= old_set.entries;
+
+   ralloc_free(old_set.table);
+}
+
+/**
+ * Inserts the key with the given hash into the set, unless it is already
+ * there, and returns its entry.
+ *
+ * Note that insertion may rearrange the set on a resize or rehash, so
+ * previously found set_entries are no longer valid after this function.
+ */
+struct set_entry *
+_mesa_set_add(struct set *set, uint32_t hash, const void *key)
+{
+   struct set_entry *entry;
+   uint32_t i;
+
+   entry = _mesa_set_search(set, hash, key);
+   if (entry != NULL)
+      return entry;
+
+   i = find_free_slot(set, hash);
+
+   /* Reusing a deleted slot is free, but an empty one uses up room. */
+   if (set->ctrl[i] == HASH_CTRL_EMPTY && set->growth_left == 0) {
+      /* Only grow if the set is really full of live entries; otherwise
+       * just rehash to get rid of the tombstones.
+       */
+      if (set->entries >= hash_ctrl_max_load(set->size) / 2)
+         set_rehash(set, set->size * 2);
+      else
+         set_rehash(set, set->size);
+
+      /* We could hit here if a required resize failed. */
+      if (set->growth_left == 0)
+         return NULL;
+
+      i = find_free_slot(set, hash);
+   }
+
+   if (set->ctrl[i] == HASH_CTRL_EMPTY)
+      set->growth_left--;
+   else
+      set->deleted_entries--;
+
+   hash_ctrl_set(set->ctrl, set->size, i, hash_ctrl_tag(hash));
+
+   entry = set->table + i;
+   entry->hash = hash;
+   entry->key = key;
+   set->entries++;
+
+   return entry;
+}
+
+/**
+ * This function deletes the given set entry.
+ *
+ * Note that deletion doesn't otherwise modify the set, so an iteration over
+ * the set deleting entries is safe.
+ */
+void
+_mesa_set_remove(struct set *set, struct set_entry *entry)
+{
+   uint32_t i;
+   uint8_t value;
+
+   if (!entry)
+      return;
+
+   i = entry - set->table;
+   value = hash_ctrl_deleted_value(set->ctrl, set->size, i);
+   hash_ctrl_set(set->ctrl, set->size, i, value);
+
+   if (value == HASH_CTRL_EMPTY)
+      set->growth_left++;
+   else
+      set->deleted_entries++;
+
+   set->entries--;
+}
+
+/**
+ * This function is an iterator over the set.
+ *
+ * Pass in NULL for the first entry, as in the start of a for loop.  Note that
+ * an iteration over the set is O(set_size) not O(entries).
+ */
+struct set_entry *
+_mesa_set_next_entry(const struct set *set, struct set_entry *entry)
+{
+   uint32_t i = entry == NULL ? 0 : entry - set->table + 1;
+
+   for (; i < set->size; i++) {
+      if (hash_ctrl_is_full(set->ctrl[i]))
+         return set->table + i;
+   }
+
+   return NULL;
+}
@@ -27,6 +27,15 @@
 
 #include "nir.h"
 #include <assert.h>
+#include <pthread.h>
+
+/*
+ * Global registers are shared by every function implementation, which may be
+ * modified from several threads at once (see nir_pass_runner.c), so the list
+ * of global registers and their use/def sets are only touched with this lock
+ * held.
+ */
+static pthread_mutex_t global_reg_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 nir_shader *
 nir_shader_create(void *mem_ctx)
@@ -44,6 +53,7 @@ nir_shader_create(void *mem_ctx)
    exec_list_make_empty(&shader->functions);
    exec_list_make_empty(&shader->registers);
    shader->reg_alloc = 0;
+   shader->globals_dirty = true;
    
    return shader;
 }
@@ -53,9 +63,9 @@ reg_create(void *mem_ctx, struct exec_list *list)
 {
    nir_register *reg = ralloc(mem_ctx, nir_register);
    
-   reg->uses = _mesa_hash_table_create(mem_ctx, _mesa_key_pointer_equal);
-   reg->defs = _mesa_hash_table_create(mem_ctx, _mesa_key_pointer_equal);
-   reg->if_uses = _mesa_hash_table_create(mem_ctx, _mesa_key_pointer_equal);
+   reg->uses = _mesa_set_create(mem_ctx, _mesa_key_pointer_equal);
+   reg->defs = _mesa_set_create(mem_ctx, _mesa_key_pointer_equal);
+   reg->if_uses = _mesa_set_create(mem_ctx, _mesa_key_pointer_equal);
    
    reg->num_components = 0;
    reg->num_array_elems = 0;
@@ -69,9 +79,12 @@ reg_create(void *mem_ctx, struct exec_list *list)
 nir_register *
 nir_global_reg_create(nir_shader *shader)
 {
+   pthread_mutex_lock(&global_reg_mutex);
    nir_register *reg = reg_create(shader, &shader->registers);
    reg->index = shader->reg_alloc++;
    reg->is_global = true;
+   shader->globals_dirty = true;
+   pthread_mutex_unlock(&global_reg_mutex);
    
    return reg;
 }
@@ -79,9 +92,14 @@ nir_global_reg_create(nir_shader *shader)
 nir_register *
 nir_local_reg_create(nir_function_impl *impl)
 {
-   nir_register *reg = reg_create(ralloc_parent(impl), &impl->registers);
+   /*
+    * Allocate out of the impl rather than the shader, so that impls being
+    * processed in parallel never allocate out of the same context.
+    */
+   nir_register *reg = reg_create(impl, &impl->registers);
    reg->index = impl->reg_alloc++;
    reg->is_global = false;
+   impl->dirty = true;
    
    return reg;
 }
@@ -96,6 +114,8 @@ nir_function_create(nir_shader *shader, const char *name)
    exec_list_make_empty(&func->overload_list);
    func->name = name;
    
+   shader->globals_dirty = true;
+   
    return func;
 }
 
@@ -113,14 +133,15 @@ nir_function_overload_create(nir_function *func)
    exec_list_push_tail(&func->overload_list, &overload->node);
    overload->function = func;
    
+   ((nir_shader *) mem_ctx)->globals_dirty = true;
+   
    return overload;
 }
 
 static inline void
 block_add_pred(nir_block *block, nir_block *pred)
 {
-   _mesa_hash_table_insert(block->predecessors, _mesa_hash_pointer(pred),
-			   pred, pred);
+   _mesa_set_add(block->predecessors, _mesa_hash_pointer(pred), pred);
 }
 
 static void
@@ -153,22 +174,22 @@ unlink_blocks(nir_block *pred, nir_block *succ)
       pred->successors[1] = NULL;
    }
    
-   struct hash_entry *entry = _mesa_hash_table_search(succ->predecessors,
-						      _mesa_hash_pointer(pred),
-						      pred);
+   struct set_entry *entry = _mesa_set_search(succ->predecessors,
+					      _mesa_hash_pointer(pred), pred);
    
    assert(entry);
    
-   _mesa_hash_table_remove(succ->predecessors, entry);
+   _mesa_set_remove(succ->predecessors, entry);
 }
 
 static void
 unlink_block_successors(nir_block *block)
 {
-   if (block->successors[0] != NULL)
-      unlink_blocks(block, block->successors[0]);
+   /* unlinking successors[0] moves successors[1] into its place */
    if (block->successors[1] != NULL)
       unlink_blocks(block, block->successors[1]);
+   if (block->successors[0] != NULL)
+      unlink_blocks(block, block->successors[0]);
 }
 
 
@@ -194,6 +215,13 @@ nir_function_impl_create(nir_function_overload *overload)
    impl->return_var = NULL;
    impl->reg_alloc = 0;
    impl->ssa_alloc = 0;
+   impl->blocks = impl->rpo_blocks = NULL;
+   impl->num_blocks = impl->num_rpo_blocks = 0;
+   impl->blocks_dirty = true;
+   impl->dirty = true;
+   impl->changes = NULL;
+   
+   ((nir_shader *) mem_ctx)->globals_dirty = true;
    
    /* create start & end blocks */
    nir_block *start_block = nir_block_create(mem_ctx);
@@ -211,16 +239,29 @@ nir_function_impl_create(nir_function_overload *overload)
    return impl;
 }
 
+/*
+ * Control flow nodes and instructions are almost never freed individually,
+ * so when the caller hands us a linear context, bump-allocate them out of it
+ * instead of paying for a separate ralloc allocation each.
+ */
+static void *
+ir_alloc(void *mem_ctx, size_t size)
+{
+   if (ralloc_is_linear_context(mem_ctx))
+      return linear_alloc_child(mem_ctx, size);
+   
+   return ralloc_size(mem_ctx, size);
+}
+
 nir_block *
 nir_block_create(void *mem_ctx)
 {
-   nir_block *block = ralloc(mem_ctx, nir_block);
+   nir_block *block = ir_alloc(mem_ctx, sizeof(nir_block));
    
    cf_init(&block->cf_node, nir_cf_node_block);
    
    block->successors[0] = block->successors[1] = NULL;
-   block->predecessors = _mesa_hash_table_create(mem_ctx,
-						 _mesa_key_pointer_equal);
+   block->predecessors = _mesa_set_create(mem_ctx, _mesa_key_pointer_equal);
    
    exec_list_make_empty(&block->instr_list);
    
@@ -239,7 +280,7 @@ src_init(nir_src *src)
 nir_if *
 nir_if_create(void *mem_ctx)
 {
-   nir_if *if_stmt = ralloc(mem_ctx, nir_if);
+   nir_if *if_stmt = ir_alloc(mem_ctx, sizeof(nir_if));
    
    cf_init(&if_stmt->cf_node, nir_cf_node_if);
    src_init(&if_stmt->condition);
@@ -260,7 +301,7 @@ nir_if_create(void *mem_ctx)
 nir_loop *
 nir_loop_create(void *mem_ctx)
 {
-   nir_loop *loop = ralloc(mem_ctx, nir_loop);
+   nir_loop *loop = ir_alloc(mem_ctx, sizeof(nir_loop));
    
    cf_init(&loop->cf_node, nir_cf_node_loop);
    
@@ -316,8 +357,8 @@ nir_alu_instr_create(void *mem_ctx, nir_op op)
 {
    unsigned num_srcs = nir_op_infos[op].num_inputs;
    nir_alu_instr *instr =
-      ralloc_size(mem_ctx,
-		  sizeof(nir_alu_instr) + num_srcs * sizeof(nir_alu_src));
+      ir_alloc(mem_ctx,
+	       sizeof(nir_alu_instr) + num_srcs * sizeof(nir_alu_src));
    
    instr_init(&instr->instr, nir_instr_type_alu);
    instr->op = op;
@@ -334,7 +375,7 @@ nir_alu_instr_create(void *mem_ctx, nir_op op)
 nir_jump_instr *
 nir_jump_instr_create(void *mem_ctx, nir_jump_type type)
 {
-   nir_jump_instr *instr = ralloc(mem_ctx, nir_jump_instr);
+   nir_jump_instr *instr = ir_alloc(mem_ctx, sizeof(nir_jump_instr));
    instr_init(&instr->instr, nir_instr_type_jump);
    instr->type = type;
    return instr;
@@ -343,7 +384,8 @@ nir_jump_instr_create(void *mem_ctx, nir_jump_type type)
 nir_load_const_instr *
 nir_load_const_instr_create(void *mem_ctx)
 {
-   nir_load_const_instr *instr = ralloc(mem_ctx, nir_load_const_instr);
+   nir_load_const_instr *instr = ir_alloc(mem_ctx,
+					  sizeof(nir_load_const_instr));
    instr_init(&instr->instr, nir_instr_type_load_const);
    
    dest_init(&instr->dest);
@@ -355,6 +397,136 @@ nir_load_const_instr_create(void *mem_ctx)
    return instr;
 }
 
+/*
+ * The variables array goes right after the sources, in the same
+ * allocation. A nir_src is pointer-aligned, so the array is too.
+ */
+nir_intrinsic_instr *
+nir_intrinsic_instr_create(void *mem_ctx, nir_intrinsic_op op)
+{
+   const nir_intrinsic_info *info = &nir_intrinsic_infos[op];
+   size_t srcs_size = info->num_srcs * sizeof(nir_src);
+   
+   nir_intrinsic_instr *instr =
+      ir_alloc(mem_ctx, sizeof(nir_intrinsic_instr) + srcs_size +
+			info->num_variables * sizeof(nir_deref_var *));
+   
+   instr_init(&instr->instr, nir_instr_type_intrinsic);
+   instr->intrinsic = op;
+   
+   dest_init(&instr->dest);
+   
+   instr->const_index[0] = instr->const_index[1] = 0;
+   
+   for (unsigned i = 0; i < info->num_srcs; i++)
+      src_init(&instr->src[i]);
+   
+   instr->variables = (nir_deref_var **) ((char *) instr->src + srcs_size);
+   for (unsigned i = 0; i < info->num_variables; i++)
+      instr->variables[i] = NULL;
+   
+   instr->has_predicate = false;
+   src_init(&instr->predicate);
+   
+   return instr;
+}
+
+nir_tex_instr *
+nir_tex_instr_create(void *mem_ctx, unsigned num_srcs)
+{
+   assert(num_srcs <= 4);
+   
+   nir_tex_instr *instr = ir_alloc(mem_ctx, sizeof(nir_tex_instr));
+   instr_init(&instr->instr, nir_instr_type_texture);
+   
+   instr->op = nir_texop_tex;
+   dest_init(&instr->dest);
+   
+   instr->num_srcs = num_srcs;
+   for (unsigned i = 0; i < 4; i++)
+      src_init(&instr->src[i]);
+   instr->coord_components = 0;
+   
+   instr->sampler_index = 0;
+   instr->sampler = NULL;
+   
+   instr->has_predicate = false;
+   src_init(&instr->predicate);
+   
+   return instr;
+}
+
+/* the params array goes right after the instruction, like in intrinsics */
+nir_call_instr *
+nir_call_instr_create(void *mem_ctx, nir_function_overload *callee)
+{
+   nir_call_instr *instr =
+      ir_alloc(mem_ctx, sizeof(nir_call_instr) +
+			callee->num_params * sizeof(nir_variable *));
+   instr_init(&instr->instr, nir_instr_type_call);
+   
+   instr->callee = callee;
+   instr->num_params = callee->num_params;
+   instr->params = (nir_variable **) (instr + 1);
+   for (unsigned i = 0; i < instr->num_params; i++)
+      instr->params[i] = NULL;
+   instr->return_var = NULL;
+   
+   instr->has_predicate = false;
+   src_init(&instr->predicate);
+   
+   return instr;
+}
+
+nir_phi_instr *
+nir_phi_instr_create(void *mem_ctx)
+{
+   nir_phi_instr *instr = ir_alloc(mem_ctx, sizeof(nir_phi_instr));
+   instr_init(&instr->instr, nir_instr_type_phi);
+   
+   dest_init(&instr->dest);
+   exec_list_make_empty(&instr->srcs);
+   
+   return instr;
+}
+
+nir_phi_src *
+nir_phi_instr_add_src(void *mem_ctx, nir_phi_instr *instr, nir_block *pred,
+		      nir_src src)
+{
+   nir_phi_src *phi_src = ir_alloc(mem_ctx, sizeof(nir_phi_src));
+   phi_src->pred = pred;
+   phi_src->src = src;
+   exec_list_push_tail(&instr->srcs, &phi_src->node);
+   
+   return phi_src;
+}
+
+nir_ssa_undef_instr *
+nir_ssa_undef_instr_create(void *mem_ctx, nir_function_impl *impl,
+			   unsigned num_components)
+{
+   nir_ssa_undef_instr *instr = ir_alloc(mem_ctx,
+					 sizeof(nir_ssa_undef_instr));
+   instr_init(&instr->instr, nir_instr_type_ssa_undef);
+   
+   nir_ssa_def_init(impl, &instr->instr, &instr->def, num_components, NULL);
+   
+   return instr;
+}
+
+nir_deref_var *
+nir_deref_var_create(void *mem_ctx, nir_variable *var)
+{
+   nir_deref_var *deref = ir_alloc(mem_ctx, sizeof(nir_deref_var));
+   deref->deref.deref_type = nir_deref_type_var;
+   deref->deref.child = NULL;
+   deref->deref.type = (struct glsl_type *) var->type;
+   deref->var = var;
+   
+   return deref;
+}
+
 
 /**
  * \name Control flow modification
@@ -468,16 +640,37 @@ link_block_to_non_block(nir_block *block, nir_cf_node *node)
  * some kind of cleanup *must* be performed after this call.
  */
 
+/*
+ * Returns the context to create blocks next to block out of. That is the
+ * function the block is in, so that functions being processed in parallel
+ * never allocate out of the same context. Blocks that aren't in a function
+ * yet use the context they were created out of. The block itself may have
+ * been allocated out of a linear context, in which case it has no ralloc
+ * parent, but its predecessor set always does.
+ */
+static void *
+block_mem_ctx(nir_block *block)
+{
+   nir_cf_node *node = &block->cf_node;
+   while (node->parent != NULL)
+      node = node->parent;
+   
+   if (node->type == nir_cf_node_function)
+      return nir_cf_node_as_function(node);
+   
+   return ralloc_parent(block->predecessors);
+}
+
 static nir_block *
 split_block_beginning(nir_block *block)
 {
-   nir_block *new_block = nir_block_create(ralloc_parent(block));
+   nir_block *new_block = nir_block_create(block_mem_ctx(block));
    new_block->cf_node.parent = block->cf_node.parent;
    exec_node_insert_node_before(&block->cf_node.node, &new_block->cf_node.node);
    
-   struct hash_entry *entry;
-   hash_table_foreach(block->predecessors, entry) {
-      nir_block *pred = (nir_block *) entry->data;
+   struct set_entry *entry;
+   set_foreach(block->predecessors, entry) {
+      nir_block *pred = (nir_block *) entry->key;
       
       unlink_blocks(pred, block);
       link_blocks(pred, new_block, NULL);
@@ -495,12 +688,9 @@ static void
 move_successors(nir_block *source, nir_block *dest)
 {
    nir_block *succ1 = source->successors[0];
-   if (succ1)
-      unlink_blocks(source, succ1);
-   
    nir_block *succ2 = source->successors[1];
-   if (succ2)
-      unlink_blocks(source, succ2);
+   
+   unlink_block_successors(source);
    
    unlink_block_successors(dest);
    link_blocks(dest, succ1, succ2);
@@ -509,7 +699,7 @@ move_successors(nir_block *source, nir_block *dest)
 static nir_block *
 split_block_end(nir_block *block)
 {
-   nir_block *new_block = nir_block_create(ralloc_parent(block));
+   nir_block *new_block = nir_block_create(block_mem_ctx(block));
    new_block->cf_node.parent = block->cf_node.parent;
    exec_node_insert_after(&block->cf_node.node, &new_block->cf_node.node);
    
@@ -576,6 +766,185 @@ get_function(nir_cf_node *node)
    return nir_cf_node_as_function(node);
 }
 
+/*
+ * Returns the function containing node, or NULL if node is part of a tree
+ * that hasn't been inserted into a function yet, in which case the insertion
+ * will take care of marking the function as changed.
+ */
+static nir_function_impl *
+get_function_or_null(nir_cf_node *node)
+{
+   while (node != NULL && node->type != nir_cf_node_function) {
+      node = node->parent;
+   }
+   
+   return node != NULL ? nir_cf_node_as_function(node) : NULL;
+}
+
+/*
+ * Marks the cached block arrays of the function containing node as stale, in
+ * addition to marking it as needing validation.
+ */
+static void
+invalidate_blocks(nir_cf_node *node)
+{
+   nir_function_impl *impl = get_function_or_null(node);
+   if (impl != NULL) {
+      impl->blocks_dirty = true;
+      impl->dirty = true;
+      if (impl->changes != NULL)
+	 impl->changes->cf_changed = true;
+   }
+}
+
+nir_change_list *
+nir_change_list_create(void *mem_ctx)
+{
+   nir_change_list *changes = ralloc(mem_ctx, nir_change_list);
+   changes->instrs = NULL;
+   changes->num_instrs = changes->instrs_size = 0;
+   changes->instr_set = _mesa_set_create(changes, _mesa_key_pointer_equal);
+   changes->blocks = NULL;
+   changes->num_blocks = changes->blocks_size = 0;
+   changes->block_set = _mesa_set_create(changes, _mesa_key_pointer_equal);
+   changes->removed = _mesa_set_create(changes, _mesa_key_pointer_equal);
+   changes->cf_changed = false;
+   return changes;
+}
+
+void
+nir_change_list_reset(nir_change_list *changes)
+{
+   changes->num_instrs = 0;
+   changes->num_blocks = 0;
+   _mesa_set_clear(changes->instr_set, NULL);
+   _mesa_set_clear(changes->block_set, NULL);
+   _mesa_set_clear(changes->removed, NULL);
+   changes->cf_changed = false;
+}
+
+bool
+nir_change_list_is_empty(nir_change_list *changes)
+{
+   return changes->instr_set->entries == 0 &&
+	  changes->block_set->entries == 0 &&
+	  changes->removed->entries == 0 && !changes->cf_changed;
+}
+
+bool
+nir_change_list_has_instr(nir_change_list *changes, nir_instr *instr)
+{
+   return _mesa_set_search(changes->instr_set, _mesa_hash_pointer(instr),
+			   instr) != NULL;
+}
+
+bool
+nir_change_list_was_removed(nir_change_list *changes, nir_instr *instr)
+{
+   return _mesa_set_search(changes->removed, _mesa_hash_pointer(instr),
+			   instr) != NULL;
+}
+
+static void
+change_list_add_block(nir_change_list *changes, nir_block *block)
+{
+   uint32_t hash = _mesa_hash_pointer(block);
+   if (_mesa_set_search(changes->block_set, hash, block) != NULL)
+      return;
+   
+   _mesa_set_add(changes->block_set, hash, block);
+   
+   if (changes->num_blocks == changes->blocks_size) {
+      changes->blocks_size = changes->blocks_size ? 2 * changes->blocks_size
+						  : 16;
+      changes->blocks = reralloc(changes, changes->blocks, nir_block *,
+				 changes->blocks_size);
+   }
+   changes->blocks[changes->num_blocks++] = block;
+}
+
+static void
+change_list_add_instr(nir_change_list *changes, nir_instr *instr)
+{
+   uint32_t hash = _mesa_hash_pointer(instr);
+   if (_mesa_set_search(changes->instr_set, hash, instr) != NULL)
+      return;
+   
+   _mesa_set_add(changes->instr_set, hash, instr);
+   
+   /* instructions removed and then re-added show up in instrs twice, but
+    * only count once, since they are in instr_set once
+    */
+   if (changes->num_instrs == changes->instrs_size) {
+      changes->instrs_size = changes->instrs_size ? 2 * changes->instrs_size
+						  : 64;
+      changes->instrs = reralloc(changes, changes->instrs, nir_instr *,
+				 changes->instrs_size);
+   }
+   changes->instrs[changes->num_instrs++] = instr;
+   
+   change_list_add_block(changes, instr->block);
+}
+
+/*
+ * Marks the function containing the instruction, which was just inserted or
+ * changed, as needing validation, and records the change if its function
+ * has a change list.
+ */
+static void
+instr_changed(nir_instr *instr)
+{
+   nir_function_impl *impl = get_function_or_null(&instr->block->cf_node);
+   if (impl == NULL)
+      return;
+   
+   impl->dirty = true;
+   
+   if (impl->changes != NULL) {
+      struct set_entry *entry =
+	 _mesa_set_search(impl->changes->removed, _mesa_hash_pointer(instr),
+			  instr);
+      if (entry != NULL)
+	 _mesa_set_remove(impl->changes->removed, entry);
+      
+      change_list_add_instr(impl->changes, instr);
+   }
+}
+
+/* like instr_changed(), for an instruction that is about to be removed */
+static void
+instr_removed(nir_instr *instr)
+{
+   nir_function_impl *impl = get_function_or_null(&instr->block->cf_node);
+   if (impl == NULL)
+      return;
+   
+   impl->dirty = true;
+   
+   nir_change_list *changes = impl->changes;
+   if (changes == NULL)
+      return;
+   
+   uint32_t hash = _mesa_hash_pointer(instr);
+   struct set_entry *entry = _mesa_set_search(changes->instr_set, hash, instr);
+   if (entry != NULL)
+      _mesa_set_remove(changes->instr_set, entry);
+   _mesa_set_add(changes->removed, hash, instr);
+   
+   change_list_add_block(changes, instr->block);
+   
+   nir_instr_foreach_src(instr, iter) {
+      if (iter.src->is_ssa)
+	 change_list_add_instr(changes, iter.src->ssa->parent_instr);
+   }
+}
+
+void
+nir_instr_mark_changed(nir_instr *instr)
+{
+   instr_changed(instr);
+}
+
 /*
  * update the CFG after a jump instruction has been added to the end of a block
  */
@@ -586,6 +955,7 @@ handle_jump(nir_block *block)
    nir_instr *instr = nir_block_last_instr(block);
    nir_jump_instr *jump_instr = nir_instr_as_jump(instr);
    
+   invalidate_blocks(&block->cf_node);
    unlink_block_successors(block);
    
    if (jump_instr->type == nir_jump_break ||
@@ -612,6 +982,7 @@ handle_jump(nir_block *block)
 static void
 handle_remove_jump(nir_block *block)
 {
+   invalidate_blocks(&block->cf_node);
    unlink_block_successors(block);
    
    if (exec_node_is_tail_sentinel(block->cf_node.node.next)) {
@@ -703,6 +1074,33 @@ insert_block_after_block(nir_block *block, nir_block *after, bool has_jump)
       handle_jump(block);
 }
 
+static void
+reg_set_add(nir_register *reg, struct set *set, void *item)
+{
+   if (reg->is_global)
+      pthread_mutex_lock(&global_reg_mutex);
+   
+   _mesa_set_add(set, _mesa_hash_pointer(item), item);
+   
+   if (reg->is_global)
+      pthread_mutex_unlock(&global_reg_mutex);
+}
+
+static void
+reg_set_remove(nir_register *reg, struct set *set, void *item)
+{
+   if (reg->is_global)
+      pthread_mutex_lock(&global_reg_mutex);
+   
+   struct set_entry *entry = _mesa_set_search(set, _mesa_hash_pointer(item),
+					      item);
+   if (entry)
+      _mesa_set_remove(set, entry);
+   
+   if (reg->is_global)
+      pthread_mutex_unlock(&global_reg_mutex);
+}
+
 static void
 update_if_uses(nir_cf_node *node)
 {
@@ -716,13 +1114,28 @@ update_if_uses(nir_cf_node *node)
    nir_register *reg = if_stmt->condition.reg.reg;
    assert(reg != NULL);
    
-   _mesa_hash_table_insert(reg->if_uses, _mesa_hash_pointer(if_stmt), if_stmt,
-			   if_stmt);
+   reg_set_add(reg, reg->if_uses, if_stmt);
+}
+
+/* the opposite of update_if_uses(), for an if that is being removed */
+static void
+remove_if_uses(nir_cf_node *node)
+{
+   if (node->type != nir_cf_node_if)
+      return;
+   
+   nir_if *if_stmt = nir_cf_node_as_if(node);
+   if (if_stmt->condition.is_ssa)
+      return;
+   
+   nir_register *reg = if_stmt->condition.reg.reg;
+   reg_set_remove(reg, reg->if_uses, if_stmt);
 }
 
 void
 nir_cf_node_insert_after(nir_cf_node *node, nir_cf_node *after)
 {
+   invalidate_blocks(node);
    update_if_uses(after);
    
    if (after->type == nir_cf_node_block) {
@@ -767,6 +1180,7 @@ nir_cf_node_insert_after(nir_cf_node *node, nir_cf_node *after)
 void
 nir_cf_node_insert_before(nir_cf_node *node, nir_cf_node *before)
 {
+   invalidate_blocks(node);
    update_if_uses(before);
    
    if (before->type == nir_cf_node_block) {
@@ -845,6 +1259,8 @@ stitch_blocks(nir_block *before, nir_block *after)
 void
 nir_cf_node_remove(nir_cf_node *node)
 {
+   invalidate_blocks(node);
+   
    if (node->type == nir_cf_node_block) {
       /*
        * Basic blocks can't really be removed by themselves, since they act as
@@ -863,52 +1279,49 @@ nir_cf_node_remove(nir_cf_node *node)
       assert(after->type == nir_cf_node_block);
       nir_block *after_block = nir_cf_node_as_block(after);
       
+      remove_if_uses(node);
       exec_node_remove(&node->node);
       stitch_blocks(before_block, after_block);
    }  
 }
 
-static bool
-add_use_cb(nir_src *src, void *state)
+static void
+add_use(nir_src *src, nir_instr *instr)
 {
-   nir_instr *instr = (nir_instr *) state;
-   
    if (src->is_ssa)
-      return true;
+      return;
    
    nir_register *reg = src->reg.reg;
    
-   _mesa_hash_table_insert(reg->uses, _mesa_hash_pointer(instr), instr, instr);
+   reg_set_add(reg, reg->uses, instr);
    
    if (src->reg.indirect != NULL)
-      add_use_cb(src->reg.indirect, state);
-   
-   return true;
+      add_use(src->reg.indirect, instr);
 }
 
-static bool
-add_def_cb(nir_dest *dest, void *state)
+static void
+add_def(nir_dest *dest, nir_instr *instr)
 {
-   nir_instr *instr = (nir_instr *) state;
-   
    if (dest->is_ssa)
-      return true;
+      return;
    
    nir_register *reg = dest->reg.reg;
    
-   _mesa_hash_table_insert(reg->defs, _mesa_hash_pointer(instr), instr, instr);
+   reg_set_add(reg, reg->defs, instr);
    
    if (dest->reg.indirect != NULL)
-      add_use_cb(dest->reg.indirect, state);
-   
-   return true;
+      add_use(dest->reg.indirect, instr);
 }
 
 static void
 add_defs_uses(nir_instr *instr)
 {
-   nir_foreach_src(instr, add_use_cb, instr);
-   nir_foreach_dest(instr, add_def_cb, instr);
+   nir_instr_foreach_src(instr, iter)
+      add_use(iter.src, instr);
+   
+   nir_dest *dest = nir_instr_dest(instr);
+   if (dest != NULL)
+      add_def(dest, instr);
 }
 
 void
@@ -918,6 +1331,7 @@ nir_instr_insert_before(nir_instr *instr, nir_instr *before)
    before->block = instr->block;
    add_defs_uses(before);
    exec_node_insert_node_before(&instr->node, &before->node);
+   instr_changed(before);
 }
 
 void
@@ -931,6 +1345,7 @@ nir_instr_insert_after(nir_instr *instr, nir_instr *after)
    after->block = instr->block;
    add_defs_uses(after);
    exec_node_insert_after(&instr->node, &after->node);
+   instr_changed(after);
    
    if (after->type == nir_instr_type_jump)
       handle_jump(after->block);
@@ -946,6 +1361,7 @@ nir_instr_insert_before_block(nir_block *block, nir_instr *before)
    add_defs_uses(before);
    exec_node_insert_after((struct exec_node *) &block->instr_list.head,
 			  &before->node);
+   instr_changed(before);
    
    if (before->type == nir_instr_type_jump)
       handle_jump(block);
@@ -963,6 +1379,7 @@ nir_instr_insert_after_block(nir_block *block, nir_instr *after)
    add_defs_uses(after);
    exec_node_insert_node_before((struct exec_node *) &block->instr_list.tail,
 				&after->node);
+   instr_changed(after);
    
    if (after->type == nir_instr_type_jump)
       handle_jump(block);
@@ -1012,66 +1429,95 @@ nir_instr_insert_after_cf_list(struct exec_list *list, nir_instr *after)
    nir_instr_insert_after_cf(last_node, after);
 }
 
-static bool
-remove_use_cb(nir_src *src, void *state)
+static void
+remove_use(nir_src *src, nir_instr *instr)
 {
-   nir_instr *instr = (nir_instr *) state;
-   
    if (src->is_ssa)
-      return true;
+      return;
    
    nir_register *reg = src->reg.reg;
    
-   struct hash_entry *entry = _mesa_hash_table_search(reg->uses,
-						      _mesa_hash_pointer(instr),
-						      instr);
-   if (entry)
-      _mesa_hash_table_remove(reg->uses, entry);
+   reg_set_remove(reg, reg->uses, instr);
    
    if (src->reg.indirect != NULL)
-      remove_use_cb(src->reg.indirect, state);
-   
-   return true;
+      remove_use(src->reg.indirect, instr);
 }
 
-static bool
-remove_def_cb(nir_dest *dest, void *state)
+static void
+remove_def(nir_dest *dest, nir_instr *instr)
 {
-   nir_instr *instr = (nir_instr *) state;
-   
    if (dest->is_ssa)
-      return true;
+      return;
    
    nir_register *reg = dest->reg.reg;
    
-   struct hash_entry *entry = _mesa_hash_table_search(reg->defs,
-						      _mesa_hash_pointer(instr),
-						      instr);
-   if (entry)
-      _mesa_hash_table_remove(reg->defs, entry);
+   reg_set_remove(reg, reg->defs, instr);
    
    if (dest->reg.indirect != NULL)
-      remove_use_cb(dest->reg.indirect, state);
-   
-   return true;
+      remove_use(dest->reg.indirect, instr);
 }
 
 static void
 remove_defs_uses(nir_instr *instr)
 {
-   nir_foreach_dest(instr, remove_def_cb, instr);
-   nir_foreach_src(instr, remove_use_cb, instr);
+   nir_dest *dest = nir_instr_dest(instr);
+   if (dest != NULL)
+      remove_def(dest, instr);
+   
+   nir_instr_foreach_src(instr, iter)
+      remove_use(iter.src, instr);
+}
+
+void
+nir_instr_insert(nir_cursor cursor, nir_instr *instr)
+{
+   switch (cursor.option) {
+      case nir_cursor_before_block:
+	 nir_instr_insert_before_block(cursor.block, instr);
+	 break;
+      case nir_cursor_after_block:
+	 nir_instr_insert_after_block(cursor.block, instr);
+	 break;
+      case nir_cursor_before_instr:
+	 nir_instr_insert_before(cursor.instr, instr);
+	 break;
+      case nir_cursor_after_instr:
+	 nir_instr_insert_after(cursor.instr, instr);
+	 break;
+      default:
+	 assert(0);
+	 break;
+   }
 }
 
 void nir_instr_remove(nir_instr *instr)
 {
    remove_defs_uses(instr);
+   instr_removed(instr);
    exec_node_remove(&instr->node);
    
    if (instr->type == nir_instr_type_jump)
       handle_remove_jump(instr->block);
 }
 
+void
+nir_ssa_def_init(nir_function_impl *impl, nir_instr *instr, nir_ssa_def *def,
+		 unsigned num_components, const char *name)
+{
+   def->name = name;
+   def->index = impl->ssa_alloc++;
+   def->parent_instr = instr;
+   def->num_components = num_components;
+}
+
+void
+nir_ssa_dest_init(nir_function_impl *impl, nir_instr *instr, nir_dest *dest,
+		  unsigned num_components, const char *name)
+{
+   dest->is_ssa = true;
+   nir_ssa_def_init(impl, instr, &dest->ssa, num_components, name);
+}
+
 /*@}*/
 
 void
@@ -1081,6 +1527,7 @@ nir_index_local_regs(nir_function_impl *impl)
    foreach_list_typed(nir_register, reg, node, &impl->registers) {
       reg->index = index++;
    }
+   impl->reg_alloc = index;
 }
 
 void
@@ -1090,193 +1537,43 @@ nir_index_global_regs(nir_shader *shader)
    foreach_list_typed(nir_register, reg, node, &shader->registers) {
       reg->index = index++;
    }
-}
-
-static bool
-visit_alu_dest(nir_alu_instr *instr, nir_foreach_dest_cb cb, void *state)
-{
-   return cb(&instr->dest.dest, state);
-}
-
-static bool
-visit_intrinsic_dest(nir_intrinsic_instr *instr, nir_foreach_dest_cb cb,
-		     void *state)
-{
-   if (nir_intrinsic_infos[instr->intrinsic].has_dest)
-      return cb(&instr->dest, state);
-   
-   return true;
-}
-
-static bool
-visit_texture_dest(nir_tex_instr *instr, nir_foreach_dest_cb cb,
-		   void *state)
-{
-   return cb(&instr->dest, state);
-}
-
-static bool
-visit_load_const_dest(nir_load_const_instr *instr, nir_foreach_dest_cb cb,
-		      void *state)
-{
-   return cb(&instr->dest, state);
-}
-
-static bool
-visit_phi_dest(nir_phi_instr *instr, nir_foreach_dest_cb cb, void *state)
-{
-   return cb(&instr->dest, state);
+   shader->reg_alloc = index;
 }
 
 bool
 nir_foreach_dest(nir_instr *instr, nir_foreach_dest_cb cb, void *state)
 {
-   switch (instr->type) {
-      case nir_instr_type_alu:
-	 return visit_alu_dest(nir_instr_as_alu(instr), cb, state);
-      case nir_instr_type_intrinsic:
-	 return visit_intrinsic_dest(nir_instr_as_intrinsic(instr), cb, state);
-      case nir_instr_type_texture:
-	 return visit_texture_dest(nir_instr_as_texture(instr), cb, state);
-      case nir_instr_type_load_const:
-	 return visit_load_const_dest(nir_instr_as_load_const(instr), cb, state);
-      case nir_instr_type_phi:
-	 return visit_phi_dest(nir_instr_as_phi(instr), cb, state);
-	 break;
-	 
-      case nir_instr_type_ssa_undef:
-      case nir_instr_type_call:
-      case nir_instr_type_jump:
-	 break;
-	 
-      default:
-	 assert(0);
-	 break;
-   }
-   
-   return true;
-}
-
-static bool
-visit_deref_array_src(nir_deref_array *deref, nir_foreach_src_cb cb,
-		      void *state)
-{
-   return cb(&deref->offset, state);
-}
-
-static bool
-visit_deref_src(nir_deref_var *deref, nir_foreach_src_cb cb, void *state)
-{
-   nir_deref *cur = &deref->deref;
-   while (cur != NULL) {
-      if (cur->deref_type == nir_deref_type_array)
-	 if (!visit_deref_array_src(nir_deref_as_array(cur), cb, state))
-	    return false;
-      
-      cur = cur->child;
-   }
-   
-   return true;
-}
-
-static bool
-visit_alu_src(nir_alu_instr *instr, nir_foreach_src_cb cb, void *state)
-{
-   for (unsigned i = 0; i < nir_op_infos[instr->op].num_inputs; i++)
-      if (!cb(&instr->src[i].src, state))
-	 return false;
-   
-   if (instr->has_predicate)
-      if (!cb(&instr->predicate, state))
-	 return false;
-   
-   return true;
-}
-
-static bool
-visit_tex_src(nir_tex_instr *instr, nir_foreach_src_cb cb, void *state)
-{
-   for (unsigned i = 0; i < instr->num_srcs; i++)
-      if (!cb(&instr->src[i], state))
-	 return false;
-   
-   if (instr->has_predicate)
-      if (!cb(&instr->predicate, state))
-	 return false;
-   
-   if (instr->sampler != NULL)
-      if (!visit_deref_src(instr->sampler, cb, state))
-	 return false;
+   nir_dest *dest = nir_instr_dest(instr);
+   if (dest != NULL)
+      return cb(dest, state);
    
    return true;
 }
 
-static bool
-visit_intrinsic_src(nir_intrinsic_instr *instr, nir_foreach_src_cb cb,
-		    void *state)
-{  
-   unsigned num_srcs = nir_intrinsic_infos[instr->intrinsic].num_srcs;
-   for (unsigned i = 0; i < num_srcs; i++)
-      if (!cb(&instr->src[i], state))
-	 return false;
-   
-   unsigned num_vars =
-      nir_intrinsic_infos[instr->intrinsic].num_variables;
-   for (unsigned i = 0; i < num_vars; i++)
-      if (!visit_deref_src(instr->variables[i], cb, state))
-	 return false;
-   
-   if (instr->has_predicate)
-      if (!cb(&instr->predicate, state))
-	 return false;
-   
-   return true;
-}
-
-static bool
-visit_call_src(nir_call_instr *instr, nir_foreach_src_cb cb, void *state)
+bool
+nir_foreach_src(nir_instr *instr, nir_foreach_src_cb cb, void *state)
 {
-   if (instr->has_predicate)
-      if (!cb(&instr->predicate, state))
+   nir_instr_foreach_src(instr, iter) {
+      if (!cb(iter.src, state))
 	 return false;
+   }
    
    return true;
 }
 
-static bool
-visit_load_const_src(nir_load_const_instr *instr, nir_foreach_src_cb cb,
-		     void *state)
-{  
-   if (instr->has_predicate)
-      if (!cb(&instr->predicate, state))
-	 return false;
-   
-   return true;
-}
 
-bool
-nir_foreach_src(nir_instr *instr, nir_foreach_src_cb cb, void *state)
+nir_if *
+nir_block_following_if(nir_block *block)
 {
-   switch (instr->type) {
-      case nir_instr_type_alu:
-	 return visit_alu_src(nir_instr_as_alu(instr), cb, state);
-      case nir_instr_type_intrinsic:
-	 return visit_intrinsic_src(nir_instr_as_intrinsic(instr), cb, state);
-      case nir_instr_type_texture:
-	 return visit_tex_src(nir_instr_as_texture(instr), cb, state);
-      case nir_instr_type_call:
-	 return visit_call_src(nir_instr_as_call(instr), cb, state);
-      case nir_instr_type_load_const:
-	 return visit_load_const_src(nir_instr_as_load_const(instr), cb, state);
-	 
-      default:
-	 break;
-   }
+   /* the end block isn't in any list */
+   if (block->cf_node.node.next == NULL ||
+       exec_node_is_tail_sentinel(block->cf_node.node.next))
+      return NULL;
    
-   return true;
+   nir_cf_node *next = nir_cf_node_next(&block->cf_node);
+   return next->type == nir_cf_node_if ? nir_cf_node_as_if(next) : NULL;
 }
 
-
 static bool foreach_cf_node(nir_cf_node *node, nir_foreach_block_cb cb,
 			    void *state);
 
@@ -1347,19 +1644,118 @@ nir_foreach_block(nir_function_impl *impl, nir_foreach_block_cb cb, void *state)
 }
 
 static bool
-index_block(nir_block *block, void *state)
+count_block(nir_block *block, void *state)
 {
-   unsigned *index = (unsigned *) state;
-   block->index = (*index)++;
+   unsigned *count = (unsigned *) state;
+   (*count)++;
    return true;
 }
 
+static bool
+add_block(nir_block *block, void *state)
+{
+   nir_block ***next = (nir_block ***) state;
+   *(*next)++ = block;
+   return true;
+}
+
+/*
+ * Fills in impl->rpo_blocks with a depth-first search of the CFG from the
+ * start block. This uses an explicit stack, since the CFG of a large shader
+ * can be deep enough to overflow the C stack.
+ */
+static void
+build_rpo_blocks(nir_function_impl *impl)
+{
+   void *mem_ctx = ralloc_context(NULL);
+   struct set *visited = _mesa_set_create(mem_ctx, _mesa_key_pointer_equal);
+   
+   /* the number of blocks bounds the depth of the search */
+   nir_block **stack = ralloc_array(mem_ctx, nir_block *, impl->num_blocks);
+   unsigned *next_succ = ralloc_array(mem_ctx, unsigned, impl->num_blocks);
+   nir_block **post_order = ralloc_array(mem_ctx, nir_block *,
+					 impl->num_blocks);
+   unsigned depth = 0, num_post_order = 0;
+   
+   _mesa_set_add(visited, _mesa_hash_pointer(impl->start_block),
+		 impl->start_block);
+   stack[depth] = impl->start_block;
+   next_succ[depth] = 0;
+   depth++;
+   
+   while (depth > 0) {
+      nir_block *block = stack[depth - 1];
+      
+      if (next_succ[depth - 1] == 2) {
+	 post_order[num_post_order++] = block;
+	 depth--;
+	 continue;
+      }
+      
+      nir_block *succ = block->successors[next_succ[depth - 1]++];
+      if (succ == NULL ||
+	  _mesa_set_search(visited, _mesa_hash_pointer(succ), succ) != NULL)
+	 continue;
+      
+      _mesa_set_add(visited, _mesa_hash_pointer(succ), succ);
+      stack[depth] = succ;
+      next_succ[depth] = 0;
+      depth++;
+   }
+   
+   impl->num_rpo_blocks = num_post_order;
+   impl->rpo_blocks = reralloc(impl, impl->rpo_blocks, nir_block *,
+			       num_post_order + 1);
+   for (unsigned i = 0; i < num_post_order; i++)
+      impl->rpo_blocks[i] = post_order[num_post_order - 1 - i];
+   impl->rpo_blocks[num_post_order] = NULL;
+   
+   ralloc_free(mem_ctx);
+}
+
+static void
+update_blocks(nir_function_impl *impl)
+{
+   if (!impl->blocks_dirty)
+      return;
+   
+   unsigned num_blocks = 0;
+   nir_foreach_block(impl, count_block, &num_blocks);
+   
+   impl->num_blocks = num_blocks;
+   impl->blocks = reralloc(impl, impl->blocks, nir_block *, num_blocks + 1);
+   
+   nir_block **next = impl->blocks;
+   nir_foreach_block(impl, add_block, &next);
+   *next = NULL;
+   
+   build_rpo_blocks(impl);
+   
+   impl->blocks_dirty = false;
+}
+
+nir_block **
+nir_impl_blocks(nir_function_impl *impl)
+{
+   update_blocks(impl);
+   return impl->blocks;
+}
+
+nir_block **
+nir_impl_rpo_blocks(nir_function_impl *impl)
+{
+   update_blocks(impl);
+   return impl->rpo_blocks;
+}
+
 void
 nir_index_blocks(nir_function_impl *impl)
 {
    unsigned index = 0;
    
-   nir_foreach_block(impl, index_block, &index);
+   nir_foreach_block_in_order(impl, block) {
+      block->index = index++;
+   }
 }
 
 static void
@@ -1403,5 +1799,6 @@ nir_index_ssa_defs(nir_function_impl *impl)
 {
    unsigned index = 0;
    nir_foreach_block(impl, index_ssa_block, &index);
+   impl->ssa_alloc = index;
 }
 
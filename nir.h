@@ -28,6 +28,7 @@
 #pragma once
 
 #include "main/hash_table.h"
+#include "main/set.h"
 #include "list.h"
 #include "GL/gl.h" /* GLenum */
 #include "ralloc.h"
@@ -349,13 +350,13 @@ typedef struct {
    bool is_global;
    
    /** set of nir_instr's where this register is used (read from) */
-   struct hash_table *uses;
+   struct set *uses;
    
    /** set of nir_instr's where this register is defined (written to) */
-   struct hash_table *defs;
+   struct set *defs;
    
    /** set of ifs where this register is used as a condition */
-   struct hash_table *if_uses;
+   struct set *if_uses;
 } nir_register;
 
 typedef enum {
@@ -644,12 +645,18 @@ typedef struct {
    
    unsigned num_srcs; /** < number of register/SSA inputs */
    
-   /** number of components of each input register */
+   /**
+    * number of components of each input register, or 0 if the intrinsic
+    * takes as many as the source has
+    */
    unsigned src_components[NIR_INTRINSIC_MAX_INPUTS];
    
    bool has_dest;
    
-   /** number of components of each output register */
+   /**
+    * number of components of each output register, or 0 if the intrinsic
+    * writes as many as the destination has
+    */
    unsigned dest_components;
    
    /** the number of inputs/outputs that are variables */
@@ -677,6 +684,7 @@ typedef enum {
    nir_tex_src_shadow, /* shadow comparitor */
    nir_tex_src_offset,
    nir_tex_src_bias,
+   nir_tex_src_lod, /* explicit LOD for txl, txf and txs */
    nir_tex_src_ms_index, /* MSAA sample index */
    nir_tex_src_gather_component,
    nir_tex_src_ddx,
@@ -863,7 +871,7 @@ typedef struct nir_block {
     */
    struct nir_block *successors[2];
    
-   struct hash_table *predecessors;
+   struct set *predecessors;
 } nir_block;
 
 #define nir_block_first_instr(block) \
@@ -900,6 +908,34 @@ typedef struct {
 #define nir_loop_last_cf_node(loop) \
    exec_node_data(nir_cf_node, exec_list_get_tail(&(loop)->body), node)
 
+/*
+ * The instructions and blocks of a function that were changed while the
+ * list was attached to it (see nir_function_impl::changes). Inserted
+ * instructions and instructions passed to nir_instr_mark_changed() are
+ * recorded along with their blocks. Removing an instruction records its
+ * block and the instructions defining its SSA sources, which may have just
+ * lost their last use.
+ */
+typedef struct {
+   /** instructions in the order they changed; only those in instr_set count */
+   nir_instr **instrs;
+   unsigned num_instrs, instrs_size;
+   struct set *instr_set;
+   
+   nir_block **blocks;
+   unsigned num_blocks, blocks_size;
+   struct set *block_set;
+   
+   /** instructions removed while the list was attached */
+   struct set *removed;
+   
+   /**
+    * Whether the control flow changed, in which case some of the recorded
+    * blocks may no longer exist.
+    */
+   bool cf_changed;
+} nir_change_list;
+
 typedef struct {
    nir_cf_node cf_node;
    
@@ -928,6 +964,30 @@ typedef struct {
    
    /** next available SSA value index */
    unsigned ssa_alloc;
+   
+   /**
+    * Cached, NULL-terminated arrays of the blocks in source order and in
+    * reverse post-order, see nir_impl_blocks(). They are thrown away
+    * whenever the control flow changes and rebuilt the next time they are
+    * asked for.
+    */
+   struct nir_block **blocks, **rpo_blocks;
+   unsigned num_blocks, num_rpo_blocks;
+   bool blocks_dirty;
+   
+   /**
+    * Whether the function has changed since nir_validate_shader() last
+    * checked it. The instruction and control flow editing functions set
+    * this; code that modifies instructions in place has to set it itself.
+    */
+   bool dirty;
+   
+   /**
+    * If not NULL, the instruction editing functions record what they change
+    * here; code that modifies instructions in place has to call
+    * nir_instr_mark_changed() itself.
+    */
+   nir_change_list *changes;
 } nir_function_impl;
 
 #define nir_cf_node_next(_node) \
@@ -1003,6 +1063,13 @@ typedef struct nir_shader {
    
    /** next available global register index */
    unsigned reg_alloc;
+   
+   /**
+    * Whether global registers, functions or overloads have been added since
+    * the last nir_validate_shader(), which then has to recheck every
+    * function instead of only the dirty ones.
+    */
+   bool globals_dirty;
 } nir_shader;
 
 nir_shader *nir_shader_create(void *mem_ctx);
@@ -1020,6 +1087,13 @@ nir_function_overload *nir_function_overload_create(nir_function *func);
 
 nir_function_impl *nir_function_impl_create(nir_function_overload *func);
 
+/*
+ * The creation functions below take the context to allocate out of; that
+ * may be a linear context (see ralloc_linear_context()), which is much
+ * cheaper when creating lots of IR. The objects they return must then not
+ * be used as ralloc contexts themselves.
+ */
+
 nir_block *nir_block_create(void *mem_ctx);
 nir_if *nir_if_create(void *mem_ctx);
 nir_loop *nir_loop_create(void *mem_ctx);
@@ -1046,6 +1120,33 @@ nir_jump_instr *nir_jump_instr_create(void *mem_ctx, nir_jump_type type);
 
 nir_load_const_instr *nir_load_const_instr_create(void *mem_ctx);
 
+/*
+ * These allocate the instruction and its arrays of sources, variables or
+ * parameters at once, sized for the opcode or callee, with NULL registers
+ * and variables.
+ */
+nir_intrinsic_instr *nir_intrinsic_instr_create(void *mem_ctx,
+						nir_intrinsic_op op);
+
+/** the op defaults to nir_texop_tex, the source types have to be filled in */
+nir_tex_instr *nir_tex_instr_create(void *mem_ctx, unsigned num_srcs);
+
+nir_call_instr *nir_call_instr_create(void *mem_ctx,
+				      struct nir_function_overload *callee);
+
+/** creates a phi with no sources, see nir_phi_instr_add_src() */
+nir_phi_instr *nir_phi_instr_create(void *mem_ctx);
+
+nir_phi_src *nir_phi_instr_add_src(void *mem_ctx, nir_phi_instr *instr,
+				   nir_block *pred, nir_src src);
+
+/** the value gets the next SSA index of impl, like with nir_ssa_def_init() */
+nir_ssa_undef_instr *nir_ssa_undef_instr_create(void *mem_ctx,
+						nir_function_impl *impl,
+						unsigned num_components);
+
+nir_deref_var *nir_deref_var_create(void *mem_ctx, nir_variable *var);
+
 void nir_instr_insert_before(nir_instr *instr, nir_instr *before);
 void nir_instr_insert_after(nir_instr *instr, nir_instr *after);
 
@@ -1060,16 +1161,357 @@ void nir_instr_insert_after_cf_list(struct exec_list *list, nir_instr *after);
 
 void nir_instr_remove(nir_instr *instr);
 
+/** for code that modifies an instruction in place */
+void nir_instr_mark_changed(nir_instr *instr);
+
+nir_change_list *nir_change_list_create(void *mem_ctx);
+void nir_change_list_reset(nir_change_list *changes);
+bool nir_change_list_is_empty(nir_change_list *changes);
+bool nir_change_list_has_instr(nir_change_list *changes, nir_instr *instr);
+bool nir_change_list_was_removed(nir_change_list *changes, nir_instr *instr);
+
+/*
+ * A position where instructions can be inserted, which is always described
+ * in terms of a block or an instruction, so that inserting there doesn't
+ * have to look anything up again.
+ */
+
+typedef enum {
+   nir_cursor_before_block,
+   nir_cursor_after_block,
+   nir_cursor_before_instr,
+   nir_cursor_after_instr,
+} nir_cursor_option;
+
+typedef struct {
+   nir_cursor_option option;
+   union {
+      nir_block *block;
+      nir_instr *instr;
+   };
+} nir_cursor;
+
+static inline nir_cursor
+nir_before_block(nir_block *block)
+{
+   nir_cursor cursor;
+   cursor.option = nir_cursor_before_block;
+   cursor.block = block;
+   return cursor;
+}
+
+static inline nir_cursor
+nir_after_block(nir_block *block)
+{
+   nir_cursor cursor;
+   cursor.option = nir_cursor_after_block;
+   cursor.block = block;
+   return cursor;
+}
+
+static inline nir_cursor
+nir_before_instr(nir_instr *instr)
+{
+   nir_cursor cursor;
+   cursor.option = nir_cursor_before_instr;
+   cursor.instr = instr;
+   return cursor;
+}
+
+static inline nir_cursor
+nir_after_instr(nir_instr *instr)
+{
+   nir_cursor cursor;
+   cursor.option = nir_cursor_after_instr;
+   cursor.instr = instr;
+   return cursor;
+}
+
+/* the end of the block before the node, which is where it starts executing */
+static inline nir_cursor
+nir_before_cf_node(nir_cf_node *node)
+{
+   if (node->type == nir_cf_node_block)
+      return nir_before_block(nir_cf_node_as_block(node));
+   
+   return nir_after_block(nir_cf_node_as_block(nir_cf_node_prev(node)));
+}
+
+/* the start of the block after the node */
+static inline nir_cursor
+nir_after_cf_node(nir_cf_node *node)
+{
+   if (node->type == nir_cf_node_block)
+      return nir_after_block(nir_cf_node_as_block(node));
+   
+   return nir_before_block(nir_cf_node_as_block(nir_cf_node_next(node)));
+}
+
+/* the first and last blocks of a control flow list, which are never empty */
+static inline nir_block *
+nir_cf_list_first_block(struct exec_list *list)
+{
+   return nir_cf_node_as_block(exec_node_data(nir_cf_node,
+					      exec_list_get_head(list), node));
+}
+
+static inline nir_block *
+nir_cf_list_last_block(struct exec_list *list)
+{
+   return nir_cf_node_as_block(exec_node_data(nir_cf_node,
+					      exec_list_get_tail(list), node));
+}
+
+static inline nir_cursor
+nir_before_cf_list(struct exec_list *list)
+{
+   return nir_before_cf_node(exec_node_data(nir_cf_node,
+					    exec_list_get_head(list), node));
+}
+
+static inline nir_cursor
+nir_after_cf_list(struct exec_list *list)
+{
+   return nir_after_cf_node(exec_node_data(nir_cf_node,
+					   exec_list_get_tail(list), node));
+}
+
+void nir_instr_insert(nir_cursor cursor, nir_instr *instr);
+
+/*
+ * Makes def an SSA value computed by instr, giving it the next index in
+ * impl.
+ */
+void nir_ssa_def_init(nir_function_impl *impl, nir_instr *instr,
+		      nir_ssa_def *def, unsigned num_components,
+		      const char *name);
+void nir_ssa_dest_init(nir_function_impl *impl, nir_instr *instr,
+		       nir_dest *dest, unsigned num_components,
+		       const char *name);
+
 typedef bool (*nir_foreach_dest_cb)(nir_dest *dest, void *state);
 typedef bool (*nir_foreach_src_cb)(nir_src *src, void *state);
 bool nir_foreach_dest(nir_instr *instr, nir_foreach_dest_cb cb, void *state);
 bool nir_foreach_src(nir_instr *instr, nir_foreach_src_cb cb, void *state);
 
+/*
+ * Inline versions of the above, for code that runs on every instruction.
+ * These don't call through a function pointer, so the loop body can be
+ * inlined.
+ */
+
+/* returns the destination of an instruction, or NULL if it has none */
+static inline nir_dest *
+nir_instr_dest(nir_instr *instr)
+{
+   switch (instr->type) {
+      case nir_instr_type_alu:
+	 return &nir_instr_as_alu(instr)->dest.dest;
+      case nir_instr_type_intrinsic: {
+	 nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(instr);
+	 if (nir_intrinsic_infos[intrin->intrinsic].has_dest)
+	    return &intrin->dest;
+	 return NULL;
+      }
+      case nir_instr_type_texture:
+	 return &nir_instr_as_texture(instr)->dest;
+      case nir_instr_type_load_const:
+	 return &nir_instr_as_load_const(instr)->dest;
+      case nir_instr_type_phi:
+	 return &nir_instr_as_phi(instr)->dest;
+      default:
+	 return NULL;
+   }
+}
+
+/* returns the predicate of an instruction, or NULL if it isn't predicated */
+static inline nir_src *
+nir_instr_predicate(nir_instr *instr)
+{
+   switch (instr->type) {
+      case nir_instr_type_alu: {
+	 nir_alu_instr *alu = nir_instr_as_alu(instr);
+	 return alu->has_predicate ? &alu->predicate : NULL;
+      }
+      case nir_instr_type_intrinsic: {
+	 nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(instr);
+	 return intrin->has_predicate ? &intrin->predicate : NULL;
+      }
+      case nir_instr_type_texture: {
+	 nir_tex_instr *tex = nir_instr_as_texture(instr);
+	 return tex->has_predicate ? &tex->predicate : NULL;
+      }
+      case nir_instr_type_call: {
+	 nir_call_instr *call = nir_instr_as_call(instr);
+	 return call->has_predicate ? &call->predicate : NULL;
+      }
+      case nir_instr_type_load_const: {
+	 nir_load_const_instr *load = nir_instr_as_load_const(instr);
+	 return load->has_predicate ? &load->predicate : NULL;
+      }
+      default:
+	 return NULL;
+   }
+}
+
+typedef enum {
+   nir_src_iter_srcs,     /** < the instruction's own sources */
+   nir_src_iter_derefs,   /** < array offsets in its dereference chains */
+   nir_src_iter_predicate,
+   nir_src_iter_done
+} nir_src_iter_stage;
+
+/*
+ * Walks the same sources as nir_foreach_src(): normal sources, the offsets
+ * of array dereferences and the predicate. Phi sources aren't included.
+ */
+typedef struct {
+   nir_instr *instr;
+   
+   /** the current source, or NULL once all of them have been visited */
+   nir_src *src;
+   
+   nir_src_iter_stage stage;
+   unsigned index; /** < next source or dereference chain */
+   nir_deref *deref; /** < next link in the current dereference chain */
+} nir_src_iter;
+
+static inline nir_src *
+nir_src_iter_get_src(nir_instr *instr, unsigned i)
+{
+   switch (instr->type) {
+      case nir_instr_type_alu: {
+	 nir_alu_instr *alu = nir_instr_as_alu(instr);
+	 if (i < nir_op_infos[alu->op].num_inputs)
+	    return &alu->src[i].src;
+	 return NULL;
+      }
+      case nir_instr_type_intrinsic: {
+	 nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(instr);
+	 if (i < nir_intrinsic_infos[intrin->intrinsic].num_srcs)
+	    return &intrin->src[i];
+	 return NULL;
+      }
+      case nir_instr_type_texture: {
+	 nir_tex_instr *tex = nir_instr_as_texture(instr);
+	 if (i < tex->num_srcs)
+	    return &tex->src[i];
+	 return NULL;
+      }
+      default:
+	 return NULL;
+   }
+}
+
+static inline nir_deref_var *
+nir_src_iter_get_deref(nir_instr *instr, unsigned i)
+{
+   switch (instr->type) {
+      case nir_instr_type_intrinsic: {
+	 nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(instr);
+	 if (i < nir_intrinsic_infos[intrin->intrinsic].num_variables)
+	    return intrin->variables[i];
+	 return NULL;
+      }
+      case nir_instr_type_texture:
+	 return i == 0 ? nir_instr_as_texture(instr)->sampler : NULL;
+      default:
+	 return NULL;
+   }
+}
+
+static inline void
+nir_src_iter_next(nir_src_iter *iter)
+{
+   for (;;) {
+      switch (iter->stage) {
+	 case nir_src_iter_srcs:
+	    iter->src = nir_src_iter_get_src(iter->instr, iter->index++);
+	    if (iter->src != NULL)
+	       return;
+	    
+	    iter->stage = nir_src_iter_derefs;
+	    iter->index = 0;
+	    iter->deref = NULL;
+	    break;
+	    
+	 case nir_src_iter_derefs:
+	    while (iter->deref != NULL) {
+	       nir_deref *deref = iter->deref;
+	       iter->deref = deref->child;
+	       if (deref->deref_type == nir_deref_type_array) {
+		  iter->src = &nir_deref_as_array(deref)->offset;
+		  return;
+	       }
+	    }
+	    
+	    nir_deref_var *chain = nir_src_iter_get_deref(iter->instr,
+							  iter->index++);
+	    if (chain != NULL)
+	       iter->deref = &chain->deref;
+	    else
+	       iter->stage = nir_src_iter_predicate;
+	    break;
+	    
+	 case nir_src_iter_predicate:
+	    iter->stage = nir_src_iter_done;
+	    iter->src = nir_instr_predicate(iter->instr);
+	    if (iter->src != NULL)
+	       return;
+	    break;
+	    
+	 case nir_src_iter_done:
+	 default:
+	    iter->src = NULL;
+	    return;
+      }
+   }
+}
+
+static inline nir_src_iter
+nir_src_iter_begin(nir_instr *instr)
+{
+   nir_src_iter iter;
+   iter.instr = instr;
+   iter.src = NULL;
+   iter.stage = nir_src_iter_srcs;
+   iter.index = 0;
+   iter.deref = NULL;
+   nir_src_iter_next(&iter);
+   return iter;
+}
+
+/* loops over the sources of an instruction, which are given by iter.src */
+#define nir_instr_foreach_src(instr, iter) \
+   for (nir_src_iter iter = nir_src_iter_begin(instr); iter.src != NULL; \
+	nir_src_iter_next(&iter))
+
 /* visits basic blocks in source-code order */
 typedef bool (*nir_foreach_block_cb)(nir_block *block, void *state);
 bool nir_foreach_block(nir_function_impl *impl, nir_foreach_block_cb cb,
 		       void *state);
 
+/*
+ * Return the cached block arrays of impl, rebuilding them first if the
+ * control flow has changed since they were last built. The source order is
+ * the same as nir_foreach_block()'s, including the end block. The reverse
+ * post-order only contains the blocks reachable from the start block.
+ */
+nir_block **nir_impl_blocks(nir_function_impl *impl);
+nir_block **nir_impl_rpo_blocks(nir_function_impl *impl);
+
+/*
+ * Plain loops over the cached arrays, for analyses that walk the blocks
+ * many times. The control flow must not be changed inside the loop.
+ */
+#define nir_foreach_block_in_order(impl, block) \
+   for (nir_block **block##_iter = nir_impl_blocks(impl), *block; \
+	(block = *block##_iter) != NULL; block##_iter++)
+
+#define nir_foreach_block_rpo(impl, block) \
+   for (nir_block **block##_iter = nir_impl_rpo_blocks(impl), *block; \
+	(block = *block##_iter) != NULL; block##_iter++)
+
 void nir_index_local_regs(nir_function_impl *impl);
 void nir_index_global_regs(nir_shader *shader);
 void nir_index_ssa_defs(nir_function_impl *impl);
@@ -1078,4 +1520,291 @@ void nir_index_blocks(nir_function_impl *impl);
 
 void nir_print_shader(nir_shader *shader, FILE *fp);
 
+/** returns what nir_print_shader() prints, as a ralloc'ed string */
+char *nir_print_shader_to_string(nir_shader *shader, void *mem_ctx);
+
+/*
+ * Only the functions whose dirty flag is set are checked, unless the
+ * shader's globals_dirty flag is set. The flags are cleared afterwards.
+ */
 void nir_validate_shader(nir_shader *shader);
+
+/*
+ * Does the same checks as nir_validate_shader(), and also checks that every
+ * SSA value dominates its uses. Registers, SSA values and blocks are
+ * renumbered with the nir_index_*() functions first, so that the
+ * bookkeeping can use arrays indexed by those numbers instead of hash
+ * tables.
+ */
+void nir_validate_shader_fast(nir_shader *shader);
+
+/*
+ * Visits the implementation of every function overload of the shader that
+ * has one. A break only skips the rest of the current function's overloads.
+ */
+#define nir_foreach_impl(shader, impl) \
+   foreach_list_typed(nir_function, impl##_func, node, &(shader)->functions) \
+      foreach_list_typed(nir_function_overload, impl##_overload, node, \
+			 &impl##_func->overload_list) \
+	 for (nir_function_impl *impl = impl##_overload->impl; impl != NULL; \
+	      impl = NULL)
+
+/** the if right after block, if any */
+nir_if *nir_block_following_if(nir_block *block);
+
+/*
+ * Running passes on several function implementations at once.
+ *
+ * Once calls are resolved, the implementations of a shader are independent,
+ * so a per-impl callback can be run on a fixed-size pool of threads. The
+ * callback may freely modify the impl it is given, as long as anything it
+ * allocates is parented to that impl (or to its worker's mem_ctx for
+ * scratch data) rather than to the shader. Global registers and glsl_types
+ * are safe to use from several workers at once; nothing else that is shared
+ * between impls is.
+ */
+
+#define NIR_PASS_SCRATCH_TABLES 4
+
+typedef struct {
+   /** which worker this is; the thread that started the run is worker 0 */
+   unsigned index;
+   
+   /** position in the shader of the impl currently being processed */
+   unsigned impl_index;
+   
+   /** scratch memory, freed once every impl has been processed */
+   void *mem_ctx;
+   
+   /** pointer-keyed hash tables, emptied before each impl */
+   struct hash_table *scratch[NIR_PASS_SCRATCH_TABLES];
+} nir_pass_worker;
+
+/** returns whether the callback made progress */
+typedef bool (*nir_impl_pass_cb)(nir_function_impl *impl,
+				 nir_pass_worker *worker, void *data);
+
+typedef struct nir_pass_runner nir_pass_runner;
+
+/** creates a pool of num_threads threads, or one per CPU if 0 */
+nir_pass_runner *nir_pass_runner_create(unsigned num_threads);
+void nir_pass_runner_destroy(nir_pass_runner *runner);
+
+/*
+ * Calls cb on every impl of the shader and waits for all of them to finish.
+ * Returns true if any of the calls made progress; per-impl results should
+ * be stored by worker->impl_index, so that the outcome doesn't depend on
+ * which thread happened to process which impl. With a NULL runner, the
+ * impls are processed one after another on the calling thread.
+ */
+bool nir_pass_runner_run(nir_pass_runner *runner, nir_shader *shader,
+			 nir_impl_pass_cb cb, void *data);
+
+/*
+ * Makes nir_shader_foreach_impl_parallel() use runner, or process impls on
+ * the calling thread again if it is NULL, which is the default. The caller
+ * keeps ownership of the runner and has to unset it before destroying it.
+ */
+void nir_set_default_pass_runner(nir_pass_runner *runner);
+
+/** like nir_pass_runner_run(), using the runner set as the default */
+bool nir_shader_foreach_impl_parallel(nir_shader *shader, nir_impl_pass_cb cb,
+				      void *data);
+
+/*
+ * Pass manager.
+ *
+ * Passes are registered by name and then run as a pipeline, given either as
+ * an array of names or as one string of names separated by commas or
+ * whitespace. Every pass run records how long it took, how it changed the
+ * number of instructions and blocks, and whether it made progress.
+ */
+
+/** returns whether the pass made progress */
+typedef bool (*nir_shader_pass_cb)(nir_shader *shader, void *data);
+
+typedef struct {
+   /** owned by the pass manager */
+   const char *name;
+   
+   /** seconds between creating the pass manager and starting the pass */
+   double start;
+   
+   double seconds;
+   
+   /** number after the pass minus number before it */
+   int instr_delta, block_delta;
+   
+   bool progress;
+} nir_pass_stat;
+
+typedef struct nir_pass_manager nir_pass_manager;
+
+nir_pass_manager *nir_pass_manager_create(void *mem_ctx);
+
+/** registering a name a second time replaces the earlier pass */
+void nir_pass_manager_add(nir_pass_manager *pm, const char *name,
+			  nir_shader_pass_cb cb, void *data);
+bool nir_pass_manager_has_pass(nir_pass_manager *pm, const char *name);
+
+/*
+ * Both return false without running anything if the pipeline names a pass
+ * that was never registered. Otherwise, *progress (if not NULL) is set to
+ * whether any of the passes made progress.
+ */
+bool nir_pass_manager_run(nir_pass_manager *pm, nir_shader *shader,
+			  const char *const *passes, unsigned num_passes,
+			  bool *progress);
+bool nir_pass_manager_run_string(nir_pass_manager *pm, nir_shader *shader,
+				 const char *pipeline, bool *progress);
+
+/** the stats of every pass run since creation or the last clear, in order */
+const nir_pass_stat *nir_pass_manager_stats(nir_pass_manager *pm,
+					    unsigned *num_stats);
+void nir_pass_manager_clear_stats(nir_pass_manager *pm);
+
+/** the stats as a JSON array of objects, one per pass run */
+char *nir_pass_manager_stats_to_json(nir_pass_manager *pm, void *mem_ctx);
+
+/** the stats in the Chrome trace-event format */
+char *nir_pass_manager_stats_to_trace(nir_pass_manager *pm, void *mem_ctx);
+
+/*
+ * Optimization loop.
+ *
+ * Runs a set of passes over a function over and over until none of them
+ * makes progress. Instruction and block passes only look at what changed in
+ * the previous round (all of the function in the first round), as recorded
+ * by the function's change list, so that a round that changes little also
+ * costs little. Instruction and block passes must not change control flow,
+ * and must call nir_instr_mark_changed() on any instruction they modify in
+ * place. Function passes may do anything, and are only rerun once something
+ * has changed since they last ran.
+ */
+
+typedef struct {
+   /** exactly one of these is set */
+   bool (*instr_cb)(nir_instr *instr, void *data);
+   bool (*block_cb)(nir_block *block, void *data);
+   bool (*impl_cb)(nir_function_impl *impl, void *data);
+   
+   void *data;
+} nir_opt_pass;
+
+/** both return true if any pass made progress */
+bool nir_optimize_impl(nir_function_impl *impl, const nir_opt_pass *passes,
+		       unsigned num_passes);
+bool nir_optimize(nir_shader *shader, const nir_opt_pass *passes,
+		  unsigned num_passes);
+
+/*
+ * Sparse conditional constant propagation: replaces SSA values that are
+ * constant along every executable path by load_const instructions, and
+ * removes the branches of ifs that are never taken.
+ */
+bool nir_opt_sccp_impl(nir_function_impl *impl);
+bool nir_opt_sccp(nir_shader *shader);
+
+/*
+ * Integer range and known-bits analysis. Every integer SSA value of the
+ * function gets a signed range and the bits known to be zero or one, which
+ * hold for all of its components. Values the analysis knows nothing about,
+ * including those created after it ran, get the full range. The SSA values
+ * are reindexed, and the function must not change in ways that change the
+ * values while the results are used.
+ */
+typedef struct {
+   int32_t min, max; /** < inclusive */
+   uint32_t known_zero, known_one;
+} nir_int_range;
+
+typedef struct nir_range_analysis nir_range_analysis;
+
+nir_range_analysis *nir_range_analysis_create(void *mem_ctx,
+					      nir_function_impl *impl);
+nir_int_range nir_range_analysis_get(const nir_range_analysis *ra,
+				     const nir_ssa_def *def);
+bool nir_ssa_def_is_non_negative(const nir_range_analysis *ra,
+				 const nir_ssa_def *def);
+/* whether def is a valid index into an array of the given size */
+bool nir_ssa_def_in_bounds(const nir_range_analysis *ra,
+			   const nir_ssa_def *def, unsigned size);
+
+/*
+ * Uses the ranges to turn ishr of non-negative values into ushr, iand with
+ * masks that don't clear anything into moves, and integer comparisons with
+ * known results into moves of constants.
+ */
+bool nir_opt_int_ranges_impl(nir_function_impl *impl);
+bool nir_opt_int_ranges(nir_shader *shader);
+
+/*
+ * Divergence analysis: which values, registers and if conditions may differ
+ * between the invocations of a shader that run together. Uniform values can
+ * live in scalar registers, and uniform ifs need no execution masks. The SSA
+ * values are reindexed, and anything created after the analysis ran is
+ * taken to be divergent.
+ */
+typedef struct nir_divergence_analysis nir_divergence_analysis;
+
+nir_divergence_analysis *nir_divergence_analysis_create(void *mem_ctx,
+							nir_function_impl *impl);
+bool nir_ssa_def_is_divergent(const nir_divergence_analysis *da,
+			      const nir_ssa_def *def);
+bool nir_reg_is_divergent(const nir_divergence_analysis *da,
+			  const nir_register *reg);
+bool nir_src_is_divergent(const nir_divergence_analysis *da,
+			  const nir_src *src);
+bool nir_if_is_divergent(const nir_divergence_analysis *da,
+			 const nir_if *if_stmt);
+
+/*
+ * Packs the scalar, vec2 and vec3 inputs or outputs (depending on mode)
+ * without an explicit location into shared vec4 slots, assigning their
+ * location and location_frac, and moves the load_input or store_output
+ * intrinsics that accessed them.
+ */
+bool nir_pack_varyings(nir_shader *shader, nir_variable_mode mode);
+
+/*
+ * Links the outputs of producer to the inputs of consumer: removes inputs
+ * that are never written and outputs that are never read, and replaces the
+ * loads of inputs that are always written the same constant by the
+ * constant. The removed stores leave dead code behind in the producer.
+ */
+bool nir_link_shaders(nir_shader *producer, nir_shader *consumer);
+
+/*
+ * Removes the uniforms, inputs, outputs and globals that nothing refers to,
+ * and gives the remaining uniforms consecutive locations, moving the
+ * load_uniform intrinsics along.
+ */
+bool nir_remove_dead_variables(nir_shader *shader);
+
+/*
+ * Texture lowering, for backends that only support the simpler forms of
+ * texture instructions. Only sources that are SSA values are lowered.
+ */
+typedef struct {
+   /** divides the coordinate and shadow comparator by the projector */
+   bool lower_projector;
+   
+   /** adds offsets to the coordinate instead of passing them */
+   bool lower_offset;
+   
+   /**
+    * If min_offset < max_offset, offsets that aren't lowered are clamped to
+    * [min_offset, max_offset].
+    */
+   int min_offset, max_offset;
+   
+   /** turns txb into txl, adding the bias to the LOD from a lod query */
+   bool lower_txb;
+   
+   /** turns txd into txl, computing the LOD from the derivatives */
+   bool lower_txd;
+} nir_lower_tex_options;
+
+bool nir_lower_tex_impl(nir_function_impl *impl,
+			const nir_lower_tex_options *options);
+bool nir_lower_tex(nir_shader *shader, const nir_lower_tex_options *options);
@@ -0,0 +1,271 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#pragma once
+
+#include "nir.h"
+
+/*
+ * Helpers for emitting instructions that produce SSA values. The builder
+ * keeps a cursor and moves it past every instruction it inserts, so a
+ * sequence of calls emits instructions in order.
+ */
+
+typedef struct nir_builder {
+   nir_cursor cursor;
+   
+   /* what instructions are allocated out of, possibly a linear context */
+   void *mem_ctx;
+   
+   nir_shader *shader;
+   nir_function_impl *impl;
+} nir_builder;
+
+/*
+ * Points the cursor at the end of the function. Instructions are allocated
+ * out of the function rather than the shader, so that functions processed
+ * in parallel never allocate out of the same context.
+ */
+static inline void
+nir_builder_init(nir_builder *build, nir_shader *shader,
+		 nir_function_impl *impl)
+{
+   build->cursor = nir_after_cf_list(&impl->body);
+   build->mem_ctx = impl;
+   build->shader = shader;
+   build->impl = impl;
+}
+
+static inline void
+nir_builder_instr_insert(nir_builder *build, nir_instr *instr)
+{
+   nir_instr_insert(build->cursor, instr);
+   build->cursor = nir_after_instr(instr);
+}
+
+/* a phi with no sources yet, see nir_phi_add_ssa_src() */
+static inline nir_phi_instr *
+nir_build_phi(nir_builder *build, unsigned num_components)
+{
+   nir_phi_instr *phi = nir_phi_instr_create(build->mem_ctx);
+   nir_ssa_dest_init(build->impl, &phi->instr, &phi->dest, num_components,
+		     NULL);
+   nir_builder_instr_insert(build, &phi->instr);
+   return phi;
+}
+
+/* makes the phi take def when coming from pred */
+static inline void
+nir_phi_add_ssa_src(nir_builder *build, nir_phi_instr *phi, nir_block *pred,
+		    nir_ssa_def *def)
+{
+   nir_src src;
+   src.is_ssa = true;
+   src.ssa = def;
+   nir_phi_instr_add_src(build->mem_ctx, phi, pred, src);
+}
+
+static inline nir_ssa_def *
+nir_build_imm(nir_builder *build, unsigned num_components,
+	      nir_const_value value)
+{
+   nir_load_const_instr *load_const =
+      nir_load_const_instr_create(build->mem_ctx);
+   load_const->value = value;
+   
+   nir_ssa_dest_init(build->impl, &load_const->instr, &load_const->dest,
+		     num_components, NULL);
+   nir_builder_instr_insert(build, &load_const->instr);
+   
+   return &load_const->dest.ssa;
+}
+
+static inline nir_ssa_def *
+nir_imm_float(nir_builder *build, float x)
+{
+   nir_const_value value;
+   value.f[0] = x;
+   value.f[1] = value.f[2] = value.f[3] = 0.0f;
+   return nir_build_imm(build, 1, value);
+}
+
+static inline nir_ssa_def *
+nir_imm_vec4(nir_builder *build, float x, float y, float z, float w)
+{
+   nir_const_value value;
+   value.f[0] = x;
+   value.f[1] = y;
+   value.f[2] = z;
+   value.f[3] = w;
+   return nir_build_imm(build, 4, value);
+}
+
+static inline nir_ssa_def *
+nir_imm_int(nir_builder *build, int x)
+{
+   nir_const_value value;
+   value.i[0] = x;
+   value.i[1] = value.i[2] = value.i[3] = 0;
+   return nir_build_imm(build, 1, value);
+}
+
+static inline nir_ssa_def *
+nir_ssa_undef(nir_builder *build, unsigned num_components)
+{
+   nir_ssa_undef_instr *undef =
+      nir_ssa_undef_instr_create(build->mem_ctx, build->impl, num_components);
+   nir_builder_instr_insert(build, &undef->instr);
+   
+   return &undef->def;
+}
+
+/* loads num_components of the uniform at index, with no indirect offset */
+static inline nir_ssa_def *
+nir_load_uniform(nir_builder *build, unsigned num_components, int index)
+{
+   nir_intrinsic_instr *load =
+      nir_intrinsic_instr_create(build->mem_ctx, nir_intrinsic_load_uniform);
+   load->src[0].is_ssa = true;
+   load->src[0].ssa = nir_imm_int(build, 0);
+   load->const_index[0] = index;
+   nir_ssa_dest_init(build->impl, &load->instr, &load->dest, num_components,
+		     NULL);
+   nir_builder_instr_insert(build, &load->instr);
+   
+   return &load->dest.ssa;
+}
+
+/* loads num_components of an input, starting at component of slot location */
+static inline nir_ssa_def *
+nir_load_input(nir_builder *build, unsigned num_components, int location,
+	       unsigned component)
+{
+   nir_intrinsic_instr *load =
+      nir_intrinsic_instr_create(build->mem_ctx, nir_intrinsic_load_input);
+   load->src[0].is_ssa = true;
+   load->src[0].ssa = nir_imm_int(build, 0);
+   load->const_index[0] = location;
+   load->const_index[1] = component;
+   nir_ssa_dest_init(build->impl, &load->instr, &load->dest, num_components,
+		     NULL);
+   nir_builder_instr_insert(build, &load->instr);
+   
+   return &load->dest.ssa;
+}
+
+/* stores value to an output, starting at component of slot location */
+static inline void
+nir_store_output(nir_builder *build, nir_ssa_def *value, int location,
+		 unsigned component)
+{
+   nir_intrinsic_instr *store =
+      nir_intrinsic_instr_create(build->mem_ctx, nir_intrinsic_store_output);
+   store->src[0].is_ssa = true;
+   store->src[0].ssa = nir_imm_int(build, 0);
+   store->src[1].is_ssa = true;
+   store->src[1].ssa = value;
+   store->const_index[0] = location;
+   store->const_index[1] = component;
+   nir_builder_instr_insert(build, &store->instr);
+}
+
+/*
+ * Emits an ALU instruction reading the given values, where the sources past
+ * the number the opcode takes are ignored. Unless the opcode has a fixed
+ * output size, the result is as wide as the widest source that isn't fixed
+ * size, like the rules in nir_opcodes.h say.
+ */
+static inline nir_ssa_def *
+nir_build_alu(nir_builder *build, nir_op op, nir_ssa_def *src0,
+	      nir_ssa_def *src1, nir_ssa_def *src2, nir_ssa_def *src3)
+{
+   const nir_op_info *info = &nir_op_infos[op];
+   nir_alu_instr *instr = nir_alu_instr_create(build->mem_ctx, op);
+   
+   nir_ssa_def *srcs[4] = { src0, src1, src2, src3 };
+   
+   unsigned num_components = info->output_size;
+   for (unsigned i = 0; i < info->num_inputs; i++) {
+      instr->src[i].src.is_ssa = true;
+      instr->src[i].src.ssa = srcs[i];
+      
+      if (info->output_size == 0 && info->input_sizes[i] == 0 &&
+	  srcs[i]->num_components > num_components)
+	 num_components = srcs[i]->num_components;
+   }
+   
+   nir_ssa_dest_init(build->impl, &instr->instr, &instr->dest.dest,
+		     num_components, NULL);
+   instr->dest.write_mask = (1 << num_components) - 1;
+   
+   nir_builder_instr_insert(build, &instr->instr);
+   
+   return &instr->dest.dest.ssa;
+}
+
+/* nir_<opcode>(build, src0, ...) for every opcode, e.g. nir_fadd(b, x, y) */
+
+#define ALU1(op)							\
+static inline nir_ssa_def *						\
+nir_##op(nir_builder *build, nir_ssa_def *src0)				\
+{									\
+   return nir_build_alu(build, nir_op_##op, src0, NULL, NULL, NULL);	\
+}
+
+#define ALU2(op)							\
+static inline nir_ssa_def *						\
+nir_##op(nir_builder *build, nir_ssa_def *src0, nir_ssa_def *src1)	\
+{									\
+   return nir_build_alu(build, nir_op_##op, src0, src1, NULL, NULL);	\
+}
+
+#define ALU3(op)							\
+static inline nir_ssa_def *						\
+nir_##op(nir_builder *build, nir_ssa_def *src0, nir_ssa_def *src1,	\
+	 nir_ssa_def *src2)						\
+{									\
+   return nir_build_alu(build, nir_op_##op, src0, src1, src2, NULL);	\
+}
+
+#define ALU4(op)							\
+static inline nir_ssa_def *						\
+nir_##op(nir_builder *build, nir_ssa_def *src0, nir_ssa_def *src1,	\
+	 nir_ssa_def *src2, nir_ssa_def *src3)				\
+{									\
+   return nir_build_alu(build, nir_op_##op, src0, src1, src2, src3);	\
+}
+
+#define OPCODE(name, num_inputs, per_component, output_size, input_sizes) \
+   ALU##num_inputs(name)
+#define LAST_OPCODE(name)
+
+#include "nir_opcodes.h"
+
+#undef OPCODE
+#undef LAST_OPCODE
+#undef ALU1
+#undef ALU2
+#undef ALU3
+#undef ALU4
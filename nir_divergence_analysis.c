@@ -0,0 +1,453 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include "nir.h"
+#include <assert.h>
+
+/*
+ * Divergence analysis: finds out which values may differ between the
+ * invocations running a shader together, and which ifs they may disagree
+ * on.
+ *
+ * Values start out uniform, and are only ever marked divergent, so the
+ * analysis walks the control flow tree until nothing changes. A value is
+ * divergent if one of its sources is, or if it is read from a source that
+ * differs per invocation (inputs, derivatives and the like). Besides that,
+ * divergent control flow makes values divergent:
+ *
+ *  - phis after an if with a divergent condition merge values from
+ *    invocations that went different ways.
+ *  - a loop whose break is taken by some invocations and not others
+ *    (because the break is inside an if with a divergent condition) is left
+ *    by the invocations in different iterations, so the phis after it and
+ *    any value from inside it that is used after it are divergent.
+ *  - likewise, a divergent continue makes the phis at the top of the loop
+ *    divergent, and invocations that continued don't leave the loop with
+ *    the others, so its breaks are divergent too.
+ *  - registers written while some invocations aren't executing, or read
+ *    from other functions (global registers), are divergent.
+ */
+
+struct nir_divergence_analysis {
+   unsigned num_defs;
+   bool *divergent_defs;
+   
+   struct set *divergent_regs;
+   struct set *divergent_ifs;
+   
+   /* loops that invocations may leave in different iterations */
+   struct set *divergent_break_loops;
+   /* loops where some invocations may continue while others don't */
+   struct set *divergent_continue_loops;
+   
+   /* some invocations may have returned before the others */
+   bool divergent_return;
+};
+
+typedef struct {
+   nir_divergence_analysis *da;
+   bool progress;
+} divergence_state;
+
+/* where in the control flow tree the walk is */
+typedef struct {
+   /* whether some invocations may not be executing the code */
+   bool divergent;
+   
+   /* whether that may be the case because of control flow inside the
+    * innermost loop, so that jumps out of it are divergent
+    */
+   bool divergent_in_loop;
+   
+   nir_loop *loop;
+} cf_context;
+
+static bool
+set_contains(struct set *set, const void *key)
+{
+   return _mesa_set_search(set, _mesa_hash_pointer(key), key) != NULL;
+}
+
+static void
+mark_in_set(divergence_state *state, struct set *set, const void *key)
+{
+   if (set_contains(set, key))
+      return;
+   
+   _mesa_set_add(set, _mesa_hash_pointer(key), key);
+   state->progress = true;
+}
+
+static void
+mark_def(divergence_state *state, nir_ssa_def *def)
+{
+   if (state->da->divergent_defs[def->index])
+      return;
+   
+   state->da->divergent_defs[def->index] = true;
+   state->progress = true;
+}
+
+static bool
+loop_has_divergent_exit(const nir_divergence_analysis *da,
+			const nir_loop *loop)
+{
+   return set_contains(da->divergent_break_loops, loop) ||
+	  set_contains(da->divergent_continue_loops, loop);
+}
+
+/*
+ * Instructions
+ */
+
+static bool
+intrinsic_is_divergent(nir_intrinsic_instr *intrin)
+{
+   switch (intrin->intrinsic) {
+      case nir_intrinsic_load_uniform:
+      case nir_intrinsic_load_ubo:
+	 return false;
+	 
+      case nir_intrinsic_load_var_vec1:
+      case nir_intrinsic_load_var_vec2:
+      case nir_intrinsic_load_var_vec3:
+      case nir_intrinsic_load_var_vec4:
+	 /* other variables may have been written with divergent values */
+	 return intrin->variables[0]->var->data.mode != nir_var_uniform;
+	 
+      case nir_intrinsic_load_input:
+      default:
+	 return true;
+   }
+}
+
+/* whether the value an instruction computes may be divergent */
+static bool
+instr_is_divergent(const nir_divergence_analysis *da, nir_instr *instr)
+{
+   nir_instr_foreach_src(instr, iter) {
+      if (nir_src_is_divergent(da, iter.src))
+	 return true;
+   }
+   
+   switch (instr->type) {
+      case nir_instr_type_alu: {
+	 nir_op op = nir_instr_as_alu(instr)->op;
+	 return op == nir_op_fddx || op == nir_op_fddy;
+      }
+      
+      case nir_instr_type_intrinsic:
+	 return intrinsic_is_divergent(nir_instr_as_intrinsic(instr));
+	 
+      case nir_instr_type_texture: {
+	 /* implicit derivatives come from the neighboring invocations */
+	 nir_texop op = nir_instr_as_texture(instr)->op;
+	 return op == nir_texop_tex || op == nir_texop_txb ||
+		op == nir_texop_lod;
+      }
+      
+      case nir_instr_type_load_const:
+      case nir_instr_type_ssa_undef:
+	 return false;
+	 
+      default:
+	 return true;
+   }
+}
+
+/* whether block is inside the control flow node */
+static bool
+block_is_inside(nir_block *block, nir_cf_node *node)
+{
+   for (nir_cf_node *cur = &block->cf_node; cur != NULL; cur = cur->parent) {
+      if (cur == node)
+	 return true;
+   }
+   
+   return false;
+}
+
+/*
+ * Marks the value of an SSA source read in block as divergent if it comes
+ * from inside a loop, not containing block, that invocations may leave in
+ * different iterations.
+ */
+static void
+visit_ssa_use(divergence_state *state, nir_src *src, nir_block *block)
+{
+   if (!src->is_ssa || state->da->divergent_defs[src->ssa->index])
+      return;
+   
+   nir_block *def_block = src->ssa->parent_instr->block;
+   for (nir_cf_node *node = def_block->cf_node.parent; node != NULL;
+	node = node->parent) {
+      if (node->type != nir_cf_node_loop)
+	 continue;
+      
+      if (block_is_inside(block, node))
+	 break;
+      
+      if (set_contains(state->da->divergent_break_loops, node)) {
+	 mark_def(state, src->ssa);
+	 return;
+      }
+   }
+}
+
+static void
+visit_phi(divergence_state *state, nir_phi_instr *phi)
+{
+   if (!phi->dest.is_ssa)
+      return;
+   
+   nir_block *block = phi->instr.block;
+   bool divergent = false;
+   
+   foreach_list_typed(nir_phi_src, src, node, &phi->srcs) {
+      visit_ssa_use(state, &src->src, block);
+      if (nir_src_is_divergent(state->da, &src->src))
+	 divergent = true;
+   }
+   
+   if (exec_node_is_head_sentinel(block->cf_node.node.prev)) {
+      /* the top of a loop */
+      nir_cf_node *parent = block->cf_node.parent;
+      if (parent->type == nir_cf_node_loop &&
+	  set_contains(state->da->divergent_continue_loops, parent))
+	 divergent = true;
+   } else {
+      /* right after an if or a loop */
+      nir_cf_node *prev = nir_cf_node_prev(&block->cf_node);
+      if (prev->type == nir_cf_node_if &&
+	  set_contains(state->da->divergent_ifs, prev))
+	 divergent = true;
+      if (prev->type == nir_cf_node_loop &&
+	  set_contains(state->da->divergent_break_loops, prev))
+	 divergent = true;
+   }
+   
+   if (divergent)
+      mark_def(state, &phi->dest.ssa);
+}
+
+static void
+visit_jump(divergence_state *state, nir_jump_instr *jump, cf_context *ctx)
+{
+   switch (jump->type) {
+      case nir_jump_break:
+	 if (ctx->divergent_in_loop)
+	    mark_in_set(state, state->da->divergent_break_loops, ctx->loop);
+	 break;
+	 
+      case nir_jump_continue:
+	 if (ctx->divergent_in_loop)
+	    mark_in_set(state, state->da->divergent_continue_loops, ctx->loop);
+	 break;
+	 
+      case nir_jump_return:
+	 if (ctx->divergent && !state->da->divergent_return) {
+	    state->da->divergent_return = true;
+	    state->progress = true;
+	 }
+	 break;
+   }
+}
+
+static void
+visit_instr(divergence_state *state, nir_instr *instr, cf_context *ctx)
+{
+   if (instr->type == nir_instr_type_phi) {
+      visit_phi(state, nir_instr_as_phi(instr));
+      return;
+   }
+   
+   if (instr->type == nir_instr_type_jump) {
+      visit_jump(state, nir_instr_as_jump(instr), ctx);
+      return;
+   }
+   
+   nir_instr_foreach_src(instr, iter)
+      visit_ssa_use(state, iter.src, instr->block);
+   
+   nir_dest *dest = nir_instr_dest(instr);
+   if (dest == NULL)
+      return;
+   
+   bool divergent = instr_is_divergent(state->da, instr);
+   
+   if (dest->is_ssa) {
+      if (divergent)
+	 mark_def(state, &dest->ssa);
+   } else {
+      /* invocations that skip the write keep the old value */
+      if (divergent || ctx->divergent ||
+	  (dest->reg.indirect != NULL &&
+	   nir_src_is_divergent(state->da, dest->reg.indirect)))
+	 mark_in_set(state, state->da->divergent_regs, dest->reg.reg);
+   }
+}
+
+/*
+ * Control flow
+ */
+
+static void visit_cf_list(divergence_state *state, struct exec_list *list,
+			  cf_context *ctx);
+
+static void
+visit_if(divergence_state *state, nir_if *if_stmt, cf_context *ctx)
+{
+   nir_block *before = nir_cf_node_as_block(nir_cf_node_prev(&if_stmt->cf_node));
+   visit_ssa_use(state, &if_stmt->condition, before);
+   
+   bool divergent = nir_src_is_divergent(state->da, &if_stmt->condition);
+   if (divergent)
+      mark_in_set(state, state->da->divergent_ifs, if_stmt);
+   
+   cf_context inner = *ctx;
+   inner.divergent |= divergent;
+   inner.divergent_in_loop |= divergent;
+   
+   visit_cf_list(state, &if_stmt->then_list, &inner);
+   visit_cf_list(state, &if_stmt->else_list, &inner);
+}
+
+static void
+visit_loop(divergence_state *state, nir_loop *loop, cf_context *ctx)
+{
+   bool continue_divergent =
+      set_contains(state->da->divergent_continue_loops, loop);
+   
+   cf_context inner;
+   inner.divergent = ctx->divergent ||
+		     loop_has_divergent_exit(state->da, loop);
+   /* invocations that continued aren't there to take the breaks */
+   inner.divergent_in_loop = continue_divergent;
+   inner.loop = loop;
+   
+   visit_cf_list(state, &loop->body, &inner);
+}
+
+static void
+visit_cf_list(divergence_state *state, struct exec_list *list,
+	      cf_context *ctx)
+{
+   foreach_list_typed(nir_cf_node, node, node, list) {
+      switch (node->type) {
+	 case nir_cf_node_block: {
+	    nir_block *block = nir_cf_node_as_block(node);
+	    nir_foreach_instr(block, instr)
+	       visit_instr(state, instr, ctx);
+	    break;
+	 }
+	 
+	 case nir_cf_node_if:
+	    visit_if(state, nir_cf_node_as_if(node), ctx);
+	    break;
+	    
+	 case nir_cf_node_loop:
+	    visit_loop(state, nir_cf_node_as_loop(node), ctx);
+	    break;
+	    
+	 default:
+	    assert(0);
+	    break;
+      }
+   }
+}
+
+nir_divergence_analysis *
+nir_divergence_analysis_create(void *mem_ctx, nir_function_impl *impl)
+{
+   nir_index_ssa_defs(impl);
+   
+   nir_divergence_analysis *da = ralloc(mem_ctx, nir_divergence_analysis);
+   da->num_defs = impl->ssa_alloc;
+   da->divergent_defs = rzalloc_array(da, bool, da->num_defs);
+   da->divergent_regs = _mesa_set_create(da, _mesa_key_pointer_equal);
+   da->divergent_ifs = _mesa_set_create(da, _mesa_key_pointer_equal);
+   da->divergent_break_loops = _mesa_set_create(da, _mesa_key_pointer_equal);
+   da->divergent_continue_loops =
+      _mesa_set_create(da, _mesa_key_pointer_equal);
+   da->divergent_return = false;
+   
+   divergence_state state;
+   state.da = da;
+   
+   do {
+      state.progress = false;
+      
+      cf_context ctx;
+      ctx.divergent = da->divergent_return;
+      ctx.divergent_in_loop = false;
+      ctx.loop = NULL;
+      
+      visit_cf_list(&state, &impl->body, &ctx);
+   } while (state.progress);
+   
+   return da;
+}
+
+bool
+nir_ssa_def_is_divergent(const nir_divergence_analysis *da,
+			 const nir_ssa_def *def)
+{
+   /* values created after the analysis ran aren't known */
+   if (def->index >= da->num_defs)
+      return true;
+   
+   return da->divergent_defs[def->index];
+}
+
+bool
+nir_reg_is_divergent(const nir_divergence_analysis *da,
+		     const nir_register *reg)
+{
+   /* they may be written by other functions */
+   if (reg->is_global)
+      return true;
+   
+   return set_contains(da->divergent_regs, reg);
+}
+
+bool
+nir_src_is_divergent(const nir_divergence_analysis *da, const nir_src *src)
+{
+   if (src->is_ssa)
+      return nir_ssa_def_is_divergent(da, src->ssa);
+   
+   if (src->reg.indirect != NULL &&
+       nir_src_is_divergent(da, src->reg.indirect))
+      return true;
+   
+   return nir_reg_is_divergent(da, src->reg.reg);
+}
+
+bool
+nir_if_is_divergent(const nir_divergence_analysis *da,
+		    const nir_if *if_stmt)
+{
+   return set_contains(da->divergent_ifs, if_stmt);
+}
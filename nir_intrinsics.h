@@ -57,18 +57,24 @@ INTRINSIC(store_var_vec4, 1, ARR(4), false, 0, 1, 0, 0)
 INTRINSIC(copy_var,       0, ARR(),  false, 0, 2, 0, 0)
 
 #define LOAD(name, num_indices, flags) \
-   INTRINSIC(load_##name, 1, ARR(1), true, 4, 0, num_indices, \
+   INTRINSIC(load_##name, 1, ARR(1), true, 0, 0, num_indices, \
 	     NIR_INTRINSIC_CAN_ELIMINATE | flags)
 
 LOAD(uniform, 1, NIR_INTRINSIC_CAN_REORDER)
 LOAD(ubo, 2, NIR_INTRINSIC_CAN_REORDER)
-LOAD(input, 1, NIR_INTRINSIC_CAN_REORDER)
+/*
+ * The indices of load_input and store_output are the slot and the first
+ * component in it, so that variables packed into the same slot can be
+ * accessed on their own. They read and write as many components as their
+ * destination or value has.
+ */
+LOAD(input, 2, NIR_INTRINSIC_CAN_REORDER)
 /* LOAD(ssbo, 2, 0) */
 
 #define STORE(name, num_indices, flags) \
-   INTRINSIC(store_##name, 2, ARR(1, 4), false, 0, 0, num_indices, flags)
+   INTRINSIC(store_##name, 2, ARR(1, 0), false, 0, 0, num_indices, flags)
 
-STORE(output, 1, 0)
+STORE(output, 2, 0)
 /* STORE(ssbo, 2, 0) */
 
 LAST_INTRINSIC(store_output)
@@ -0,0 +1,447 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include "nir.h"
+#include <assert.h>
+#include <string.h>
+
+/*
+ * Links the outputs of one stage to the inputs of the next.
+ *
+ * An output and an input match when they have the same location and
+ * location_frac, or the same name if neither has been given a location.
+ * Inputs that the producer never writes are removed, and their loads
+ * replaced by undefined values. Outputs that the producer always sets to
+ * the same constant are folded into the consumer, which no longer needs the
+ * inputs. Finally, outputs that the consumer doesn't read (anymore) are
+ * removed along with their stores, which leaves whatever computed them dead.
+ *
+ * Variables accessed through dereferences rather than load_input and
+ * store_output are left alone, as are built-in variables, which may be
+ * read or written by fixed-function hardware in between the stages.
+ */
+
+typedef struct varying {
+   nir_variable *var;
+   
+   /* the variable of the other stage it is linked to, if any */
+   struct varying *link;
+   
+   /* read with load_input or written with store_output */
+   bool accessed;
+   
+   /* accessed through a dereference, or built in */
+   bool pinned;
+   
+   /* for outputs, whether every store writes value */
+   bool is_constant;
+   nir_const_value value;
+   unsigned value_components;
+   
+   bool removed;
+} varying;
+
+typedef struct {
+   varying *varyings;
+   unsigned num_varyings;
+} varying_list;
+
+static bool
+is_builtin(const nir_variable *var)
+{
+   return var->name != NULL && strncmp(var->name, "gl_", 3) == 0;
+}
+
+static unsigned
+num_components(const nir_variable *var)
+{
+   return glsl_type_is_vector_or_scalar(var->type) ?
+	  glsl_get_vector_elements(var->type) : 4;
+}
+
+static void
+collect_varyings(struct hash_table *ht, void *mem_ctx, varying_list *list)
+{
+   list->varyings = rzalloc_array(mem_ctx, varying, ht->entries);
+   list->num_varyings = 0;
+   
+   struct hash_entry *entry;
+   hash_table_foreach(ht, entry) {
+      varying *v = &list->varyings[list->num_varyings++];
+      v->var = (nir_variable *) entry->data;
+      v->pinned = is_builtin(v->var);
+      
+      /* only vectors and scalars are folded into the consumer */
+      v->is_constant = glsl_type_is_vector_or_scalar(v->var->type);
+   }
+}
+
+/*
+ * The variable a load or store accesses: vectors and scalars, which may
+ * share a slot, have to start at the accessed component, while anything
+ * else is accessed through any of the slots it takes up.
+ */
+static varying *
+find_varying(varying_list *list, nir_intrinsic_instr *intrin)
+{
+   int slot = intrin->const_index[0];
+   if (slot < 0)
+      return NULL;
+   
+   for (unsigned i = 0; i < list->num_varyings; i++) {
+      nir_variable *var = list->varyings[i].var;
+      int location = var->data.location;
+      if (location < 0)
+	 continue;
+      
+      if (glsl_type_is_vector_or_scalar(var->type)) {
+	 if (location == slot &&
+	     var->data.location_frac == intrin->const_index[1])
+	    return &list->varyings[i];
+      } else {
+	 int end = location + glsl_count_attribute_slots(var->type);
+	 if (slot >= location && slot < end)
+	    return &list->varyings[i];
+      }
+   }
+   
+   return NULL;
+}
+
+static varying *
+find_varying_by_var(varying_list *list, nir_variable *var)
+{
+   for (unsigned i = 0; i < list->num_varyings; i++) {
+      if (list->varyings[i].var == var)
+	 return &list->varyings[i];
+   }
+   
+   return NULL;
+}
+
+static bool
+vars_match(const nir_variable *a, const nir_variable *b)
+{
+   if (a->data.location >= 0 && b->data.location >= 0)
+      return a->data.location == b->data.location &&
+	     a->data.location_frac == b->data.location_frac;
+   
+   if (a->data.location < 0 && b->data.location < 0)
+      return strcmp(a->name, b->name) == 0;
+   
+   return false;
+}
+
+/* folds the value written by an output store into the output's constant */
+static void
+record_store(varying *v, nir_intrinsic_instr *store)
+{
+   nir_src *value = &store->src[1];
+   if (!value->is_ssa ||
+       value->ssa->parent_instr->type != nir_instr_type_load_const) {
+      v->is_constant = false;
+      return;
+   }
+   
+   nir_load_const_instr *load_const =
+      nir_instr_as_load_const(value->ssa->parent_instr);
+   unsigned components = value->ssa->num_components;
+   if (components > num_components(v->var))
+      components = num_components(v->var);
+   
+   if (!v->accessed) {
+      v->value = load_const->value;
+      v->value_components = components;
+      return;
+   }
+   
+   if (components != v->value_components) {
+      v->is_constant = false;
+      return;
+   }
+   
+   for (unsigned i = 0; i < components; i++) {
+      if (load_const->value.u[i] != v->value.u[i])
+	 v->is_constant = false;
+   }
+}
+
+static void
+scan_accesses(nir_shader *shader, nir_variable_mode mode, varying_list *list)
+{
+   nir_intrinsic_op op = mode == nir_var_shader_in ?
+			 nir_intrinsic_load_input : nir_intrinsic_store_output;
+   
+   nir_foreach_impl(shader, impl) {
+      nir_foreach_block_in_order(impl, block) {
+	 nir_foreach_instr(block, instr) {
+	    if (instr->type != nir_instr_type_intrinsic)
+	       continue;
+	    
+	    nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(instr);
+	    
+	    unsigned num_variables =
+	       nir_intrinsic_infos[intrin->intrinsic].num_variables;
+	    for (unsigned i = 0; i < num_variables; i++) {
+	       nir_variable *var = intrin->variables[i]->var;
+	       if (var->data.mode != mode)
+		  continue;
+	       
+	       varying *v = find_varying_by_var(list, var);
+	       if (v != NULL)
+		  v->pinned = true;
+	    }
+	    
+	    if (intrin->intrinsic != op)
+	       continue;
+	    
+	    varying *v = find_varying(list, intrin);
+	    if (v == NULL)
+	       continue;
+	    
+	    if (op == nir_intrinsic_store_output)
+	       record_store(v, intrin);
+	    v->accessed = true;
+	 }
+      }
+   }
+}
+
+static void
+rewrite_src(struct hash_table *replacements, nir_src *src, nir_instr *instr)
+{
+   if (!src->is_ssa)
+      return;
+   
+   struct hash_entry *entry =
+      _mesa_hash_table_search(replacements, _mesa_hash_pointer(src->ssa),
+			      src->ssa);
+   if (entry == NULL)
+      return;
+   
+   src->ssa = (nir_ssa_def *) entry->data;
+   if (instr != NULL)
+      nir_instr_mark_changed(instr);
+}
+
+/* points the uses of the SSA values in replacements to their replacement */
+static void
+rewrite_uses(nir_function_impl *impl, struct hash_table *replacements)
+{
+   nir_foreach_block_in_order(impl, block) {
+      nir_foreach_instr(block, instr) {
+	 if (instr->type == nir_instr_type_phi) {
+	    nir_phi_instr *phi = nir_instr_as_phi(instr);
+	    foreach_list_typed(nir_phi_src, src, node, &phi->srcs)
+	       rewrite_src(replacements, &src->src, instr);
+	 } else {
+	    nir_instr_foreach_src(instr, iter)
+	       rewrite_src(replacements, iter.src, instr);
+	 }
+      }
+      
+      nir_if *if_stmt = nir_block_following_if(block);
+      if (if_stmt != NULL)
+	 rewrite_src(replacements, &if_stmt->condition, NULL);
+   }
+}
+
+/*
+ * Replaces the loads of removed inputs by their linked output's constant,
+ * or by an undefined value if the producer never writes them.
+ */
+static void
+replace_loads(nir_shader *consumer, varying_list *inputs)
+{
+   nir_foreach_impl(consumer, impl) {
+      struct hash_table *replacements =
+	 _mesa_hash_table_create(NULL, _mesa_key_pointer_equal);
+      
+      nir_foreach_block_in_order(impl, block) {
+	 foreach_list_safe(node, &block->instr_list) {
+	    nir_instr *instr = exec_node_data(nir_instr, node, node);
+	    if (instr->type != nir_instr_type_intrinsic)
+	       continue;
+	    
+	    nir_intrinsic_instr *load = nir_instr_as_intrinsic(instr);
+	    if (load->intrinsic != nir_intrinsic_load_input)
+	       continue;
+	    
+	    varying *v = find_varying(inputs, load);
+	    if (v == NULL || !v->removed)
+	       continue;
+	    
+	    unsigned components = load->dest.is_ssa ?
+				  load->dest.ssa.num_components :
+				  load->dest.reg.reg->num_components;
+	    
+	    if (v->link == NULL) {
+	       /* a register left unwritten is just as undefined */
+	       if (load->dest.is_ssa) {
+		  nir_ssa_undef_instr *undef =
+		     nir_ssa_undef_instr_create(impl, impl, components);
+		  nir_instr_insert_before(instr, &undef->instr);
+		  _mesa_hash_table_insert(replacements,
+					  _mesa_hash_pointer(&load->dest.ssa),
+					  &load->dest.ssa, &undef->def);
+	       }
+	    } else {
+	       nir_load_const_instr *load_const =
+		  nir_load_const_instr_create(impl);
+	       for (unsigned i = 0; i < components; i++) {
+		  load_const->value.u[i] = i < v->link->value_components ?
+					   v->link->value.u[i] : 0;
+	       }
+	       
+	       if (load->dest.is_ssa) {
+		  nir_ssa_dest_init(impl, &load_const->instr, &load_const->dest,
+				    components, NULL);
+		  _mesa_hash_table_insert(replacements,
+					  _mesa_hash_pointer(&load->dest.ssa),
+					  &load->dest.ssa,
+					  &load_const->dest.ssa);
+	       } else {
+		  load_const->dest = load->dest;
+	       }
+	       nir_instr_insert_before(instr, &load_const->instr);
+	    }
+	    
+	    nir_instr_remove(instr);
+	 }
+      }
+      
+      if (replacements->entries != 0)
+	 rewrite_uses(impl, replacements);
+      
+      _mesa_hash_table_destroy(replacements, NULL);
+   }
+}
+
+static void
+remove_stores(nir_shader *producer, varying_list *outputs)
+{
+   nir_foreach_impl(producer, impl) {
+      nir_foreach_block_in_order(impl, block) {
+	 foreach_list_safe(node, &block->instr_list) {
+	    nir_instr *instr = exec_node_data(nir_instr, node, node);
+	    if (instr->type != nir_instr_type_intrinsic)
+	       continue;
+	    
+	    nir_intrinsic_instr *store = nir_instr_as_intrinsic(instr);
+	    if (store->intrinsic != nir_intrinsic_store_output)
+	       continue;
+	    
+	    varying *v = find_varying(outputs, store);
+	    if (v != NULL && v->removed)
+	       nir_instr_remove(instr);
+	 }
+      }
+   }
+}
+
+static void
+remove_vars(struct hash_table *ht, varying_list *list)
+{
+   for (unsigned i = 0; i < list->num_varyings; i++) {
+      if (!list->varyings[i].removed)
+	 continue;
+      
+      nir_variable *var = list->varyings[i].var;
+      struct hash_entry *entry =
+	 _mesa_hash_table_search(ht, _mesa_hash_string(var->name), var->name);
+      assert(entry != NULL && entry->data == var);
+      _mesa_hash_table_remove(ht, entry);
+   }
+}
+
+bool
+nir_link_shaders(nir_shader *producer, nir_shader *consumer)
+{
+   void *mem_ctx = ralloc_context(NULL);
+   
+   varying_list outputs, inputs;
+   collect_varyings(producer->outputs, mem_ctx, &outputs);
+   collect_varyings(consumer->inputs, mem_ctx, &inputs);
+   
+   scan_accesses(producer, nir_var_shader_out, &outputs);
+   scan_accesses(consumer, nir_var_shader_in, &inputs);
+   
+   for (unsigned i = 0; i < inputs.num_varyings; i++) {
+      varying *input = &inputs.varyings[i];
+      for (unsigned j = 0; j < outputs.num_varyings; j++) {
+	 if (vars_match(outputs.varyings[j].var, input->var)) {
+	    input->link = &outputs.varyings[j];
+	    break;
+	 }
+      }
+   }
+   
+   bool progress = false;
+   
+   for (unsigned i = 0; i < inputs.num_varyings; i++) {
+      varying *input = &inputs.varyings[i];
+      if (input->pinned)
+	 continue;
+      
+      varying *output = input->link;
+      
+      /* an output nobody writes is as good as a missing one */
+      if (output != NULL && !output->accessed && !output->pinned)
+	 input->link = output = NULL;
+      
+      if (output == NULL || !input->accessed ||
+	  (output->is_constant && output->accessed && !output->pinned)) {
+	 input->removed = true;
+	 progress = true;
+      }
+   }
+   
+   for (unsigned i = 0; i < outputs.num_varyings; i++) {
+      varying *output = &outputs.varyings[i];
+      if (output->pinned)
+	 continue;
+      
+      bool read = false;
+      for (unsigned j = 0; j < inputs.num_varyings; j++) {
+	 varying *input = &inputs.varyings[j];
+	 if (vars_match(output->var, input->var) && !input->removed)
+	    read = true;
+      }
+      
+      if (!read) {
+	 output->removed = true;
+	 progress = true;
+      }
+   }
+   
+   if (progress) {
+      replace_loads(consumer, &inputs);
+      remove_stores(producer, &outputs);
+      remove_vars(consumer->inputs, &inputs);
+      remove_vars(producer->outputs, &outputs);
+   }
+   
+   ralloc_free(mem_ctx);
+   return progress;
+}
@@ -0,0 +1,405 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include "nir.h"
+#include "nir_builder.h"
+
+/*
+ * Lowers texture instructions to simpler ones, as selected by the options:
+ *
+ * - The projector is folded into the coordinate and shadow comparator by
+ *   multiplying them with its reciprocal.
+ * - Offsets are added to the coordinate, scaled by the size of the texture
+ *   for sampling instructions, or clamped to the range the hardware takes.
+ * - txb becomes txl, with the LOD computed by a lod query plus the bias.
+ * - txd becomes txl, with the LOD computed from the derivatives scaled by
+ *   the size of the texture, the way the GL spec describes it.
+ *
+ * The texture size comes from a txs of the base level, which only returns
+ * two components, so offsets and derivatives are only lowered for one- and
+ * two-dimensional coordinates.
+ */
+
+/* whether the sources we may read and the sampler can be copied */
+static bool
+can_lower(nir_tex_instr *tex)
+{
+   for (unsigned i = 0; i < tex->num_srcs; i++) {
+      if (!tex->src[i].is_ssa)
+	 return false;
+   }
+   
+   return tex->sampler == NULL || tex->sampler->deref.child == NULL;
+}
+
+static nir_ssa_def *
+get_src(nir_tex_instr *tex, nir_texinput_type type)
+{
+   int index = nir_tex_instr_src_index(tex, type);
+   return index < 0 ? NULL : tex->src[index].ssa;
+}
+
+static void
+set_src(nir_tex_instr *tex, nir_texinput_type type, nir_ssa_def *def)
+{
+   int index = nir_tex_instr_src_index(tex, type);
+   assert(index >= 0);
+   tex->src[index].ssa = def;
+}
+
+static void
+remove_src(nir_tex_instr *tex, nir_texinput_type type)
+{
+   int index = nir_tex_instr_src_index(tex, type);
+   assert(index >= 0);
+   
+   for (unsigned i = index + 1; i < tex->num_srcs; i++) {
+      tex->src[i - 1] = tex->src[i];
+      tex->src_type[i - 1] = tex->src_type[i];
+   }
+   tex->num_srcs--;
+}
+
+static void
+add_src(nir_tex_instr *tex, nir_texinput_type type, nir_ssa_def *def)
+{
+   assert(tex->num_srcs < 4);
+   
+   tex->src[tex->num_srcs].is_ssa = true;
+   tex->src[tex->num_srcs].ssa = def;
+   tex->src_type[tex->num_srcs] = type;
+   tex->num_srcs++;
+}
+
+/* the given components of def, with component i of the result taken from
+ * component swizzle[i]
+ */
+static nir_ssa_def *
+swizzle(nir_builder *b, nir_ssa_def *def, const uint8_t *swizzle,
+	unsigned num_components)
+{
+   nir_alu_instr *mov = nir_alu_instr_create(b->mem_ctx, nir_op_mov);
+   mov->src[0].src.is_ssa = true;
+   mov->src[0].src.ssa = def;
+   for (unsigned i = 0; i < num_components; i++)
+      mov->src[0].swizzle[i] = swizzle[i];
+   
+   nir_ssa_dest_init(b->impl, &mov->instr, &mov->dest.dest, num_components,
+		     NULL);
+   mov->dest.write_mask = (1 << num_components) - 1;
+   nir_builder_instr_insert(b, &mov->instr);
+   
+   return &mov->dest.dest.ssa;
+}
+
+/* component c of def, repeated num_components times */
+static nir_ssa_def *
+channel(nir_builder *b, nir_ssa_def *def, unsigned c, unsigned num_components)
+{
+   if (def->num_components == 1 && num_components == 1)
+      return def;
+   
+   uint8_t swiz[4] = { c, c, c, c };
+   return swizzle(b, def, swiz, num_components);
+}
+
+/* the first num_components components of def */
+static nir_ssa_def *
+channels(nir_builder *b, nir_ssa_def *def, unsigned num_components)
+{
+   static const uint8_t identity[4] = { 0, 1, 2, 3 };
+   if (def->num_components == num_components)
+      return def;
+   return swizzle(b, def, identity, num_components);
+}
+
+/* offset with num_components components, the ones it lacks being 0; the
+ * offset has no component for the array index, which comes last in the
+ * coordinate
+ */
+static nir_ssa_def *
+pad_offset(nir_builder *b, nir_ssa_def *offset, unsigned num_components)
+{
+   if (offset->num_components >= num_components)
+      return channels(b, offset, num_components);
+   
+   nir_ssa_def *comps[4];
+   for (unsigned i = 0; i < num_components; i++) {
+      if (i < offset->num_components)
+	 comps[i] = channel(b, offset, i, 1);
+      else
+	 comps[i] = nir_imm_int(b, 0);
+   }
+   
+   switch (num_components) {
+   case 2:
+      return nir_vec2(b, comps[0], comps[1]);
+   case 3:
+      return nir_vec3(b, comps[0], comps[1], comps[2]);
+   default:
+      return nir_vec4(b, comps[0], comps[1], comps[2], comps[3]);
+   }
+}
+
+/* a texture instruction using the same sampler as tex */
+static nir_tex_instr *
+create_query(nir_builder *b, nir_tex_instr *tex, nir_texop op,
+	     unsigned num_srcs)
+{
+   nir_ssa_def *sampler_index = get_src(tex, nir_tex_src_sampler_index);
+   
+   nir_tex_instr *query = nir_tex_instr_create(b->mem_ctx, num_srcs +
+					       (sampler_index != NULL));
+   query->op = op;
+   query->sampler_index = tex->sampler_index;
+   if (tex->sampler != NULL)
+      query->sampler = nir_deref_var_create(b->mem_ctx, tex->sampler->var);
+   
+   if (sampler_index != NULL) {
+      query->src[num_srcs].is_ssa = true;
+      query->src[num_srcs].ssa = sampler_index;
+      query->src_type[num_srcs] = nir_tex_src_sampler_index;
+   }
+   
+   return query;
+}
+
+/* the first num_components sizes of the base level of the texture, as
+ * floats
+ */
+static nir_ssa_def *
+get_texture_size(nir_builder *b, nir_tex_instr *tex, unsigned num_components)
+{
+   nir_tex_instr *txs = create_query(b, tex, nir_texop_txs, 1);
+   txs->src[0].is_ssa = true;
+   txs->src[0].ssa = nir_imm_int(b, 0);
+   txs->src_type[0] = nir_tex_src_lod;
+   
+   nir_ssa_dest_init(b->impl, &txs->instr, &txs->dest,
+		     nir_tex_instr_dest_size(txs), NULL);
+   nir_builder_instr_insert(b, &txs->instr);
+   
+   return nir_i2f(b, channels(b, &txs->dest.ssa, num_components));
+}
+
+static bool
+lower_projector(nir_builder *b, nir_tex_instr *tex)
+{
+   nir_ssa_def *projector = get_src(tex, nir_tex_src_projector);
+   if (projector == NULL)
+      return false;
+   
+   nir_ssa_def *inv = nir_frcp(b, channel(b, projector, 0, 1));
+   
+   nir_ssa_def *coord = get_src(tex, nir_tex_src_coord);
+   if (coord != NULL) {
+      nir_ssa_def *invs = channel(b, inv, 0, coord->num_components);
+      set_src(tex, nir_tex_src_coord, nir_fmul(b, coord, invs));
+   }
+   
+   nir_ssa_def *shadow = get_src(tex, nir_tex_src_shadow);
+   if (shadow != NULL)
+      set_src(tex, nir_tex_src_shadow, nir_fmul(b, shadow, inv));
+   
+   remove_src(tex, nir_tex_src_projector);
+   return true;
+}
+
+static bool
+lower_offset(nir_builder *b, nir_tex_instr *tex)
+{
+   nir_ssa_def *offset = get_src(tex, nir_tex_src_offset);
+   nir_ssa_def *coord = get_src(tex, nir_tex_src_coord);
+   if (offset == NULL || coord == NULL ||
+       (tex->op != nir_texop_txf && tex->coord_components > 2))
+      return false;
+   
+   /* the offset applies to the projected coordinate */
+   if (get_src(tex, nir_tex_src_projector) != NULL)
+      return false;
+   
+   offset = pad_offset(b, offset, coord->num_components);
+   
+   if (tex->op == nir_texop_txf) {
+      coord = nir_iadd(b, coord, offset);
+   } else {
+      nir_ssa_def *size = get_texture_size(b, tex, coord->num_components);
+      coord = nir_fadd(b, coord, nir_fdiv(b, nir_i2f(b, offset), size));
+   }
+   
+   set_src(tex, nir_tex_src_coord, coord);
+   remove_src(tex, nir_tex_src_offset);
+   return true;
+}
+
+static bool
+clamp_offset(nir_builder *b, nir_tex_instr *tex, int min, int max)
+{
+   nir_ssa_def *offset = get_src(tex, nir_tex_src_offset);
+   if (offset == NULL)
+      return false;
+   
+   unsigned num_components = offset->num_components;
+   nir_ssa_def *min_def = channel(b, nir_imm_int(b, min), 0, num_components);
+   offset = nir_imax(b, offset, min_def);
+   nir_ssa_def *max_def = channel(b, nir_imm_int(b, max), 0, num_components);
+   offset = nir_imin(b, offset, max_def);
+   
+   set_src(tex, nir_tex_src_offset, offset);
+   return true;
+}
+
+static bool
+lower_txb(nir_builder *b, nir_tex_instr *tex)
+{
+   nir_ssa_def *bias = get_src(tex, nir_tex_src_bias);
+   nir_ssa_def *coord = get_src(tex, nir_tex_src_coord);
+   if (tex->op != nir_texop_txb || bias == NULL || coord == NULL)
+      return false;
+   
+   nir_tex_instr *query = create_query(b, tex, nir_texop_lod, 1);
+   query->src[0].is_ssa = true;
+   query->src[0].ssa = coord;
+   query->src_type[0] = nir_tex_src_coord;
+   query->coord_components = tex->coord_components;
+   
+   nir_ssa_dest_init(b->impl, &query->instr, &query->dest,
+		     nir_tex_instr_dest_size(query), NULL);
+   nir_builder_instr_insert(b, &query->instr);
+   
+   /* y is the LOD before it is clamped to the levels of the texture */
+   nir_ssa_def *lod = channel(b, &query->dest.ssa, 1, 1);
+   lod = nir_fadd(b, lod, channel(b, bias, 0, 1));
+   
+   remove_src(tex, nir_tex_src_bias);
+   add_src(tex, nir_tex_src_lod, lod);
+   tex->op = nir_texop_txl;
+   return true;
+}
+
+static nir_ssa_def *
+length_squared(nir_builder *b, nir_ssa_def *v)
+{
+   return v->num_components == 1 ? nir_fmul(b, v, v) : nir_fdot2(b, v, v);
+}
+
+static bool
+lower_txd(nir_builder *b, nir_tex_instr *tex)
+{
+   nir_ssa_def *ddx = get_src(tex, nir_tex_src_ddx);
+   nir_ssa_def *ddy = get_src(tex, nir_tex_src_ddy);
+   if (tex->op != nir_texop_txd || ddx == NULL || ddy == NULL ||
+       tex->coord_components > 2)
+      return false;
+   
+   /* the derivatives have no component for the array index */
+   unsigned num_components = ddx->num_components;
+   if (ddy->num_components != num_components ||
+       num_components > tex->coord_components)
+      return false;
+   
+   nir_ssa_def *size = get_texture_size(b, tex, num_components);
+   ddx = nir_fmul(b, ddx, size);
+   ddy = nir_fmul(b, ddy, size);
+   
+   /* log2(max(|ddx|, |ddy|)), taking the square root as a factor of 1/2 */
+   nir_ssa_def *rho2_x = length_squared(b, ddx);
+   nir_ssa_def *rho2_y = length_squared(b, ddy);
+   nir_ssa_def *lod = nir_flog2(b, nir_fmax(b, rho2_x, rho2_y));
+   lod = nir_fmul(b, lod, nir_imm_float(b, 0.5f));
+   
+   remove_src(tex, nir_tex_src_ddx);
+   remove_src(tex, nir_tex_src_ddy);
+   add_src(tex, nir_tex_src_lod, lod);
+   tex->op = nir_texop_txl;
+   return true;
+}
+
+static bool
+lower_tex_instr(nir_builder *b, nir_tex_instr *tex,
+		const nir_lower_tex_options *options)
+{
+   if (!can_lower(tex))
+      return false;
+   
+   b->cursor = nir_before_instr(&tex->instr);
+   
+   bool progress = false;
+   
+   if (options->lower_projector && lower_projector(b, tex))
+      progress = true;
+   
+   if (options->lower_offset) {
+      if (lower_offset(b, tex))
+	 progress = true;
+   } else if (options->min_offset < options->max_offset) {
+      if (clamp_offset(b, tex, options->min_offset, options->max_offset))
+	 progress = true;
+   }
+   
+   if (options->lower_txb && lower_txb(b, tex))
+      progress = true;
+   
+   if (options->lower_txd && lower_txd(b, tex))
+      progress = true;
+   
+   if (progress)
+      nir_instr_mark_changed(&tex->instr);
+   
+   return progress;
+}
+
+bool
+nir_lower_tex_impl(nir_function_impl *impl,
+		   const nir_lower_tex_options *options)
+{
+   nir_builder b;
+   nir_builder_init(&b, NULL, impl);
+   
+   bool progress = false;
+   
+   nir_foreach_block_in_order(impl, block) {
+      nir_foreach_instr(block, instr) {
+	 if (instr->type == nir_instr_type_texture &&
+	     lower_tex_instr(&b, nir_instr_as_texture(instr), options))
+	    progress = true;
+      }
+   }
+   
+   return progress;
+}
+
+static bool
+lower_tex_impl_cb(nir_function_impl *impl, nir_pass_worker *worker,
+		  void *data)
+{
+   return nir_lower_tex_impl(impl, (const nir_lower_tex_options *) data);
+}
+
+bool
+nir_lower_tex(nir_shader *shader, const nir_lower_tex_options *options)
+{
+   return nir_shader_foreach_impl_parallel(shader, lower_tex_impl_cb,
+					   (void *) options);
+}
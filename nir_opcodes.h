@@ -35,13 +35,16 @@
  * included in both ir.h to create the nir_op enum (with members of the form
  * nir_op_(name)) and and in opcodes.c to create nir_op_infos, which is a
  * const array of nir_op_info structures for each opcode.
+ *
+ * per_component is true exactly when output_size and all of input_sizes are
+ * 0, as described in nir_op_info.
  */
 
 #define ARR(...) { __VA_ARGS__ }
 
-#define UNOP(name) OPCODE(name, 1, false, 0, ARR(0))
+#define UNOP(name) OPCODE(name, 1, true, 0, ARR(0))
 #define UNOP_HORIZ(name, output_size, input_size) \
-   OPCODE(name, 1, true, output_size, ARR(input_size))
+   OPCODE(name, 1, false, output_size, ARR(input_size))
 
 #define UNOP_REDUCE(name, output_size) \
    UNOP_HORIZ(name##2, output_size, 2) \
@@ -146,7 +149,7 @@ UNOP_REDUCE(fnoise4, 4)
 
 #define BINOP(name) OPCODE(name, 2, true, 0, ARR(0, 0))
 #define BINOP_HORIZ(name, output_size, src1_size, src2_size) \
-   OPCODE(name, 2, true, output_size, ARR(src1_size, src2_size))
+   OPCODE(name, 2, false, output_size, ARR(src1_size, src2_size))
 #define BINOP_REDUCE(name, output_size) \
    BINOP_HORIZ(name##2, output_size, 2, 2) \
    BINOP_HORIZ(name##3, output_size, 3, 3) \
@@ -275,13 +278,13 @@ TRIOP(flrp)
  * bools (0.0 vs 1.0) and one for integer bools (0 vs ~0).
  */
 
-OPCODE(fcsel, 3, true, 0, ARR(1, 0, 0))
-OPCODE(icsel, 3, true, 0, ARR(1, 0, 0))
+OPCODE(fcsel, 3, false, 0, ARR(1, 0, 0))
+OPCODE(icsel, 3, false, 0, ARR(1, 0, 0))
 
 TRIOP(bfi)
 
-OPCODE(fvector_insert, 3, true, 0, ARR(0, 1, 1))
-OPCODE(ivector_insert, 3, true, 0, ARR(0, 1, 1))
+OPCODE(fvector_insert, 3, false, 0, ARR(0, 1, 1))
+OPCODE(ivector_insert, 3, false, 0, ARR(0, 1, 1))
 
 /**
  * Combines the first component of each input to make a 3-component vector.
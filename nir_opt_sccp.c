@@ -0,0 +1,1138 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include "nir.h"
+#include <assert.h>
+#include <math.h>
+
+/*
+ * Sparse conditional constant propagation (Wegman and Zadeck).
+ *
+ * Every SSA value starts out unknown and can only move down the lattice,
+ * to a constant and then to varying. Blocks and CFG edges start out
+ * unreachable; a block's instructions are only evaluated once an edge into
+ * it is found to be executable, and phis only take the values coming in
+ * along executable edges. This finds constants that flow around loops and
+ * through branches whose conditions are constant, which folding each
+ * instruction on its own can't.
+ *
+ * Afterwards, values that turned out constant are replaced by load_const
+ * instructions, and ifs with a constant condition lose their dead branch.
+ * If what is left of the if is a single block, its instructions are moved
+ * in front of the if and the if is removed entirely.
+ *
+ * Only SSA values take part; anything read from a register is varying.
+ */
+
+typedef enum {
+   LATTICE_UNKNOWN,
+   LATTICE_CONST,
+   LATTICE_VARYING,
+} lattice_state;
+
+typedef struct {
+   lattice_state state;
+   nir_const_value value;
+} lattice_value;
+
+/* an instruction or an if reading an SSA value */
+typedef struct {
+   nir_instr *instr;
+   nir_if *if_stmt;
+} sccp_use;
+
+typedef struct {
+   nir_function_impl *impl;
+   void *mem_ctx;
+   
+   /* indexed by SSA value */
+   unsigned num_defs;
+   lattice_value *values;
+   
+   /* the uses of SSA value i are uses[use_start[i]] to uses[use_start[i+1]] */
+   unsigned *use_start;
+   sccp_use *uses;
+   
+   /* indexed by block; edges are indexed by block * 2 + successor */
+   unsigned num_blocks;
+   bool *block_executable;
+   bool *edge_executable;
+   
+   /* SSA values whose lattice value changed */
+   nir_ssa_def **ssa_worklist;
+   unsigned ssa_worklist_len;
+   
+   /* edges that became executable */
+   unsigned *cfg_worklist;
+   unsigned cfg_worklist_len;
+   
+   /* instructions removed while rewriting, whose uses are stale */
+   struct set *removed;
+   
+   /* SSA values that were replaced, mapped to their replacement */
+   struct hash_table *replacements;
+} sccp_state;
+
+static bool
+block_ends_in_jump(nir_block *block)
+{
+   return !exec_list_is_empty(&block->instr_list) &&
+	  nir_block_last_instr(block)->type == nir_instr_type_jump;
+}
+
+/*
+ * Constant folding
+ */
+
+typedef union {
+   float f;
+   int32_t i;
+   uint32_t u;
+} scalar;
+
+#define NIR_TRUE (~0u)
+#define NIR_FALSE 0u
+
+static bool
+op_has_float_srcs(nir_op op)
+{
+   switch (op) {
+      case nir_op_fnot:
+      case nir_op_fneg:
+      case nir_op_fabs:
+      case nir_op_fsign:
+      case nir_op_frcp:
+      case nir_op_frsq:
+      case nir_op_fsqrt:
+      case nir_op_f2i:
+      case nir_op_f2u:
+      case nir_op_f2b:
+      case nir_op_ftrunc:
+      case nir_op_fceil:
+      case nir_op_ffloor:
+      case nir_op_ffract:
+      case nir_op_fadd:
+      case nir_op_fsub:
+      case nir_op_fmul:
+      case nir_op_fdiv:
+      case nir_op_flt:
+      case nir_op_fge:
+      case nir_op_feq:
+      case nir_op_fne:
+      case nir_op_slt:
+      case nir_op_sge:
+      case nir_op_seq:
+      case nir_op_sne:
+      case nir_op_fmin:
+      case nir_op_fmax:
+      case nir_op_ffma:
+      case nir_op_flrp:
+      case nir_op_fdot2:
+      case nir_op_fdot3:
+      case nir_op_fdot4:
+	 return true;
+      default:
+	 return false;
+   }
+}
+
+static bool
+op_has_float_dest(nir_op op)
+{
+   switch (op) {
+      case nir_op_i2f:
+      case nir_op_u2f:
+      case nir_op_b2f:
+	 return true;
+      case nir_op_f2i:
+      case nir_op_f2u:
+      case nir_op_f2b:
+      case nir_op_flt:
+      case nir_op_fge:
+      case nir_op_feq:
+      case nir_op_fne:
+	 return false;
+      default:
+	 return op_has_float_srcs(op);
+   }
+}
+
+static scalar
+apply_src_modifiers(nir_op op, const nir_alu_src *src, scalar value)
+{
+   if (op_has_float_srcs(op)) {
+      if (src->abs)
+	 value.f = fabsf(value.f);
+      if (src->negate)
+	 value.f = -value.f;
+   } else {
+      /* done on unsigned values, so that negating INT_MIN wraps */
+      if (src->abs && value.i < 0)
+	 value.u = -value.u;
+      if (src->negate)
+	 value.u = -value.u;
+   }
+   
+   return value;
+}
+
+/* folds a per-component opcode; returns false if it can't be folded */
+static bool
+eval_scalar(nir_op op, const scalar *s, scalar *dst)
+{
+   switch (op) {
+      case nir_op_mov: *dst = s[0]; break;
+      
+      case nir_op_fnot: dst->f = s[0].f == 0.0f ? 1.0f : 0.0f; break;
+      case nir_op_fneg: dst->f = -s[0].f; break;
+      case nir_op_fabs: dst->f = fabsf(s[0].f); break;
+      case nir_op_fsign:
+	 dst->f = s[0].f > 0.0f ? 1.0f : (s[0].f < 0.0f ? -1.0f : 0.0f);
+	 break;
+      case nir_op_frcp: dst->f = 1.0f / s[0].f; break;
+      case nir_op_frsq: dst->f = 1.0f / sqrtf(s[0].f); break;
+      case nir_op_fsqrt: dst->f = sqrtf(s[0].f); break;
+      case nir_op_ftrunc: dst->f = truncf(s[0].f); break;
+      case nir_op_fceil: dst->f = ceilf(s[0].f); break;
+      case nir_op_ffloor: dst->f = floorf(s[0].f); break;
+      case nir_op_ffract: dst->f = s[0].f - floorf(s[0].f); break;
+      
+      case nir_op_inot: dst->u = ~s[0].u; break;
+      case nir_op_ineg: dst->u = -s[0].u; break;
+      case nir_op_iabs: dst->u = s[0].i < 0 ? -s[0].u : s[0].u; break;
+      case nir_op_isign:
+	 dst->i = s[0].i > 0 ? 1 : (s[0].i < 0 ? -1 : 0);
+	 break;
+	 
+      case nir_op_f2i:
+	 /* out of range conversions are undefined */
+	 if (!(s[0].f > -2147483904.0f && s[0].f < 2147483648.0f))
+	    return false;
+	 dst->i = (int32_t) s[0].f;
+	 break;
+      case nir_op_f2u:
+	 if (!(s[0].f > -1.0f && s[0].f < 4294967296.0f))
+	    return false;
+	 dst->u = (uint32_t) s[0].f;
+	 break;
+      case nir_op_i2f: dst->f = (float) s[0].i; break;
+      case nir_op_u2f: dst->f = (float) s[0].u; break;
+      case nir_op_f2b: dst->u = s[0].f != 0.0f ? NIR_TRUE : NIR_FALSE; break;
+      case nir_op_b2f: dst->f = s[0].u != 0 ? 1.0f : 0.0f; break;
+      case nir_op_i2b: dst->u = s[0].u != 0 ? NIR_TRUE : NIR_FALSE; break;
+      
+      case nir_op_fadd: dst->f = s[0].f + s[1].f; break;
+      case nir_op_fsub: dst->f = s[0].f - s[1].f; break;
+      case nir_op_fmul: dst->f = s[0].f * s[1].f; break;
+      case nir_op_fdiv: dst->f = s[0].f / s[1].f; break;
+      case nir_op_fmin: dst->f = fminf(s[0].f, s[1].f); break;
+      case nir_op_fmax: dst->f = fmaxf(s[0].f, s[1].f); break;
+      
+      case nir_op_iadd: dst->u = s[0].u + s[1].u; break;
+      case nir_op_isub: dst->u = s[0].u - s[1].u; break;
+      case nir_op_imul: dst->u = s[0].u * s[1].u; break;
+      case nir_op_idiv:
+	 if (s[1].i == 0 || (s[0].i == INT32_MIN && s[1].i == -1))
+	    return false;
+	 dst->i = s[0].i / s[1].i;
+	 break;
+      case nir_op_udiv:
+	 if (s[1].u == 0)
+	    return false;
+	 dst->u = s[0].u / s[1].u;
+	 break;
+      case nir_op_imin: dst->i = s[0].i < s[1].i ? s[0].i : s[1].i; break;
+      case nir_op_imax: dst->i = s[0].i > s[1].i ? s[0].i : s[1].i; break;
+      case nir_op_umax: dst->u = s[0].u > s[1].u ? s[0].u : s[1].u; break;
+      
+      case nir_op_flt: dst->u = s[0].f < s[1].f ? NIR_TRUE : NIR_FALSE; break;
+      case nir_op_fge: dst->u = s[0].f >= s[1].f ? NIR_TRUE : NIR_FALSE; break;
+      case nir_op_feq: dst->u = s[0].f == s[1].f ? NIR_TRUE : NIR_FALSE; break;
+      case nir_op_fne: dst->u = s[0].f != s[1].f ? NIR_TRUE : NIR_FALSE; break;
+      case nir_op_ilt: dst->u = s[0].i < s[1].i ? NIR_TRUE : NIR_FALSE; break;
+      case nir_op_ige: dst->u = s[0].i >= s[1].i ? NIR_TRUE : NIR_FALSE; break;
+      case nir_op_ieq: dst->u = s[0].u == s[1].u ? NIR_TRUE : NIR_FALSE; break;
+      case nir_op_ine: dst->u = s[0].u != s[1].u ? NIR_TRUE : NIR_FALSE; break;
+      case nir_op_ult: dst->u = s[0].u < s[1].u ? NIR_TRUE : NIR_FALSE; break;
+      case nir_op_uge: dst->u = s[0].u >= s[1].u ? NIR_TRUE : NIR_FALSE; break;
+      
+      case nir_op_slt: dst->f = s[0].f < s[1].f ? 1.0f : 0.0f; break;
+      case nir_op_sge: dst->f = s[0].f >= s[1].f ? 1.0f : 0.0f; break;
+      case nir_op_seq: dst->f = s[0].f == s[1].f ? 1.0f : 0.0f; break;
+      case nir_op_sne: dst->f = s[0].f != s[1].f ? 1.0f : 0.0f; break;
+      
+      case nir_op_ishl: dst->u = s[0].u << (s[1].u & 31); break;
+      case nir_op_ishr: dst->i = s[0].i >> (s[1].u & 31); break;
+      case nir_op_ushr: dst->u = s[0].u >> (s[1].u & 31); break;
+      case nir_op_iand: dst->u = s[0].u & s[1].u; break;
+      case nir_op_ior: dst->u = s[0].u | s[1].u; break;
+      case nir_op_ixor: dst->u = s[0].u ^ s[1].u; break;
+      
+      case nir_op_ffma: dst->f = s[0].f * s[1].f + s[2].f; break;
+      case nir_op_flrp:
+	 dst->f = s[0].f * (1.0f - s[2].f) + s[1].f * s[2].f;
+	 break;
+	 
+      default:
+	 return false;
+   }
+   
+   return true;
+}
+
+/*
+ * Folds an ALU instruction whose sources are all constant. Returns false if
+ * the opcode isn't one that is folded.
+ */
+static bool
+eval_alu(nir_alu_instr *alu, const nir_const_value **srcs,
+	 nir_const_value *dst)
+{
+   const nir_op_info *info = &nir_op_infos[alu->op];
+   unsigned num_components = alu->dest.dest.ssa.num_components;
+   scalar s[4];
+   
+#define SRC(i, c) \
+   apply_src_modifiers(alu->op, &alu->src[i], \
+		       (scalar) { .u = srcs[i]->u[alu->src[i].swizzle[c]] })
+   
+   if (info->per_component) {
+      for (unsigned c = 0; c < num_components; c++) {
+	 for (unsigned i = 0; i < info->num_inputs; i++)
+	    s[i] = SRC(i, c);
+	 
+	 scalar result;
+	 if (!eval_scalar(alu->op, s, &result))
+	    return false;
+	 dst->u[c] = result.u;
+      }
+   } else {
+      unsigned size = info->input_sizes[0];
+      float sum = 0.0f;
+      bool any = false, all = true;
+      
+      switch (alu->op) {
+	 case nir_op_vec2:
+	 case nir_op_vec3:
+	 case nir_op_vec4:
+	    for (unsigned i = 0; i < info->num_inputs; i++)
+	       dst->u[i] = SRC(i, 0).u;
+	    break;
+	    
+	 case nir_op_fdot2:
+	 case nir_op_fdot3:
+	 case nir_op_fdot4:
+	    for (unsigned c = 0; c < size; c++)
+	       sum += SRC(0, c).f * SRC(1, c).f;
+	    dst->f[0] = sum;
+	    break;
+	    
+	 case nir_op_bany2:
+	 case nir_op_bany3:
+	 case nir_op_bany4:
+	 case nir_op_ball2:
+	 case nir_op_ball3:
+	 case nir_op_ball4:
+	    for (unsigned c = 0; c < size; c++) {
+	       bool set = SRC(0, c).u != 0;
+	       any |= set;
+	       all &= set;
+	    }
+	    if (alu->op == nir_op_bany2 || alu->op == nir_op_bany3 ||
+		alu->op == nir_op_bany4)
+	       dst->u[0] = any ? NIR_TRUE : NIR_FALSE;
+	    else
+	       dst->u[0] = all ? NIR_TRUE : NIR_FALSE;
+	    break;
+	    
+	 default:
+	    return false;
+      }
+   }
+   
+#undef SRC
+   
+   if (alu->dest.saturate) {
+      if (!op_has_float_dest(alu->op))
+	 return false;
+      
+      for (unsigned c = 0; c < num_components; c++)
+	 dst->f[c] = fminf(fmaxf(dst->f[c], 0.0f), 1.0f);
+   }
+   
+   return true;
+}
+
+/*
+ * Propagation
+ */
+
+static lattice_value *
+get_value(sccp_state *state, nir_ssa_def *def)
+{
+   return &state->values[def->index];
+}
+
+static void
+set_varying(sccp_state *state, nir_ssa_def *def)
+{
+   lattice_value *value = get_value(state, def);
+   if (value->state == LATTICE_VARYING)
+      return;
+   
+   value->state = LATTICE_VARYING;
+   state->ssa_worklist[state->ssa_worklist_len++] = def;
+}
+
+static void
+set_const(sccp_state *state, nir_ssa_def *def, const nir_const_value *c)
+{
+   lattice_value *value = get_value(state, def);
+   if (value->state == LATTICE_VARYING)
+      return;
+   
+   if (value->state == LATTICE_CONST) {
+      /* compare bits, so that NaN equals NaN */
+      for (unsigned i = 0; i < def->num_components; i++) {
+	 if (value->value.u[i] != c->u[i]) {
+	    set_varying(state, def);
+	    return;
+	 }
+      }
+      return;
+   }
+   
+   value->state = LATTICE_CONST;
+   value->value = *c;
+   state->ssa_worklist[state->ssa_worklist_len++] = def;
+}
+
+static void
+mark_edge_executable(sccp_state *state, nir_block *block, unsigned succ)
+{
+   unsigned edge = block->index * 2 + succ;
+   if (state->edge_executable[edge])
+      return;
+   
+   state->edge_executable[edge] = true;
+   state->cfg_worklist[state->cfg_worklist_len++] = edge;
+}
+
+static bool
+edge_is_executable(sccp_state *state, nir_block *pred, nir_block *succ)
+{
+   unsigned i = pred->successors[0] == succ ? 0 : 1;
+   assert(pred->successors[i] == succ);
+   return state->edge_executable[pred->index * 2 + i];
+}
+
+static void
+visit_phi(sccp_state *state, nir_phi_instr *phi)
+{
+   if (!phi->dest.is_ssa)
+      return;
+   
+   nir_ssa_def *def = &phi->dest.ssa;
+   if (get_value(state, def)->state == LATTICE_VARYING)
+      return;
+   
+   foreach_list_typed(nir_phi_src, src, node, &phi->srcs) {
+      if (!edge_is_executable(state, src->pred, phi->instr.block))
+	 continue;
+      
+      if (!src->src.is_ssa) {
+	 set_varying(state, def);
+	 return;
+      }
+      
+      lattice_value *value = get_value(state, src->src.ssa);
+      if (value->state == LATTICE_VARYING) {
+	 set_varying(state, def);
+	 return;
+      }
+      
+      if (value->state == LATTICE_CONST) {
+	 set_const(state, def, &value->value);
+	 if (get_value(state, def)->state == LATTICE_VARYING)
+	    return;
+      }
+   }
+}
+
+static void
+visit_alu(sccp_state *state, nir_alu_instr *alu)
+{
+   nir_ssa_def *def = &alu->dest.dest.ssa;
+   const nir_const_value *srcs[4];
+   
+   if (alu->has_predicate) {
+      set_varying(state, def);
+      return;
+   }
+   
+   for (unsigned i = 0; i < nir_op_infos[alu->op].num_inputs; i++) {
+      if (!alu->src[i].src.is_ssa) {
+	 set_varying(state, def);
+	 return;
+      }
+      
+      lattice_value *value = get_value(state, alu->src[i].src.ssa);
+      if (value->state == LATTICE_UNKNOWN)
+	 return;
+      if (value->state == LATTICE_VARYING) {
+	 set_varying(state, def);
+	 return;
+      }
+      
+      srcs[i] = &value->value;
+   }
+   
+   nir_const_value result = { { { 0 } } };
+   if (eval_alu(alu, srcs, &result))
+      set_const(state, def, &result);
+   else
+      set_varying(state, def);
+}
+
+static void
+visit_instr(sccp_state *state, nir_instr *instr)
+{
+   nir_dest *dest = nir_instr_dest(instr);
+   if (dest == NULL || !dest->is_ssa) {
+      /* other than undefs, which are varying, nothing else defines SSA
+       * values without a destination
+       */
+      if (instr->type == nir_instr_type_ssa_undef)
+	 set_varying(state, &nir_instr_as_ssa_undef(instr)->def);
+      return;
+   }
+   
+   switch (instr->type) {
+      case nir_instr_type_alu:
+	 visit_alu(state, nir_instr_as_alu(instr));
+	 break;
+	 
+      case nir_instr_type_phi:
+	 visit_phi(state, nir_instr_as_phi(instr));
+	 break;
+	 
+      case nir_instr_type_load_const: {
+	 nir_load_const_instr *load_const = nir_instr_as_load_const(instr);
+	 if (load_const->has_predicate || load_const->array_elems != 0)
+	    set_varying(state, &dest->ssa);
+	 else
+	    set_const(state, &dest->ssa, &load_const->value);
+	 break;
+      }
+      
+      default:
+	 set_varying(state, &dest->ssa);
+	 break;
+   }
+}
+
+/* marks the edges out of block that can be taken as executable */
+static void
+visit_block_end(sccp_state *state, nir_block *block)
+{
+   nir_if *if_stmt = nir_block_following_if(block);
+   
+   if (if_stmt != NULL && !block_ends_in_jump(block) &&
+       if_stmt->condition.is_ssa) {
+      lattice_value *cond = get_value(state, if_stmt->condition.ssa);
+      if (cond->state == LATTICE_CONST) {
+	 mark_edge_executable(state, block, cond->value.u[0] != 0 ? 0 : 1);
+	 return;
+      }
+      if (cond->state == LATTICE_UNKNOWN)
+	 return;
+   }
+   
+   for (unsigned i = 0; i < 2; i++) {
+      if (block->successors[i] != NULL)
+	 mark_edge_executable(state, block, i);
+   }
+}
+
+static void
+visit_edge(sccp_state *state, unsigned edge)
+{
+   nir_block *pred = state->impl->blocks[edge / 2];
+   nir_block *block = pred->successors[edge % 2];
+   
+   if (state->block_executable[block->index]) {
+      /* only the phis can see the new edge */
+      nir_foreach_instr(block, instr) {
+	 if (instr->type != nir_instr_type_phi)
+	    break;
+	 visit_phi(state, nir_instr_as_phi(instr));
+      }
+      return;
+   }
+   
+   state->block_executable[block->index] = true;
+   
+   nir_foreach_instr(block, instr)
+      visit_instr(state, instr);
+   
+   visit_block_end(state, block);
+}
+
+static void
+visit_use(sccp_state *state, sccp_use *use)
+{
+   if (use->if_stmt != NULL) {
+      nir_cf_node *prev = nir_cf_node_prev(&use->if_stmt->cf_node);
+      nir_block *block = nir_cf_node_as_block(prev);
+      if (state->block_executable[block->index])
+	 visit_block_end(state, block);
+   } else if (state->block_executable[use->instr->block->index]) {
+      visit_instr(state, use->instr);
+   }
+}
+
+static void
+add_use(sccp_state *state, nir_src *src, nir_instr *instr, nir_if *if_stmt,
+	bool count_only)
+{
+   if (!src->is_ssa)
+      return;
+   
+   unsigned index = src->ssa->index;
+   if (count_only) {
+      state->use_start[index + 1]++;
+   } else {
+      sccp_use *use = &state->uses[state->use_start[index]++];
+      use->instr = instr;
+      use->if_stmt = if_stmt;
+   }
+}
+
+/* fills in use_start and uses, by counting the uses first */
+static void
+collect_uses(sccp_state *state)
+{
+   state->use_start = rzalloc_array(state->mem_ctx, unsigned,
+				    state->num_defs + 1);
+   
+   for (unsigned pass = 0; pass < 2; pass++) {
+      bool count_only = pass == 0;
+      
+      nir_foreach_block_in_order(state->impl, block) {
+	 nir_foreach_instr(block, instr) {
+	    if (instr->type == nir_instr_type_phi) {
+	       nir_phi_instr *phi = nir_instr_as_phi(instr);
+	       foreach_list_typed(nir_phi_src, src, node, &phi->srcs)
+		  add_use(state, &src->src, instr, NULL, count_only);
+	    } else {
+	       nir_instr_foreach_src(instr, iter)
+		  add_use(state, iter.src, instr, NULL, count_only);
+	    }
+	 }
+	 
+	 nir_if *if_stmt = nir_block_following_if(block);
+	 if (if_stmt != NULL)
+	    add_use(state, &if_stmt->condition, NULL, if_stmt, count_only);
+      }
+      
+      if (count_only) {
+	 for (unsigned i = 0; i < state->num_defs; i++)
+	    state->use_start[i + 1] += state->use_start[i];
+	 
+	 state->uses = ralloc_array(state->mem_ctx, sccp_use,
+				    state->use_start[state->num_defs]);
+      } else {
+	 /* filling in moved every start up to the next one */
+	 for (unsigned i = state->num_defs; i > 0; i--)
+	    state->use_start[i] = state->use_start[i - 1];
+	 state->use_start[0] = 0;
+      }
+   }
+}
+
+static void
+propagate(sccp_state *state)
+{
+   nir_block *start = state->impl->start_block;
+   state->block_executable[start->index] = true;
+   nir_foreach_instr(start, instr)
+      visit_instr(state, instr);
+   visit_block_end(state, start);
+   
+   while (state->cfg_worklist_len > 0 || state->ssa_worklist_len > 0) {
+      while (state->cfg_worklist_len > 0)
+	 visit_edge(state, state->cfg_worklist[--state->cfg_worklist_len]);
+      
+      while (state->ssa_worklist_len > 0) {
+	 nir_ssa_def *def = state->ssa_worklist[--state->ssa_worklist_len];
+	 for (unsigned i = state->use_start[def->index];
+	      i < state->use_start[def->index + 1]; i++)
+	    visit_use(state, &state->uses[i]);
+      }
+   }
+}
+
+/*
+ * Rewriting
+ */
+
+static void
+remove_instr(sccp_state *state, nir_instr *instr)
+{
+   _mesa_set_add(state->removed, _mesa_hash_pointer(instr), instr);
+   nir_instr_remove(instr);
+}
+
+static bool
+instr_was_removed(sccp_state *state, nir_instr *instr)
+{
+   return _mesa_set_search(state->removed, _mesa_hash_pointer(instr),
+			   instr) != NULL;
+}
+
+/* the value def was replaced by, following chains of replacements */
+static nir_ssa_def *
+resolve_def(sccp_state *state, nir_ssa_def *def)
+{
+   for (;;) {
+      struct hash_entry *entry =
+	 _mesa_hash_table_search(state->replacements,
+				 _mesa_hash_pointer(def), def);
+      if (entry == NULL)
+	 return def;
+      def = (nir_ssa_def *) entry->data;
+   }
+}
+
+/*
+ * Makes the uses of old_def read new_def. The use lists only describe the
+ * shader as it was before rewriting, and folding an if can replace a value
+ * whose users were pointed at it by an earlier replacement, so the uses are
+ * only rewritten once everything is replaced, by rewrite_uses().
+ */
+static void
+replace_def(sccp_state *state, nir_ssa_def *old_def, nir_ssa_def *new_def)
+{
+   _mesa_hash_table_insert(state->replacements, _mesa_hash_pointer(old_def),
+			   old_def, resolve_def(state, new_def));
+}
+
+static void
+rewrite_src(sccp_state *state, nir_src *src, nir_instr *instr)
+{
+   if (!src->is_ssa)
+      return;
+   
+   nir_ssa_def *def = resolve_def(state, src->ssa);
+   if (def == src->ssa)
+      return;
+   
+   src->ssa = def;
+   if (instr != NULL)
+      nir_instr_mark_changed(instr);
+}
+
+/* points the uses of replaced SSA values to their replacement */
+static void
+rewrite_uses(sccp_state *state)
+{
+   if (state->replacements->entries == 0)
+      return;
+   
+   nir_foreach_block_in_order(state->impl, block) {
+      nir_foreach_instr(block, instr) {
+	 if (instr->type == nir_instr_type_phi) {
+	    nir_phi_instr *phi = nir_instr_as_phi(instr);
+	    foreach_list_typed(nir_phi_src, src, node, &phi->srcs)
+	       rewrite_src(state, &src->src, instr);
+	 } else {
+	    nir_instr_foreach_src(instr, iter)
+	       rewrite_src(state, iter.src, instr);
+	 }
+      }
+      
+      nir_if *if_stmt = nir_block_following_if(block);
+      if (if_stmt != NULL)
+	 rewrite_src(state, &if_stmt->condition, NULL);
+   }
+   
+   state->impl->dirty = true;
+}
+
+static nir_instr *
+first_non_phi(nir_block *block)
+{
+   nir_foreach_instr(block, instr) {
+      if (instr->type != nir_instr_type_phi)
+	 return instr;
+   }
+   
+   return NULL;
+}
+
+/* replaces values that are constant, but not loaded as such, by constants */
+static bool
+replace_constants(sccp_state *state)
+{
+   bool progress = false;
+   
+   nir_foreach_block_in_order(state->impl, block) {
+      if (!state->block_executable[block->index])
+	 continue;
+      
+      foreach_list_safe(node, &block->instr_list) {
+	 nir_instr *instr = exec_node_data(nir_instr, node, node);
+	 if (instr->type != nir_instr_type_alu &&
+	     instr->type != nir_instr_type_phi)
+	    continue;
+	 
+	 nir_dest *dest = nir_instr_dest(instr);
+	 if (!dest->is_ssa)
+	    continue;
+	 
+	 lattice_value *value = get_value(state, &dest->ssa);
+	 if (value->state != LATTICE_CONST)
+	    continue;
+	 
+	 nir_load_const_instr *load_const =
+	    nir_load_const_instr_create(state->impl);
+	 nir_ssa_dest_init(state->impl, &load_const->instr, &load_const->dest,
+			   dest->ssa.num_components, dest->ssa.name);
+	 load_const->value = value->value;
+	 
+	 if (instr->type == nir_instr_type_phi) {
+	    nir_instr *first = first_non_phi(block);
+	    if (first != NULL)
+	       nir_instr_insert_before(first, &load_const->instr);
+	    else
+	       nir_instr_insert_after_block(block, &load_const->instr);
+	 } else {
+	    nir_instr_insert_before(instr, &load_const->instr);
+	 }
+	 
+	 replace_def(state, &dest->ssa, &load_const->dest.ssa);
+	 remove_instr(state, instr);
+	 progress = true;
+      }
+   }
+   
+   return progress;
+}
+
+static void delete_cf_list(sccp_state *state, struct exec_list *list);
+
+/* removes all the instructions inside node, but not node itself */
+static void
+delete_cf_node_contents(sccp_state *state, nir_cf_node *node)
+{
+   switch (node->type) {
+      case nir_cf_node_block: {
+	 nir_block *block = nir_cf_node_as_block(node);
+	 foreach_list_safe(instr_node, &block->instr_list) {
+	    remove_instr(state, exec_node_data(nir_instr, instr_node, node));
+	 }
+	 break;
+      }
+      
+      case nir_cf_node_if: {
+	 nir_if *if_stmt = nir_cf_node_as_if(node);
+	 delete_cf_list(state, &if_stmt->then_list);
+	 delete_cf_list(state, &if_stmt->else_list);
+	 break;
+      }
+      
+      case nir_cf_node_loop:
+	 delete_cf_list(state, &nir_cf_node_as_loop(node)->body);
+	 break;
+	 
+      default:
+	 assert(0);
+	 break;
+   }
+}
+
+/* empties a branch or loop body, leaving a single empty block */
+static void
+delete_cf_list(sccp_state *state, struct exec_list *list)
+{
+   foreach_list_typed(nir_cf_node, node, node, list)
+      delete_cf_node_contents(state, node);
+   
+   nir_cf_node *first = exec_node_data(nir_cf_node, exec_list_get_head(list),
+				       node);
+   while (!exec_node_is_tail_sentinel(first->node.next)) {
+      nir_cf_node *next = nir_cf_node_next(first);
+      assert(next->type != nir_cf_node_block);
+      nir_cf_node_remove(next);
+   }
+}
+
+static bool
+cf_list_is_empty(struct exec_list *list)
+{
+   nir_cf_node *first = exec_node_data(nir_cf_node, exec_list_get_head(list),
+				       node);
+   return exec_node_is_tail_sentinel(first->node.next) &&
+	  exec_list_is_empty(&nir_cf_node_as_block(first)->instr_list);
+}
+
+/*
+ * Removes the branch of the if that is never taken. If the other branch is
+ * then just a block, its instructions are moved in front of the if, which
+ * is removed.
+ */
+static bool
+fold_if(sccp_state *state, nir_if *if_stmt, bool condition)
+{
+   bool progress = false;
+   
+   struct exec_list *taken = condition ? &if_stmt->then_list
+				       : &if_stmt->else_list;
+   struct exec_list *dead = condition ? &if_stmt->else_list
+				      : &if_stmt->then_list;
+   
+   if (!cf_list_is_empty(dead)) {
+      delete_cf_list(state, dead);
+      progress = true;
+   }
+   
+   nir_cf_node *taken_node = exec_node_data(nir_cf_node,
+					    exec_list_get_head(taken), node);
+   if (!exec_node_is_tail_sentinel(taken_node->node.next))
+      return progress;
+   
+   nir_block *taken_block = nir_cf_node_as_block(taken_node);
+   if (block_ends_in_jump(taken_block))
+      return progress;
+   
+   nir_instr *first = nir_block_first_instr(taken_block);
+   if (first != NULL && first->type == nir_instr_type_phi)
+      return progress;
+   
+   nir_block *before = nir_cf_node_as_block(nir_cf_node_prev(&if_stmt->cf_node));
+   nir_block *after = nir_cf_node_as_block(nir_cf_node_next(&if_stmt->cf_node));
+   
+   foreach_list_safe(node, &taken_block->instr_list) {
+      nir_instr *instr = exec_node_data(nir_instr, node, node);
+      nir_instr_remove(instr);
+      nir_instr_insert_after_block(before, instr);
+   }
+   
+   /* once the if is gone, the phis after it only have one value to pick */
+   foreach_list_safe(node, &after->instr_list) {
+      nir_instr *instr = exec_node_data(nir_instr, node, node);
+      if (instr->type != nir_instr_type_phi)
+	 break;
+      
+      nir_phi_instr *phi = nir_instr_as_phi(instr);
+      foreach_list_typed(nir_phi_src, src, node, &phi->srcs) {
+	 if (src->pred == taken_block) {
+	    assert(src->src.is_ssa && phi->dest.is_ssa);
+	    replace_def(state, &phi->dest.ssa, src->src.ssa);
+	    break;
+	 }
+      }
+      
+      remove_instr(state, instr);
+   }
+   
+   nir_cf_node_remove(&if_stmt->cf_node);
+   return true;
+}
+
+typedef struct {
+   nir_if *if_stmt;
+   bool condition;
+} if_decision;
+
+/* collects the reachable ifs with a known condition, outermost first */
+static void
+collect_ifs(sccp_state *state, struct exec_list *list, if_decision **ifs,
+	    unsigned *num_ifs, unsigned *size)
+{
+   foreach_list_typed(nir_cf_node, node, node, list) {
+      if (node->type == nir_cf_node_if) {
+	 nir_if *if_stmt = nir_cf_node_as_if(node);
+	 nir_block *before = nir_cf_node_as_block(nir_cf_node_prev(node));
+	 
+	 if (state->block_executable[before->index] &&
+	     !block_ends_in_jump(before) && if_stmt->condition.is_ssa) {
+	    lattice_value *cond = get_value(state, if_stmt->condition.ssa);
+	    if (cond->state == LATTICE_CONST) {
+	       if (*num_ifs == *size) {
+		  *size *= 2;
+		  *ifs = reralloc(state->mem_ctx, *ifs, if_decision, *size);
+	       }
+	       (*ifs)[*num_ifs].if_stmt = if_stmt;
+	       (*ifs)[(*num_ifs)++].condition = cond->value.u[0] != 0;
+	    }
+	 }
+	 
+	 collect_ifs(state, &if_stmt->then_list, ifs, num_ifs, size);
+	 collect_ifs(state, &if_stmt->else_list, ifs, num_ifs, size);
+      } else if (node->type == nir_cf_node_loop) {
+	 collect_ifs(state, &nir_cf_node_as_loop(node)->body, ifs, num_ifs,
+		     size);
+      }
+   }
+}
+
+static nir_src
+create_undef(nir_function_impl *impl, unsigned num_components)
+{
+   nir_ssa_undef_instr *undef =
+      nir_ssa_undef_instr_create(impl, impl, num_components);
+   nir_instr_insert_before_cf_list(&impl->body, &undef->instr);
+   
+   nir_src src;
+   src.is_ssa = true;
+   src.ssa = &undef->def;
+   return src;
+}
+
+/*
+ * Makes the phis agree with the predecessors of their blocks again after the
+ * control flow changed: sources from blocks that are no longer predecessors
+ * go away, and new predecessors get an undefined value. So do sources whose
+ * value was computed in a deleted branch, which are never executed.
+ */
+static void
+repair_phis(sccp_state *state)
+{
+   nir_function_impl *impl = state->impl;
+   
+   nir_foreach_block_in_order(impl, block) {
+      nir_foreach_instr(block, instr) {
+	 if (instr->type != nir_instr_type_phi)
+	    break;
+	 
+	 nir_phi_instr *phi = nir_instr_as_phi(instr);
+	 
+	 foreach_list_safe(node, &phi->srcs) {
+	    nir_phi_src *src = exec_node_data(nir_phi_src, node, node);
+	    if (_mesa_set_search(block->predecessors,
+				 _mesa_hash_pointer(src->pred),
+				 src->pred) == NULL) {
+	       exec_node_remove(&src->node);
+	       nir_instr_mark_changed(instr);
+	    } else if (src->src.is_ssa &&
+		       instr_was_removed(state, src->src.ssa->parent_instr)) {
+	       src->src = create_undef(impl, src->src.ssa->num_components);
+	       nir_instr_mark_changed(instr);
+	    }
+	 }
+	 
+	 struct set_entry *entry;
+	 set_foreach(block->predecessors, entry) {
+	    nir_block *pred = (nir_block *) entry->key;
+	    
+	    bool found = false;
+	    foreach_list_typed(nir_phi_src, src, node, &phi->srcs) {
+	       if (src->pred == pred) {
+		  found = true;
+		  break;
+	       }
+	    }
+	    if (found)
+	       continue;
+	    
+	    nir_src src = create_undef(impl, phi->dest.ssa.num_components);
+	    nir_phi_instr_add_src(impl, phi, pred, src);
+	    nir_instr_mark_changed(instr);
+	 }
+      }
+   }
+}
+
+bool
+nir_opt_sccp_impl(nir_function_impl *impl)
+{
+   sccp_state state;
+   state.impl = impl;
+   state.mem_ctx = ralloc_context(NULL);
+   
+   nir_index_ssa_defs(impl);
+   nir_index_blocks(impl);
+   nir_impl_blocks(impl);
+   
+   state.num_defs = impl->ssa_alloc;
+   state.num_blocks = impl->num_blocks;
+   state.values = rzalloc_array(state.mem_ctx, lattice_value,
+				state.num_defs);
+   state.block_executable = rzalloc_array(state.mem_ctx, bool,
+					  state.num_blocks);
+   state.edge_executable = rzalloc_array(state.mem_ctx, bool,
+					 state.num_blocks * 2);
+   
+   /* every value is lowered at most twice, and every edge is added once */
+   state.ssa_worklist = ralloc_array(state.mem_ctx, nir_ssa_def *,
+				     state.num_defs * 2);
+   state.ssa_worklist_len = 0;
+   state.cfg_worklist = ralloc_array(state.mem_ctx, unsigned,
+				     state.num_blocks * 2);
+   state.cfg_worklist_len = 0;
+   
+   state.removed = _mesa_set_create(state.mem_ctx, _mesa_key_pointer_equal);
+   state.replacements = _mesa_hash_table_create(state.mem_ctx,
+						 _mesa_key_pointer_equal);
+   
+   collect_uses(&state);
+   propagate(&state);
+   
+   unsigned num_ifs = 0, size = 16;
+   if_decision *ifs = ralloc_array(state.mem_ctx, if_decision, size);
+   collect_ifs(&state, &impl->body, &ifs, &num_ifs, &size);
+   
+   bool progress = replace_constants(&state);
+   
+   /* inner ifs first, so that their outer ifs may be left with a block */
+   bool cf_progress = false;
+   for (unsigned i = num_ifs; i-- > 0; ) {
+      if (fold_if(&state, ifs[i].if_stmt, ifs[i].condition))
+	 cf_progress = true;
+   }
+   
+   rewrite_uses(&state);
+   
+   if (cf_progress) {
+      repair_phis(&state);
+      progress = true;
+   }
+   
+   ralloc_free(state.mem_ctx);
+   return progress;
+}
+
+static bool
+sccp_impl_cb(nir_function_impl *impl, nir_pass_worker *worker, void *data)
+{
+   return nir_opt_sccp_impl(impl);
+}
+
+bool
+nir_opt_sccp(nir_shader *shader)
+{
+   return nir_shader_foreach_impl_parallel(shader, sccp_impl_cb, NULL);
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include "nir.h"
+#include <assert.h>
+
+/*
+ * The optimization loop keeps two change lists per function: the one for
+ * the previous round, which says what the instruction and block passes of
+ * the current round look at, and the one attached to the function, which
+ * collects what the current round changes. They are swapped after every
+ * round.
+ */
+
+typedef struct {
+   nir_function_impl *impl;
+   
+   /* what the previous round changed, or NULL to look at everything */
+   nir_change_list *prev;
+   
+   /* what the current round has changed so far */
+   nir_change_list *cur;
+   
+   void *mem_ctx;
+} opt_state;
+
+static bool
+run_instr_pass(opt_state *state, const nir_opt_pass *pass)
+{
+   bool progress = false;
+   bool cf_changed = state->cur->cf_changed;
+   nir_instr **instrs;
+   unsigned num_instrs = 0;
+   
+   /* take a snapshot first, since the pass may remove instructions */
+   if (state->prev == NULL) {
+      unsigned size = 64;
+      instrs = ralloc_array(state->mem_ctx, nir_instr *, size);
+      nir_foreach_block_in_order(state->impl, block) {
+	 nir_foreach_instr(block, instr) {
+	    if (num_instrs == size) {
+	       size *= 2;
+	       instrs = reralloc(state->mem_ctx, instrs, nir_instr *, size);
+	    }
+	    instrs[num_instrs++] = instr;
+	 }
+      }
+   } else {
+      instrs = ralloc_array(state->mem_ctx, nir_instr *,
+			    state->prev->num_instrs);
+      for (unsigned i = 0; i < state->prev->num_instrs; i++) {
+	 nir_instr *instr = state->prev->instrs[i];
+	 /* entries that were removed, or are duplicates from removing and
+	  * reinserting an instruction, aren't in the set anymore
+	  */
+	 if (!nir_change_list_has_instr(state->prev, instr))
+	    continue;
+	 instrs[num_instrs++] = instr;
+      }
+   }
+   
+   for (unsigned i = 0; i < num_instrs; i++) {
+      /* removed earlier in this round */
+      if (nir_change_list_was_removed(state->cur, instrs[i]))
+	 continue;
+      
+      if (pass->instr_cb(instrs[i], pass->data))
+	 progress = true;
+      
+      assert(state->cur->cf_changed == cf_changed);
+   }
+   
+   ralloc_free(instrs);
+   return progress;
+}
+
+static bool
+run_block_pass(opt_state *state, const nir_opt_pass *pass)
+{
+   bool progress = false;
+   bool cf_changed = state->cur->cf_changed;
+   
+   /* a function pass earlier in this round may have removed blocks */
+   if (state->prev == NULL || cf_changed) {
+      nir_foreach_block_in_order(state->impl, block) {
+	 if (pass->block_cb(block, pass->data))
+	    progress = true;
+	 
+	 assert(state->cur->cf_changed == cf_changed);
+      }
+   } else {
+      for (unsigned i = 0; i < state->prev->num_blocks; i++) {
+	 if (pass->block_cb(state->prev->blocks[i], pass->data))
+	    progress = true;
+	 
+	 assert(!state->cur->cf_changed);
+      }
+   }
+   
+   return progress;
+}
+
+bool
+nir_optimize_impl(nir_function_impl *impl, const nir_opt_pass *passes,
+		  unsigned num_passes)
+{
+   assert(impl->changes == NULL);
+   
+   opt_state state;
+   state.impl = impl;
+   state.mem_ctx = ralloc_context(NULL);
+   
+   nir_change_list *lists[2];
+   lists[0] = nir_change_list_create(state.mem_ctx);
+   lists[1] = nir_change_list_create(state.mem_ctx);
+   unsigned cur_list = 0;
+   
+   state.prev = NULL;
+   state.cur = lists[cur_list];
+   
+   /* whether each function pass needs to run, because something changed
+    * since it last did
+    */
+   bool *stale = ralloc_array(state.mem_ctx, bool, num_passes);
+   for (unsigned i = 0; i < num_passes; i++)
+      stale[i] = true;
+   
+   bool progress = false;
+   
+   for (;;) {
+      bool round_progress = false;
+      impl->changes = state.cur;
+      
+      for (unsigned i = 0; i < num_passes; i++) {
+	 const nir_opt_pass *pass = &passes[i];
+	 bool pass_progress;
+	 
+	 if (pass->instr_cb != NULL) {
+	    pass_progress = run_instr_pass(&state, pass);
+	 } else if (pass->block_cb != NULL) {
+	    pass_progress = run_block_pass(&state, pass);
+	 } else {
+	    if (!stale[i])
+	       continue;
+	    
+	    stale[i] = false;
+	    pass_progress = pass->impl_cb(impl, pass->data);
+	 }
+	 
+	 if (pass_progress) {
+	    round_progress = true;
+	    for (unsigned j = 0; j < num_passes; j++)
+	       stale[j] = true;
+	 }
+      }
+      
+      impl->changes = NULL;
+      
+      if (!round_progress)
+	 break;
+      
+      progress = true;
+      
+      /*
+       * If something was changed in place without being marked, or the
+       * recorded blocks may be gone, look at everything again.
+       */
+      if (nir_change_list_is_empty(state.cur) || state.cur->cf_changed)
+	 state.prev = NULL;
+      else
+	 state.prev = state.cur;
+      
+      cur_list ^= 1;
+      state.cur = lists[cur_list];
+      nir_change_list_reset(state.cur);
+   }
+   
+   ralloc_free(state.mem_ctx);
+   return progress;
+}
+
+bool
+nir_optimize(nir_shader *shader, const nir_opt_pass *passes,
+	     unsigned num_passes)
+{
+   bool progress = false;
+   
+   nir_foreach_impl(shader, impl) {
+      if (nir_optimize_impl(impl, passes, num_passes))
+	 progress = true;
+   }
+   
+   return progress;
+}
@@ -0,0 +1,379 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include "nir.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Packs scalar, vec2 and vec3 shader inputs or outputs into shared vec4
+ * slots.
+ *
+ * Variables that take up whole slots (vec4s, arrays, structures), and those
+ * with an explicit location, keep their locations; the packed variables go
+ * into the slots after them. They are placed largest first, each into the
+ * first slot with enough free components that holds variables interpolated
+ * the same way, which gives their location and location_frac. Loads and
+ * stores that use the old locations are moved to the new ones.
+ *
+ * The variables are visited ordered by their old location and name, so two
+ * stages with matching variables pack them the same way, and packing again
+ * changes nothing.
+ */
+
+typedef struct {
+   nir_variable *var;
+   int old_location;
+   unsigned old_component;
+   unsigned num_components;
+   
+   /* whether all of its loads and stores can be moved */
+   bool can_pack;
+} varying;
+
+typedef struct {
+   unsigned interp_key;
+   unsigned used_components;
+} varying_slot;
+
+static int
+compare_varyings(const void *a, const void *b)
+{
+   const varying *va = (const varying *) a, *vb = (const varying *) b;
+   
+   if (va->old_location != vb->old_location)
+      return va->old_location < vb->old_location ? -1 : 1;
+   if (va->old_component != vb->old_component)
+      return va->old_component < vb->old_component ? -1 : 1;
+   return strcmp(va->var->name, vb->var->name);
+}
+
+/* like compare_varyings(), but larger variables first */
+static int
+compare_varyings_by_size(const void *a, const void *b)
+{
+   const varying *va = (const varying *) a, *vb = (const varying *) b;
+   
+   if (va->num_components != vb->num_components)
+      return va->num_components > vb->num_components ? -1 : 1;
+   return compare_varyings(a, b);
+}
+
+/* only variables interpolated the same way can share a slot */
+static unsigned
+interp_key(const nir_variable *var)
+{
+   return var->data.interpolation | var->data.centroid << 2 |
+	  var->data.sample << 3;
+}
+
+static bool
+is_packable(const nir_variable *var)
+{
+   return !var->data.explicit_location &&
+	  glsl_type_is_vector_or_scalar(var->type) &&
+	  glsl_get_vector_elements(var->type) < 4;
+}
+
+static varying *
+find_varying(varying *varyings, unsigned num_varyings,
+	     nir_intrinsic_instr *intrin)
+{
+   if (intrin->const_index[0] < 0)
+      return NULL;
+   
+   for (unsigned i = 0; i < num_varyings; i++) {
+      if (varyings[i].old_location == intrin->const_index[0] &&
+	  varyings[i].old_component == intrin->const_index[1])
+	 return &varyings[i];
+   }
+   
+   return NULL;
+}
+
+static nir_intrinsic_op
+io_intrinsic(nir_variable_mode mode)
+{
+   return mode == nir_var_shader_in ? nir_intrinsic_load_input
+				    : nir_intrinsic_store_output;
+}
+
+/*
+ * Rules out packing variables with accesses that can't be moved: loads into
+ * and stores of registers wider than the variable, which would read or
+ * overwrite its neighbors.
+ */
+static void
+check_accesses(nir_shader *shader, nir_variable_mode mode,
+	       varying *varyings, unsigned num_varyings)
+{
+   nir_foreach_impl(shader, impl) {
+      nir_foreach_block_in_order(impl, block) {
+	 nir_foreach_instr(block, instr) {
+	    if (instr->type != nir_instr_type_intrinsic)
+	       continue;
+	    
+	    nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(instr);
+	    if (intrin->intrinsic != io_intrinsic(mode))
+	       continue;
+	    
+	    varying *v = find_varying(varyings, num_varyings, intrin);
+	    if (v == NULL)
+	       continue;
+	    
+	    if (mode == nir_var_shader_in && !intrin->dest.is_ssa &&
+		intrin->dest.reg.reg->num_components > v->num_components)
+	       v->can_pack = false;
+	    
+	    if (mode == nir_var_shader_out && !intrin->src[1].is_ssa &&
+		intrin->src[1].reg.reg->num_components > v->num_components)
+	       v->can_pack = false;
+	 }
+      }
+   }
+}
+
+/* makes a store write only the first num_components of its value */
+static void
+narrow_store(nir_function_impl *impl, nir_intrinsic_instr *store,
+	     unsigned num_components)
+{
+   if (!store->src[1].is_ssa ||
+       store->src[1].ssa->num_components <= num_components)
+      return;
+   
+   nir_alu_instr *mov = nir_alu_instr_create(impl, nir_op_mov);
+   mov->src[0].src = store->src[1];
+   nir_ssa_dest_init(impl, &mov->instr, &mov->dest.dest, num_components,
+		     NULL);
+   mov->dest.write_mask = (1 << num_components) - 1;
+   nir_instr_insert_before(&store->instr, &mov->instr);
+   
+   store->src[1].ssa = &mov->dest.dest.ssa;
+}
+
+static void
+rewrite_src(struct hash_table *replacements, nir_src *src, nir_instr *instr)
+{
+   if (!src->is_ssa)
+      return;
+   
+   struct hash_entry *entry =
+      _mesa_hash_table_search(replacements, _mesa_hash_pointer(src->ssa),
+			      src->ssa);
+   if (entry == NULL)
+      return;
+   
+   src->ssa = (nir_ssa_def *) entry->data;
+   if (instr != NULL)
+      nir_instr_mark_changed(instr);
+}
+
+/* points the uses of the SSA values in replacements to their replacement */
+static void
+rewrite_uses(nir_function_impl *impl, struct hash_table *replacements)
+{
+   nir_foreach_block_in_order(impl, block) {
+      nir_foreach_instr(block, instr) {
+	 if (instr->type == nir_instr_type_phi) {
+	    nir_phi_instr *phi = nir_instr_as_phi(instr);
+	    foreach_list_typed(nir_phi_src, src, node, &phi->srcs)
+	       rewrite_src(replacements, &src->src, instr);
+	 } else {
+	    nir_instr_foreach_src(instr, iter)
+	       rewrite_src(replacements, iter.src, instr);
+	 }
+      }
+      
+      nir_if *if_stmt = nir_block_following_if(block);
+      if (if_stmt != NULL)
+	 rewrite_src(replacements, &if_stmt->condition, NULL);
+   }
+}
+
+/*
+ * Replaces a load by one of only the first num_components, padded back to its
+ * old width by repeating the last component for the users, which are pointed
+ * at the padded value through replacements. The components past the end of
+ * the variable were undefined anyway.
+ */
+static void
+narrow_load(nir_function_impl *impl, nir_intrinsic_instr *load,
+	    unsigned num_components, struct hash_table *replacements)
+{
+   nir_intrinsic_instr *narrowed =
+      nir_intrinsic_instr_create(impl, load->intrinsic);
+   for (unsigned i = 0; i < nir_intrinsic_infos[load->intrinsic].num_srcs; i++)
+      narrowed->src[i] = load->src[i];
+   narrowed->const_index[0] = load->const_index[0];
+   narrowed->const_index[1] = load->const_index[1];
+   narrowed->has_predicate = load->has_predicate;
+   narrowed->predicate = load->predicate;
+   nir_ssa_dest_init(impl, &narrowed->instr, &narrowed->dest, num_components,
+		     NULL);
+   nir_instr_insert_before(&load->instr, &narrowed->instr);
+   
+   unsigned old_components = load->dest.ssa.num_components;
+   nir_alu_instr *mov = nir_alu_instr_create(impl, nir_op_mov);
+   mov->src[0].src.is_ssa = true;
+   mov->src[0].src.ssa = &narrowed->dest.ssa;
+   for (unsigned c = 0; c < 4; c++)
+      mov->src[0].swizzle[c] = c < num_components ? c : num_components - 1;
+   nir_ssa_dest_init(impl, &mov->instr, &mov->dest.dest, old_components,
+		     NULL);
+   mov->dest.write_mask = (1 << old_components) - 1;
+   nir_instr_insert_before(&load->instr, &mov->instr);
+   
+   _mesa_hash_table_insert(replacements, _mesa_hash_pointer(&load->dest.ssa),
+			   &load->dest.ssa, &mov->dest.dest.ssa);
+   nir_instr_remove(&load->instr);
+}
+
+static void
+rewrite_accesses(nir_shader *shader, nir_variable_mode mode,
+		 varying *varyings, unsigned num_varyings)
+{
+   nir_foreach_impl(shader, impl) {
+      struct hash_table *replacements =
+	 _mesa_hash_table_create(NULL, _mesa_key_pointer_equal);
+      
+      nir_foreach_block_in_order(impl, block) {
+	 foreach_list_safe(node, &block->instr_list) {
+	    nir_instr *instr = exec_node_data(nir_instr, node, node);
+	    if (instr->type != nir_instr_type_intrinsic)
+	       continue;
+	    
+	    nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(instr);
+	    if (intrin->intrinsic != io_intrinsic(mode))
+	       continue;
+	    
+	    varying *v = find_varying(varyings, num_varyings, intrin);
+	    if (v == NULL || !v->can_pack)
+	       continue;
+	    
+	    intrin->const_index[0] = v->var->data.location;
+	    intrin->const_index[1] = v->var->data.location_frac;
+	    nir_instr_mark_changed(instr);
+	    
+	    /* the components after the variable's belong to others */
+	    if (mode == nir_var_shader_in) {
+	       if (intrin->dest.is_ssa &&
+		   intrin->dest.ssa.num_components > v->num_components)
+		  narrow_load(impl, intrin, v->num_components, replacements);
+	    } else {
+	       narrow_store(impl, intrin, v->num_components);
+	    }
+	 }
+      }
+      
+      if (replacements->entries != 0)
+	 rewrite_uses(impl, replacements);
+      
+      _mesa_hash_table_destroy(replacements, NULL);
+   }
+}
+
+bool
+nir_pack_varyings(nir_shader *shader, nir_variable_mode mode)
+{
+   assert(mode == nir_var_shader_in || mode == nir_var_shader_out);
+   
+   struct hash_table *ht = mode == nir_var_shader_in ? shader->inputs
+						     : shader->outputs;
+   void *mem_ctx = ralloc_context(NULL);
+   
+   varying *varyings = ralloc_array(mem_ctx, varying, ht->entries);
+   unsigned num_varyings = 0;
+   
+   struct hash_entry *entry;
+   hash_table_foreach(ht, entry) {
+      nir_variable *var = (nir_variable *) entry->data;
+      varying *v = &varyings[num_varyings++];
+      v->var = var;
+      v->old_location = var->data.location;
+      v->old_component = var->data.location_frac;
+      v->can_pack = is_packable(var);
+      v->num_components = v->can_pack ? glsl_get_vector_elements(var->type)
+				      : 4;
+   }
+   
+   check_accesses(shader, mode, varyings, num_varyings);
+   
+   /* the first slot after the variables that stay where they are */
+   int first_slot = 0;
+   for (unsigned i = 0; i < num_varyings; i++) {
+      varying *v = &varyings[i];
+      if (v->can_pack || v->old_location < 0)
+	 continue;
+      
+      int end = v->old_location + glsl_count_attribute_slots(v->var->type);
+      if (end > first_slot)
+	 first_slot = end;
+   }
+   
+   qsort(varyings, num_varyings, sizeof(varying), compare_varyings_by_size);
+   
+   varying_slot *slots = ralloc_array(mem_ctx, varying_slot, num_varyings);
+   unsigned num_slots = 0;
+   bool progress = false;
+   
+   for (unsigned i = 0; i < num_varyings; i++) {
+      varying *v = &varyings[i];
+      if (!v->can_pack)
+	 continue;
+      
+      unsigned key = interp_key(v->var);
+      unsigned s;
+      for (s = 0; s < num_slots; s++) {
+	 if (slots[s].interp_key == key &&
+	     slots[s].used_components + v->num_components <= 4)
+	    break;
+      }
+      
+      if (s == num_slots) {
+	 slots[s].interp_key = key;
+	 slots[s].used_components = 0;
+	 num_slots++;
+      }
+      
+      int location = first_slot + s;
+      unsigned frac = slots[s].used_components;
+      slots[s].used_components += v->num_components;
+      
+      if (v->var->data.location != location ||
+	  v->var->data.location_frac != frac)
+	 progress = true;
+      
+      v->var->data.location = location;
+      v->var->data.location_frac = frac;
+   }
+   
+   if (progress)
+      rewrite_accesses(shader, mode, varyings, num_varyings);
+   
+   ralloc_free(mem_ctx);
+   return progress;
+}
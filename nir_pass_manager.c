@@ -0,0 +1,301 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "nir.h"
+#include "main/hash_table.h"
+#include <assert.h>
+#include <time.h>
+
+/*
+ * Runs named passes over a shader and records what each run did. The stats
+ * of every run are appended to one array until they are cleared, so that
+ * a pipeline (or several) can be dumped as a whole afterwards. The stats
+ * point to the names of the registered passes, so those live as long as the
+ * pass manager.
+ */
+
+typedef struct {
+   const char *name;
+   nir_shader_pass_cb cb;
+   void *data;
+} registered_pass;
+
+struct nir_pass_manager {
+   /* name -> registered_pass */
+   struct hash_table *passes;
+   
+   nir_pass_stat *stats;
+   unsigned num_stats, stats_size;
+   
+   /* the stats' start times are relative to this */
+   double epoch;
+};
+
+static double
+now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+nir_pass_manager *
+nir_pass_manager_create(void *mem_ctx)
+{
+   nir_pass_manager *pm = ralloc(mem_ctx, nir_pass_manager);
+   pm->passes = _mesa_hash_table_create(pm, _mesa_key_string_equal);
+   pm->stats = NULL;
+   pm->num_stats = 0;
+   pm->stats_size = 0;
+   pm->epoch = now();
+   return pm;
+}
+
+void
+nir_pass_manager_add(nir_pass_manager *pm, const char *name,
+		     nir_shader_pass_cb cb, void *data)
+{
+   uint32_t hash = _mesa_hash_string(name);
+   struct hash_entry *entry = _mesa_hash_table_search(pm->passes, hash, name);
+   
+   /* keep the old record, whose name earlier stats still use */
+   registered_pass *pass;
+   if (entry != NULL) {
+      pass = (registered_pass *) entry->data;
+   } else {
+      pass = ralloc(pm, registered_pass);
+      pass->name = ralloc_strdup(pass, name);
+      _mesa_hash_table_insert(pm->passes, hash, pass->name, pass);
+   }
+   
+   pass->cb = cb;
+   pass->data = data;
+}
+
+bool
+nir_pass_manager_has_pass(nir_pass_manager *pm, const char *name)
+{
+   return _mesa_hash_table_search(pm->passes, _mesa_hash_string(name),
+				  name) != NULL;
+}
+
+static void
+count_shader(nir_shader *shader, unsigned *num_instrs, unsigned *num_blocks)
+{
+   *num_instrs = 0;
+   *num_blocks = 0;
+   
+   nir_foreach_impl(shader, impl) {
+      nir_foreach_block_in_order(impl, block) {
+	 foreach_list_typed(nir_instr, instr, node, &block->instr_list)
+	    (*num_instrs)++;
+      }
+      *num_blocks += impl->num_blocks;
+   }
+}
+
+static nir_pass_stat *
+add_stat(nir_pass_manager *pm)
+{
+   if (pm->num_stats == pm->stats_size) {
+      pm->stats_size = pm->stats_size ? 2 * pm->stats_size : 16;
+      pm->stats = reralloc(pm, pm->stats, nir_pass_stat, pm->stats_size);
+   }
+   
+   return &pm->stats[pm->num_stats++];
+}
+
+static registered_pass *
+find_pass(nir_pass_manager *pm, const char *name)
+{
+   struct hash_entry *entry =
+      _mesa_hash_table_search(pm->passes, _mesa_hash_string(name), name);
+   return entry != NULL ? (registered_pass *) entry->data : NULL;
+}
+
+static bool
+run_pass(nir_pass_manager *pm, nir_shader *shader, registered_pass *pass)
+{
+   unsigned instrs_before, blocks_before;
+   count_shader(shader, &instrs_before, &blocks_before);
+   
+   double start = now();
+   bool progress = pass->cb(shader, pass->data);
+   double end = now();
+   
+   unsigned instrs_after, blocks_after;
+   count_shader(shader, &instrs_after, &blocks_after);
+   
+   nir_pass_stat *stat = add_stat(pm);
+   stat->name = pass->name;
+   stat->start = start - pm->epoch;
+   stat->seconds = end - start;
+   stat->instr_delta = (int) instrs_after - (int) instrs_before;
+   stat->block_delta = (int) blocks_after - (int) blocks_before;
+   stat->progress = progress;
+   
+   return progress;
+}
+
+bool
+nir_pass_manager_run(nir_pass_manager *pm, nir_shader *shader,
+		     const char *const *passes, unsigned num_passes,
+		     bool *progress)
+{
+   for (unsigned i = 0; i < num_passes; i++) {
+      if (find_pass(pm, passes[i]) == NULL)
+	 return false;
+   }
+   
+   bool any_progress = false;
+   for (unsigned i = 0; i < num_passes; i++) {
+      if (run_pass(pm, shader, find_pass(pm, passes[i])))
+	 any_progress = true;
+   }
+   
+   if (progress != NULL)
+      *progress = any_progress;
+   return true;
+}
+
+static bool
+is_separator(char c)
+{
+   return c == ',' || c == ' ' || c == '\t' || c == '\n';
+}
+
+bool
+nir_pass_manager_run_string(nir_pass_manager *pm, nir_shader *shader,
+			    const char *pipeline, bool *progress)
+{
+   void *mem_ctx = ralloc_context(NULL);
+   
+   /* split the string first, so that nothing runs if a name is wrong */
+   const char **names = NULL;
+   unsigned num_names = 0, names_size = 0;
+   
+   const char *p = pipeline;
+   for (;;) {
+      while (is_separator(*p))
+	 p++;
+      if (*p == '\0')
+	 break;
+      
+      unsigned len = 0;
+      while (p[len] != '\0' && !is_separator(p[len]))
+	 len++;
+      
+      if (num_names == names_size) {
+	 names_size = names_size ? 2 * names_size : 16;
+	 names = reralloc(mem_ctx, names, const char *, names_size);
+      }
+      names[num_names++] = ralloc_strndup(mem_ctx, p, len);
+      p += len;
+   }
+   
+   bool ok = nir_pass_manager_run(pm, shader, names, num_names, progress);
+   
+   ralloc_free(mem_ctx);
+   return ok;
+}
+
+const nir_pass_stat *
+nir_pass_manager_stats(nir_pass_manager *pm, unsigned *num_stats)
+{
+   *num_stats = pm->num_stats;
+   return pm->stats;
+}
+
+void
+nir_pass_manager_clear_stats(nir_pass_manager *pm)
+{
+   pm->num_stats = 0;
+}
+
+/* pass names are registered by the caller, so they may need escaping */
+static void
+append_json_string(char **str, const char *s)
+{
+   ralloc_strcat(str, "\"");
+   for (; *s != '\0'; s++) {
+      if (*s == '"' || *s == '\\')
+	 ralloc_asprintf_append(str, "\\%c", *s);
+      else if ((unsigned char) *s < 0x20)
+	 ralloc_asprintf_append(str, "\\u%04x", (unsigned char) *s);
+      else
+	 ralloc_asprintf_append(str, "%c", *s);
+   }
+   ralloc_strcat(str, "\"");
+}
+
+char *
+nir_pass_manager_stats_to_json(nir_pass_manager *pm, void *mem_ctx)
+{
+   char *str = ralloc_strdup(mem_ctx, "[");
+   
+   for (unsigned i = 0; i < pm->num_stats; i++) {
+      const nir_pass_stat *stat = &pm->stats[i];
+      
+      ralloc_strcat(&str, i == 0 ? "\n  {\"pass\": " : ",\n  {\"pass\": ");
+      append_json_string(&str, stat->name);
+      ralloc_asprintf_append(&str, ", \"seconds\": %.9f, \"instr_delta\": %d, "
+			     "\"block_delta\": %d, \"progress\": %s}",
+			     stat->seconds, stat->instr_delta,
+			     stat->block_delta,
+			     stat->progress ? "true" : "false");
+   }
+   
+   ralloc_strcat(&str, "\n]\n");
+   return str;
+}
+
+/*
+ * One complete ("X") event per pass run, with timestamps in microseconds,
+ * as understood by chrome://tracing and Perfetto.
+ */
+char *
+nir_pass_manager_stats_to_trace(nir_pass_manager *pm, void *mem_ctx)
+{
+   char *str = ralloc_strdup(mem_ctx, "{\"traceEvents\": [");
+   
+   for (unsigned i = 0; i < pm->num_stats; i++) {
+      const nir_pass_stat *stat = &pm->stats[i];
+      
+      ralloc_strcat(&str, i == 0 ? "\n  {\"name\": " : ",\n  {\"name\": ");
+      append_json_string(&str, stat->name);
+      ralloc_asprintf_append(&str, ", \"cat\": \"nir\", \"ph\": \"X\", "
+			     "\"ts\": %.3f, \"dur\": %.3f, \"pid\": 0, "
+			     "\"tid\": 0, \"args\": {\"instr_delta\": %d, "
+			     "\"block_delta\": %d, \"progress\": %s}}",
+			     stat->start * 1e6, stat->seconds * 1e6,
+			     stat->instr_delta, stat->block_delta,
+			     stat->progress ? "true" : "false");
+   }
+   
+   ralloc_strcat(&str, "\n]}\n");
+   return str;
+}
@@ -0,0 +1,331 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include "nir.h"
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/*
+ * A fixed-size pool of threads that run a callback on every function
+ * implementation of a shader.
+ *
+ * The threads are created once and sleep on a condition variable between
+ * runs. A run publishes the list of impls and bumps the generation counter;
+ * every worker, including the thread that started the run, then claims impls
+ * one at a time through an atomic counter until there are none left. The
+ * progress of each impl is recorded by its position in the shader and only
+ * combined once all the workers are done.
+ */
+
+struct nir_pass_runner {
+   /* the number of workers, including the thread that starts a run */
+   unsigned num_threads;
+
+   pthread_t *threads;
+   nir_pass_worker *workers;
+
+   /* serializes runs started from different threads */
+   pthread_mutex_t run_lock;
+
+   /* protects generation, busy and quit */
+   pthread_mutex_t lock;
+   pthread_cond_t work_cond, done_cond;
+
+   unsigned generation;
+   unsigned busy; /** < number of pool threads still working on this run */
+   bool quit;
+
+   /* the current run */
+   nir_function_impl **impls;
+   bool *progress;
+   unsigned num_impls;
+   unsigned next_impl;
+   nir_impl_pass_cb cb;
+   void *data;
+};
+
+typedef struct {
+   nir_pass_runner *runner;
+   unsigned index;
+} thread_args;
+
+/* set while a thread is running a callback, so that nested runs don't wait
+ * on a pool that is busy running their caller
+ */
+static __thread bool in_pass_runner;
+
+/* everything the worker allocates is freed along with parent */
+static void
+worker_init(nir_pass_worker *worker, unsigned index, void *parent)
+{
+   worker->index = index;
+   worker->impl_index = 0;
+   worker->mem_ctx = ralloc_context(parent);
+   for (unsigned i = 0; i < NIR_PASS_SCRATCH_TABLES; i++) {
+      worker->scratch[i] = _mesa_hash_table_create(parent,
+						   _mesa_key_pointer_equal);
+   }
+}
+
+static bool
+worker_run_impl(nir_pass_worker *worker, nir_function_impl *impl,
+		unsigned impl_index, nir_impl_pass_cb cb, void *data)
+{
+   for (unsigned i = 0; i < NIR_PASS_SCRATCH_TABLES; i++)
+      _mesa_hash_table_clear(worker->scratch[i], NULL);
+
+   worker->impl_index = impl_index;
+
+   bool nested = in_pass_runner;
+   in_pass_runner = true;
+   bool progress = cb(impl, worker, data);
+   in_pass_runner = nested;
+
+   return progress;
+}
+
+static void
+worker_run(nir_pass_runner *runner, nir_pass_worker *worker)
+{
+   for (;;) {
+      unsigned i = __atomic_fetch_add(&runner->next_impl, 1, __ATOMIC_RELAXED);
+      if (i >= runner->num_impls)
+	 break;
+
+      runner->progress[i] = worker_run_impl(worker, runner->impls[i], i,
+					    runner->cb, runner->data);
+   }
+}
+
+static void *
+thread_main(void *data)
+{
+   thread_args *args = (thread_args *) data;
+   nir_pass_runner *runner = args->runner;
+   nir_pass_worker *worker = &runner->workers[args->index];
+   free(args);
+
+   unsigned generation = 0;
+
+   pthread_mutex_lock(&runner->lock);
+   for (;;) {
+      while (!runner->quit && runner->generation == generation)
+	 pthread_cond_wait(&runner->work_cond, &runner->lock);
+
+      if (runner->quit)
+	 break;
+
+      generation = runner->generation;
+      pthread_mutex_unlock(&runner->lock);
+
+      worker_run(runner, worker);
+
+      pthread_mutex_lock(&runner->lock);
+      if (--runner->busy == 0)
+	 pthread_cond_signal(&runner->done_cond);
+   }
+   pthread_mutex_unlock(&runner->lock);
+
+   return NULL;
+}
+
+static unsigned
+num_cpus(void)
+{
+   long n = sysconf(_SC_NPROCESSORS_ONLN);
+   return n < 1 ? 1 : (unsigned) n;
+}
+
+nir_pass_runner *
+nir_pass_runner_create(unsigned num_threads)
+{
+   if (num_threads == 0)
+      num_threads = num_cpus();
+
+   nir_pass_runner *runner = ralloc(NULL, nir_pass_runner);
+   runner->num_threads = num_threads;
+   runner->threads = ralloc_array(runner, pthread_t, num_threads);
+   runner->workers = ralloc_array(runner, nir_pass_worker, num_threads);
+   runner->generation = 0;
+   runner->busy = 0;
+   runner->quit = false;
+   runner->num_impls = 0;
+
+   pthread_mutex_init(&runner->run_lock, NULL);
+   pthread_mutex_init(&runner->lock, NULL);
+   pthread_cond_init(&runner->work_cond, NULL);
+   pthread_cond_init(&runner->done_cond, NULL);
+
+   for (unsigned i = 0; i < num_threads; i++)
+      worker_init(&runner->workers[i], i, runner);
+
+   /* worker 0 is whoever starts the run, so it doesn't get a thread */
+   for (unsigned i = 1; i < num_threads; i++) {
+      thread_args *args = malloc(sizeof(*args));
+      args->runner = runner;
+      args->index = i;
+
+      if (pthread_create(&runner->threads[i], NULL, thread_main, args) != 0) {
+	 /* run with however many threads we managed to get */
+	 free(args);
+	 runner->num_threads = i;
+	 break;
+      }
+   }
+
+   return runner;
+}
+
+void
+nir_pass_runner_destroy(nir_pass_runner *runner)
+{
+   pthread_mutex_lock(&runner->lock);
+   runner->quit = true;
+   pthread_cond_broadcast(&runner->work_cond);
+   pthread_mutex_unlock(&runner->lock);
+
+   for (unsigned i = 1; i < runner->num_threads; i++)
+      pthread_join(runner->threads[i], NULL);
+
+   pthread_cond_destroy(&runner->done_cond);
+   pthread_cond_destroy(&runner->work_cond);
+   pthread_mutex_destroy(&runner->lock);
+   pthread_mutex_destroy(&runner->run_lock);
+
+   ralloc_free(runner);
+}
+
+static unsigned
+collect_impls(nir_shader *shader, void *mem_ctx, nir_function_impl ***impls)
+{
+   unsigned num_impls = 0;
+   nir_foreach_impl(shader, impl)
+      num_impls++;
+
+   *impls = ralloc_array(mem_ctx, nir_function_impl *, num_impls);
+
+   unsigned i = 0;
+   nir_foreach_impl(shader, impl)
+      (*impls)[i++] = impl;
+
+   return num_impls;
+}
+
+static bool
+run_serial(nir_function_impl **impls, unsigned num_impls,
+	   nir_impl_pass_cb cb, void *data, void *mem_ctx)
+{
+   bool progress = false;
+
+   nir_pass_worker worker;
+   worker_init(&worker, 0, mem_ctx);
+
+   for (unsigned i = 0; i < num_impls; i++) {
+      if (worker_run_impl(&worker, impls[i], i, cb, data))
+	 progress = true;
+   }
+
+   return progress;
+}
+
+bool
+nir_pass_runner_run(nir_pass_runner *runner, nir_shader *shader,
+		    nir_impl_pass_cb cb, void *data)
+{
+   void *mem_ctx = ralloc_context(NULL);
+
+   nir_function_impl **impls;
+   unsigned num_impls = collect_impls(shader, mem_ctx, &impls);
+
+   if (runner == NULL || runner->num_threads == 1 || num_impls <= 1 ||
+       in_pass_runner) {
+      bool progress = run_serial(impls, num_impls, cb, data, mem_ctx);
+      ralloc_free(mem_ctx);
+      return progress;
+   }
+
+   pthread_mutex_lock(&runner->run_lock);
+
+   runner->impls = impls;
+   runner->progress = rzalloc_array(mem_ctx, bool, num_impls);
+   runner->num_impls = num_impls;
+   runner->next_impl = 0;
+   runner->cb = cb;
+   runner->data = data;
+
+   pthread_mutex_lock(&runner->lock);
+   runner->generation++;
+   runner->busy = runner->num_threads - 1;
+   pthread_cond_broadcast(&runner->work_cond);
+   pthread_mutex_unlock(&runner->lock);
+
+   worker_run(runner, &runner->workers[0]);
+
+   pthread_mutex_lock(&runner->lock);
+   while (runner->busy != 0)
+      pthread_cond_wait(&runner->done_cond, &runner->lock);
+   pthread_mutex_unlock(&runner->lock);
+
+   bool progress = false;
+   for (unsigned i = 0; i < num_impls; i++) {
+      if (runner->progress[i])
+	 progress = true;
+   }
+
+   /* throw away this run's scratch memory */
+   for (unsigned i = 0; i < runner->num_threads; i++) {
+      ralloc_free(runner->workers[i].mem_ctx);
+      runner->workers[i].mem_ctx = ralloc_context(runner);
+   }
+
+   runner->impls = NULL;
+   runner->progress = NULL;
+   runner->num_impls = 0;
+
+   pthread_mutex_unlock(&runner->run_lock);
+
+   ralloc_free(mem_ctx);
+   return progress;
+}
+
+/* NULL unless the application asked for one, so that no threads are
+ * started behind its back
+ */
+static nir_pass_runner *default_runner;
+
+void
+nir_set_default_pass_runner(nir_pass_runner *runner)
+{
+   __atomic_store_n(&default_runner, runner, __ATOMIC_RELEASE);
+}
+
+bool
+nir_shader_foreach_impl_parallel(nir_shader *shader, nir_impl_pass_cb cb,
+				 void *data)
+{
+   nir_pass_runner *runner = __atomic_load_n(&default_runner,
+					     __ATOMIC_ACQUIRE);
+   return nir_pass_runner_run(runner, shader, cb, data);
+}
@@ -27,17 +27,228 @@
 
 #include "nir.h"
 #include <stdio.h>
-#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Everything is printed into a growable buffer, which is then either handed
+ * out as a string or written out with a single fwrite(). Numbers are
+ * formatted by hand rather than going through the printf machinery for
+ * every token.
+ */
+
+typedef struct {
+   void *mem_ctx;
+   char *data; /** < not NUL-terminated until the end */
+   size_t len, size;
+} print_buffer;
+
+static void
+buf_init(print_buffer *buf, void *mem_ctx)
+{
+   buf->mem_ctx = mem_ctx;
+   buf->size = 4096;
+   buf->len = 0;
+   buf->data = ralloc_size(mem_ctx, buf->size);
+}
+
+/* makes room for n more bytes */
+static inline void
+buf_reserve(print_buffer *buf, size_t n)
+{
+   if (buf->len + n <= buf->size)
+      return;
+   
+   while (buf->len + n > buf->size)
+      buf->size *= 2;
+   
+   buf->data = reralloc_size(buf->mem_ctx, buf->data, buf->size);
+}
+
+static inline void
+buf_putc(print_buffer *buf, char c)
+{
+   buf_reserve(buf, 1);
+   buf->data[buf->len++] = c;
+}
+
+static inline void
+buf_write(print_buffer *buf, const char *str, size_t len)
+{
+   buf_reserve(buf, len);
+   memcpy(buf->data + buf->len, str, len);
+   buf->len += len;
+}
+
+static inline void
+buf_puts(print_buffer *buf, const char *str)
+{
+   buf_write(buf, str, strlen(str));
+}
+
+static void
+buf_put_uint64(print_buffer *buf, uint64_t value)
+{
+   char digits[20];
+   unsigned n = 0;
+   
+   do {
+      digits[n++] = '0' + value % 10;
+      value /= 10;
+   } while (value != 0);
+   
+   buf_reserve(buf, n);
+   while (n > 0)
+      buf->data[buf->len++] = digits[--n];
+}
+
+static void
+buf_put_uint(print_buffer *buf, unsigned value)
+{
+   buf_put_uint64(buf, value);
+}
+
+/* like "%08x" */
+static void
+buf_put_hex32(print_buffer *buf, uint32_t value)
+{
+   buf_reserve(buf, 8);
+   for (int shift = 28; shift >= 0; shift -= 4)
+      buf->data[buf->len++] = "0123456789abcdef"[(value >> shift) & 0xf];
+}
+
+/*
+ * Prints the same thing as "%f". A float is mant * 2^exp with a 24-bit
+ * mantissa, so as long as the value is below 2^32 the integer part fits in
+ * 32 bits and six digits of the fraction can be computed exactly in 64-bit
+ * integers, rounding to even like printf() does. Anything else (huge values,
+ * infinities and NaNs) is rare enough to leave to snprintf().
+ */
+static void
+buf_put_float(print_buffer *buf, float value)
+{
+   union { float f; uint32_t u; } bits = { value };
+   
+   unsigned biased_exp = (bits.u >> 23) & 0xff;
+   uint64_t mant = bits.u & 0x7fffff;
+   int exp;
+   
+   if (biased_exp == 0) {
+      exp = -149; /* denormal */
+   } else {
+      mant |= 0x800000;
+      exp = (int) biased_exp - 150;
+   }
+   
+   if (biased_exp == 0xff || exp > 8) {
+      char str[64];
+      int len = snprintf(str, sizeof(str), "%f", value);
+      buf_write(buf, str, len);
+      return;
+   }
+   
+   if (bits.u >> 31)
+      buf_putc(buf, '-');
+   
+   uint64_t int_part, frac = 0;
+   
+   if (exp >= 0) {
+      int_part = mant << exp;
+   } else if (-exp >= 64) {
+      /* below 2^-40, which always rounds down to 0 */
+      int_part = 0;
+   } else {
+      unsigned frac_bits = -exp;
+      int_part = mant >> frac_bits;
+      
+      uint64_t scaled = (mant & ((UINT64_C(1) << frac_bits) - 1)) * 1000000;
+      uint64_t rem = scaled & ((UINT64_C(1) << frac_bits) - 1);
+      uint64_t half = UINT64_C(1) << (frac_bits - 1);
+      frac = scaled >> frac_bits;
+      
+      if (rem > half || (rem == half && (frac & 1)))
+	 frac++;
+      
+      if (frac == 1000000) {
+	 frac = 0;
+	 int_part++;
+      }
+   }
+   
+   buf_put_uint64(buf, int_part);
+   
+   buf_reserve(buf, 7);
+   buf->data[buf->len++] = '.';
+   for (unsigned i = 0, div = 100000; i < 6; i++, div /= 10)
+      buf->data[buf->len++] = '0' + (frac / div) % 10;
+}
 
 static void
-print_tabs(unsigned num_tabs, FILE *fp)
+print_tabs(unsigned num_tabs, print_buffer *buf)
 {
-   for (unsigned i = 0; i < num_tabs; i++)
-      fprintf(fp, "\t");
+   buf_reserve(buf, num_tabs);
+   memset(buf->data + buf->len, '\t', num_tabs);
+   buf->len += num_tabs;
+}
+
+/* prints "name " as a comment, if there is one */
+static void
+print_name(const char *name, print_buffer *buf)
+{
+   if (name == NULL)
+      return;
+   
+   buf_puts(buf, "/* ");
+   buf_puts(buf, name);
+   buf_puts(buf, " */ ");
+}
+
+/* same as glsl_print_type() */
+static void
+print_type(const struct glsl_type *type, print_buffer *buf)
+{
+   if (glsl_type_is_array(type)) {
+      print_type(glsl_get_array_element(type), buf);
+      buf_putc(buf, '[');
+      buf_put_uint(buf, glsl_get_length(type));
+      buf_putc(buf, ']');
+      return;
+   }
+   
+   const char *name = glsl_get_type_name(type);
+   buf_puts(buf, name);
+   
+   /* anonymous and user structures may share names, so add the address */
+   if (glsl_type_is_struct(type) && strncmp(name, "gl_", 3) != 0) {
+      char str[32];
+      int len = snprintf(str, sizeof(str), "@%p", (void *) type);
+      buf_write(buf, str, len);
+   }
+}
+
+/* same as glsl_print_struct() */
+static void
+print_struct(const struct glsl_type *type, print_buffer *buf)
+{
+   assert(glsl_type_is_struct(type));
+   
+   buf_puts(buf, "struct {\n");
+   for (unsigned i = 0; i < glsl_get_length(type); i++) {
+      buf_putc(buf, '\t');
+      print_type(glsl_get_struct_elem_type(type, i), buf);
+      buf_putc(buf, ' ');
+      buf_puts(buf, glsl_get_struct_elem_name(type, i));
+      buf_puts(buf, ";\n");
+   }
+   buf_puts(buf, "}\n");
 }
 
 typedef struct {
-   /** map from nir_variable -> printable name */
+   void *mem_ctx;
+   
+   /**
+    * map from nir_variable -> printable name, created along with syms when
+    * the first variable is declared
+    */
    struct hash_table *ht;
    
    /** set of names used so far for nir_variables */
@@ -45,161 +256,175 @@ typedef struct {
    
    /* an index used to make new non-conflicting names */
    unsigned index;
-} print_var_state;
+   
+   /* scratch array for sorting the predecessors of a block */
+   nir_block **preds;
+   unsigned preds_size;
+} print_state;
 
 static const char *sizes[] = { "error", "vec1", "vec2", "vec3", "vec4" };
 
 static void
-print_register_decl(nir_register *reg, FILE *fp)
+print_register_decl(nir_register *reg, print_buffer *buf)
 {  
-   fprintf(fp, "decl_reg %s r%u", sizes[reg->num_components], reg->index);
-   if (reg->num_array_elems != 0)
-      fprintf(fp, "[%u]", reg->num_array_elems);
-   fprintf(fp, "\n");
+   buf_puts(buf, "decl_reg ");
+   buf_puts(buf, sizes[reg->num_components]);
+   buf_puts(buf, " r");
+   buf_put_uint(buf, reg->index);
+   if (reg->num_array_elems != 0) {
+      buf_putc(buf, '[');
+      buf_put_uint(buf, reg->num_array_elems);
+      buf_putc(buf, ']');
+   }
+   buf_putc(buf, '\n');
 }
 
 static void
-print_register(nir_register *reg, FILE *fp)
+print_register(nir_register *reg, print_buffer *buf)
 {
-   if (reg->name != NULL)
-      fprintf(fp, "/* %s */ ", reg->name);
-   fprintf(fp, "r%u", reg->index);
+   print_name(reg->name, buf);
+   buf_putc(buf, 'r');
+   buf_put_uint(buf, reg->index);
 }
 
 static void
-print_ssa_def(nir_ssa_def *def, FILE *fp)
+print_ssa_def(nir_ssa_def *def, print_buffer *buf)
 {
-   if (def->name != NULL)
-      fprintf(fp, "/* %s */ ", def->name);
-   fprintf(fp, "%s ssa_%u", sizes[def->num_components], def->index);
+   print_name(def->name, buf);
+   buf_puts(buf, sizes[def->num_components]);
+   buf_puts(buf, " ssa_");
+   buf_put_uint(buf, def->index);
 }
 
 static void
-print_ssa_use(nir_ssa_def *def, FILE *fp)
+print_ssa_use(nir_ssa_def *def, print_buffer *buf)
 {
-   if (def->name != NULL)
-      fprintf(fp, "/* %s */ ", def->name);
-   fprintf(fp, "ssa_%u", def->index);
+   print_name(def->name, buf);
+   buf_puts(buf, "ssa_");
+   buf_put_uint(buf, def->index);
 }
 
-static void print_src(nir_src *src, FILE *fp);
+static void print_src(nir_src *src, print_buffer *buf);
 
 static void
-print_reg_src(nir_reg_src *src, FILE *fp)
+print_reg_src(nir_reg_src *src, print_buffer *buf)
 {
-   print_register(src->reg, fp);
+   print_register(src->reg, buf);
    if (src->base_offset != 0) {
-      fprintf(fp, "[%u", src->base_offset);
+      buf_putc(buf, '[');
+      buf_put_uint(buf, src->base_offset);
       if (src->indirect != NULL) {
-	 fprintf(fp, " + ");
-	 print_src(src->indirect, fp);
+	 buf_puts(buf, " + ");
+	 print_src(src->indirect, buf);
       }
-      fprintf(fp, "]");
+      buf_putc(buf, ']');
    }
 }
 
 static void
-print_reg_dest(nir_reg_dest *dest, FILE *fp)
+print_reg_dest(nir_reg_dest *dest, print_buffer *buf)
 {
-   print_register(dest->reg, fp);
+   print_register(dest->reg, buf);
    if (dest->base_offset != 0) {
-      fprintf(fp, "[%u", dest->base_offset);
+      buf_putc(buf, '[');
+      buf_put_uint(buf, dest->base_offset);
       if (dest->indirect != NULL) {
-	 fprintf(fp, " + ");
-	 print_src(dest->indirect, fp);
+	 buf_puts(buf, " + ");
+	 print_src(dest->indirect, buf);
       }
-      fprintf(fp, "]");
+      buf_putc(buf, ']');
    }
 }
 
 static void
-print_src(nir_src *src, FILE *fp)
+print_src(nir_src *src, print_buffer *buf)
 {
    if (src->is_ssa)
-      print_ssa_use(src->ssa, fp);
+      print_ssa_use(src->ssa, buf);
    else
-      print_reg_src(&src->reg, fp);
+      print_reg_src(&src->reg, buf);
 }
 
 static void
-print_dest(nir_dest *dest, FILE *fp)
+print_dest(nir_dest *dest, print_buffer *buf)
 {
    if (dest->is_ssa)
-      print_ssa_def(&dest->ssa, fp);
+      print_ssa_def(&dest->ssa, buf);
    else
-      print_reg_dest(&dest->reg, fp);
+      print_reg_dest(&dest->reg, buf);
 }
 
 static void
-print_alu_src(nir_alu_src *src, FILE *fp)
+print_alu_src(nir_alu_src *src, print_buffer *buf)
 {
    if (src->negate)
-      fprintf(fp, "-");
+      buf_putc(buf, '-');
    if (src->abs)
-      fprintf(fp, "abs(");
+      buf_puts(buf, "abs(");
    
-   print_src(&src->src, fp);
+   print_src(&src->src, buf);
    
    if (src->swizzle[0] != 0 ||
        src->swizzle[1] != 1 ||
        src->swizzle[2] != 2 ||
        src->swizzle[3] != 3) {
-      fprintf(fp, ".");
+      buf_putc(buf, '.');
       for (unsigned i = 0; i < 4; i++)
-	 fprintf(fp, "%c", "xyzw"[src->swizzle[i]]);
+	 buf_putc(buf, "xyzw"[src->swizzle[i]]);
    }
    
    if (src->abs)
-      fprintf(fp, ")");
+      buf_putc(buf, ')');
 }
 
 static void
-print_alu_dest(nir_alu_dest *dest, FILE *fp)
+print_alu_dest(nir_alu_dest *dest, print_buffer *buf)
 {
    /* we're going to print the saturate modifier later, after the opcode */
    
-   print_dest(&dest->dest, fp);
+   print_dest(&dest->dest, buf);
    
    if (!dest->dest.is_ssa &&
        dest->write_mask != (1 << dest->dest.reg.reg->num_components) - 1) {
-      fprintf(fp, ".");
+      buf_putc(buf, '.');
       for (unsigned i = 0; i < 4; i++)
 	 if ((dest->write_mask >> i) & 1)
-	    fprintf(fp, "%c", "xyzw"[i]);
+	    buf_putc(buf, "xyzw"[i]);
    }
 }
 
 static void
-print_alu_instr(nir_alu_instr *instr, FILE *fp)
+print_alu_instr(nir_alu_instr *instr, print_buffer *buf)
 {
    if (instr->has_predicate) {
-      fprintf(fp, "(");
-      print_src(&instr->predicate, fp);
-      fprintf(fp, ") ");
+      buf_putc(buf, '(');
+      print_src(&instr->predicate, buf);
+      buf_puts(buf, ") ");
    }
    
-   print_alu_dest(&instr->dest, fp);
+   print_alu_dest(&instr->dest, buf);
    
-   fprintf(fp, " = %s", nir_op_infos[instr->op].name);
+   buf_puts(buf, " = ");
+   buf_puts(buf, nir_op_infos[instr->op].name);
    if (instr->dest.saturate)
-      fprintf(fp, ".sat");
-   fprintf(fp, " ");
+      buf_puts(buf, ".sat");
+   buf_putc(buf, ' ');
    
    bool first = true;
    for (unsigned i = 0; i < nir_op_infos[instr->op].num_inputs; i++) {
       if (!first)
-	 fprintf(fp, ", ");
+	 buf_puts(buf, ", ");
       
-      print_alu_src(&instr->src[i], fp);
+      print_alu_src(&instr->src[i], buf);
       
       first = false;
    }
 }
 
 static void
-print_var_decl(nir_variable *var, print_var_state *state, FILE *fp)
+print_var_decl(nir_variable *var, print_state *state, print_buffer *buf)
 {
-   fprintf(fp, "decl_var ");
+   buf_puts(buf, "decl_var ");
    
    const char *const cent = (var->data.centroid) ? "centroid " : "";
    const char *const samp = (var->data.sample) ? "sample " : "";
@@ -208,10 +433,21 @@ print_var_decl(nir_variable *var, print_var_state *state, FILE *fp)
 				"uniform " };
    const char *const interp[] = { "", "smooth", "flat", "noperspective" };
    
-   fprintf(fp, "%s%s%s%s%s ",
-      cent, samp, inv, mode[var->data.mode], interp[var->data.interpolation]);
+   buf_puts(buf, cent);
+   buf_puts(buf, samp);
+   buf_puts(buf, inv);
+   buf_puts(buf, mode[var->data.mode]);
+   buf_puts(buf, interp[var->data.interpolation]);
+   buf_putc(buf, ' ');
+   
+   print_type(var->type, buf);
    
-   glsl_print_type(var->type, fp);
+   if (state->ht == NULL) {
+      state->ht = _mesa_hash_table_create(state->mem_ctx,
+					  _mesa_key_pointer_equal);
+      state->syms = _mesa_hash_table_create(state->mem_ctx,
+					    _mesa_key_string_equal);
+   }
    
    struct hash_entry *entry =
       _mesa_hash_table_search(state->syms, _mesa_hash_string(var->name),
@@ -226,58 +462,60 @@ print_var_decl(nir_variable *var, print_var_state *state, FILE *fp)
       name = var->name;
    }
    
-   fprintf(fp, "%s\n", name);
+   buf_puts(buf, name);
+   buf_putc(buf, '\n');
    
    _mesa_hash_table_insert(state->syms, _mesa_hash_string(name), name, name);
    _mesa_hash_table_insert(state->ht, _mesa_hash_pointer(var), var, name);
 }
 
 static void
-print_var(nir_variable *var, print_var_state *state, FILE *fp)
+print_var(nir_variable *var, print_state *state, print_buffer *buf)
 {
    struct hash_entry *entry =
       _mesa_hash_table_search(state->ht, _mesa_hash_pointer(var), var);
    
    assert(entry != NULL);
    
-   fprintf(fp, "%s", (char *) entry->data);
+   buf_puts(buf, (char *) entry->data);
 }
 
 static void
-print_deref_var(nir_deref_var *deref, print_var_state *state, FILE *fp)
+print_deref_var(nir_deref_var *deref, print_state *state, print_buffer *buf)
 {
-   print_var(deref->var, state, fp);
+   print_var(deref->var, state, buf);
 }
 
 static void
-print_deref_array(nir_deref_array *deref, print_var_state *state, FILE *fp)
+print_deref_array(nir_deref_array *deref, print_state *state, print_buffer *buf)
 {
-   fprintf(fp, "[");
-   print_src(&deref->offset, fp);
-   fprintf(fp, "]");
+   buf_putc(buf, '[');
+   print_src(&deref->offset, buf);
+   buf_putc(buf, ']');
 }
 
 static void
-print_deref_struct(nir_deref_struct *deref, print_var_state *state, FILE *fp)
+print_deref_struct(nir_deref_struct *deref, print_state *state, print_buffer *buf)
 {
-   fprintf(fp, ".%s", deref->elem);
+   buf_putc(buf, '.');
+   buf_puts(buf, deref->elem);
 }
 
 static void
-print_deref(nir_deref *deref, print_var_state *state, FILE *fp)
+print_deref(nir_deref *deref, print_state *state, print_buffer *buf)
 {
    while (deref != NULL) {
       switch (deref->deref_type) {
 	 case nir_deref_type_var:
-	    print_deref_var(nir_deref_as_var(deref), state, fp);
+	    print_deref_var(nir_deref_as_var(deref), state, buf);
 	    break;
 	    
 	 case nir_deref_type_array:
-	    print_deref_array(nir_deref_as_array(deref), state, fp);
+	    print_deref_array(nir_deref_as_array(deref), state, buf);
 	    break;
 	    
 	 case nir_deref_type_struct:
-	    print_deref_struct(nir_deref_as_struct(deref), state, fp);
+	    print_deref_struct(nir_deref_as_struct(deref), state, buf);
 	    break;
 	    
 	 default:
@@ -290,108 +528,110 @@ print_deref(nir_deref *deref, print_var_state *state, FILE *fp)
 }
 
 static void
-print_intrinsic_instr(nir_intrinsic_instr *instr, print_var_state *state,
-		      FILE *fp)
+print_intrinsic_instr(nir_intrinsic_instr *instr, print_state *state,
+		      print_buffer *buf)
 {
    unsigned num_srcs = nir_intrinsic_infos[instr->intrinsic].num_srcs;
    
    if (instr->has_predicate) {
-      fprintf(fp, "(");
-      print_src(&instr->predicate, fp);
-      fprintf(fp, ") ");
+      buf_putc(buf, '(');
+      print_src(&instr->predicate, buf);
+      buf_puts(buf, ") ");
    }
    
    if (nir_intrinsic_infos[instr->intrinsic].has_dest) {
-      print_dest(&instr->dest, fp);
-      fprintf(fp, " = ");
+      print_dest(&instr->dest, buf);
+      buf_puts(buf, " = ");
    }
    
-   fprintf(fp, "instrinsic %s (", nir_intrinsic_infos[instr->intrinsic].name);
+   buf_puts(buf, "instrinsic ");
+   buf_puts(buf, nir_intrinsic_infos[instr->intrinsic].name);
+   buf_puts(buf, " (");
    
    bool first = true;
    for (unsigned i = 0; i < num_srcs; i++) {
       if (!first)
-	 fprintf(fp, ", ");
+	 buf_puts(buf, ", ");
       
-      print_src(&instr->src[i], fp);
+      print_src(&instr->src[i], buf);
       
       first = false;
    }
    
-   fprintf(fp, ") (");
+   buf_puts(buf, ") (");
    
    unsigned num_vars = nir_intrinsic_infos[instr->intrinsic].num_variables;
    
    first = true;
    for (unsigned i = 0; i < num_vars; i++) {
       if (!first)
-	 fprintf(fp, ", ");
+	 buf_puts(buf, ", ");
       
-      print_deref(&instr->variables[i]->deref, state, fp);
+      print_deref(&instr->variables[i]->deref, state, buf);
       
       first = false;
    }
    
-   fprintf(fp, ") (");
+   buf_puts(buf, ") (");
    
    unsigned num_indices = nir_intrinsic_infos[instr->intrinsic].num_indices;
    
    first = true;
    for (unsigned i = 0; i < num_indices; i++) {
       if (!first)
-	 fprintf(fp, ", ");
+	 buf_puts(buf, ", ");
       
-      fprintf(fp, "%u", instr->const_index[i]);
+      buf_put_uint(buf, instr->const_index[i]);
       
       first = false;
    }
    
-   fprintf(fp, ")");
+   buf_putc(buf, ')');
 }
 
 static void
-print_tex_instr(nir_tex_instr *instr, print_var_state *state, FILE *fp)
+print_tex_instr(nir_tex_instr *instr, print_state *state, print_buffer *buf)
 {
    if (instr->has_predicate) {
-      fprintf(fp, "(");
-      print_src(&instr->predicate, fp);
-      fprintf(fp, ") ");
+      buf_putc(buf, '(');
+      print_src(&instr->predicate, buf);
+      buf_puts(buf, ") ");
    }
    
-   print_dest(&instr->dest, fp);
+   print_dest(&instr->dest, buf);
    
-   fprintf(fp, " = ");
+   buf_puts(buf, " = ");
    
    switch (instr->op) {
       case nir_texop_tex:
-	 fprintf(fp, "tex ");
+	 buf_puts(buf, "tex ");
 	 break;
       case nir_texop_txb:
-	 fprintf(fp, "txb ");
+	 buf_puts(buf, "txb ");
 	 break;
       case nir_texop_txl:
-	 fprintf(fp, "txl ");
+	 buf_puts(buf, "txl ");
 	 break;
       case nir_texop_txd:
-	 fprintf(fp, "txd ");
+	 buf_puts(buf, "txd ");
 	 break;
       case nir_texop_txf:
-	 fprintf(fp, "txf ");
+	 buf_puts(buf, "txf ");
 	 break;
       case nir_texop_txf_ms:
-	 fprintf(fp, "txf_ms ");
+	 buf_puts(buf, "txf_ms ");
 	 break;
       case nir_texop_txs:
-	 fprintf(fp, "txs ");
+	 buf_puts(buf, "txs ");
 	 break;
       case nir_texop_lod:
-	 fprintf(fp, "lod ");
+	 buf_puts(buf, "lod ");
 	 break;
       case nir_texop_tg4:
-	 fprintf(fp, "tg4 ");
+	 buf_puts(buf, "tg4 ");
 	 break;
       case nir_texop_query_levels:
-	 fprintf(fp, "query_levels ");
+	 buf_puts(buf, "query_levels ");
 	 
       default:
 	 assert(0);
@@ -399,40 +639,43 @@ print_tex_instr(nir_tex_instr *instr, print_var_state *state, FILE *fp)
    }
    
    for (unsigned i = 0; i < instr->num_srcs; i++) {
-      print_src(&instr->src[i], fp);
+      print_src(&instr->src[i], buf);
       
-      fprintf(fp, " ");
+      buf_putc(buf, ' ');
       
       switch(instr->src_type[i]) {
 	 case nir_tex_src_coord:
-	    fprintf(fp, "(coord)");
+	    buf_puts(buf, "(coord)");
 	    break;
 	 case nir_tex_src_projector:
-	    fprintf(fp, "(projector)");
+	    buf_puts(buf, "(projector)");
 	    break;
 	 case nir_tex_src_shadow:
-	    fprintf(fp, "(shadow)");
+	    buf_puts(buf, "(shadow)");
 	    break;
 	 case nir_tex_src_offset:
-	    fprintf(fp, "(offset)");
+	    buf_puts(buf, "(offset)");
 	    break;
 	 case nir_tex_src_bias:
-	    fprintf(fp, "(bias)");
+	    buf_puts(buf, "(bias)");
+	    break;
+	 case nir_tex_src_lod:
+	    buf_puts(buf, "(lod)");
 	    break;
 	 case nir_tex_src_ms_index:
-	    fprintf(fp, "(ms_index)");
+	    buf_puts(buf, "(ms_index)");
 	    break;
 	 case nir_tex_src_gather_component:
-	    fprintf(fp, "(gather_component)");
+	    buf_puts(buf, "(gather_component)");
 	    break;
 	 case nir_tex_src_ddx:
-	    fprintf(fp, "(ddx)");
+	    buf_puts(buf, "(ddx)");
 	    break;
 	 case nir_tex_src_ddy:
-	    fprintf(fp, "(ddy)");
+	    buf_puts(buf, "(ddy)");
 	    break;
 	 case nir_tex_src_sampler_index:
-	    fprintf(fp, "(sampler_index)");
+	    buf_puts(buf, "(sampler_index)");
 	    break;
 	    
 	 default:
@@ -440,53 +683,55 @@ print_tex_instr(nir_tex_instr *instr, print_var_state *state, FILE *fp)
 	    break;
       }
       
-      fprintf(fp, ", ");
+      buf_puts(buf, ", ");
    }
    
    if (instr->sampler) {
-      print_deref(&instr->sampler->deref, state, fp);
+      print_deref(&instr->sampler->deref, state, buf);
    } else {
-      fprintf(fp, "%u", instr->sampler_index);
+      buf_put_uint(buf, instr->sampler_index);
    }
    
-   fprintf(fp, "(sampler)");
+   buf_puts(buf, "(sampler)");
 }
 
 static void
-print_call_instr(nir_call_instr *instr, print_var_state *state, FILE *fp)
+print_call_instr(nir_call_instr *instr, print_state *state, print_buffer *buf)
 {
    if (instr->has_predicate) {
-      fprintf(fp, "(");
-      print_src(&instr->predicate, fp);
-      fprintf(fp, ") ");
+      buf_putc(buf, '(');
+      print_src(&instr->predicate, buf);
+      buf_puts(buf, ") ");
    }
    
-   fprintf(fp, "call %s ", instr->callee->function->name);
+   buf_puts(buf, "call ");
+   buf_puts(buf, instr->callee->function->name);
+   buf_putc(buf, ' ');
    
    for (unsigned i = 0; i < instr->num_params; i++) {
       if (i != 0)
-	 fprintf(fp, ", ");
+	 buf_puts(buf, ", ");
       
-      print_var(instr->params[i], state, fp);
+      print_var(instr->params[i], state, buf);
    }
    
    if (instr->return_var != NULL) {
       if (instr->num_params != 0)
-	 fprintf(fp, ", ");
-      fprintf(fp, "returning ");
-      print_var(instr->return_var, state, fp);
+	 buf_puts(buf, ", ");
+      buf_puts(buf, "returning ");
+      print_var(instr->return_var, state, buf);
    }
 }
 
 static void
-print_const_value(nir_const_value value, unsigned num_components, FILE *fp)
+print_const_value(nir_const_value value, unsigned num_components, print_buffer *buf)
 {
-   fprintf(fp, "(");
+   buf_putc(buf, '(');
    
    bool first = true;
    for (unsigned i = 0; i < num_components; i++) {
       if (!first)
-	 fprintf(fp, ", ");
+	 buf_puts(buf, ", ");
       
       /*
        * we don't really know the type of the constant (if it will be used as a
@@ -494,233 +739,247 @@ print_const_value(nir_const_value value, unsigned num_components, FILE *fp)
        * and then print the float in a comment for readability.
        */
       
-      fprintf(fp, "0x%08x /* %f */", value.u[i], value.f[i]);
+      buf_puts(buf, "0x");
+      buf_put_hex32(buf, value.u[i]);
+      buf_puts(buf, " /* ");
+      buf_put_float(buf, value.f[i]);
+      buf_puts(buf, " */");
       
       first = false;
    }
    
-   fprintf(fp, ")");
+   buf_putc(buf, ')');
 }
 
 static void
-print_load_const_instr(nir_load_const_instr *instr, unsigned tabs, FILE *fp)
+print_load_const_instr(nir_load_const_instr *instr, unsigned tabs, print_buffer *buf)
 {
    if (instr->has_predicate) {
-      fprintf(fp, "(");
-      print_src(&instr->predicate, fp);
-      fprintf(fp, ") ");
+      buf_putc(buf, '(');
+      print_src(&instr->predicate, buf);
+      buf_puts(buf, ") ");
    }
    
-   print_dest(&instr->dest, fp);
+   print_dest(&instr->dest, buf);
    
-   fprintf(fp, " = load_const ");
+   buf_puts(buf, " = load_const ");
    
    unsigned num_components =
       instr->dest.is_ssa ? instr->dest.ssa.num_components :
 			   instr->dest.reg.reg->num_components;
    
    if (instr->array_elems == 0) {
-      print_const_value(instr->value, num_components, fp);
+      print_const_value(instr->value, num_components, buf);
    } else {
-      fprintf(fp, "{\n");
+      buf_puts(buf, "{\n");
       for (unsigned i = 0; i < instr->array_elems; i++) {
-	 print_tabs(tabs + 1, fp);
-	 print_const_value(instr->array[i], num_components, fp);
-	 fprintf(fp, ", \n");
+	 print_tabs(tabs + 1, buf);
+	 print_const_value(instr->array[i], num_components, buf);
+	 buf_puts(buf, ", \n");
       }
-      fprintf(fp, "}");
+      buf_putc(buf, '}');
    }
 }
 
 static void
-print_jump_instr(nir_jump_instr *instr, FILE *fp)
+print_jump_instr(nir_jump_instr *instr, print_buffer *buf)
 {
    switch (instr->type) {
       case nir_jump_break:
-	 fprintf(fp, "break");
+	 buf_puts(buf, "break");
 	 break;
 	 
       case nir_jump_continue:
-	 fprintf(fp, "continue");
+	 buf_puts(buf, "continue");
 	 break;
 	 
       case nir_jump_return:
-	 fprintf(fp, "return");
+	 buf_puts(buf, "return");
 	 break;
    }
 }
 
 static void
-print_ssa_undef_instr(nir_ssa_undef_instr* instr, FILE *fp)
+print_ssa_undef_instr(nir_ssa_undef_instr* instr, print_buffer *buf)
 {
-   print_ssa_def(&instr->def, fp);
-   fprintf(fp, " = undefined");
+   print_ssa_def(&instr->def, buf);
+   buf_puts(buf, " = undefined");
 }
 
 static void
-print_phi_instr(nir_phi_instr *instr, FILE *fp)
+print_phi_instr(nir_phi_instr *instr, print_buffer *buf)
 {
-   print_dest(&instr->dest, fp);
-   fprintf(fp, " = phi ");
+   print_dest(&instr->dest, buf);
+   buf_puts(buf, " = phi ");
    bool first = true;
    foreach_list_typed(nir_phi_src, src, node, &instr->srcs) {
       if (!first)
-	 fprintf(fp, ", ");
+	 buf_puts(buf, ", ");
       
-      fprintf(fp, "block_%u: ", src->pred->index);
-      print_src(&src->src, fp);
+      buf_puts(buf, "block_");
+      buf_put_uint(buf, src->pred->index);
+      buf_puts(buf, ": ");
+      print_src(&src->src, buf);
       
       first = false;
    }
 }
 
 static void
-print_instr(nir_instr *instr, print_var_state *state, unsigned tabs, FILE *fp)
+print_instr(nir_instr *instr, print_state *state, unsigned tabs, print_buffer *buf)
 {
-   print_tabs(tabs, fp);
+   print_tabs(tabs, buf);
    
    switch (instr->type) {
       case nir_instr_type_alu:
-	 print_alu_instr(nir_instr_as_alu(instr), fp);
+	 print_alu_instr(nir_instr_as_alu(instr), buf);
 	 break;
 	 
       case nir_instr_type_call:
-	 print_call_instr(nir_instr_as_call(instr), state, fp);
+	 print_call_instr(nir_instr_as_call(instr), state, buf);
 	 break;
 	 
       case nir_instr_type_intrinsic:
-	 print_intrinsic_instr(nir_instr_as_intrinsic(instr), state, fp);
+	 print_intrinsic_instr(nir_instr_as_intrinsic(instr), state, buf);
 	 break;
 	 
       case nir_instr_type_texture:
-	 print_tex_instr(nir_instr_as_texture(instr), state, fp);
+	 print_tex_instr(nir_instr_as_texture(instr), state, buf);
 	 break;
 	 
       case nir_instr_type_load_const:
-	 print_load_const_instr(nir_instr_as_load_const(instr), tabs, fp);
+	 print_load_const_instr(nir_instr_as_load_const(instr), tabs, buf);
 	 break;
 	 
       case nir_instr_type_jump:
-	 print_jump_instr(nir_instr_as_jump(instr), fp);
+	 print_jump_instr(nir_instr_as_jump(instr), buf);
 	 break;
 	 
       case nir_instr_type_ssa_undef:
-	 print_ssa_undef_instr(nir_instr_as_ssa_undef(instr), fp);
+	 print_ssa_undef_instr(nir_instr_as_ssa_undef(instr), buf);
 	 break;
 	 
       case nir_instr_type_phi:
-	 print_phi_instr(nir_instr_as_phi(instr), fp);
+	 print_phi_instr(nir_instr_as_phi(instr), buf);
 	 break;
 	 
       default:
 	 assert(0);
-	 fprintf(fp, "error");
+	 buf_puts(buf, "error");
 	 break;
    }
    
-   fprintf(fp, "\n");
-}
-
-static int
-compare_block_index(const void *p1, const void *p2)
-{
-   const nir_block *block1 = *((const nir_block **) p1);
-   const nir_block *block2 = *((const nir_block **) p2);
-   
-   return (int) block1->index - (int) block2->index;
+   buf_putc(buf, '\n');
 }
 
-static void print_cf_node(nir_cf_node *node, print_var_state *state,
-			  unsigned tabs, FILE *fp);
+static void print_cf_node(nir_cf_node *node, print_state *state,
+			  unsigned tabs, print_buffer *buf);
 
 static void
-print_block(nir_block *block, print_var_state *state, unsigned tabs, FILE *fp)
+print_block(nir_block *block, print_state *state, unsigned tabs,
+	    print_buffer *buf)
 {
-   print_tabs(tabs, fp);
-   fprintf(fp, "block block_%u:\n", block->index);
-   
-   /* sort the predecessors by index so we consistently print the same thing */
-   
-   nir_block **preds =
-      malloc(block->predecessors->entries * sizeof(nir_block *));
+   print_tabs(tabs, buf);
+   buf_puts(buf, "block block_");
+   buf_put_uint(buf, block->index);
+   buf_puts(buf, ":\n");
+   
+   /*
+    * sort the predecessors by index so we consistently print the same thing.
+    * There are rarely more than a few, so an insertion sort does fine.
+    */
+   
+   unsigned num_preds = block->predecessors->entries;
+   if (num_preds > state->preds_size) {
+      state->preds_size = 2 * state->preds_size;
+      if (state->preds_size < num_preds)
+	 state->preds_size = num_preds;
+      state->preds = reralloc(state->mem_ctx, state->preds, nir_block *,
+			      state->preds_size);
+   }
+   nir_block **preds = state->preds;
    
-   struct hash_entry *entry;
+   struct set_entry *entry;
    unsigned i = 0;
-   hash_table_foreach(block->predecessors, entry) {
-      preds[i++] = (nir_block *) entry->data;
+   set_foreach(block->predecessors, entry) {
+      nir_block *pred = (nir_block *) entry->key;
+      
+      unsigned j = i++;
+      for (; j > 0 && preds[j - 1]->index > pred->index; j--)
+	 preds[j] = preds[j - 1];
+      preds[j] = pred;
    }
    
-   qsort(preds, block->predecessors->entries, sizeof(nir_block *),
-	 compare_block_index);
-   
-   print_tabs(tabs, fp);
-   fprintf(fp, "/* preds: ");
-   for (unsigned i = 0; i < block->predecessors->entries; i++) {
-      fprintf(fp, "block_%u ", preds[i]->index);
+   print_tabs(tabs, buf);
+   buf_puts(buf, "/* preds: ");
+   for (unsigned i = 0; i < num_preds; i++) {
+      buf_puts(buf, "block_");
+      buf_put_uint(buf, preds[i]->index);
+      buf_putc(buf, ' ');
    }
-   fprintf(fp, "*/\n");
-   
-   free(preds);
+   buf_puts(buf, "*/\n");
    
    nir_foreach_instr(block, instr) {
-      print_instr(instr, state, tabs, fp);
+      print_instr(instr, state, tabs, buf);
    }
    
-   print_tabs(tabs, fp);
-   fprintf(fp, "/* succs: ");
+   print_tabs(tabs, buf);
+   buf_puts(buf, "/* succs: ");
    for (unsigned i = 0; i < 2; i++)
       if (block->successors[i]) {
-	 fprintf(fp, "block_%u ", block->successors[i]->index);
+	 buf_puts(buf, "block_");
+	 buf_put_uint(buf, block->successors[i]->index);
+	 buf_putc(buf, ' ');
       }
-   fprintf(fp, "*/\n");
+   buf_puts(buf, "*/\n");
 }
 
 static void
-print_if(nir_if *if_stmt, print_var_state *state, unsigned tabs, FILE *fp)
+print_if(nir_if *if_stmt, print_state *state, unsigned tabs, print_buffer *buf)
 {
-   print_tabs(tabs, fp);
-   fprintf(fp, "if ");
-   print_src(&if_stmt->condition, fp);
-   fprintf(fp, " {\n");
+   print_tabs(tabs, buf);
+   buf_puts(buf, "if ");
+   print_src(&if_stmt->condition, buf);
+   buf_puts(buf, " {\n");
    foreach_list_typed(nir_cf_node, node, node, &if_stmt->then_list) {
-      print_cf_node(node, state, tabs + 1, fp);
+      print_cf_node(node, state, tabs + 1, buf);
    }
-   print_tabs(tabs, fp);
-   fprintf(fp, "} else {\n");
+   print_tabs(tabs, buf);
+   buf_puts(buf, "} else {\n");
    foreach_list_typed(nir_cf_node, node, node, &if_stmt->else_list) {
-      print_cf_node(node, state, tabs + 1, fp);
+      print_cf_node(node, state, tabs + 1, buf);
    }
-   print_tabs(tabs, fp);
-   fprintf(fp, "}\n");
+   print_tabs(tabs, buf);
+   buf_puts(buf, "}\n");
 }
 
 static void
-print_loop(nir_loop *loop, print_var_state *state, unsigned tabs, FILE *fp)
+print_loop(nir_loop *loop, print_state *state, unsigned tabs, print_buffer *buf)
 {
-   print_tabs(tabs, fp);
-   fprintf(fp, "loop {\n");
+   print_tabs(tabs, buf);
+   buf_puts(buf, "loop {\n");
    foreach_list_typed(nir_cf_node, node, node, &loop->body) {
-      print_cf_node(node, state, tabs + 1, fp);
+      print_cf_node(node, state, tabs + 1, buf);
    }
-   print_tabs(tabs, fp);
-   fprintf(fp, "}\n");
+   print_tabs(tabs, buf);
+   buf_puts(buf, "}\n");
 }
 
 static void
-print_cf_node(nir_cf_node *node, print_var_state *state, unsigned int tabs,
-	      FILE *fp)
+print_cf_node(nir_cf_node *node, print_state *state, unsigned int tabs,
+	      print_buffer *buf)
 {
    switch (node->type) {
       case nir_cf_node_block:
-	 print_block(nir_cf_node_as_block(node), state, tabs, fp);
+	 print_block(nir_cf_node_as_block(node), state, tabs, buf);
 	 break;
 	 
       case nir_cf_node_if:
-	 print_if(nir_cf_node_as_if(node), state, tabs, fp);
+	 print_if(nir_cf_node_as_if(node), state, tabs, buf);
 	 break;
 	 
       case nir_cf_node_loop:
-	 print_loop(nir_cf_node_as_loop(node), state, tabs, fp);
+	 print_loop(nir_cf_node_as_loop(node), state, tabs, buf);
 	 break;
 	 
       default:
@@ -730,151 +989,180 @@ print_cf_node(nir_cf_node *node, print_var_state *state, unsigned int tabs,
 }
 
 static void
-print_function_impl(nir_function_impl *impl, print_var_state *state, FILE *fp)
+print_function_impl(nir_function_impl *impl, print_state *state, print_buffer *buf)
 {
-   fprintf(fp, "\nimpl %s ", impl->overload->function->name);
+   buf_puts(buf, "\nimpl ");
+   buf_puts(buf, impl->overload->function->name);
+   buf_putc(buf, ' ');
    
    for (unsigned i = 0; i < impl->num_params; i++) {
       if (i != 0)
-	 fprintf(fp, ", ");
+	 buf_puts(buf, ", ");
       
-      print_var(impl->params[i], state, fp);
+      print_var(impl->params[i], state, buf);
    }
    
    if (impl->return_var != NULL) {
       if (impl->num_params != 0)
-	 fprintf(fp, ", ");
-      fprintf(fp, "returning ");
-      print_var(impl->return_var, state, fp);
+	 buf_puts(buf, ", ");
+      buf_puts(buf, "returning ");
+      print_var(impl->return_var, state, buf);
    }
    
-   fprintf(fp, "{\n");
+   buf_puts(buf, "{\n");
    
    foreach_list_typed(nir_variable, var, node, &impl->locals) {
-      fprintf(fp, "\t");
-      print_var_decl(var, state, fp);
+      buf_putc(buf, '\t');
+      print_var_decl(var, state, buf);
    }
    
    nir_index_local_regs(impl);
    
    foreach_list_typed(nir_register, reg, node, &impl->registers) {
-      fprintf(fp, "\t");
-      print_register_decl(reg, fp);
+      buf_putc(buf, '\t');
+      print_register_decl(reg, buf);
    }
    
    nir_index_blocks(impl);
    nir_index_ssa_defs(impl);
    
    foreach_list_typed(nir_cf_node, node, node, &impl->body) {
-      print_cf_node(node, state, 1, fp);
+      print_cf_node(node, state, 1, buf);
    }
    
-   fprintf(fp, "\tblock block_%u:\n}\n\n", impl->end_block->index);
+   buf_puts(buf, "\tblock block_");
+   buf_put_uint(buf, impl->end_block->index);
+   buf_puts(buf, ":\n}\n\n");
 }
 
 static void
 print_function_overload(nir_function_overload *overload,
-			print_var_state *state, FILE *fp)
+			print_state *state, print_buffer *buf)
 {
-   fprintf(fp, "decl_overload %s ", overload->function->name);
+   buf_puts(buf, "decl_overload ");
+   buf_puts(buf, overload->function->name);
+   buf_putc(buf, ' ');
    
    for (unsigned i = 0; i < overload->num_params; i++) {
       if (i != 0)
-	 fprintf(fp, ", ");
+	 buf_puts(buf, ", ");
       
       switch (overload->params[i].param_type) {
 	 case nir_parameter_in:
-	    fprintf(fp, "in ");
+	    buf_puts(buf, "in ");
 	    break;
 	 case nir_parameter_out:
-	    fprintf(fp, "out ");
+	    buf_puts(buf, "out ");
 	    break;
 	 case nir_parameter_inout:
-	    fprintf(fp, "inout ");
+	    buf_puts(buf, "inout ");
 	    break;
 	 default:
 	    assert(0);
 	    break;
       }
       
-      glsl_print_type(overload->params[i].type, fp);
+      print_type(overload->params[i].type, buf);
    }
    
    if (overload->return_type != NULL) {
       if (overload->num_params != 0)
-	 fprintf(fp, ", ");
-      fprintf(fp, "returning ");
-      glsl_print_type(overload->return_type, fp);
+	 buf_puts(buf, ", ");
+      buf_puts(buf, "returning ");
+      print_type(overload->return_type, buf);
    }
    
-   fprintf(fp, "\n");
+   buf_putc(buf, '\n');
    
    if (overload->impl != NULL) {
-      print_function_impl(overload->impl, state, fp);
+      print_function_impl(overload->impl, state, buf);
       return;
    }
 }
 
 static void
-print_function(nir_function *func, print_var_state *state, FILE *fp)
+print_function(nir_function *func, print_state *state, print_buffer *buf)
 {
    foreach_list_typed(nir_function_overload, overload, node, &func->overload_list) {
-      print_function_overload(overload, state, fp);
+      print_function_overload(overload, state, buf);
    }
 }
 
 static void
-init_print_state(print_var_state *state)
+init_print_state(print_state *state, void *mem_ctx)
 {
-   state->ht = _mesa_hash_table_create(NULL, _mesa_key_pointer_equal);
-   state->syms = _mesa_hash_table_create(NULL, _mesa_key_string_equal);
+   state->mem_ctx = mem_ctx;
+   state->ht = NULL;
+   state->syms = NULL;
    state->index = 0;
+   state->preds = NULL;
+   state->preds_size = 0;
 }
 
 static void
-destroy_print_state(print_var_state *state)
+print_shader(nir_shader *shader, print_buffer *buf, void *mem_ctx)
 {
-   _mesa_hash_table_destroy(state->ht, NULL);
-   _mesa_hash_table_destroy(state->syms, NULL);
-}
-
-void
-nir_print_shader(nir_shader *shader, FILE *fp)
-{
-   print_var_state state;
-   init_print_state(&state);
+   print_state state;
+   init_print_state(&state, mem_ctx);
    
    for (unsigned i = 0; i < shader->num_user_structures; i++) {
-      glsl_print_struct(shader->user_structures[i], fp);
+      print_struct(shader->user_structures[i], buf);
    }
    
    struct hash_entry *entry;
    
    hash_table_foreach(shader->uniforms, entry) {
-      print_var_decl((nir_variable *) entry->data, &state, fp);
+      print_var_decl((nir_variable *) entry->data, &state, buf);
    }
    
    hash_table_foreach(shader->inputs, entry) {
-      print_var_decl((nir_variable *) entry->data, &state, fp);
+      print_var_decl((nir_variable *) entry->data, &state, buf);
    }
    
    hash_table_foreach(shader->outputs, entry) {
-      print_var_decl((nir_variable *) entry->data, &state, fp);
+      print_var_decl((nir_variable *) entry->data, &state, buf);
    }
    
    hash_table_foreach(shader->globals, entry) {
-      print_var_decl((nir_variable *) entry->data, &state, fp);
+      print_var_decl((nir_variable *) entry->data, &state, buf);
    }
    
    nir_index_global_regs(shader);
    
    foreach_list_typed(nir_register, reg, node, &shader->registers) {
-      print_register_decl(reg, fp);
+      print_register_decl(reg, buf);
    }
    
    foreach_list_typed(nir_function, func, node, &shader->functions) {
-      print_function(func, &state, fp);
+      print_function(func, &state, buf);
    }
+}
+
+void
+nir_print_shader(nir_shader *shader, FILE *fp)
+{
+   void *mem_ctx = ralloc_context(NULL);
+   
+   print_buffer buf;
+   buf_init(&buf, mem_ctx);
+   print_shader(shader, &buf, mem_ctx);
+   fwrite(buf.data, 1, buf.len, fp);
+   
+   ralloc_free(mem_ctx);
+}
+
+char *
+nir_print_shader_to_string(nir_shader *shader, void *mem_ctx)
+{
+   void *tmp_ctx = ralloc_context(NULL);
+   
+   print_buffer buf;
+   buf_init(&buf, mem_ctx);
+   print_shader(shader, &buf, tmp_ctx);
+   buf_putc(&buf, '\0');
+   
+   ralloc_free(tmp_ctx);
    
-   destroy_print_state(&state);
+   /* give back the unused part of the buffer */
+   return reralloc_size(mem_ctx, buf.data, buf.len);
 }
@@ -0,0 +1,951 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include "nir.h"
+#include <assert.h>
+
+/*
+ * Integer range and known-bits analysis.
+ *
+ * Every SSA value gets a signed range [min, max] and masks of the bits that
+ * are known to be zero or one, covering all of its components. The two are
+ * kept consistent with each other: a range that doesn't cross zero fixes the
+ * bits its bounds have in common, and known bits bound the range.
+ *
+ * The values are computed by iterating over the blocks in reverse post-order
+ * until nothing changes. A value only ever grows, and one that keeps growing
+ * (around a loop) is widened to the full range in the direction it grows.
+ * Induction variables are recognized instead: a loop header phi stepping by
+ * a constant, which the loop breaks out of once it passes a bound, is bounded
+ * by its initial value and the last value to get past the bound.
+ *
+ * The ranges are those of the 32-bit results, so arithmetic that may wrap
+ * around gives the full range; known bits are exact modulo 2^32 and survive
+ * wrapping.
+ */
+
+struct nir_range_analysis {
+   unsigned num_defs;
+   nir_int_range *ranges;
+   bool *visited;
+};
+
+typedef struct {
+   nir_range_analysis *ra;
+   
+   /* how often each value has grown, to know when to widen it */
+   unsigned *num_changes;
+} range_state;
+
+/* after this many changes, a value that still grows is widened */
+#define WIDEN_THRESHOLD 4
+
+static const nir_int_range full_range = { INT32_MIN, INT32_MAX, 0, 0 };
+
+/* the mask of the bits that the values in [0, max] may have set */
+static uint32_t
+bits_below(uint32_t max)
+{
+   return max == 0 ? 0 : ~0u >> __builtin_clz(max);
+}
+
+/* tightens the range using the known bits, and the other way around */
+static nir_int_range
+normalize(nir_int_range r)
+{
+   nir_int_range n = r;
+   
+   /* when the sign is known, the bits order the same signed and unsigned */
+   if ((r.known_zero | r.known_one) & 0x80000000u) {
+      if ((int32_t) r.known_one > n.min)
+	 n.min = (int32_t) r.known_one;
+      if ((int32_t) ~r.known_zero < n.max)
+	 n.max = (int32_t) ~r.known_zero;
+   }
+   
+   /* the values of a range of one sign share the leading bits of its bounds */
+   if (n.min >= 0 || n.max < 0) {
+      uint32_t diff = (uint32_t) n.min ^ (uint32_t) n.max;
+      uint32_t common = ~bits_below(diff);
+      n.known_one |= (uint32_t) n.min & common;
+      n.known_zero |= ~(uint32_t) n.min & common;
+   }
+   
+   /* only unreachable code can end up with an empty range */
+   if (n.min > n.max || (n.known_zero & n.known_one) != 0)
+      return r;
+   
+   return n;
+}
+
+static nir_int_range
+range_from_bounds(int64_t min, int64_t max)
+{
+   if (min < INT32_MIN || max > INT32_MAX)
+      return full_range;
+   
+   nir_int_range r = { (int32_t) min, (int32_t) max, 0, 0 };
+   return normalize(r);
+}
+
+static nir_int_range
+range_with_bits(nir_int_range r, uint32_t known_zero, uint32_t known_one)
+{
+   r.known_zero |= known_zero;
+   r.known_one |= known_one;
+   return normalize(r);
+}
+
+static nir_int_range
+range_union(nir_int_range a, nir_int_range b)
+{
+   nir_int_range r;
+   r.min = a.min < b.min ? a.min : b.min;
+   r.max = a.max > b.max ? a.max : b.max;
+   r.known_zero = a.known_zero & b.known_zero;
+   r.known_one = a.known_one & b.known_one;
+   return normalize(r);
+}
+
+static bool
+range_equal(nir_int_range a, nir_int_range b)
+{
+   return a.min == b.min && a.max == b.max &&
+	  a.known_zero == b.known_zero && a.known_one == b.known_one;
+}
+
+static bool
+range_is_const(nir_int_range r)
+{
+   return r.min == r.max;
+}
+
+/* the number of low bits known to be zero */
+static unsigned
+trailing_zeros(nir_int_range r)
+{
+   return r.known_zero == ~0u ? 32 : __builtin_ctz(~r.known_zero);
+}
+
+/*
+ * Transfer functions
+ */
+
+static nir_int_range
+range_neg(nir_int_range a)
+{
+   /* -INT32_MIN wraps around to itself */
+   if (a.min == INT32_MIN)
+      return full_range;
+   
+   return range_from_bounds(-(int64_t) a.max, -(int64_t) a.min);
+}
+
+static nir_int_range
+range_abs(nir_int_range a)
+{
+   if (a.min >= 0)
+      return a;
+   if (a.max < 0)
+      return range_neg(a);
+   if (a.min == INT32_MIN)
+      return full_range;
+   
+   return range_from_bounds(0, -a.min > a.max ? -a.min : a.max);
+}
+
+static nir_int_range
+range_not(nir_int_range a)
+{
+   nir_int_range r = { ~a.max, ~a.min, a.known_one, a.known_zero };
+   return r;
+}
+
+static nir_int_range
+range_add(nir_int_range a, nir_int_range b)
+{
+   nir_int_range r = range_from_bounds((int64_t) a.min + b.min,
+				       (int64_t) a.max + b.max);
+   
+   /* the carries are known where the largest and the smallest possible sums
+    * agree with the known bits of the operands
+    */
+   uint32_t max_sum = ~a.known_zero + ~b.known_zero;
+   uint32_t min_sum = a.known_one + b.known_one;
+   uint32_t carry_known_zero = ~(max_sum ^ a.known_zero ^ b.known_zero);
+   uint32_t carry_known_one = min_sum ^ a.known_one ^ b.known_one;
+   uint32_t known = (a.known_zero | a.known_one) &
+		    (b.known_zero | b.known_one) &
+		    (carry_known_zero | carry_known_one);
+   
+   return range_with_bits(r, ~max_sum & known, min_sum & known);
+}
+
+static nir_int_range
+range_sub(nir_int_range a, nir_int_range b)
+{
+   return range_from_bounds((int64_t) a.min - b.max,
+			    (int64_t) a.max - b.min);
+}
+
+static nir_int_range
+range_mul(nir_int_range a, nir_int_range b)
+{
+   int64_t p[4] = {
+      (int64_t) a.min * b.min, (int64_t) a.min * b.max,
+      (int64_t) a.max * b.min, (int64_t) a.max * b.max,
+   };
+   int64_t min = p[0], max = p[0];
+   for (unsigned i = 1; i < 4; i++) {
+      if (p[i] < min)
+	 min = p[i];
+      if (p[i] > max)
+	 max = p[i];
+   }
+   
+   nir_int_range r = range_from_bounds(min, max);
+   
+   unsigned zeros = trailing_zeros(a) + trailing_zeros(b);
+   return range_with_bits(r, zeros >= 32 ? ~0u : (1u << zeros) - 1, 0);
+}
+
+static nir_int_range
+range_and(nir_int_range a, nir_int_range b)
+{
+   nir_int_range r = full_range;
+   
+   /* the result is no larger than a non-negative operand */
+   if (a.min >= 0) {
+      r.min = 0;
+      r.max = a.max;
+   }
+   if (b.min >= 0) {
+      r.min = 0;
+      if (b.max < r.max)
+	 r.max = b.max;
+   }
+   
+   return range_with_bits(r, a.known_zero | b.known_zero,
+			  a.known_one & b.known_one);
+}
+
+static nir_int_range
+range_or(nir_int_range a, nir_int_range b)
+{
+   return range_with_bits(full_range, a.known_zero & b.known_zero,
+			  a.known_one | b.known_one);
+}
+
+static nir_int_range
+range_xor(nir_int_range a, nir_int_range b)
+{
+   return range_with_bits(full_range,
+			  (a.known_zero & b.known_zero) |
+			  (a.known_one & b.known_one),
+			  (a.known_zero & b.known_one) |
+			  (a.known_one & b.known_zero));
+}
+
+static nir_int_range
+range_ishl(nir_int_range a, nir_int_range b)
+{
+   if (!range_is_const(b))
+      return full_range;
+   
+   unsigned s = b.min & 31;
+   nir_int_range r = range_from_bounds((int64_t) a.min * ((int64_t) 1 << s),
+				       (int64_t) a.max * ((int64_t) 1 << s));
+   
+   return range_with_bits(r, (a.known_zero << s) | ((1u << s) - 1),
+			  a.known_one << s);
+}
+
+static nir_int_range
+range_ushr(nir_int_range a, nir_int_range b)
+{
+   if (!range_is_const(b)) {
+      if (a.min >= 0)
+	 return range_from_bounds(0, a.max);
+      return full_range;
+   }
+   
+   unsigned s = b.min & 31;
+   nir_int_range r = full_range;
+   if (a.min >= 0) {
+      r.min = a.min >> s;
+      r.max = a.max >> s;
+   }
+   
+   return range_with_bits(r, (a.known_zero >> s) | ~(~0u >> s),
+			  a.known_one >> s);
+}
+
+static nir_int_range
+range_ishr(nir_int_range a, nir_int_range b)
+{
+   /* shifting moves a value towards 0 or -1, whatever the amount */
+   if (!range_is_const(b)) {
+      return range_from_bounds(a.min >= 0 ? 0 : a.min,
+			       a.max < 0 ? -1 : a.max);
+   }
+   
+   /* the sign bit, known or not, is shifted in */
+   unsigned s = b.min & 31;
+   nir_int_range r = { a.min >> s, a.max >> s, 0, 0 };
+   return range_with_bits(r, (uint32_t) ((int32_t) a.known_zero >> s),
+			  (uint32_t) ((int32_t) a.known_one >> s));
+}
+
+static nir_int_range
+range_imin(nir_int_range a, nir_int_range b)
+{
+   nir_int_range r = range_union(a, b);
+   r.max = a.max < b.max ? a.max : b.max;
+   return normalize(r);
+}
+
+static nir_int_range
+range_imax(nir_int_range a, nir_int_range b)
+{
+   nir_int_range r = range_union(a, b);
+   r.min = a.min > b.min ? a.min : b.min;
+   return normalize(r);
+}
+
+static bool
+get_def_range(range_state *state, nir_ssa_def *def, nir_int_range *range)
+{
+   if (def->index >= state->ra->num_defs || !state->ra->visited[def->index])
+      return false;
+   
+   *range = state->ra->ranges[def->index];
+   return true;
+}
+
+/* the range of a source, with its modifiers applied */
+static nir_int_range
+get_alu_src_range(const nir_range_analysis *ra, nir_alu_instr *alu,
+		  unsigned i)
+{
+   nir_alu_src *src = &alu->src[i];
+   if (!src->src.is_ssa)
+      return full_range;
+   
+   nir_int_range r = nir_range_analysis_get(ra, src->src.ssa);
+   if (src->abs)
+      r = range_abs(r);
+   if (src->negate)
+      r = range_neg(r);
+   return r;
+}
+
+static nir_int_range
+eval_alu(range_state *state, nir_alu_instr *alu)
+{
+   if (alu->has_predicate || alu->dest.saturate)
+      return full_range;
+   
+   const nir_op_info *info = &nir_op_infos[alu->op];
+   nir_int_range s[4];
+   for (unsigned i = 0; i < info->num_inputs && i < 4; i++)
+      s[i] = get_alu_src_range(state->ra, alu, i);
+   
+   switch (alu->op) {
+      case nir_op_mov:
+	 return s[0];
+	 
+      case nir_op_vec2:
+      case nir_op_vec3:
+      case nir_op_vec4: {
+	 nir_int_range r = s[0];
+	 for (unsigned i = 1; i < info->num_inputs; i++)
+	    r = range_union(r, s[i]);
+	 return r;
+      }
+      
+      case nir_op_ineg: return range_neg(s[0]);
+      case nir_op_iabs: return range_abs(s[0]);
+      case nir_op_inot: return range_not(s[0]);
+      case nir_op_isign: return range_from_bounds(s[0].min < 0 ? -1 : 0,
+						 s[0].max > 0 ? 1 : 0);
+      case nir_op_iadd: return range_add(s[0], s[1]);
+      case nir_op_isub: return range_sub(s[0], s[1]);
+      case nir_op_imul: return range_mul(s[0], s[1]);
+      case nir_op_iand: return range_and(s[0], s[1]);
+      case nir_op_ior: return range_or(s[0], s[1]);
+      case nir_op_ixor: return range_xor(s[0], s[1]);
+      case nir_op_ishl: return range_ishl(s[0], s[1]);
+      case nir_op_ushr: return range_ushr(s[0], s[1]);
+      case nir_op_ishr: return range_ishr(s[0], s[1]);
+      case nir_op_imin: return range_imin(s[0], s[1]);
+      case nir_op_imax: return range_imax(s[0], s[1]);
+	 
+      /* booleans */
+      case nir_op_ilt:
+      case nir_op_ige:
+      case nir_op_ieq:
+      case nir_op_ine:
+      case nir_op_ult:
+      case nir_op_uge:
+      case nir_op_flt:
+      case nir_op_fge:
+      case nir_op_feq:
+      case nir_op_fne:
+      case nir_op_i2b:
+      case nir_op_f2b:
+      case nir_op_bany2:
+      case nir_op_bany3:
+      case nir_op_bany4:
+      case nir_op_ball2:
+      case nir_op_ball3:
+      case nir_op_ball4:
+	 return range_from_bounds(-1, 0);
+	 
+      case nir_op_bit_count:
+	 return range_from_bounds(0, 32);
+      case nir_op_find_msb:
+      case nir_op_find_lsb:
+	 return range_from_bounds(-1, 31);
+	 
+      default:
+	 return full_range;
+   }
+}
+
+static bool
+is_break_list(struct exec_list *list)
+{
+   if (exec_list_get_head(list) != exec_list_get_tail(list))
+      return false;
+   
+   nir_cf_node *node = exec_node_data(nir_cf_node, exec_list_get_head(list),
+				      node);
+   nir_block *block = nir_cf_node_as_block(node);
+   nir_instr *instr = nir_block_first_instr(block);
+   
+   return instr != NULL && instr == nir_block_last_instr(block) &&
+	  instr->type == nir_instr_type_jump &&
+	  nir_instr_as_jump(instr)->type == nir_jump_break;
+}
+
+/*
+ * Looks for an if at the top level of the loop that breaks out of it unless
+ * def compares to a bound, and returns the bound it implies on def for the
+ * iterations that go on: def <= *bound if upper, def >= *bound otherwise.
+ */
+static bool
+find_exit_bound(range_state *state, nir_loop *loop, nir_ssa_def *def,
+		bool upper, int64_t *bound)
+{
+   foreach_list_typed(nir_cf_node, node, node, &loop->body) {
+      if (node->type != nir_cf_node_if)
+	 continue;
+      
+      nir_if *if_stmt = nir_cf_node_as_if(node);
+      bool break_on_true = is_break_list(&if_stmt->then_list);
+      if (!break_on_true && !is_break_list(&if_stmt->else_list))
+	 continue;
+      
+      if (!if_stmt->condition.is_ssa ||
+	  if_stmt->condition.ssa->parent_instr->type != nir_instr_type_alu)
+	 continue;
+      
+      nir_alu_instr *cmp =
+	 nir_instr_as_alu(if_stmt->condition.ssa->parent_instr);
+      if ((cmp->op != nir_op_ilt && cmp->op != nir_op_ige) ||
+	  cmp->has_predicate)
+	 continue;
+      
+      /* which side of the comparison def is on */
+      unsigned side;
+      for (side = 0; side < 2; side++) {
+	 nir_alu_src *src = &cmp->src[side];
+	 if (src->src.is_ssa && src->src.ssa == def &&
+	     !src->abs && !src->negate)
+	    break;
+      }
+      if (side == 2)
+	 continue;
+      
+      nir_int_range limit = get_alu_src_range(state->ra, cmp, 1 - side);
+      
+      /* the condition is true either when def is below the limit (def < limit
+       * with def first, def <= limit with def second) or when it is above
+       */
+      bool true_if_below = (cmp->op == nir_op_ilt) == (side == 0);
+      bool continue_if_below = break_on_true ? !true_if_below : true_if_below;
+      if (continue_if_below != upper)
+	 continue;
+      
+      if (upper)
+	 *bound = (int64_t) limit.max - (side == 0 ? 1 : 0);
+      else
+	 *bound = (int64_t) limit.min + (side == 0 ? 0 : 1);
+      return true;
+   }
+   
+   return false;
+}
+
+/*
+ * Bounds a loop header phi that starts from a value coming from before the
+ * loop and is stepped by a constant on the way back to the header, if the
+ * loop is left before the value gets past a bound.
+ */
+static bool
+induction_range(range_state *state, nir_phi_instr *phi, nir_int_range *range)
+{
+   nir_block *block = phi->instr.block;
+   nir_cf_node *parent = block->cf_node.parent;
+   if (parent == NULL || parent->type != nir_cf_node_loop)
+      return false;
+   
+   nir_loop *loop = nir_cf_node_as_loop(parent);
+   if (nir_loop_first_cf_node(loop) != &block->cf_node)
+      return false;
+   
+   if (phi->dest.ssa.num_components != 1)
+      return false;
+   
+   nir_block *preheader =
+      nir_cf_node_as_block(nir_cf_node_prev(&loop->cf_node));
+   nir_src *init_src = NULL, *step_src = NULL;
+   unsigned num_srcs = 0;
+   foreach_list_typed(nir_phi_src, src, node, &phi->srcs) {
+      if (src->pred == preheader)
+	 init_src = &src->src;
+      else
+	 step_src = &src->src;
+      num_srcs++;
+   }
+   
+   /* continues would add more sources */
+   if (num_srcs != 2 || init_src == NULL || step_src == NULL ||
+       !init_src->is_ssa || !step_src->is_ssa)
+      return false;
+   
+   nir_int_range init;
+   if (!get_def_range(state, init_src->ssa, &init))
+      return false;
+   
+   if (step_src->ssa->parent_instr->type != nir_instr_type_alu)
+      return false;
+   
+   nir_alu_instr *step = nir_instr_as_alu(step_src->ssa->parent_instr);
+   if (step->op != nir_op_iadd || step->has_predicate)
+      return false;
+   
+   unsigned side;
+   for (side = 0; side < 2; side++) {
+      nir_alu_src *src = &step->src[side];
+      if (src->src.is_ssa && src->src.ssa == &phi->dest.ssa &&
+	  !src->abs && !src->negate)
+	 break;
+   }
+   if (side == 2)
+      return false;
+   
+   nir_int_range inc = get_alu_src_range(state->ra, step, 1 - side);
+   if (!range_is_const(inc) || inc.min == 0)
+      return false;
+   
+   int64_t bound;
+   bool upper = inc.min > 0;
+   if (!find_exit_bound(state, loop, &phi->dest.ssa, upper, &bound))
+      return false;
+   
+   /* the last value is the last one to pass the bound, plus one step */
+   nir_int_range r;
+   if (upper) {
+      int64_t max = bound + inc.min;
+      r = range_from_bounds(init.min, max > init.max ? max : init.max);
+      if (max > INT32_MAX)
+	 return false;
+   } else {
+      int64_t min = bound + inc.min;
+      r = range_from_bounds(min < init.min ? min : init.min, init.max);
+      if (min < INT32_MIN)
+	 return false;
+   }
+   
+   /* a value stepping by multiples of 2^n keeps the low bits of its start */
+   unsigned zeros = trailing_zeros(init);
+   unsigned step_zeros = __builtin_ctz(inc.min);
+   if (step_zeros < zeros)
+      zeros = step_zeros;
+   
+   *range = range_with_bits(r, (1u << zeros) - 1, 0);
+   return true;
+}
+
+static bool
+eval_phi(range_state *state, nir_phi_instr *phi, nir_int_range *range)
+{
+   if (induction_range(state, phi, range))
+      return true;
+   
+   bool any = false;
+   foreach_list_typed(nir_phi_src, src, node, &phi->srcs) {
+      nir_int_range r = full_range;
+      
+      /* values from blocks that weren't reached yet don't count */
+      if (src->src.is_ssa && !get_def_range(state, src->src.ssa, &r))
+	 continue;
+      
+      *range = any ? range_union(*range, r) : r;
+      any = true;
+   }
+   
+   return any;
+}
+
+static void
+eval_load_const(nir_load_const_instr *load_const, nir_int_range *range)
+{
+   if (load_const->array_elems != 0) {
+      *range = full_range;
+      return;
+   }
+   
+   for (unsigned i = 0; i < load_const->dest.ssa.num_components; i++) {
+      int32_t v = load_const->value.i[i];
+      nir_int_range r = { v, v, ~(uint32_t) v, (uint32_t) v };
+      *range = i == 0 ? r : range_union(*range, r);
+   }
+}
+
+/* merges a newly computed range into def's, returning whether it grew */
+static bool
+update_def(range_state *state, nir_ssa_def *def, nir_int_range range)
+{
+   nir_range_analysis *ra = state->ra;
+   
+   if (!ra->visited[def->index]) {
+      ra->visited[def->index] = true;
+      ra->ranges[def->index] = range;
+      return true;
+   }
+   
+   nir_int_range old = ra->ranges[def->index];
+   nir_int_range r = range_union(old, range);
+   if (range_equal(r, old))
+      return false;
+   
+   if (++state->num_changes[def->index] > WIDEN_THRESHOLD) {
+      if (r.min < old.min)
+	 r.min = INT32_MIN;
+      if (r.max > old.max)
+	 r.max = INT32_MAX;
+      r = normalize(r);
+   }
+   
+   ra->ranges[def->index] = r;
+   return true;
+}
+
+static bool
+visit_instr(range_state *state, nir_instr *instr)
+{
+   nir_ssa_def *def;
+   nir_int_range range = full_range;
+   
+   switch (instr->type) {
+      case nir_instr_type_ssa_undef:
+	 def = &nir_instr_as_ssa_undef(instr)->def;
+	 break;
+	 
+      case nir_instr_type_load_const: {
+	 nir_load_const_instr *load_const = nir_instr_as_load_const(instr);
+	 if (!load_const->dest.is_ssa)
+	    return false;
+	 def = &load_const->dest.ssa;
+	 if (!load_const->has_predicate)
+	    eval_load_const(load_const, &range);
+	 break;
+      }
+      
+      case nir_instr_type_alu: {
+	 nir_alu_instr *alu = nir_instr_as_alu(instr);
+	 if (!alu->dest.dest.is_ssa)
+	    return false;
+	 def = &alu->dest.dest.ssa;
+	 range = eval_alu(state, alu);
+	 break;
+      }
+      
+      case nir_instr_type_phi: {
+	 nir_phi_instr *phi = nir_instr_as_phi(instr);
+	 if (!phi->dest.is_ssa)
+	    return false;
+	 def = &phi->dest.ssa;
+	 if (!eval_phi(state, phi, &range))
+	    return false;
+	 break;
+      }
+      
+      default: {
+	 nir_dest *dest = nir_instr_dest(instr);
+	 if (dest == NULL || !dest->is_ssa)
+	    return false;
+	 def = &dest->ssa;
+	 break;
+      }
+   }
+   
+   return update_def(state, def, range);
+}
+
+nir_range_analysis *
+nir_range_analysis_create(void *mem_ctx, nir_function_impl *impl)
+{
+   nir_index_ssa_defs(impl);
+   
+   nir_range_analysis *ra = ralloc(mem_ctx, nir_range_analysis);
+   ra->num_defs = impl->ssa_alloc;
+   ra->ranges = ralloc_array(ra, nir_int_range, ra->num_defs);
+   ra->visited = rzalloc_array(ra, bool, ra->num_defs);
+   
+   range_state state;
+   state.ra = ra;
+   state.num_changes = rzalloc_array(ra, unsigned, ra->num_defs);
+   
+   bool progress;
+   do {
+      progress = false;
+      nir_foreach_block_rpo(impl, block) {
+	 nir_foreach_instr(block, instr) {
+	    if (visit_instr(&state, instr))
+	       progress = true;
+	 }
+      }
+   } while (progress);
+   
+   ralloc_free(state.num_changes);
+   return ra;
+}
+
+nir_int_range
+nir_range_analysis_get(const nir_range_analysis *ra, const nir_ssa_def *def)
+{
+   /* values in unreachable code, or created after the analysis ran */
+   if (def->index >= ra->num_defs || !ra->visited[def->index])
+      return full_range;
+   
+   return ra->ranges[def->index];
+}
+
+bool
+nir_ssa_def_is_non_negative(const nir_range_analysis *ra,
+			    const nir_ssa_def *def)
+{
+   return nir_range_analysis_get(ra, def).min >= 0;
+}
+
+bool
+nir_ssa_def_in_bounds(const nir_range_analysis *ra, const nir_ssa_def *def,
+		      unsigned size)
+{
+   nir_int_range r = nir_range_analysis_get(ra, def);
+   return r.min >= 0 && (int64_t) r.max < (int64_t) size;
+}
+
+/*
+ * Simplifications using the ranges
+ */
+
+/* turns alu into a move of its source src */
+static void
+make_mov(nir_alu_instr *alu, unsigned src)
+{
+   alu->op = nir_op_mov;
+   if (src != 0)
+      alu->src[0] = alu->src[src];
+}
+
+/*
+ * Dropping or replacing a register source would leave the instruction in the
+ * register's uses, so the rewrites below that do it only handle SSA sources.
+ */
+static bool
+alu_srcs_are_ssa(const nir_alu_instr *alu)
+{
+   for (unsigned i = 0; i < nir_op_infos[alu->op].num_inputs; i++) {
+      if (!alu->src[i].src.is_ssa)
+	 return false;
+   }
+   
+   return true;
+}
+
+/* the unsigned bounds of a range, if it doesn't cross zero */
+static void
+unsigned_bounds(nir_int_range r, uint32_t *min, uint32_t *max)
+{
+   if (r.min >= 0 || r.max < 0) {
+      *min = (uint32_t) r.min;
+      *max = (uint32_t) r.max;
+   } else {
+      *min = 0;
+      *max = UINT32_MAX;
+   }
+}
+
+/* returns 1 or 0 if the comparison always has that result, -1 otherwise */
+static int
+eval_compare(nir_op op, nir_int_range a, nir_int_range b)
+{
+   uint32_t a_min, a_max, b_min, b_max;
+   unsigned_bounds(a, &a_min, &a_max);
+   unsigned_bounds(b, &b_min, &b_max);
+   
+   switch (op) {
+      case nir_op_ilt:
+	 return a.max < b.min ? 1 : (a.min >= b.max ? 0 : -1);
+      case nir_op_ige:
+	 return a.min >= b.max ? 1 : (a.max < b.min ? 0 : -1);
+      case nir_op_ult:
+	 return a_max < b_min ? 1 : (a_min >= b_max ? 0 : -1);
+      case nir_op_uge:
+	 return a_min >= b_max ? 1 : (a_max < b_min ? 0 : -1);
+      case nir_op_ieq:
+      case nir_op_ine: {
+	 /* the values differ if their ranges don't overlap or a known bit
+	  * differs
+	  */
+	 bool differ = a.max < b.min || b.max < a.min ||
+		       (a.known_zero & b.known_one) != 0 ||
+		       (a.known_one & b.known_zero) != 0;
+	 if (!differ)
+	    return -1;
+	 return op == nir_op_ine ? 1 : 0;
+      }
+      default:
+	 return -1;
+   }
+}
+
+static bool
+opt_alu(nir_function_impl *impl, const nir_range_analysis *ra,
+	nir_alu_instr *alu)
+{
+   if (alu->has_predicate || !alu->dest.dest.is_ssa)
+      return false;
+   
+   switch (alu->op) {
+      case nir_op_ishr:
+	 /* shifting in zeros is the same for non-negative values */
+	 if (get_alu_src_range(ra, alu, 0).min < 0)
+	    return false;
+	 alu->op = nir_op_ushr;
+	 return true;
+	 
+      case nir_op_iand:
+	 /* the mask is redundant if it keeps every bit the other source may
+	  * have set
+	  */
+	 if (!alu_srcs_are_ssa(alu))
+	    return false;
+	 
+	 for (unsigned i = 0; i < 2; i++) {
+	    nir_int_range value = get_alu_src_range(ra, alu, i);
+	    nir_int_range mask = get_alu_src_range(ra, alu, 1 - i);
+	    if ((~value.known_zero & ~mask.known_one) == 0) {
+	       make_mov(alu, i);
+	       return true;
+	    }
+	 }
+	 return false;
+	 
+      case nir_op_ilt:
+      case nir_op_ige:
+      case nir_op_ult:
+      case nir_op_uge:
+      case nir_op_ieq:
+      case nir_op_ine: {
+	 if (!alu_srcs_are_ssa(alu))
+	    return false;
+	 
+	 int result = eval_compare(alu->op, get_alu_src_range(ra, alu, 0),
+				   get_alu_src_range(ra, alu, 1));
+	 if (result < 0)
+	    return false;
+	 
+	 /* replaced by a move, so that its users don't need to be found */
+	 nir_load_const_instr *load_const = nir_load_const_instr_create(impl);
+	 unsigned num_components = alu->dest.dest.ssa.num_components;
+	 nir_ssa_dest_init(impl, &load_const->instr, &load_const->dest,
+			   num_components, NULL);
+	 for (unsigned i = 0; i < 4; i++)
+	    load_const->value.u[i] = i < num_components && result ? ~0u : 0;
+	 nir_instr_insert_before(&alu->instr, &load_const->instr);
+	 
+	 alu->op = nir_op_mov;
+	 alu->src[0].src.is_ssa = true;
+	 alu->src[0].src.ssa = &load_const->dest.ssa;
+	 alu->src[0].abs = alu->src[0].negate = false;
+	 for (unsigned i = 0; i < 4; i++)
+	    alu->src[0].swizzle[i] = i;
+	 return true;
+      }
+      
+      default:
+	 return false;
+   }
+}
+
+bool
+nir_opt_int_ranges_impl(nir_function_impl *impl)
+{
+   void *mem_ctx = ralloc_context(NULL);
+   nir_range_analysis *ra = nir_range_analysis_create(mem_ctx, impl);
+   bool progress = false;
+   
+   /* every rewrite keeps the value the same, so the ranges stay valid */
+   nir_foreach_block_in_order(impl, block) {
+      nir_foreach_instr(block, instr) {
+	 if (instr->type == nir_instr_type_alu &&
+	     opt_alu(impl, ra, nir_instr_as_alu(instr))) {
+	    nir_instr_mark_changed(instr);
+	    progress = true;
+	 }
+      }
+   }
+   
+   ralloc_free(mem_ctx);
+   return progress;
+}
+
+static bool
+int_ranges_impl_cb(nir_function_impl *impl, nir_pass_worker *worker,
+		   void *data)
+{
+   return nir_opt_int_ranges_impl(impl);
+}
+
+bool
+nir_opt_int_ranges(nir_shader *shader)
+{
+   return nir_shader_foreach_impl_parallel(shader, int_ranges_impl_cb, NULL);
+}
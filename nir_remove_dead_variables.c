@@ -0,0 +1,287 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include "nir.h"
+#include "main/set.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Removes the uniforms, inputs, outputs and globals that the shader never
+ * uses.
+ *
+ * A variable is used if an intrinsic, texture or call refers to it, or, for
+ * variables with a location, if a load_uniform, load_input or store_output
+ * accesses one of its slots. Uniforms that belong to an interface block are
+ * read through their block, so they are always kept. The uniforms that
+ * remain are then given consecutive locations, in the order of their old
+ * ones, and the load_uniform intrinsics are moved with them.
+ */
+
+typedef struct {
+   struct set *vars;
+   
+   /* for every mode with location-based access, which slots are accessed */
+   bool *slots[nir_var_uniform + 1];
+   unsigned num_slots[nir_var_uniform + 1];
+} used_state;
+
+static void
+add_var(used_state *state, nir_variable *var)
+{
+   if (var != NULL)
+      _mesa_set_add(state->vars, _mesa_hash_pointer(var), var);
+}
+
+static bool
+var_is_used(used_state *state, nir_variable *var)
+{
+   return _mesa_set_search(state->vars, _mesa_hash_pointer(var), var) != NULL;
+}
+
+/* the mode of the variables that a location-based intrinsic accesses */
+static int
+location_mode(nir_intrinsic_op op)
+{
+   switch (op) {
+      case nir_intrinsic_load_uniform:
+	 return nir_var_uniform;
+      case nir_intrinsic_load_input:
+	 return nir_var_shader_in;
+      case nir_intrinsic_store_output:
+	 return nir_var_shader_out;
+      default:
+	 return -1;
+   }
+}
+
+static unsigned
+end_slot(struct hash_table *ht)
+{
+   unsigned end = 0;
+   
+   struct hash_entry *entry;
+   hash_table_foreach(ht, entry) {
+      nir_variable *var = (nir_variable *) entry->data;
+      if (var->data.location < 0)
+	 continue;
+      
+      unsigned var_end = var->data.location +
+			 glsl_count_attribute_slots(var->type);
+      if (var_end > end)
+	 end = var_end;
+   }
+   
+   return end;
+}
+
+static void
+init_slots(used_state *state, nir_variable_mode mode, struct hash_table *ht,
+	   void *mem_ctx)
+{
+   state->num_slots[mode] = end_slot(ht);
+   state->slots[mode] = rzalloc_array(mem_ctx, bool, state->num_slots[mode]);
+}
+
+static void
+mark_used_instr(used_state *state, nir_instr *instr)
+{
+   if (instr->type == nir_instr_type_call) {
+      nir_call_instr *call = nir_instr_as_call(instr);
+      for (unsigned i = 0; i < call->num_params; i++)
+	 add_var(state, call->params[i]);
+      add_var(state, call->return_var);
+      return;
+   }
+   
+   nir_deref_var *deref;
+   for (unsigned i = 0; (deref = nir_src_iter_get_deref(instr, i)) != NULL;
+	i++)
+      add_var(state, deref->var);
+   
+   if (instr->type != nir_instr_type_intrinsic)
+      return;
+   
+   nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(instr);
+   int mode = location_mode(intrin->intrinsic);
+   if (mode < 0)
+      return;
+   
+   int slot = intrin->const_index[0];
+   if (slot >= 0 && (unsigned) slot < state->num_slots[mode])
+      state->slots[mode][slot] = true;
+}
+
+static bool
+slots_used(used_state *state, nir_variable *var)
+{
+   if (var->data.location < 0 || var->data.mode > nir_var_uniform ||
+       state->slots[var->data.mode] == NULL)
+      return false;
+   
+   unsigned end = var->data.location + glsl_count_attribute_slots(var->type);
+   for (unsigned i = var->data.location; i < end; i++) {
+      if (state->slots[var->data.mode][i])
+	 return true;
+   }
+   
+   return false;
+}
+
+static bool
+remove_dead_vars(struct hash_table *ht, used_state *state)
+{
+   bool progress = false;
+   
+   struct hash_entry *entry;
+   hash_table_foreach(ht, entry) {
+      nir_variable *var = (nir_variable *) entry->data;
+      
+      if (var_is_used(state, var) || slots_used(state, var) ||
+	  (var->data.mode == nir_var_uniform && var->interface_type != NULL))
+	 continue;
+      
+      _mesa_hash_table_remove(ht, entry);
+      progress = true;
+   }
+   
+   return progress;
+}
+
+typedef struct {
+   nir_variable *var;
+   int old_location;
+   unsigned num_slots;
+} uniform_slots;
+
+static int
+compare_uniforms(const void *a, const void *b)
+{
+   const uniform_slots *ua = (const uniform_slots *) a;
+   const uniform_slots *ub = (const uniform_slots *) b;
+   
+   if (ua->old_location != ub->old_location)
+      return ua->old_location < ub->old_location ? -1 : 1;
+   return strcmp(ua->var->name, ub->var->name);
+}
+
+/* the new slot of an old uniform slot, or -1 if no uniform covers it */
+static int
+remap_slot(uniform_slots *uniforms, unsigned num_uniforms, int slot)
+{
+   for (unsigned i = 0; i < num_uniforms; i++) {
+      int offset = slot - uniforms[i].old_location;
+      if (offset >= 0 && (unsigned) offset < uniforms[i].num_slots)
+	 return uniforms[i].var->data.location + offset;
+   }
+   
+   return -1;
+}
+
+static bool
+renumber_uniforms(nir_shader *shader, void *mem_ctx)
+{
+   uniform_slots *uniforms = ralloc_array(mem_ctx, uniform_slots,
+					  shader->uniforms->entries);
+   unsigned num_uniforms = 0;
+   
+   struct hash_entry *entry;
+   hash_table_foreach(shader->uniforms, entry) {
+      nir_variable *var = (nir_variable *) entry->data;
+      if (var->data.location < 0)
+	 continue;
+      
+      uniform_slots *u = &uniforms[num_uniforms++];
+      u->var = var;
+      u->old_location = var->data.location;
+      u->num_slots = glsl_count_attribute_slots(var->type);
+   }
+   
+   qsort(uniforms, num_uniforms, sizeof(uniform_slots), compare_uniforms);
+   
+   bool progress = false;
+   int location = 0;
+   for (unsigned i = 0; i < num_uniforms; i++) {
+      if (uniforms[i].old_location != location)
+	 progress = true;
+      
+      uniforms[i].var->data.location = location;
+      location += uniforms[i].num_slots;
+   }
+   
+   if (!progress)
+      return false;
+   
+   nir_foreach_impl(shader, impl) {
+      nir_foreach_block_in_order(impl, block) {
+	 nir_foreach_instr(block, instr) {
+	    if (instr->type != nir_instr_type_intrinsic)
+	       continue;
+	    
+	    nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(instr);
+	    if (intrin->intrinsic != nir_intrinsic_load_uniform)
+	       continue;
+	    
+	    int slot = remap_slot(uniforms, num_uniforms,
+				  intrin->const_index[0]);
+	    if (slot >= 0 && slot != intrin->const_index[0]) {
+	       intrin->const_index[0] = slot;
+	       nir_instr_mark_changed(instr);
+	    }
+	 }
+      }
+   }
+   
+   return true;
+}
+
+bool
+nir_remove_dead_variables(nir_shader *shader)
+{
+   void *mem_ctx = ralloc_context(NULL);
+   
+   used_state state;
+   memset(&state, 0, sizeof(state));
+   state.vars = _mesa_set_create(mem_ctx, _mesa_key_pointer_equal);
+   init_slots(&state, nir_var_uniform, shader->uniforms, mem_ctx);
+   init_slots(&state, nir_var_shader_in, shader->inputs, mem_ctx);
+   init_slots(&state, nir_var_shader_out, shader->outputs, mem_ctx);
+   
+   nir_foreach_impl(shader, impl) {
+      nir_foreach_block_in_order(impl, block) {
+	 nir_foreach_instr(block, instr)
+	    mark_used_instr(&state, instr);
+      }
+   }
+   
+   bool progress = false;
+   progress |= remove_dead_vars(shader->uniforms, &state);
+   progress |= remove_dead_vars(shader->inputs, &state);
+   progress |= remove_dead_vars(shader->outputs, &state);
+   progress |= remove_dead_vars(shader->globals, &state);
+   progress |= renumber_uniforms(shader, mem_ctx);
+   
+   ralloc_free(mem_ctx);
+   return progress;
+}
@@ -71,6 +71,42 @@ glsl_get_array_element(const glsl_type* type)
    return type->fields.array;
 }
 
+const char *
+glsl_get_type_name(const glsl_type *type)
+{
+   return type->name;
+}
+
+unsigned
+glsl_get_length(const glsl_type *type)
+{
+   return type->length;
+}
+
+const glsl_type *
+glsl_get_struct_elem_type(const glsl_type *type, unsigned index)
+{
+   return type->fields.structure[index].type;
+}
+
+const char *
+glsl_get_struct_elem_name(const glsl_type *type, unsigned index)
+{
+   return type->fields.structure[index].name;
+}
+
+bool
+glsl_type_is_array(const glsl_type *type)
+{
+   return type->base_type == GLSL_TYPE_ARRAY;
+}
+
+bool
+glsl_type_is_struct(const glsl_type *type)
+{
+   return type->base_type == GLSL_TYPE_STRUCT;
+}
+
 const glsl_type*
 glsl_get_struct_field(const glsl_type *type, const char *field)
 {
@@ -83,6 +119,24 @@ glsl_get_struct_field(const glsl_type *type, const char *field)
    return NULL;
 }
 
+bool
+glsl_type_is_vector_or_scalar(const glsl_type *type)
+{
+   return type->is_vector() || type->is_scalar();
+}
+
+unsigned
+glsl_get_vector_elements(const glsl_type *type)
+{
+   return type->vector_elements;
+}
+
+unsigned
+glsl_count_attribute_slots(const glsl_type *type)
+{
+   return type->count_attribute_slots();
+}
+
 bool
 glsl_type_is_void(const glsl_type *type)
 {
@@ -95,4 +149,32 @@ glsl_void_type(void)
    return glsl_type::void_type;
 }
 
+const glsl_type *
+glsl_float_type(void)
+{
+   return glsl_type::float_type;
+}
+
+const glsl_type *
+glsl_vec4_type(void)
+{
+   return glsl_type::vec4_type;
+}
+
+const glsl_type *
+glsl_vec_type(unsigned components)
+{
+   return glsl_type::vec(components);
+}
+
+const glsl_type *
+glsl_int_type(void)
+{
+   return glsl_type::int_type;
+}
 
+const glsl_type *
+glsl_array_type(const glsl_type *base, unsigned elements)
+{
+   return glsl_type::get_array_instance(base, elements);
+}
@@ -45,8 +45,37 @@ const struct glsl_type *glsl_get_struct_field(const struct glsl_type *type,
 
 const struct glsl_type *glsl_get_array_element(const struct glsl_type *type);
 
+const char *glsl_get_type_name(const struct glsl_type *type);
+
+/** the number of array elements or structure fields */
+unsigned glsl_get_length(const struct glsl_type *type);
+
+const struct glsl_type *glsl_get_struct_elem_type(const struct glsl_type *type,
+						  unsigned index);
+const char *glsl_get_struct_elem_name(const struct glsl_type *type,
+				      unsigned index);
+
+bool glsl_type_is_array(const struct glsl_type *type);
+bool glsl_type_is_struct(const struct glsl_type *type);
+
+bool glsl_type_is_vector_or_scalar(const struct glsl_type *type);
+
+/** the number of components of a scalar or vector type */
+unsigned glsl_get_vector_elements(const struct glsl_type *type);
+
+/** the number of vec4 slots the type takes as a shader input or output */
+unsigned glsl_count_attribute_slots(const struct glsl_type *type);
+
 bool glsl_type_is_void(const struct glsl_type *type);
 const struct glsl_type *glsl_void_type(void);
+const struct glsl_type *glsl_float_type(void);
+const struct glsl_type *glsl_vec4_type(void);
+const struct glsl_type *glsl_vec_type(unsigned components);
+const struct glsl_type *glsl_int_type(void);
+
+/** thread-safe; returns the same pointer for the same base and size */
+const struct glsl_type *glsl_array_type(const struct glsl_type *base,
+					unsigned elements);
 
 #ifdef __cplusplus
 }
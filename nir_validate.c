@@ -27,6 +27,7 @@
 
 #include "nir.h"
 #include <assert.h>
+#include <pthread.h>
 
 /*
  * This file checks for invalid IR indicating a bug somewhere in the compiler.
@@ -41,14 +42,60 @@ typedef struct {
     * equivalent to the uses and defs in nir_register, but built up by the
     * validator. At the end, we verify that the sets have the same entries.
     */
-   struct hash_table *uses, *defs;
+   struct set *uses, *defs;
    nir_function_impl *where_defined; /* NULL for global registers */
 } reg_validate_state;
 
+/*
+ * What nir_validate_shader_fast() uses instead of reg_validate_state, for
+ * either the local registers of a function or the global registers. Every
+ * array is indexed by register index.
+ */
+
+typedef struct {
+   unsigned num_regs;
+   
+   /* the register with each index, to check where a register is declared */
+   nir_register **regs;
+   
+   /*
+    * number of different instructions found reading from/writing to each
+    * register, compared against the size of nir_register.uses/defs at the
+    * end. The arrays for global registers are shared by all functions.
+    */
+   unsigned *num_uses, *num_defs;
+   
+   /* the last instruction counted for each register */
+   nir_instr **last_use, **last_def;
+} reg_index_state;
+
+/*
+ * Dominance information for nir_validate_shader_fast(), indexed by block
+ * index.
+ */
+
+typedef struct {
+   /* position in reverse post-order, or ~0 for unreachable blocks */
+   unsigned *rpo_index;
+   
+   /* pre- and post-order numbers in the dominator tree */
+   unsigned *dom_pre, *dom_post;
+} dominance_state;
+
 typedef struct {
+   /* owns the per-register validation state */
+   void *mem_ctx;
+   
    /* map of register -> validation state (struct above) */
    struct hash_table *regs;
    
+   /*
+    * Same as regs, but for global registers. Function implementations are
+    * validated in parallel, each with their own regs table, while this one
+    * is shared by all of them.
+    */
+   struct hash_table *global_regs;
+   
    /* the current instruction being validated */
    nir_instr *instr;
    
@@ -66,32 +113,107 @@ typedef struct {
    
    /* map of local variable -> function implementation where it is defined */
    struct hash_table *var_defs;
+   
+   /* whether this is nir_validate_shader_fast() */
+   bool fast;
+   
+   /*
+    * whether every function is checked, rather than only the dirty ones.
+    * If not, the use/def sets of global registers may contain entries from
+    * functions that aren't checked, so they can only be checked for missing
+    * entries.
+    */
+   bool all_impls;
+   
+   /*
+    * Fast mode only: these replace regs, global_regs and ssa_defs, indexed by
+    * register and SSA value index instead.
+    */
+   reg_index_state local_reg_index, global_reg_index;
+   unsigned num_ssa_defs;
+   nir_ssa_def **ssa_defs_by_index;
+   nir_block **ssa_def_blocks;
+   dominance_state dom;
 } validate_state;
 
+/* protects the uses and defs of global registers' validation state */
+static pthread_mutex_t global_reg_state_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 static void validate_src(nir_src *src, validate_state *state);
 
+static reg_validate_state *
+get_reg_state(nir_register *reg, validate_state *state)
+{
+   struct hash_table *regs = reg->is_global ? state->global_regs : state->regs;
+   struct hash_entry *entry = _mesa_hash_table_search(regs,
+						      _mesa_hash_pointer(reg),
+						      reg);
+   assert(entry);
+   
+   return (reg_validate_state *) entry->data;
+}
+
 static void
-validate_reg_src(nir_reg_src *src, validate_state *state)
+reg_state_add(nir_register *reg, struct set *set, nir_instr *instr)
 {
-   assert(src->reg != NULL);
+   if (reg->is_global)
+      pthread_mutex_lock(&global_reg_state_mutex);
    
-   struct hash_entry *entry =
-      _mesa_hash_table_search(src->reg->uses, _mesa_hash_pointer(state->instr),
-			      state->instr);
-   assert(entry && "use not in nir_register.uses");
+   _mesa_set_add(set, _mesa_hash_pointer(instr), instr);
    
-   entry = _mesa_hash_table_search(state->regs, _mesa_hash_pointer(src->reg),
-				 src->reg);
+   if (reg->is_global)
+      pthread_mutex_unlock(&global_reg_state_mutex);
+}
+
+static reg_index_state *
+get_reg_index_state(nir_register *reg, validate_state *state)
+{
+   reg_index_state *regs = reg->is_global ? &state->global_reg_index
+					  : &state->local_reg_index;
    
-   assert(entry);
+   assert(reg->index < regs->num_regs && regs->regs[reg->index] == reg &&
+	  "using a register declared in a different function");
    
-   reg_validate_state *reg_state = (reg_validate_state *) entry->data;
-   _mesa_hash_table_insert(reg_state->uses, _mesa_hash_pointer(state->instr),
-			   state->instr, state->instr);
+   return regs;
+}
+
+/* counts instr in counts, unless it has already been counted */
+static void
+reg_index_count(nir_register *reg, unsigned *counts, nir_instr **last,
+		nir_instr *instr)
+{
+   if (last[reg->index] == instr)
+      return;
    
-   if (!src->reg->is_global) {
-      assert(reg_state->where_defined == state->impl &&
-	     "using a register declared in a different function");
+   last[reg->index] = instr;
+   
+   if (reg->is_global)
+      __atomic_fetch_add(&counts[reg->index], 1, __ATOMIC_RELAXED);
+   else
+      counts[reg->index]++;
+}
+
+static void
+validate_reg_src(nir_reg_src *src, validate_state *state)
+{
+   assert(src->reg != NULL);
+   
+   struct set_entry *entry =
+      _mesa_set_search(src->reg->uses, _mesa_hash_pointer(state->instr),
+		       state->instr);
+   assert(entry && "use not in nir_register.uses");
+   
+   if (state->fast) {
+      reg_index_state *regs = get_reg_index_state(src->reg, state);
+      reg_index_count(src->reg, regs->num_uses, regs->last_use, state->instr);
+   } else {
+      reg_validate_state *reg_state = get_reg_state(src->reg, state);
+      reg_state_add(src->reg, reg_state->uses, state->instr);
+      
+      if (!src->reg->is_global) {
+	 assert(reg_state->where_defined == state->impl &&
+		"using a register declared in a different function");
+      }
    }
    
    assert((src->reg->num_array_elems == 0 ||
@@ -106,11 +228,46 @@ validate_reg_src(nir_reg_src *src, validate_state *state)
    }
 }
 
+/* whether block a dominates block b, using the numbers from compute_dominance() */
+static bool
+block_dominates(nir_block *a, nir_block *b, validate_state *state)
+{
+   unsigned rpo_a = state->dom.rpo_index[a->index];
+   unsigned rpo_b = state->dom.rpo_index[b->index];
+   
+   /* anything goes in code that is never executed */
+   if (rpo_b == ~0u)
+      return true;
+   
+   if (rpo_a == ~0u)
+      return false;
+   
+   return state->dom.dom_pre[a->index] <= state->dom.dom_pre[b->index] &&
+	  state->dom.dom_post[b->index] <= state->dom.dom_post[a->index];
+}
+
 static void
 validate_ssa_src(nir_ssa_def *def, validate_state *state)
 {
    assert(def != NULL);
    
+   if (state->fast) {
+      /*
+       * Values are visited in source order, and the sources of a phi at the
+       * end of the corresponding predecessor, so a value that hasn't been
+       * seen yet is either used before it's defined or not part of this
+       * function.
+       */
+      assert(def->index < state->num_ssa_defs &&
+	     state->ssa_defs_by_index[def->index] == def &&
+	     "using an SSA value defined in a different function");
+      
+      assert(block_dominates(state->ssa_def_blocks[def->index], state->block,
+			     state) &&
+	     "SSA value used where its definition doesn't dominate");
+      return;
+   }
+   
    struct hash_entry *entry = _mesa_hash_table_search(state->ssa_defs,
 						      _mesa_hash_pointer(def),
 						      def);
@@ -137,8 +294,6 @@ validate_alu_src(nir_alu_src *src, validate_state *state)
 {
    for (unsigned i = 0; i < 4; i++)
       assert(src->swizzle[i] < 4);
-   
-   validate_src(&src->src, state);
 }
 
 static void
@@ -146,23 +301,22 @@ validate_reg_dest(nir_reg_dest *dest, validate_state *state)
 {
    assert(dest->reg != NULL);
    
-   struct hash_entry *entry =
-      _mesa_hash_table_search(dest->reg->defs, _mesa_hash_pointer(state->instr),
-			      state->instr);
+   struct set_entry *entry =
+      _mesa_set_search(dest->reg->defs, _mesa_hash_pointer(state->instr),
+		       state->instr);
    assert(entry && "definition not in nir_register.defs");
    
-   entry = _mesa_hash_table_search(state->regs, _mesa_hash_pointer(dest->reg),
-				   dest->reg);
-   
-   assert(entry);
-   
-   reg_validate_state *reg_state = (reg_validate_state *) entry->data;
-   _mesa_hash_table_insert(reg_state->defs, _mesa_hash_pointer(state->instr),
-			   state->instr, state->instr);
-   
-   if (!dest->reg->is_global) {
-      assert(reg_state->where_defined == state->impl &&
-	     "writing to a register declared in a different function");
+   if (state->fast) {
+      reg_index_state *regs = get_reg_index_state(dest->reg, state);
+      reg_index_count(dest->reg, regs->num_defs, regs->last_def, state->instr);
+   } else {
+      reg_validate_state *reg_state = get_reg_state(dest->reg, state);
+      reg_state_add(dest->reg, reg_state->defs, state->instr);
+      
+      if (!dest->reg->is_global) {
+	 assert(reg_state->where_defined == state->impl &&
+		"writing to a register declared in a different function");
+      }
    }
    
    assert((dest->reg->num_array_elems == 0 ||
@@ -181,6 +335,15 @@ static void
 validate_ssa_def(nir_ssa_def *def, validate_state *state)
 {
    assert(def->num_components <= 4);
+   
+   if (state->fast) {
+      assert(def->index < state->num_ssa_defs &&
+	     state->ssa_defs_by_index[def->index] == NULL);
+      state->ssa_defs_by_index[def->index] = def;
+      state->ssa_def_blocks[def->index] = state->block;
+      return;
+   }
+   
    _mesa_hash_table_insert(state->ssa_defs, _mesa_hash_pointer(def), def,
 			   state->impl);
 }
@@ -218,9 +381,6 @@ validate_alu_instr(nir_alu_instr *instr, validate_state *state)
    for (unsigned i = 0; i < nir_op_infos[instr->op].num_inputs; i++) {
       validate_alu_src(&instr->src[i], state);
    }
-   
-   if (instr->has_predicate)
-      validate_src(&instr->predicate, state);
 }
 
 static void
@@ -275,11 +435,6 @@ validate_deref_var(nir_deref_var *deref, validate_state *state)
 static void
 validate_intrinsic_instr(nir_intrinsic_instr *instr, validate_state *state)
 {
-   unsigned num_srcs = nir_intrinsic_infos[instr->intrinsic].num_srcs;
-   for (unsigned i = 0; i < num_srcs; i++) {
-      validate_src(&instr->src[i], state);
-   }
-   
    if (nir_intrinsic_infos[instr->intrinsic].has_dest) {
       validate_dest(&instr->dest, state);
    }
@@ -288,9 +443,6 @@ validate_intrinsic_instr(nir_intrinsic_instr *instr, validate_state *state)
    for (unsigned i = 0; i < num_vars; i++) {
       validate_deref_var(instr->variables[i], state);
    }
-   
-   if (instr->has_predicate)
-      validate_src(&instr->predicate, state);
 }
 
 static void
@@ -305,7 +457,6 @@ validate_tex_instr(nir_tex_instr *instr, validate_state *state)
    for (unsigned i = 0; i < instr->num_srcs; i++) {
       assert(!src_type_seen[instr->src_type[i]]);
       src_type_seen[instr->src_type[i]] = true;
-      validate_src(&instr->src[i], state);
    }
    
    if (instr->sampler != NULL)
@@ -325,9 +476,6 @@ validate_call_instr(nir_call_instr *instr, validate_state *state)
    for (unsigned i = 0; i < instr->num_params; i++) {
       assert(instr->callee->params[i].type == instr->params[i]->type);
    }
-   
-   if (instr->has_predicate)
-      validate_src(&instr->predicate, state);
 }
 
 static void
@@ -340,9 +488,6 @@ validate_load_const_instr(nir_load_const_instr *instr, validate_state *state)
       assert(instr->dest.reg.base_offset + instr->array_elems <=
 	     instr->dest.reg.reg->num_array_elems);
    }
-   
-   if (instr->has_predicate)
-      validate_src(&instr->predicate, state);
 }
 
 static void
@@ -376,6 +521,14 @@ validate_instr(nir_instr *instr, validate_state *state)
    
    state->instr = instr;
    
+   /*
+    * The sources of every kind of instruction (other than phis, see
+    * validate_phi_instr()) are checked here; the functions below only check
+    * what is specific to each kind.
+    */
+   nir_instr_foreach_src(instr, iter)
+      validate_src(iter.src, state);
+   
    switch (instr->type) {
       case nir_instr_type_alu:
 	 validate_alu_instr(nir_instr_as_alu(instr), state);
@@ -464,9 +617,9 @@ validate_block(nir_block *block, validate_state *state)
    
    for (unsigned i = 0; i < 2; i++) {
       if (block->successors[i] != NULL) {
-	 struct hash_entry *entry =
-	    _mesa_hash_table_search(block->successors[i]->predecessors,
-				    _mesa_hash_pointer(block), block);
+	 struct set_entry *entry =
+	    _mesa_set_search(block->successors[i]->predecessors,
+			     _mesa_hash_pointer(block), block);
 	 assert(entry);
 	 
 	 validate_phi_srcs(block, block->successors[i], state);
@@ -497,10 +650,12 @@ validate_if(nir_if *if_stmt, validate_state *state)
    
    if (!if_stmt->condition.is_ssa) {
       nir_register *reg = if_stmt->condition.reg.reg;
-      struct hash_entry *entry =
-	 _mesa_hash_table_search(reg->if_uses, _mesa_hash_pointer(if_stmt),
-				 if_stmt);
+      struct set_entry *entry =
+	 _mesa_set_search(reg->if_uses, _mesa_hash_pointer(if_stmt), if_stmt);
       assert(entry);
+   } else {
+      /* state->block is still the block before the if */
+      validate_ssa_src(if_stmt->condition.ssa, state);
    }
    
    assert(!exec_list_is_empty(&if_stmt->then_list));
@@ -576,11 +731,17 @@ prevalidate_reg_decl(nir_register *reg, bool is_global, validate_state *state)
 {
    assert(reg->is_global == is_global);
    
-   reg_validate_state *reg_state = ralloc(state->regs, reg_validate_state);
-   reg_state->uses = _mesa_hash_table_create(reg_state,
-					     _mesa_key_pointer_equal);
-   reg_state->defs = _mesa_hash_table_create(reg_state,
-					     _mesa_key_pointer_equal);
+   if (state->fast) {
+      reg_index_state *regs = is_global ? &state->global_reg_index
+					: &state->local_reg_index;
+      assert(reg->index < regs->num_regs && regs->regs[reg->index] == NULL);
+      regs->regs[reg->index] = reg;
+      return;
+   }
+   
+   reg_validate_state *reg_state = ralloc(state->mem_ctx, reg_validate_state);
+   reg_state->uses = _mesa_set_create(reg_state, _mesa_key_pointer_equal);
+   reg_state->defs = _mesa_set_create(reg_state, _mesa_key_pointer_equal);
    
    reg_state->where_defined = is_global ? NULL : state->impl;
    
@@ -591,23 +752,38 @@ prevalidate_reg_decl(nir_register *reg, bool is_global, validate_state *state)
 static void
 postvalidate_reg_decl(nir_register *reg, validate_state *state)
 {
-   struct hash_entry *entry = _mesa_hash_table_search(state->regs,
-						      _mesa_hash_pointer(reg),
-						      reg);
+   if (state->fast) {
+      reg_index_state *regs = reg->is_global ? &state->global_reg_index
+					     : &state->local_reg_index;
+      
+      /*
+       * Every instruction counted was found in the register's sets, so the
+       * counts only differ if the sets contain extra entries.
+       */
+      if (regs->num_uses[reg->index] != reg->uses->entries) {
+	 printf("extra entries in register uses\n");
+	 abort();
+      }
+      
+      if (regs->num_defs[reg->index] != reg->defs->entries) {
+	 printf("extra entries in register defs\n");
+	 abort();
+      }
+      
+      return;
+   }
    
-   reg_validate_state *reg_state = (reg_validate_state *) entry->data;
+   reg_validate_state *reg_state = get_reg_state(reg, state);
    
    if (reg_state->uses->entries != reg->uses->entries) {
       printf("extra entries in register uses:\n");
-      struct hash_entry *entry;
-      hash_table_foreach(reg->uses, entry) {
-	 struct hash_entry *entry2 =
-	    _mesa_hash_table_search(reg_state->uses,
-				    _mesa_hash_pointer(entry->data),
-				    entry->data);
+      struct set_entry *entry;
+      set_foreach(reg->uses, entry) {
+	 struct set_entry *entry2 =
+	    _mesa_set_search(reg_state->uses, entry->hash, entry->key);
 	    
 	 if (entry2 == NULL) {
-	    printf("0x%p\n", entry->data);
+	    printf("0x%p\n", entry->key);
 	 }
       }
       
@@ -616,15 +792,13 @@ postvalidate_reg_decl(nir_register *reg, validate_state *state)
    
    if (reg_state->defs->entries != reg->defs->entries) {
       printf("extra entries in register defs:\n");
-      struct hash_entry *entry;
-      hash_table_foreach(reg->defs, entry) {
-	 struct hash_entry *entry2 =
-	    _mesa_hash_table_search(reg_state->defs,
-				    _mesa_hash_pointer(entry->data),
-				    entry->data);
+      struct set_entry *entry;
+      set_foreach(reg->defs, entry) {
+	 struct set_entry *entry2 =
+	    _mesa_set_search(reg_state->defs, entry->hash, entry->key);
 	    
 	 if (entry2 == NULL) {
-	    printf("0x%p\n", entry->data);
+	    printf("0x%p\n", entry->key);
 	 }
       }
       
@@ -688,11 +862,178 @@ validate_function_impl(nir_function_impl *impl, validate_state *state)
 }
 
 static void
-validate_function_overload(nir_function_overload *overload,
-			   validate_state *state)
+reg_index_state_init(reg_index_state *regs, unsigned num_regs, void *mem_ctx)
+{
+   regs->num_regs = num_regs;
+   regs->regs = rzalloc_array(mem_ctx, nir_register *, num_regs);
+   regs->num_uses = rzalloc_array(mem_ctx, unsigned, num_regs);
+   regs->num_defs = rzalloc_array(mem_ctx, unsigned, num_regs);
+   regs->last_use = rzalloc_array(mem_ctx, nir_instr *, num_regs);
+   regs->last_def = rzalloc_array(mem_ctx, nir_instr *, num_regs);
+}
+
+static unsigned
+dominance_intersect(unsigned a, unsigned b, const unsigned *idom)
+{
+   while (a != b) {
+      while (a > b)
+	 a = idom[a];
+      while (b > a)
+	 b = idom[b];
+   }
+   
+   return a;
+}
+
+/*
+ * Computes the dominator tree with the algorithm from "A Simple, Fast
+ * Dominance Algorithm" by Cooper, Harvey and Kennedy, working on positions
+ * in reverse post-order, and then numbers it so that dominance can be
+ * checked in constant time. Requires the blocks to be indexed.
+ */
+static void
+compute_dominance(nir_function_impl *impl, validate_state *state,
+		  void *mem_ctx)
+{
+   nir_block **rpo = nir_impl_rpo_blocks(impl);
+   unsigned num_rpo = impl->num_rpo_blocks;
+   unsigned num_blocks = impl->num_blocks;
+   
+   dominance_state *dom = &state->dom;
+   dom->rpo_index = ralloc_array(mem_ctx, unsigned, num_blocks);
+   dom->dom_pre = ralloc_array(mem_ctx, unsigned, num_blocks);
+   dom->dom_post = ralloc_array(mem_ctx, unsigned, num_blocks);
+   
+   for (unsigned i = 0; i < num_blocks; i++)
+      dom->rpo_index[i] = ~0u;
+   for (unsigned i = 0; i < num_rpo; i++)
+      dom->rpo_index[rpo[i]->index] = i;
+   
+   unsigned *idom = ralloc_array(mem_ctx, unsigned, num_rpo);
+   idom[0] = 0;
+   for (unsigned i = 1; i < num_rpo; i++)
+      idom[i] = ~0u;
+   
+   bool progress = true;
+   while (progress) {
+      progress = false;
+      
+      for (unsigned i = 1; i < num_rpo; i++) {
+	 unsigned new_idom = ~0u;
+	 
+	 struct set_entry *entry;
+	 set_foreach(rpo[i]->predecessors, entry) {
+	    const nir_block *pred = (const nir_block *) entry->key;
+	    unsigned p = dom->rpo_index[pred->index];
+	    if (p == ~0u || idom[p] == ~0u)
+	       continue;
+	    
+	    new_idom = new_idom == ~0u ? p
+				       : dominance_intersect(new_idom, p, idom);
+	 }
+	 
+	 if (idom[i] != new_idom) {
+	    idom[i] = new_idom;
+	    progress = true;
+	 }
+      }
+   }
+   
+   /* lay out the children of each node of the tree contiguously */
+   unsigned *child_start = rzalloc_array(mem_ctx, unsigned, num_rpo + 1);
+   unsigned *children = ralloc_array(mem_ctx, unsigned, num_rpo);
+   for (unsigned i = 1; i < num_rpo; i++)
+      child_start[idom[i] + 1]++;
+   for (unsigned i = 0; i < num_rpo; i++)
+      child_start[i + 1] += child_start[i];
+   
+   unsigned *next_child = ralloc_array(mem_ctx, unsigned, num_rpo);
+   for (unsigned i = 0; i < num_rpo; i++)
+      next_child[i] = child_start[i];
+   for (unsigned i = 1; i < num_rpo; i++)
+      children[next_child[idom[i]]++] = i;
+   
+   /* number the tree with an iterative depth-first search */
+   unsigned *stack = ralloc_array(mem_ctx, unsigned, num_rpo);
+   unsigned depth = 0, pre = 0, post = 0;
+   
+   for (unsigned i = 0; i < num_rpo; i++)
+      next_child[i] = child_start[i];
+   
+   if (num_rpo > 0) {
+      stack[depth++] = 0;
+      dom->dom_pre[rpo[0]->index] = pre++;
+   }
+   
+   while (depth > 0) {
+      unsigned node = stack[depth - 1];
+      
+      if (next_child[node] == child_start[node + 1]) {
+	 dom->dom_post[rpo[node]->index] = post++;
+	 depth--;
+	 continue;
+      }
+      
+      unsigned child = children[next_child[node]++];
+      dom->dom_pre[rpo[child]->index] = pre++;
+      stack[depth++] = child;
+   }
+}
+
+static bool
+validate_function_impl_cb(nir_function_impl *impl, nir_pass_worker *worker,
+			  void *data)
 {
-   if (overload->impl != NULL)
-      validate_function_impl(overload->impl, state);
+   validate_state *global_state = (validate_state *) data;
+   
+   if (!global_state->all_impls && !impl->dirty)
+      return false;
+   
+   /* validation aborts on failure, so the flag can be cleared right away */
+   impl->dirty = false;
+   
+   validate_state state;
+   state.mem_ctx = worker->mem_ctx;
+   state.regs = worker->scratch[0];
+   state.global_regs = global_state->regs;
+   state.ssa_defs = worker->scratch[1];
+   state.var_defs = worker->scratch[2];
+   state.fast = global_state->fast;
+   state.all_impls = global_state->all_impls;
+   
+   if (!state.fast) {
+      validate_function_impl(impl, &state);
+      return false;
+   }
+   
+   void *mem_ctx = ralloc_context(worker->mem_ctx);
+   
+   nir_index_local_regs(impl);
+   nir_index_ssa_defs(impl);
+   nir_index_blocks(impl);
+   
+   reg_index_state_init(&state.local_reg_index, impl->reg_alloc, mem_ctx);
+   
+   /* the global counts are shared, but each function needs its own last_* */
+   state.global_reg_index = global_state->global_reg_index;
+   unsigned num_global_regs = state.global_reg_index.num_regs;
+   state.global_reg_index.last_use =
+      rzalloc_array(mem_ctx, nir_instr *, num_global_regs);
+   state.global_reg_index.last_def =
+      rzalloc_array(mem_ctx, nir_instr *, num_global_regs);
+   
+   state.num_ssa_defs = impl->ssa_alloc;
+   state.ssa_defs_by_index = rzalloc_array(mem_ctx, nir_ssa_def *,
+					   impl->ssa_alloc);
+   state.ssa_def_blocks = rzalloc_array(mem_ctx, nir_block *, impl->ssa_alloc);
+   
+   compute_dominance(impl, &state, mem_ctx);
+   
+   validate_function_impl(impl, &state);
+   
+   ralloc_free(mem_ctx);
+   
+   return false;
 }
 
 static void
@@ -700,32 +1041,54 @@ validate_function(nir_function *func, validate_state *state)
 {
    foreach_list_typed(nir_function_overload, overload, node, &func->overload_list) {
       assert(overload->function == func);
-      validate_function_overload(overload, state);
    }
 }
 
 static void
 init_validate_state(validate_state *state)
 {
-   state->regs = _mesa_hash_table_create(NULL, _mesa_key_pointer_equal);
-   state->ssa_defs = _mesa_hash_table_create(NULL, _mesa_key_pointer_equal);
-   state->var_defs = _mesa_hash_table_create(NULL, _mesa_key_pointer_equal);
+   state->mem_ctx = ralloc_context(NULL);
+   state->regs = _mesa_hash_table_create(state->mem_ctx,
+					 _mesa_key_pointer_equal);
+   state->global_regs = state->regs;
+   state->ssa_defs = _mesa_hash_table_create(state->mem_ctx,
+					     _mesa_key_pointer_equal);
+   state->var_defs = _mesa_hash_table_create(state->mem_ctx,
+					     _mesa_key_pointer_equal);
 }
 
 static void
 destroy_validate_state(validate_state *state)
 {
-   _mesa_hash_table_destroy(state->regs, NULL);
-   _mesa_hash_table_destroy(state->ssa_defs, NULL);
-   _mesa_hash_table_destroy(state->var_defs, NULL);
+   ralloc_free(state->mem_ctx);
 }
 
-void
-nir_validate_shader(nir_shader *shader)
+static bool
+all_impls_dirty(nir_shader *shader)
+{
+   nir_foreach_impl(shader, impl) {
+      if (!impl->dirty)
+	 return false;
+   }
+   
+   return true;
+}
+
+static void
+validate_shader(nir_shader *shader, bool fast)
 {
    validate_state state;
    init_validate_state(&state);
    
+   state.fast = fast;
+   state.all_impls = shader->globals_dirty || all_impls_dirty(shader);
+   
+   if (fast) {
+      nir_index_global_regs(shader);
+      reg_index_state_init(&state.global_reg_index, shader->reg_alloc,
+			   state.mem_ctx);
+   }
+   
    struct hash_entry *entry;
    hash_table_foreach(shader->uniforms, entry) {
       validate_var_decl((nir_variable *) entry->data, true, &state);
@@ -751,9 +1114,27 @@ nir_validate_shader(nir_shader *shader)
       validate_function(func, &state);
    }
    
-   foreach_list_typed(nir_register, reg, node, &shader->registers) {
-      postvalidate_reg_decl(reg, &state);
+   nir_shader_foreach_impl_parallel(shader, validate_function_impl_cb, &state);
+   
+   if (state.all_impls) {
+      foreach_list_typed(nir_register, reg, node, &shader->registers) {
+	 postvalidate_reg_decl(reg, &state);
+      }
    }
    
+   shader->globals_dirty = false;
+   
    destroy_validate_state(&state);
 }
+
+void
+nir_validate_shader(nir_shader *shader)
+{
+   validate_shader(shader, false);
+}
+
+void
+nir_validate_shader_fast(nir_shader *shader)
+{
+   validate_shader(shader, true);
+}
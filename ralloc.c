@@ -51,27 +51,48 @@ _CRTIMP int _vscprintf(const char *format, va_list argptr);
 
 #define CANARY 0x5A1106
 
+/* Flags stored in the low bits of ralloc_header::flags */
+#define RALLOC_HAS_DESTRUCTOR  (1 << 0) /* first child is a destructor record */
+#define RALLOC_IS_DESTRUCTOR   (1 << 1) /* this is a destructor record */
+#define RALLOC_IS_LINEAR       (1 << 2) /* this is a linear context */
+#define RALLOC_FLAG_BITS       8
+
+/*
+ * The header in front of every allocation.
+ *
+ * Destructors are rare, so they don't get a slot in every header either.
+ * ralloc_set_destructor allocates a small record instead, which is kept as
+ * the node's first child and flagged with RALLOC_HAS_DESTRUCTOR.
+ */
 struct ralloc_header
 {
-#ifdef DEBUG
-   /* A canary value used to determine whether a pointer is ralloc'd. */
-   unsigned canary;
-#endif
-
    struct ralloc_header *parent;
 
    /* The first child (head of a linked list) */
    struct ralloc_header *child;
 
-   /* Linked list of siblings */
+   /* Previous and next siblings */
    struct ralloc_header *prev;
    struct ralloc_header *next;
 
-   void (*destructor)(void *);
+   /*
+    * RALLOC_* flags in the low bits; in DEBUG builds, the rest holds a
+    * canary value used to determine whether a pointer is ralloc'd.
+    */
+   uint32_t flags;
+
+   /* The number of children, not counting a destructor record */
+   uint32_t num_children;
 };
 
 typedef struct ralloc_header ralloc_header;
 
+typedef struct
+{
+   ralloc_header header;
+   void (*destructor)(void *);
+} destructor_record;
+
 static void unlink_block(ralloc_header *info);
 static void unsafe_free(ralloc_header *info);
 
@@ -81,7 +102,7 @@ get_header(const void *ptr)
    ralloc_header *info = (ralloc_header *) (((char *) ptr) -
 					    sizeof(ralloc_header));
 #ifdef DEBUG
-   assert(info->canary == CANARY);
+   assert(info->flags >> RALLOC_FLAG_BITS == CANARY);
 #endif
    return info;
 }
@@ -92,12 +113,24 @@ static void
 add_child(ralloc_header *parent, ralloc_header *info)
 {
    if (parent != NULL) {
+      /* Keep the destructor record, if any, at the front. */
+      ralloc_header *prev = NULL;
+      ralloc_header **link = &parent->child;
+      if (parent->flags & RALLOC_HAS_DESTRUCTOR) {
+	 prev = parent->child;
+	 link = &prev->next;
+      }
+
       info->parent = parent;
-      info->next = parent->child;
-      parent->child = info;
+      info->prev = prev;
+      info->next = *link;
+      *link = info;
 
       if (info->next != NULL)
 	 info->next->prev = info;
+
+      if (!(info->flags & RALLOC_IS_DESTRUCTOR))
+	 parent->num_children++;
    }
 }
 
@@ -119,12 +152,12 @@ ralloc_size(const void *ctx, size_t size)
    info = (ralloc_header *) block;
    parent = ctx != NULL ? get_header(ctx) : NULL;
 
-   add_child(parent, info);
-
 #ifdef DEBUG
-   info->canary = CANARY;
+   info->flags = CANARY << RALLOC_FLAG_BITS;
 #endif
 
+   add_child(parent, info);
+
    return PTR_FROM_HEADER(info);
 }
 
@@ -231,6 +264,9 @@ unlink_block(ralloc_header *info)
 
       if (info->next != NULL)
 	 info->next->prev = info->prev;
+
+      assert(!(info->flags & RALLOC_IS_DESTRUCTOR));
+      info->parent->num_children--;
    }
    info->parent = NULL;
    info->prev = NULL;
@@ -240,8 +276,17 @@ unlink_block(ralloc_header *info)
 static void
 unsafe_free(ralloc_header *info)
 {
-   /* Recursively free any children...don't waste time unlinking them. */
+   void (*destructor)(void *) = NULL;
    ralloc_header *temp;
+
+   if (info->flags & RALLOC_HAS_DESTRUCTOR) {
+      temp = info->child;
+      info->child = temp->next;
+      destructor = ((destructor_record *) temp)->destructor;
+      free(temp);
+   }
+
+   /* Recursively free any children...don't waste time unlinking them. */
    while (info->child != NULL) {
       temp = info->child;
       info->child = temp->next;
@@ -249,8 +294,8 @@ unsafe_free(ralloc_header *info)
    }
 
    /* Free the block itself.  Call the destructor first, if any. */
-   if (info->destructor != NULL)
-      info->destructor(PTR_FROM_HEADER(info));
+   if (destructor != NULL)
+      destructor(PTR_FROM_HEADER(info));
 
    free(info);
 }
@@ -283,6 +328,12 @@ ralloc_parent(const void *ptr)
    return info->parent ? PTR_FROM_HEADER(info->parent) : NULL;
 }
 
+unsigned
+ralloc_num_children(const void *ptr)
+{
+   return get_header(ptr)->num_children;
+}
+
 static void *autofree_context = NULL;
 
 static void
@@ -305,7 +356,24 @@ void
 ralloc_set_destructor(const void *ptr, void(*destructor)(void *))
 {
    ralloc_header *info = get_header(ptr);
-   info->destructor = destructor;
+   destructor_record *record;
+
+   if (info->flags & RALLOC_HAS_DESTRUCTOR) {
+      ((destructor_record *) info->child)->destructor = destructor;
+      return;
+   }
+
+   if (destructor == NULL)
+      return;
+
+   record = calloc(1, sizeof(destructor_record));
+   assert(record != NULL);
+   record->header.flags = info->flags & ~((1 << RALLOC_FLAG_BITS) - 1);
+   record->header.flags |= RALLOC_IS_DESTRUCTOR;
+   record->destructor = destructor;
+
+   add_child(info, &record->header);
+   info->flags |= RALLOC_HAS_DESTRUCTOR;
 }
 
 char *
@@ -490,3 +558,105 @@ ralloc_vasprintf_rewrite_tail(char **str, size_t *start, const char *fmt,
    *start += new_length;
    return true;
 }
+
+/*
+ * Linear allocation
+ *
+ * A linear context is a ralloc node holding a bump pointer into the chunk it
+ * allocated most recently.  Chunks are ralloc children of the context, so
+ * they go away with it, and move with it when it is stolen.
+ */
+
+#define LINEAR_CHUNK_SIZE (16 * 1024)
+
+/* the same alignment ralloc_size gives us */
+#define LINEAR_ALIGNMENT (sizeof(ralloc_header) % 16 == 0 ? 16 : 8)
+
+/* children larger than this get a chunk of their own */
+#define LINEAR_MAX_CHILD_SIZE (LINEAR_CHUNK_SIZE / 4)
+
+struct linear_ctx
+{
+   /* first free byte in the current chunk */
+   char *next;
+
+   /* end of the current chunk */
+   char *end;
+};
+
+typedef struct linear_ctx linear_ctx;
+
+void *
+ralloc_linear_context(const void *ctx)
+{
+   linear_ctx *lin = ralloc(ctx, linear_ctx);
+   if (unlikely(lin == NULL))
+      return NULL;
+
+   lin->next = NULL;
+   lin->end = NULL;
+   get_header(lin)->flags |= RALLOC_IS_LINEAR;
+
+   return lin;
+}
+
+bool
+ralloc_is_linear_context(const void *ctx)
+{
+   return ctx != NULL && (get_header(ctx)->flags & RALLOC_IS_LINEAR);
+}
+
+void *
+linear_alloc_child(void *linear_ctx_ptr, size_t size)
+{
+   linear_ctx *lin = (linear_ctx *) linear_ctx_ptr;
+   char *ptr;
+
+   assert(ralloc_is_linear_context(lin));
+
+   size = (size + LINEAR_ALIGNMENT - 1) & ~(LINEAR_ALIGNMENT - 1);
+
+   if (unlikely(size > (size_t) (lin->end - lin->next))) {
+      /* Don't throw away the rest of the current chunk for a big child. */
+      if (size > LINEAR_MAX_CHILD_SIZE)
+	 return ralloc_size(lin, size);
+
+      char *chunk = ralloc_size(lin, LINEAR_CHUNK_SIZE);
+      if (unlikely(chunk == NULL))
+	 return NULL;
+
+      lin->next = chunk;
+      lin->end = chunk + LINEAR_CHUNK_SIZE;
+   }
+
+   ptr = lin->next;
+   lin->next += size;
+   return ptr;
+}
+
+void *
+linear_zalloc_child(void *linear_ctx_ptr, size_t size)
+{
+   void *ptr = linear_alloc_child(linear_ctx_ptr, size);
+   if (likely(ptr != NULL))
+      memset(ptr, 0, size);
+   return ptr;
+}
+
+char *
+linear_strdup(void *linear_ctx_ptr, const char *str)
+{
+   size_t n;
+   char *ptr;
+
+   if (unlikely(str == NULL))
+      return NULL;
+
+   n = strlen(str);
+   ptr = linear_alloc_child(linear_ctx_ptr, n + 1);
+   if (unlikely(ptr == NULL))
+      return NULL;
+
+   memcpy(ptr, str, n + 1);
+   return ptr;
+}
@@ -238,6 +238,11 @@ void ralloc_steal(const void *new_ctx, void *ptr);
  */
 void *ralloc_parent(const void *ptr);
 
+/**
+ * Return the number of children the given pointer currently has.
+ */
+unsigned ralloc_num_children(const void *ptr);
+
 /**
  * Return a context whose memory will be automatically freed at program exit.
  *
@@ -249,6 +254,9 @@ void *ralloc_autofree_context(void);
 
 /**
  * Set a callback to occur just before an object is freed.
+ *
+ * Space for the callback is only allocated the first time a non-NULL
+ * destructor is set on an object.
  */
 void ralloc_set_destructor(const void *ptr, void(*destructor)(void *));
 
@@ -399,6 +407,59 @@ bool ralloc_asprintf_append (char **str, const char *fmt, ...)
 bool ralloc_vasprintf_append(char **str, const char *fmt, va_list args);
 /// @}
 
+/// \defgroup linear Linear Allocators @{
+
+/**
+ * Allocate a new linear context.
+ *
+ * A linear context is an ordinary ralloc context, which can be freed, stolen
+ * and used as the parent of other ralloc allocations, but which can also
+ * hand out "linear" children with \c linear_alloc_child.  Those are bump
+ * allocated out of large chunks owned by the context, so they cost neither
+ * a \c malloc call nor a ralloc header each.  In exchange, a linear child
+ * can't be freed, resized or stolen on its own, nor used as a ralloc
+ * context: its memory is only released when the whole linear context is.
+ */
+void *ralloc_linear_context(const void *ctx);
+
+/**
+ * Return whether \p ctx was created with \c ralloc_linear_context.
+ */
+bool ralloc_is_linear_context(const void *ctx);
+
+/**
+ * Allocate \p size bytes out of the given linear context.
+ *
+ * The memory is suitably aligned for any of the types that ralloc_size
+ * would be used for, but is not initialized.
+ */
+void *linear_alloc_child(void *linear_ctx, size_t size);
+
+/**
+ * Allocate zero-initialized memory out of the given linear context.
+ */
+void *linear_zalloc_child(void *linear_ctx, size_t size);
+
+/**
+ * \def linear_alloc(ctx, type)
+ * Allocate a new object out of the given linear context.
+ */
+#define linear_alloc(ctx, type) \
+   ((type *) linear_alloc_child(ctx, sizeof(type)))
+
+/**
+ * \def linear_zalloc(ctx, type)
+ * Allocate a new zero-initialized object out of the given linear context.
+ */
+#define linear_zalloc(ctx, type) \
+   ((type *) linear_zalloc_child(ctx, sizeof(type)))
+
+/**
+ * Duplicate a string, allocating the memory out of the given linear context.
+ */
+char *linear_strdup(void *linear_ctx, const char *str);
+/// @}
+
 #ifdef __cplusplus
 } /* end of extern "C" */
 #endif
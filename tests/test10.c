@@ -0,0 +1,74 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Authors:
+ *    Connor Abbott (cwabbott0@gmail.com)
+ *
+ */
+
+/*
+ * Emits SSA code with nir_builder, moving the cursor around an if.
+ */
+
+#include "nir_builder.h"
+
+int main(void)
+{
+   nir_shader *shader = nir_shader_create(NULL);
+   nir_function *func = nir_function_create(shader, "main");
+   nir_function_overload *overload = nir_function_overload_create(func);
+   nir_function_impl *impl = nir_function_impl_create(overload);
+   
+   nir_builder b;
+   nir_builder_init(&b, shader, impl);
+   
+   nir_ssa_def *x = nir_imm_vec4(&b, 1.0f, 2.0f, 3.0f, 4.0f);
+   nir_ssa_def *doubled = nir_fadd(&b, x, x);
+   nir_ssa_def *dot = nir_fdot4(&b, x, doubled);
+   nir_ssa_def *limit = nir_imm_float(&b, 10.0f);
+   nir_ssa_def *less = nir_flt(&b, dot, limit);
+   
+   nir_if *if_stmt = nir_if_create(shader);
+   if_stmt->condition.is_ssa = true;
+   if_stmt->condition.ssa = less;
+   nir_cf_node_insert_end(&impl->body, &if_stmt->cf_node);
+   
+   b.cursor = nir_after_cf_list(&if_stmt->then_list);
+   nir_fsub(&b, limit, dot);
+   
+   b.cursor = nir_before_cf_list(&if_stmt->else_list);
+   nir_ffma(&b, dot, dot, limit);
+   
+   b.cursor = nir_after_cf_node(&if_stmt->cf_node);
+   nir_vec2(&b, dot, limit);
+   
+   /* goes in between the two constants at the start */
+   b.cursor = nir_before_instr(doubled->parent_instr);
+   nir_ineg(&b, nir_imm_int(&b, 7));
+   
+   nir_validate_shader_fast(shader);
+   nir_print_shader(shader, stdout);
+   
+   ralloc_free(shader);
+   
+   return 0;
+}
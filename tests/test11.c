@@ -0,0 +1,113 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Authors:
+ *    Connor Abbott (cwabbott0@gmail.com)
+ *
+ */
+
+/*
+ * Creates one instruction of every kind that has a creation function and
+ * checks that the result validates and prints.
+ */
+
+#include "nir_builder.h"
+
+int main(void)
+{
+   nir_shader *shader = nir_shader_create(NULL);
+   
+   nir_function *helper_func = nir_function_create(shader, "helper");
+   nir_function_overload *helper = nir_function_overload_create(helper_func);
+   nir_function_impl_create(helper);
+   
+   nir_function *func = nir_function_create(shader, "main");
+   nir_function_overload *overload = nir_function_overload_create(func);
+   nir_function_impl *impl = nir_function_impl_create(overload);
+   
+   nir_variable *var = rzalloc(shader, nir_variable);
+   var->type = glsl_vec4_type();
+   var->name = "color";
+   var->data.mode = nir_var_local;
+   exec_list_push_tail(&impl->locals, &var->node);
+   
+   nir_builder b;
+   nir_builder_init(&b, shader, impl);
+   
+   nir_intrinsic_instr *load =
+      nir_intrinsic_instr_create(shader, nir_intrinsic_load_var_vec4);
+   load->variables[0] = nir_deref_var_create(shader, var);
+   nir_ssa_dest_init(impl, &load->instr, &load->dest, 4, "loaded");
+   nir_builder_instr_insert(&b, &load->instr);
+   
+   nir_tex_instr *tex = nir_tex_instr_create(shader, 1);
+   tex->op = nir_texop_tex;
+   tex->src[0].is_ssa = true;
+   tex->src[0].ssa = &load->dest.ssa;
+   tex->src_type[0] = nir_tex_src_coord;
+   tex->coord_components = 2;
+   tex->sampler_index = 3;
+   nir_ssa_dest_init(impl, &tex->instr, &tex->dest, 4, NULL);
+   nir_builder_instr_insert(&b, &tex->instr);
+   
+   nir_call_instr *call = nir_call_instr_create(shader, helper);
+   nir_builder_instr_insert(&b, &call->instr);
+   
+   nir_ssa_def *condition = nir_imm_int(&b, 1);
+   
+   nir_if *if_stmt = nir_if_create(shader);
+   if_stmt->condition.is_ssa = true;
+   if_stmt->condition.ssa = condition;
+   nir_cf_node_insert_end(&impl->body, &if_stmt->cf_node);
+   
+   b.cursor = nir_after_cf_list(&if_stmt->then_list);
+   nir_ssa_def *then_value = nir_fadd(&b, &tex->dest.ssa, &load->dest.ssa);
+   
+   b.cursor = nir_after_cf_list(&if_stmt->else_list);
+   nir_ssa_def *else_value = nir_ssa_undef(&b, 4);
+   
+   nir_phi_instr *phi = nir_phi_instr_create(shader);
+   nir_src src;
+   src.is_ssa = true;
+   src.ssa = then_value;
+   nir_phi_instr_add_src(shader, phi, then_value->parent_instr->block, src);
+   src.ssa = else_value;
+   nir_phi_instr_add_src(shader, phi, else_value->parent_instr->block, src);
+   nir_ssa_dest_init(impl, &phi->instr, &phi->dest, 4, NULL);
+   b.cursor = nir_after_cf_node(&if_stmt->cf_node);
+   nir_builder_instr_insert(&b, &phi->instr);
+   
+   nir_intrinsic_instr *store =
+      nir_intrinsic_instr_create(shader, nir_intrinsic_store_var_vec4);
+   store->variables[0] = nir_deref_var_create(shader, var);
+   store->src[0].is_ssa = true;
+   store->src[0].ssa = &phi->dest.ssa;
+   nir_builder_instr_insert(&b, &store->instr);
+   
+   nir_validate_shader_fast(shader);
+   nir_validate_shader(shader);
+   nir_print_shader(shader, stdout);
+   
+   ralloc_free(shader);
+   
+   return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Authors:
+ *    Connor Abbott (cwabbott0@gmail.com)
+ *
+ */
+
+/*
+ * Runs a few made-up passes through the pass manager and checks the stats
+ * it records for them.
+ */
+
+#include <string.h>
+#include "nir.h"
+
+static nir_function_impl *
+get_main(nir_shader *shader)
+{
+   nir_function *func = exec_node_data(nir_function,
+				       exec_list_get_head(&shader->functions),
+				       node);
+   nir_function_overload *overload =
+      exec_node_data(nir_function_overload,
+		     exec_list_get_head(&func->overload_list), node);
+   return overload->impl;
+}
+
+static bool
+remove_load_consts(nir_shader *shader, void *data)
+{
+   bool progress = false;
+   
+   nir_foreach_block_in_order(get_main(shader), block) {
+      foreach_list_safe(node, &block->instr_list) {
+	 nir_instr *instr = exec_node_data(nir_instr, node, node);
+	 if (instr->type == nir_instr_type_load_const) {
+	    nir_instr_remove(instr);
+	    progress = true;
+	 }
+      }
+   }
+   
+   return progress;
+}
+
+static bool
+add_if(nir_shader *shader, void *data)
+{
+   nir_if *if_stmt = nir_if_create(shader);
+   if_stmt->condition.reg.reg = (nir_register *) data;
+   nir_cf_node_insert_end(&get_main(shader)->body, &if_stmt->cf_node);
+   return true;
+}
+
+static bool
+do_nothing(nir_shader *shader, void *data)
+{
+   return false;
+}
+
+static void
+print_stats(nir_pass_manager *pm)
+{
+   unsigned num_stats;
+   const nir_pass_stat *stats = nir_pass_manager_stats(pm, &num_stats);
+   
+   for (unsigned i = 0; i < num_stats; i++) {
+      printf("%s: instrs %+d, blocks %+d, %s\n", stats[i].name,
+	     stats[i].instr_delta, stats[i].block_delta,
+	     stats[i].progress ? "progress" : "no progress");
+   }
+}
+
+/* the timings vary between runs, so only count the objects */
+static unsigned
+count_lines(const char *str)
+{
+   unsigned lines = 0;
+   for (; *str != '\0'; str++) {
+      if (*str == '\n')
+	 lines++;
+   }
+   return lines;
+}
+
+int main(void)
+{
+   nir_shader *shader = nir_shader_create(NULL);
+   nir_function *func = nir_function_create(shader, "main");
+   nir_function_overload *overload = nir_function_overload_create(func);
+   nir_function_impl *impl = nir_function_impl_create(overload);
+   
+   nir_register *reg = nir_local_reg_create(impl);
+   reg->num_components = 1;
+   
+   for (unsigned i = 0; i < 3; i++) {
+      nir_load_const_instr *load_const = nir_load_const_instr_create(shader);
+      load_const->dest.reg.reg = reg;
+      load_const->value.i[0] = i;
+      nir_instr_insert_after_cf_list(&impl->body, &load_const->instr);
+   }
+   
+   nir_pass_manager *pm = nir_pass_manager_create(shader);
+   nir_pass_manager_add(pm, "remove_load_consts", remove_load_consts, NULL);
+   nir_pass_manager_add(pm, "add_if", add_if, reg);
+   nir_pass_manager_add(pm, "nothing", add_if, reg);
+   nir_pass_manager_add(pm, "nothing", do_nothing, NULL);
+   
+   printf("has add_if: %d, has missing: %d\n",
+	  nir_pass_manager_has_pass(pm, "add_if"),
+	  nir_pass_manager_has_pass(pm, "missing"));
+   
+   bool progress;
+   bool ok = nir_pass_manager_run_string(pm, shader,
+					 " add_if,nothing, remove_load_consts "
+					 "nothing\tremove_load_consts",
+					 &progress);
+   printf("ok: %d, progress: %d\n", ok, progress);
+   print_stats(pm);
+   
+   /* the stats keep the name of a pass that is registered again */
+   nir_pass_manager_add(pm, "add_if", do_nothing, NULL);
+   
+   char *json = nir_pass_manager_stats_to_json(pm, shader);
+   char *trace = nir_pass_manager_stats_to_trace(pm, shader);
+   printf("json lines: %u, trace lines: %u\n", count_lines(json),
+	  count_lines(trace));
+   printf("%.*s", (int) (strchr(trace, '\n') - trace + 1), trace);
+   
+   nir_pass_manager_clear_stats(pm);
+   
+   const char *const passes[] = { "nothing", "remove_load_consts" };
+   ok = nir_pass_manager_run(pm, shader, passes, 2, &progress);
+   printf("ok: %d, progress: %d\n", ok, progress);
+   print_stats(pm);
+   
+   /* nothing runs if any of the names is wrong */
+   ok = nir_pass_manager_run_string(pm, shader, "nothing missing", NULL);
+   printf("ok: %d\n", ok);
+   print_stats(pm);
+   
+   nir_validate_shader(shader);
+   nir_print_shader(shader, stdout);
+   
+   ralloc_free(shader);
+   
+   return 0;
+}
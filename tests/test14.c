@@ -0,0 +1,130 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Authors:
+ *    Connor Abbott (cwabbott0@gmail.com)
+ *
+ */
+
+/*
+ * Runs a simple dead code elimination through the optimization loop, and
+ * checks that each round only revisits what the previous one changed.
+ */
+
+#include "nir_builder.h"
+
+static bool
+is_used(nir_function_impl *impl, nir_ssa_def *def)
+{
+   nir_foreach_block_in_order(impl, block) {
+      nir_foreach_instr(block, instr) {
+	 nir_instr_foreach_src(instr, iter) {
+	    if (iter.src->is_ssa && iter.src->ssa == def)
+	       return true;
+	 }
+      }
+      
+      nir_if *if_stmt = nir_block_following_if(block);
+      if (if_stmt != NULL && if_stmt->condition.is_ssa &&
+	  if_stmt->condition.ssa == def)
+	 return true;
+   }
+   
+   return false;
+}
+
+static bool
+dce_instr(nir_instr *instr, void *data)
+{
+   nir_dest *dest = nir_instr_dest(instr);
+   if (dest == NULL || !dest->is_ssa)
+      return false;
+   
+   printf("dce: ssa_%u", dest->ssa.index);
+   
+   if (is_used((nir_function_impl *) data, &dest->ssa)) {
+      printf("\n");
+      return false;
+   }
+   
+   printf(" removed\n");
+   nir_instr_remove(instr);
+   return true;
+}
+
+static bool
+visit_block(nir_block *block, void *data)
+{
+   printf("block: block_%u\n", block->index);
+   return false;
+}
+
+static bool
+visit_impl(nir_function_impl *impl, void *data)
+{
+   printf("impl\n");
+   return false;
+}
+
+int main(void)
+{
+   nir_shader *shader = nir_shader_create(NULL);
+   nir_function *func = nir_function_create(shader, "main");
+   nir_function_overload *overload = nir_function_overload_create(func);
+   nir_function_impl *impl = nir_function_impl_create(overload);
+   
+   nir_builder b;
+   nir_builder_init(&b, shader, impl);
+   
+   nir_ssa_def *x = nir_imm_float(&b, 1.0f);
+   nir_fneg(&b, nir_fneg(&b, nir_fneg(&b, x)));
+   nir_ssa_def *sum = nir_fadd(&b, x, x);
+   
+   nir_if *if_stmt = nir_if_create(shader);
+   if_stmt->condition.is_ssa = true;
+   if_stmt->condition.ssa = sum;
+   nir_cf_node_insert_end(&impl->body, &if_stmt->cf_node);
+   
+   b.cursor = nir_after_cf_list(&if_stmt->then_list);
+   nir_fneg(&b, nir_imm_float(&b, 2.0f));
+   
+   nir_index_blocks(impl);
+   
+   nir_opt_pass passes[3] = {
+      { .instr_cb = dce_instr, .data = impl },
+      { .block_cb = visit_block },
+      { .impl_cb = visit_impl },
+   };
+   
+   bool progress = nir_optimize(shader, passes, 3);
+   printf("progress: %d\n", progress);
+   
+   progress = nir_optimize(shader, passes, 1);
+   printf("progress: %d\n", progress);
+   
+   nir_validate_shader(shader);
+   nir_print_shader(shader, stdout);
+   
+   ralloc_free(shader);
+   
+   return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Authors:
+ *    Connor Abbott (cwabbott0@gmail.com)
+ *
+ */
+
+/*
+ * Runs sparse conditional constant propagation on a function where a
+ * constant only shows up once the branch that is never taken is ignored,
+ * and then flows around a loop.
+ */
+
+#include "nir_builder.h"
+
+/* an empty if at the end of the function */
+static nir_if *
+build_if(nir_builder *b, nir_ssa_def *condition)
+{
+   nir_if *if_stmt = nir_if_create(b->shader);
+   if_stmt->condition.is_ssa = true;
+   if_stmt->condition.ssa = condition;
+   nir_cf_node_insert_end(&b->impl->body, &if_stmt->cf_node);
+   return if_stmt;
+}
+
+/*
+ * Two ifs that both fold, where the phi after the second one is replaced by
+ * a phi after the first one, which is then replaced in turn.
+ */
+static nir_shader *
+create_sequential_ifs(void)
+{
+   nir_shader *shader = nir_shader_create(NULL);
+   nir_function *func = nir_function_create(shader, "main");
+   nir_function_overload *overload = nir_function_overload_create(func);
+   nir_function_impl *impl = nir_function_impl_create(overload);
+   
+   nir_builder b;
+   nir_builder_init(&b, shader, impl);
+   
+   nir_ssa_def *true_value = nir_imm_int(&b, 1);
+   nir_ssa_def *unknown = nir_ssa_undef(&b, 1);
+   
+   /* x = true ? unknown + 1.0 : 2.0 */
+   nir_if *first = build_if(&b, true_value);
+   b.cursor = nir_after_cf_list(&first->then_list);
+   nir_ssa_def *then_value = nir_fadd(&b, unknown, nir_imm_float(&b, 1.0f));
+   b.cursor = nir_after_cf_list(&first->else_list);
+   nir_ssa_def *else_value = nir_imm_float(&b, 2.0f);
+   
+   b.cursor = nir_after_cf_list(&impl->body);
+   nir_phi_instr *x = nir_build_phi(&b, 1);
+   nir_phi_add_ssa_src(&b, x, nir_cf_list_last_block(&first->then_list),
+		       then_value);
+   nir_phi_add_ssa_src(&b, x, nir_cf_list_last_block(&first->else_list),
+		       else_value);
+   
+   /* p = true ? x : x * x; p * p */
+   nir_if *second = build_if(&b, true_value);
+   b.cursor = nir_after_cf_list(&second->else_list);
+   else_value = nir_fmul(&b, &x->dest.ssa, &x->dest.ssa);
+   
+   b.cursor = nir_after_cf_list(&impl->body);
+   nir_phi_instr *p = nir_build_phi(&b, 1);
+   nir_phi_add_ssa_src(&b, p, nir_cf_list_last_block(&second->then_list),
+		       &x->dest.ssa);
+   nir_phi_add_ssa_src(&b, p, nir_cf_list_last_block(&second->else_list),
+		       else_value);
+   nir_fmul(&b, &p->dest.ssa, &p->dest.ssa);
+   
+   return shader;
+}
+
+int main(void)
+{
+   nir_shader *shader = nir_shader_create(NULL);
+   nir_function *func = nir_function_create(shader, "main");
+   nir_function_overload *overload = nir_function_overload_create(func);
+   nir_function_impl *impl = nir_function_impl_create(overload);
+   
+   nir_builder b;
+   nir_builder_init(&b, shader, impl);
+   
+   nir_ssa_def *x = nir_imm_float(&b, 2.0f);
+   nir_ssa_def *unknown = nir_ssa_undef(&b, 1);
+   nir_ssa_def *cond = nir_flt(&b, x, nir_imm_float(&b, 3.0f));
+   
+   /* if (x < 3.0) a = x + 1.0; else a = x * unknown; */
+   nir_if *if_stmt = nir_if_create(shader);
+   if_stmt->condition.is_ssa = true;
+   if_stmt->condition.ssa = cond;
+   nir_cf_node_insert_end(&impl->body, &if_stmt->cf_node);
+   
+   b.cursor = nir_after_cf_list(&if_stmt->then_list);
+   nir_ssa_def *then_value = nir_fadd(&b, x, nir_imm_float(&b, 1.0f));
+   
+   b.cursor = nir_after_cf_list(&if_stmt->else_list);
+   nir_ssa_def *else_value = nir_fmul(&b, x, unknown);
+   
+   nir_block *join =
+      nir_cf_node_as_block(nir_cf_node_next(&if_stmt->cf_node));
+   b.cursor = nir_after_block(join);
+   nir_phi_instr *a = nir_build_phi(&b, 1);
+   nir_phi_add_ssa_src(&b, a, nir_cf_list_last_block(&if_stmt->then_list),
+		       then_value);
+   nir_phi_add_ssa_src(&b, a, nir_cf_list_last_block(&if_stmt->else_list),
+		       else_value);
+   
+   /* loop { v = phi(a, w); w = v * 1.0; if (unknown) break; } */
+   nir_loop *loop = nir_loop_create(shader);
+   nir_cf_node_insert_end(&impl->body, &loop->cf_node);
+   
+   nir_if *break_if = nir_if_create(shader);
+   break_if->condition.is_ssa = true;
+   break_if->condition.ssa = unknown;
+   nir_cf_node_insert_end(&loop->body, &break_if->cf_node);
+   
+   nir_jump_instr *jump = nir_jump_instr_create(shader, nir_jump_break);
+   nir_instr_insert_after_cf_list(&break_if->then_list, &jump->instr);
+   
+   b.cursor = nir_after_block(nir_cf_list_first_block(&loop->body));
+   nir_phi_instr *v = nir_build_phi(&b, 1);
+   
+   b.cursor = nir_after_instr(&v->instr);
+   nir_ssa_def *w = nir_fmul(&b, &v->dest.ssa, nir_imm_float(&b, 1.0f));
+   
+   nir_phi_add_ssa_src(&b, v, join, &a->dest.ssa);
+   nir_phi_add_ssa_src(&b, v, nir_cf_list_last_block(&loop->body), w);
+   
+   b.cursor = nir_after_cf_list(&impl->body);
+   nir_fadd(&b, w, x);
+   
+   /* unary, vector-building and reducing opcodes fold as well */
+   nir_ssa_def *neg = nir_fneg(&b, x);
+   nir_ssa_def *pair = nir_vec2(&b, neg, x);
+   nir_fdot2(&b, pair, pair);
+   
+   nir_validate_shader(shader);
+   
+   bool progress = nir_opt_sccp(shader);
+   printf("progress: %d\n", progress);
+   
+   nir_validate_shader(shader);
+   nir_print_shader(shader, stdout);
+   
+   progress = nir_opt_sccp(shader);
+   printf("progress: %d\n", progress);
+   
+   ralloc_free(shader);
+   
+   shader = create_sequential_ifs();
+   nir_validate_shader(shader);
+   
+   progress = nir_opt_sccp(shader);
+   printf("progress: %d\n", progress);
+   
+   nir_validate_shader(shader);
+   nir_print_shader(shader, stdout);
+   
+   ralloc_free(shader);
+   
+   return 0;
+}
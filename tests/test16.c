@@ -0,0 +1,147 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Authors:
+ *    Connor Abbott (cwabbott0@gmail.com)
+ *
+ */
+
+/*
+ * Computes integer ranges and known bits for a counting loop, and uses them
+ * to simplify shifts, masks and comparisons of the loop counter.
+ */
+
+#include "nir_builder.h"
+
+static void
+print_ranges(nir_function_impl *impl, const nir_range_analysis *ra)
+{
+   nir_foreach_block_in_order(impl, block) {
+      nir_foreach_instr(block, instr) {
+	 nir_dest *dest = nir_instr_dest(instr);
+	 if (dest == NULL || !dest->is_ssa)
+	    continue;
+	 
+	 nir_int_range r = nir_range_analysis_get(ra, &dest->ssa);
+	 printf("ssa_%u: [%d, %d] zero 0x%08x one 0x%08x\n", dest->ssa.index,
+		r.min, r.max, r.known_zero, r.known_one);
+      }
+   }
+}
+
+/* emits op reading reg as source reg_src and value as the other source */
+static void
+build_reg_alu(nir_builder *b, nir_op op, nir_register *reg, unsigned reg_src,
+	      nir_ssa_def *value)
+{
+   nir_alu_instr *alu = nir_alu_instr_create(b->shader, op);
+   alu->src[reg_src].src.reg.reg = reg;
+   alu->src[1 - reg_src].src.is_ssa = true;
+   alu->src[1 - reg_src].src.ssa = value;
+   nir_ssa_dest_init(b->impl, &alu->instr, &alu->dest.dest, 1, NULL);
+   alu->dest.write_mask = 1;
+   nir_builder_instr_insert(b, &alu->instr);
+}
+
+int main(void)
+{
+   nir_shader *shader = nir_shader_create(NULL);
+   nir_function *func = nir_function_create(shader, "main");
+   nir_function_overload *overload = nir_function_overload_create(func);
+   nir_function_impl *impl = nir_function_impl_create(overload);
+   
+   nir_builder b;
+   nir_builder_init(&b, shader, impl);
+   
+   nir_ssa_def *zero = nir_imm_int(&b, 0);
+   nir_ssa_def *one = nir_imm_int(&b, 1);
+   nir_ssa_def *eight = nir_imm_int(&b, 8);
+   nir_ssa_def *mask = nir_imm_int(&b, 15);
+   nir_ssa_def *hundred = nir_imm_int(&b, 100);
+   nir_ssa_def *minus_four = nir_imm_int(&b, -4);
+   nir_block *preheader = nir_cf_list_last_block(&impl->body);
+   
+   /* loop { i = phi(0, i + 1); if (i >= 8) break; ... } */
+   nir_loop *loop = nir_loop_create(shader);
+   nir_cf_node_insert_end(&impl->body, &loop->cf_node);
+   
+   b.cursor = nir_after_block(nir_cf_list_first_block(&loop->body));
+   nir_phi_instr *i = nir_build_phi(&b, 1);
+   
+   b.cursor = nir_after_instr(&i->instr);
+   nir_ssa_def *done = nir_ige(&b, &i->dest.ssa, eight);
+   
+   nir_if *if_stmt = nir_if_create(shader);
+   if_stmt->condition.is_ssa = true;
+   if_stmt->condition.ssa = done;
+   nir_cf_node_insert_end(&loop->body, &if_stmt->cf_node);
+   
+   nir_jump_instr *jump = nir_jump_instr_create(shader, nir_jump_break);
+   nir_instr_insert_after_cf_list(&if_stmt->then_list, &jump->instr);
+   
+   b.cursor = nir_after_cf_list(&loop->body);
+   nir_ishr(&b, &i->dest.ssa, one);
+   nir_iand(&b, &i->dest.ssa, mask);
+   nir_ilt(&b, &i->dest.ssa, hundred);
+   nir_ishr(&b, minus_four, one);
+   nir_ssa_def *next = nir_iadd(&b, &i->dest.ssa, one);
+   
+   nir_phi_add_ssa_src(&b, i, preheader, zero);
+   nir_phi_add_ssa_src(&b, i, nir_cf_list_last_block(&loop->body), next);
+   
+   b.cursor = nir_after_cf_list(&impl->body);
+   nir_ishl(&b, &i->dest.ssa, nir_imm_int(&b, 2));
+   
+   /* always 0 and always true, but the register sources are kept */
+   nir_register *reg = nir_local_reg_create(impl);
+   reg->num_components = 1;
+   nir_alu_instr *mov = nir_alu_instr_create(shader, nir_op_mov);
+   mov->src[0].src.is_ssa = true;
+   mov->src[0].src.ssa = &i->dest.ssa;
+   mov->dest.dest.reg.reg = reg;
+   mov->dest.write_mask = 1;
+   nir_builder_instr_insert(&b, &mov->instr);
+   build_reg_alu(&b, nir_op_iand, reg, 1, zero);
+   build_reg_alu(&b, nir_op_uge, reg, 0, zero);
+   
+   nir_validate_shader(shader);
+   
+   void *mem_ctx = ralloc_context(NULL);
+   nir_range_analysis *ra = nir_range_analysis_create(mem_ctx, impl);
+   print_ranges(impl, ra);
+   printf("i in bounds of 9: %d\n", nir_ssa_def_in_bounds(ra, &i->dest.ssa, 9));
+   printf("i in bounds of 8: %d\n", nir_ssa_def_in_bounds(ra, &i->dest.ssa, 8));
+   ralloc_free(mem_ctx);
+   
+   bool progress = nir_opt_int_ranges(shader);
+   printf("progress: %d\n", progress);
+   
+   nir_validate_shader(shader);
+   nir_print_shader(shader, stdout);
+   
+   progress = nir_opt_int_ranges(shader);
+   printf("progress: %d\n", progress);
+   
+   ralloc_free(shader);
+   
+   return 0;
+}
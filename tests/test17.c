@@ -0,0 +1,188 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Authors:
+ *    Connor Abbott (cwabbott0@gmail.com)
+ *
+ */
+
+/*
+ * Runs the divergence analysis on a function with uniform and divergent
+ * values, ifs, loop exits and registers.
+ */
+
+#include "nir_builder.h"
+
+static void
+build_reg_write(nir_builder *b, nir_register *reg, nir_ssa_def *value)
+{
+   nir_alu_instr *mov = nir_alu_instr_create(b->shader, nir_op_mov);
+   mov->src[0].src.is_ssa = true;
+   mov->src[0].src.ssa = value;
+   mov->dest.dest.reg.reg = reg;
+   mov->dest.write_mask = 1;
+   nir_builder_instr_insert(b, &mov->instr);
+}
+
+static nir_if *
+build_if(nir_builder *b, struct exec_list *list, nir_ssa_def *condition)
+{
+   nir_if *if_stmt = nir_if_create(b->shader);
+   if_stmt->condition.is_ssa = true;
+   if_stmt->condition.ssa = condition;
+   nir_cf_node_insert_end(list, &if_stmt->cf_node);
+   return if_stmt;
+}
+
+/* if (a) x = b + 1 else x = b * b, writing reg in the then branch */
+static nir_ssa_def *
+build_select(nir_builder *b, nir_ssa_def *a, nir_ssa_def *value,
+	     nir_register *reg)
+{
+   nir_function_impl *impl = b->impl;
+   nir_if *if_stmt = build_if(b, &impl->body, nir_flt(b, a, nir_imm_float(b, 1.0f)));
+   
+   b->cursor = nir_after_cf_list(&if_stmt->then_list);
+   nir_ssa_def *then_value = nir_fadd(b, value, nir_imm_float(b, 1.0f));
+   build_reg_write(b, reg, value);
+   
+   b->cursor = nir_after_cf_list(&if_stmt->else_list);
+   nir_ssa_def *else_value = nir_fmul(b, value, value);
+   
+   b->cursor = nir_after_cf_list(&impl->body);
+   nir_phi_instr *phi = nir_build_phi(b, 1);
+   nir_phi_add_ssa_src(b, phi, nir_cf_list_last_block(&if_stmt->then_list),
+		       then_value);
+   nir_phi_add_ssa_src(b, phi, nir_cf_list_last_block(&if_stmt->else_list),
+		       else_value);
+   
+   return &phi->dest.ssa;
+}
+
+/* loop { i = phi(0, i + 1); if (i >= limit) break; }, then i + 1 */
+static void
+build_counting_loop(nir_builder *b, nir_ssa_def *limit)
+{
+   nir_function_impl *impl = b->impl;
+   nir_ssa_def *zero = nir_imm_int(b, 0);
+   nir_ssa_def *one = nir_imm_int(b, 1);
+   nir_block *preheader = nir_cf_list_last_block(&impl->body);
+   
+   nir_loop *loop = nir_loop_create(b->shader);
+   nir_cf_node_insert_end(&impl->body, &loop->cf_node);
+   
+   b->cursor = nir_after_block(nir_cf_list_first_block(&loop->body));
+   nir_phi_instr *i = nir_build_phi(b, 1);
+   
+   b->cursor = nir_after_instr(&i->instr);
+   nir_if *if_stmt = build_if(b, &loop->body,
+			      nir_ige(b, &i->dest.ssa, limit));
+   nir_jump_instr *jump = nir_jump_instr_create(b->shader, nir_jump_break);
+   nir_instr_insert_after_cf_list(&if_stmt->then_list, &jump->instr);
+   
+   b->cursor = nir_after_cf_list(&loop->body);
+   nir_ssa_def *next = nir_iadd(b, &i->dest.ssa, one);
+   
+   nir_phi_add_ssa_src(b, i, preheader, zero);
+   nir_phi_add_ssa_src(b, i, nir_cf_list_last_block(&loop->body), next);
+   
+   b->cursor = nir_after_cf_list(&impl->body);
+   nir_iadd(b, &i->dest.ssa, one);
+}
+
+static void
+print_cf_list(const nir_divergence_analysis *da, struct exec_list *list)
+{
+   foreach_list_typed(nir_cf_node, node, node, list) {
+      switch (node->type) {
+	 case nir_cf_node_block:
+	    nir_foreach_instr(nir_cf_node_as_block(node), instr) {
+	       nir_dest *dest = nir_instr_dest(instr);
+	       if (dest != NULL && dest->is_ssa) {
+		  printf("ssa_%u: %s\n", dest->ssa.index,
+			 nir_ssa_def_is_divergent(da, &dest->ssa) ?
+			 "divergent" : "uniform");
+	       }
+	    }
+	    break;
+	    
+	 case nir_cf_node_if: {
+	    nir_if *if_stmt = nir_cf_node_as_if(node);
+	    printf("if ssa_%u: %s\n", if_stmt->condition.ssa->index,
+		   nir_if_is_divergent(da, if_stmt) ? "divergent" : "uniform");
+	    print_cf_list(da, &if_stmt->then_list);
+	    print_cf_list(da, &if_stmt->else_list);
+	    break;
+	 }
+	 
+	 case nir_cf_node_loop:
+	    print_cf_list(da, &nir_cf_node_as_loop(node)->body);
+	    break;
+	    
+	 default:
+	    break;
+      }
+   }
+}
+
+int main(void)
+{
+   nir_shader *shader = nir_shader_create(NULL);
+   nir_function *func = nir_function_create(shader, "main");
+   nir_function_overload *overload = nir_function_overload_create(func);
+   nir_function_impl *impl = nir_function_impl_create(overload);
+   
+   nir_builder b;
+   nir_builder_init(&b, shader, impl);
+   
+   nir_register *r0 = nir_local_reg_create(impl);
+   r0->num_components = 1;
+   nir_register *r1 = nir_local_reg_create(impl);
+   r1->num_components = 1;
+   
+   nir_ssa_def *uniform = nir_load_uniform(&b, 4, 0);
+   uniform = nir_fdot4(&b, uniform, uniform);
+   nir_ssa_def *input = nir_load_input(&b, 4, 0, 0);
+   input = nir_fdot4(&b, input, input);
+   nir_fddx(&b, uniform);
+   
+   build_select(&b, input, uniform, r0);
+   build_select(&b, uniform, uniform, r1);
+   
+   build_counting_loop(&b, nir_f2i(&b, input));
+   build_counting_loop(&b, nir_f2i(&b, uniform));
+   
+   nir_validate_shader(shader);
+   
+   void *mem_ctx = ralloc_context(NULL);
+   nir_divergence_analysis *da = nir_divergence_analysis_create(mem_ctx, impl);
+   
+   nir_print_shader(shader, stdout);
+   print_cf_list(da, &impl->body);
+   printf("r0: %s\n", nir_reg_is_divergent(da, r0) ? "divergent" : "uniform");
+   printf("r1: %s\n", nir_reg_is_divergent(da, r1) ? "divergent" : "uniform");
+   
+   ralloc_free(mem_ctx);
+   ralloc_free(shader);
+   
+   return 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Authors:
+ *    Connor Abbott (cwabbott0@gmail.com)
+ *
+ */
+
+/*
+ * Packs the outputs and inputs of a shader into vec4 slots, keeping flat
+ * and smooth variables apart.
+ */
+
+#include "nir_builder.h"
+
+static nir_variable *
+create_var(nir_shader *shader, nir_variable_mode mode, const char *name,
+	   unsigned components, int location, unsigned interpolation)
+{
+   nir_variable *var = rzalloc(shader, nir_variable);
+   var->name = ralloc_strdup(var, name);
+   var->type = glsl_vec_type(components);
+   var->data.mode = mode;
+   var->data.location = location;
+   var->data.interpolation = interpolation;
+   
+   struct hash_table *ht = mode == nir_var_shader_in ? shader->inputs
+						     : shader->outputs;
+   _mesa_hash_table_insert(ht, _mesa_hash_string(var->name), var->name, var);
+   return var;
+}
+
+static void
+print_var(nir_variable *var)
+{
+   printf("%s: location %d component %u\n", var->name, var->data.location,
+	  var->data.location_frac);
+}
+
+int main(void)
+{
+   nir_shader *shader = nir_shader_create(NULL);
+   nir_function *func = nir_function_create(shader, "main");
+   nir_function_overload *overload = nir_function_overload_create(func);
+   nir_function_impl *impl = nir_function_impl_create(overload);
+   
+   nir_builder b;
+   nir_builder_init(&b, shader, impl);
+   
+   /* interpolation 1 is smooth, 2 is flat */
+   nir_variable *outputs[] = {
+      create_var(shader, nir_var_shader_out, "color", 4, 0, 1),
+      create_var(shader, nir_var_shader_out, "a", 1, 1, 1),
+      create_var(shader, nir_var_shader_out, "b", 2, 2, 1),
+      create_var(shader, nir_var_shader_out, "c", 3, 3, 1),
+      create_var(shader, nir_var_shader_out, "d", 1, 4, 2),
+      create_var(shader, nir_var_shader_out, "e", 2, 5, 2),
+      create_var(shader, nir_var_shader_out, "f", 1, 6, 1),
+   };
+   nir_variable *inputs[] = {
+      create_var(shader, nir_var_shader_in, "in_a", 1, 0, 1),
+      create_var(shader, nir_var_shader_in, "in_b", 2, 1, 1),
+   };
+   
+   /* the loads are narrowed, so the users of in_b mustn't see it shrink */
+   nir_load_input(&b, 4, inputs[0]->data.location, 0);
+   nir_ssa_def *in_b = nir_load_input(&b, 4, inputs[1]->data.location, 0);
+   nir_fadd(&b, in_b, in_b);
+   nir_store_output(&b, in_b, outputs[0]->data.location, 0);
+   for (unsigned i = 1; i < 7; i++) {
+      nir_ssa_def *value = nir_imm_vec4(&b, 1.0f, 2.0f, 3.0f, 4.0f);
+      nir_store_output(&b, value, outputs[i]->data.location, 0);
+   }
+   
+   nir_validate_shader(shader);
+   
+   bool progress = nir_pack_varyings(shader, nir_var_shader_out);
+   printf("outputs: %d\n", progress);
+   progress = nir_pack_varyings(shader, nir_var_shader_in);
+   printf("inputs: %d\n", progress);
+   
+   for (unsigned i = 0; i < 7; i++)
+      print_var(outputs[i]);
+   for (unsigned i = 0; i < 2; i++)
+      print_var(inputs[i]);
+   
+   nir_validate_shader(shader);
+   nir_print_shader(shader, stdout);
+   
+   progress = nir_pack_varyings(shader, nir_var_shader_out);
+   printf("outputs: %d\n", progress);
+   
+   ralloc_free(shader);
+   
+   return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Authors:
+ *    Connor Abbott (cwabbott0@gmail.com)
+ *
+ */
+
+/*
+ * Links a vertex-like producer to a fragment-like consumer: an unread
+ * output, an unwritten input and a constant output are removed, while an
+ * array only accessed through its second element is kept.
+ */
+
+#include "nir_builder.h"
+
+static nir_variable *
+create_var(nir_shader *shader, nir_variable_mode mode, const char *name,
+	   unsigned components, int location)
+{
+   nir_variable *var = rzalloc(shader, nir_variable);
+   var->name = ralloc_strdup(var, name);
+   var->type = glsl_vec_type(components);
+   var->data.mode = mode;
+   var->data.location = location;
+   
+   struct hash_table *ht = mode == nir_var_shader_in ? shader->inputs
+						     : shader->outputs;
+   _mesa_hash_table_insert(ht, _mesa_hash_string(var->name), var->name, var);
+   return var;
+}
+
+static nir_function_impl *
+create_main(nir_shader *shader)
+{
+   nir_function *func = nir_function_create(shader, "main");
+   nir_function_overload *overload = nir_function_overload_create(func);
+   return nir_function_impl_create(overload);
+}
+
+static void
+print_vars(const char *title, struct hash_table *ht)
+{
+   printf("%s: %u\n", title, ht->entries);
+   
+   struct hash_entry *entry;
+   hash_table_foreach(ht, entry) {
+      nir_variable *var = (nir_variable *) entry->data;
+      printf("   %s\n", var->name);
+   }
+}
+
+int main(void)
+{
+   nir_shader *producer = nir_shader_create(NULL);
+   nir_shader *consumer = nir_shader_create(NULL);
+   nir_builder b;
+   
+   /* producer */
+   nir_function_impl *impl = create_main(producer);
+   nir_builder_init(&b, producer, impl);
+   
+   nir_variable *pos_in = create_var(producer, nir_var_shader_in, "pos", 4, 0);
+   nir_variable *position = create_var(producer, nir_var_shader_out,
+				       "gl_Position", 4, 0);
+   nir_variable *color = create_var(producer, nir_var_shader_out, "color", 4, 1);
+   nir_variable *scale = create_var(producer, nir_var_shader_out, "scale", 2, 2);
+   nir_variable *unused = create_var(producer, nir_var_shader_out, "unused", 4, 3);
+   
+   nir_ssa_def *pos = nir_load_input(&b, 4, pos_in->data.location, 0);
+   nir_store_output(&b, pos, position->data.location, 0);
+   nir_store_output(&b, nir_fadd(&b, pos, pos), color->data.location, 0);
+   nir_store_output(&b, nir_imm_vec4(&b, 0.5f, 2.0f, 0.0f, 0.0f),
+		    scale->data.location, 0);
+   nir_store_output(&b, nir_fmul(&b, pos, pos), unused->data.location, 0);
+   
+   nir_variable *arr = create_var(producer, nir_var_shader_out, "arr", 4, 5);
+   arr->type = glsl_array_type(arr->type, 2);
+   nir_store_output(&b, pos, arr->data.location + 1, 0);
+   
+   /* consumer */
+   impl = create_main(consumer);
+   nir_builder_init(&b, consumer, impl);
+   
+   color = create_var(consumer, nir_var_shader_in, "color", 4, 1);
+   scale = create_var(consumer, nir_var_shader_in, "scale", 2, 2);
+   nir_variable *missing = create_var(consumer, nir_var_shader_in,
+				      "missing", 4, 4);
+   nir_variable *frag = create_var(consumer, nir_var_shader_out,
+				   "frag_color", 4, 0);
+   
+   nir_ssa_def *value =
+      nir_fmul(&b, nir_load_input(&b, 4, color->data.location, 0),
+	       nir_load_input(&b, 2, scale->data.location, 0));
+   value = nir_fadd(&b, value,
+		    nir_load_input(&b, 4, missing->data.location, 0));
+   
+   arr = create_var(consumer, nir_var_shader_in, "arr", 4, 5);
+   arr->type = glsl_array_type(arr->type, 2);
+   value = nir_fadd(&b, value,
+		    nir_load_input(&b, 4, arr->data.location + 1, 0));
+   nir_store_output(&b, value, frag->data.location, 0);
+   
+   nir_validate_shader(producer);
+   nir_validate_shader(consumer);
+   
+   bool progress = nir_link_shaders(producer, consumer);
+   printf("progress: %d\n", progress);
+   
+   nir_validate_shader(producer);
+   nir_validate_shader(consumer);
+   
+   print_vars("outputs", producer->outputs);
+   print_vars("inputs", consumer->inputs);
+   nir_print_shader(producer, stdout);
+   nir_print_shader(consumer, stdout);
+   
+   progress = nir_link_shaders(producer, consumer);
+   printf("progress: %d\n", progress);
+   
+   ralloc_free(producer);
+   ralloc_free(consumer);
+   
+   return 0;
+}
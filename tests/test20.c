@@ -0,0 +1,132 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Authors:
+ *    Connor Abbott (cwabbott0@gmail.com)
+ *
+ */
+
+/*
+ * Removes the variables a shader never refers to and renumbers the uniforms
+ * that are left.
+ */
+
+#include "nir_builder.h"
+
+static nir_variable *
+create_var(nir_shader *shader, nir_variable_mode mode, const char *name,
+	   const struct glsl_type *type, int location)
+{
+   nir_variable *var = rzalloc(shader, nir_variable);
+   var->name = ralloc_strdup(var, name);
+   var->type = type;
+   var->data.mode = mode;
+   var->data.location = location;
+   
+   struct hash_table *ht;
+   switch (mode) {
+      case nir_var_shader_in: ht = shader->inputs; break;
+      case nir_var_shader_out: ht = shader->outputs; break;
+      case nir_var_uniform: ht = shader->uniforms; break;
+      default: ht = shader->globals; break;
+   }
+   _mesa_hash_table_insert(ht, _mesa_hash_string(var->name), var->name, var);
+   return var;
+}
+
+static void
+print_vars(const char *title, struct hash_table *ht)
+{
+   printf("%s: %u\n", title, ht->entries);
+   
+   struct hash_entry *entry;
+   hash_table_foreach(ht, entry) {
+      nir_variable *var = (nir_variable *) entry->data;
+      printf("   %s: location %d\n", var->name, var->data.location);
+   }
+}
+
+int main(void)
+{
+   nir_shader *shader = nir_shader_create(NULL);
+   nir_function *func = nir_function_create(shader, "main");
+   nir_function_overload *overload = nir_function_overload_create(func);
+   nir_function_impl *impl = nir_function_impl_create(overload);
+   
+   nir_builder b;
+   nir_builder_init(&b, shader, impl);
+   
+   const struct glsl_type *vec4 = glsl_vec4_type();
+   
+   create_var(shader, nir_var_uniform, "u_a", vec4, 0);
+   create_var(shader, nir_var_uniform, "u_dead", glsl_array_type(vec4, 3), 1);
+   create_var(shader, nir_var_uniform, "u_b", glsl_array_type(vec4, 2), 4);
+   nir_variable *u_deref = create_var(shader, nir_var_uniform, "u_deref",
+				      vec4, -1);
+   create_var(shader, nir_var_shader_in, "in_used", vec4, 0);
+   create_var(shader, nir_var_shader_in, "in_dead", vec4, 1);
+   create_var(shader, nir_var_shader_out, "out_dead", vec4, 0);
+   nir_variable *g_used = create_var(shader, nir_var_global, "g_used",
+				     vec4, -1);
+   create_var(shader, nir_var_global, "g_dead", vec4, -1);
+   
+   nir_ssa_def *u_a = nir_load_uniform(&b, 4, 0);
+   /* the second element of u_b */
+   nir_ssa_def *u_b = nir_load_uniform(&b, 4, 5);
+   nir_ssa_def *value = nir_fadd(&b, u_a, u_b);
+   nir_ssa_def *input = nir_load_input(&b, 4, 0, 0);
+   value = nir_fadd(&b, value, input);
+   
+   nir_intrinsic_instr *load =
+      nir_intrinsic_instr_create(shader, nir_intrinsic_load_var_vec4);
+   load->variables[0] = nir_deref_var_create(shader, u_deref);
+   nir_ssa_dest_init(impl, &load->instr, &load->dest, 4, NULL);
+   nir_builder_instr_insert(&b, &load->instr);
+   value = nir_fadd(&b, value, &load->dest.ssa);
+   
+   nir_intrinsic_instr *store =
+      nir_intrinsic_instr_create(shader, nir_intrinsic_store_var_vec4);
+   store->variables[0] = nir_deref_var_create(shader, g_used);
+   store->src[0].is_ssa = true;
+   store->src[0].ssa = value;
+   nir_builder_instr_insert(&b, &store->instr);
+   
+   nir_validate_shader(shader);
+   
+   bool progress = nir_remove_dead_variables(shader);
+   printf("progress: %d\n", progress);
+   
+   nir_validate_shader(shader);
+   
+   print_vars("uniforms", shader->uniforms);
+   print_vars("inputs", shader->inputs);
+   print_vars("outputs", shader->outputs);
+   print_vars("globals", shader->globals);
+   nir_print_shader(shader, stdout);
+   
+   progress = nir_remove_dead_variables(shader);
+   printf("progress: %d\n", progress);
+   
+   ralloc_free(shader);
+   
+   return 0;
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Authors:
+ *    Connor Abbott (cwabbott0@gmail.com)
+ *
+ */
+
+/*
+ * Lowers projectors, offsets, txb and txd, and clamps offsets in a second
+ * shader.
+ */
+
+#include "nir_builder.h"
+
+static nir_ssa_def *
+imm_vec2(nir_builder *b, float x, float y)
+{
+   nir_const_value value = { { { 0 } } };
+   value.f[0] = x;
+   value.f[1] = y;
+   return nir_build_imm(b, 2, value);
+}
+
+static nir_ssa_def *
+imm_ivec2(nir_builder *b, int x, int y)
+{
+   nir_const_value value = { { { 0 } } };
+   value.i[0] = x;
+   value.i[1] = y;
+   return nir_build_imm(b, 2, value);
+}
+
+static void
+build_tex(nir_builder *b, nir_texop op, unsigned num_srcs,
+	  const nir_texinput_type *types, nir_ssa_def **srcs)
+{
+   nir_tex_instr *tex = nir_tex_instr_create(b->shader, num_srcs);
+   tex->op = op;
+   tex->sampler_index = 1;
+   for (unsigned i = 0; i < num_srcs; i++) {
+      tex->src[i].is_ssa = true;
+      tex->src[i].ssa = srcs[i];
+      tex->src_type[i] = types[i];
+      if (types[i] == nir_tex_src_coord)
+	 tex->coord_components = srcs[i]->num_components;
+   }
+   
+   nir_ssa_dest_init(b->impl, &tex->instr, &tex->dest,
+		     nir_tex_instr_dest_size(tex), NULL);
+   nir_builder_instr_insert(b, &tex->instr);
+}
+
+static nir_shader *
+create_shader(nir_builder *b)
+{
+   nir_shader *shader = nir_shader_create(NULL);
+   nir_function *func = nir_function_create(shader, "main");
+   nir_function_overload *overload = nir_function_overload_create(func);
+   nir_function_impl *impl = nir_function_impl_create(overload);
+   nir_builder_init(b, shader, impl);
+   return shader;
+}
+
+int main(void)
+{
+   nir_builder b;
+   nir_shader *shader = create_shader(&b);
+   
+   nir_ssa_def *coord = imm_vec2(&b, 0.25f, 0.75f);
+   
+   {
+      nir_texinput_type types[] = {
+	 nir_tex_src_coord, nir_tex_src_projector, nir_tex_src_shadow
+      };
+      nir_ssa_def *projector = nir_imm_float(&b, 2.0f);
+      nir_ssa_def *shadow = nir_imm_float(&b, 0.5f);
+      nir_ssa_def *srcs[] = { coord, projector, shadow };
+      build_tex(&b, nir_texop_tex, 3, types, srcs);
+   }
+   {
+      nir_texinput_type types[] = { nir_tex_src_coord, nir_tex_src_offset };
+      nir_ssa_def *srcs[] = { coord, imm_ivec2(&b, 1, -1) };
+      build_tex(&b, nir_texop_tex, 2, types, srcs);
+   }
+   {
+      nir_texinput_type types[] = { nir_tex_src_coord, nir_tex_src_offset,
+				    nir_tex_src_lod };
+      nir_ssa_def *texel = imm_ivec2(&b, 3, 4);
+      nir_ssa_def *offset = imm_ivec2(&b, 1, -1);
+      nir_ssa_def *lod = nir_imm_int(&b, 0);
+      nir_ssa_def *srcs[] = { texel, offset, lod };
+      build_tex(&b, nir_texop_txf, 3, types, srcs);
+   }
+   {
+      /* a 2D array, where the offset has no component for the layer */
+      nir_texinput_type types[] = { nir_tex_src_coord, nir_tex_src_offset,
+				    nir_tex_src_lod };
+      nir_const_value value = { { { 0 } } };
+      value.i[0] = 3;
+      value.i[1] = 4;
+      value.i[2] = 5;
+      nir_ssa_def *texel = nir_build_imm(&b, 3, value);
+      nir_ssa_def *offset = imm_ivec2(&b, 1, -1);
+      nir_ssa_def *lod = nir_imm_int(&b, 0);
+      nir_ssa_def *srcs[] = { texel, offset, lod };
+      build_tex(&b, nir_texop_txf, 3, types, srcs);
+   }
+   {
+      nir_texinput_type types[] = { nir_tex_src_coord, nir_tex_src_bias };
+      nir_ssa_def *srcs[] = { coord, nir_imm_float(&b, 1.5f) };
+      build_tex(&b, nir_texop_txb, 2, types, srcs);
+   }
+   {
+      nir_texinput_type types[] = { nir_tex_src_coord, nir_tex_src_ddx,
+				    nir_tex_src_ddy };
+      nir_ssa_def *ddx = imm_vec2(&b, 0.01f, 0.0f);
+      nir_ssa_def *ddy = imm_vec2(&b, 0.0f, 0.02f);
+      nir_ssa_def *srcs[] = { coord, ddx, ddy };
+      build_tex(&b, nir_texop_txd, 3, types, srcs);
+   }
+   {
+      /* a 1D array, where the derivatives have no component for the layer */
+      nir_texinput_type types[] = { nir_tex_src_coord, nir_tex_src_ddx,
+				    nir_tex_src_ddy };
+      nir_ssa_def *ddx = nir_imm_float(&b, 0.01f);
+      nir_ssa_def *ddy = nir_imm_float(&b, 0.02f);
+      nir_ssa_def *srcs[] = { coord, ddx, ddy };
+      build_tex(&b, nir_texop_txd, 3, types, srcs);
+   }
+   
+   nir_validate_shader(shader);
+   
+   nir_lower_tex_options options = {
+      .lower_projector = true,
+      .lower_offset = true,
+      .lower_txb = true,
+      .lower_txd = true,
+   };
+   bool progress = nir_lower_tex(shader, &options);
+   printf("progress: %d\n", progress);
+   
+   nir_validate_shader(shader);
+   nir_print_shader(shader, stdout);
+   
+   progress = nir_lower_tex(shader, &options);
+   printf("progress: %d\n", progress);
+   
+   ralloc_free(shader);
+   
+   /* offsets the hardware takes, clamped to [-8, 7] */
+   shader = create_shader(&b);
+   {
+      nir_texinput_type types[] = { nir_tex_src_coord, nir_tex_src_offset };
+      nir_ssa_def *clamp_coord = imm_vec2(&b, 0.25f, 0.75f);
+      nir_ssa_def *offset = imm_ivec2(&b, 9, -12);
+      nir_ssa_def *srcs[] = { clamp_coord, offset };
+      build_tex(&b, nir_texop_tex, 2, types, srcs);
+   }
+   
+   nir_lower_tex_options clamp_options = {
+      .min_offset = -8,
+      .max_offset = 7,
+   };
+   progress = nir_lower_tex(shader, &clamp_options);
+   printf("progress: %d\n", progress);
+   
+   nir_validate_shader(shader);
+   nir_print_shader(shader, stdout);
+   
+   ralloc_free(shader);
+   
+   /* the offset isn't added to a coordinate that still needs projecting */
+   shader = create_shader(&b);
+   {
+      nir_texinput_type types[] = { nir_tex_src_coord, nir_tex_src_projector,
+				    nir_tex_src_offset };
+      nir_ssa_def *proj_coord = imm_vec2(&b, 0.25f, 0.75f);
+      nir_ssa_def *projector = nir_imm_float(&b, 2.0f);
+      nir_ssa_def *offset = imm_ivec2(&b, 1, -1);
+      nir_ssa_def *srcs[] = { proj_coord, projector, offset };
+      build_tex(&b, nir_texop_tex, 3, types, srcs);
+   }
+   
+   nir_lower_tex_options offset_options = {
+      .lower_offset = true,
+   };
+   progress = nir_lower_tex(shader, &offset_options);
+   printf("progress: %d\n", progress);
+   
+   ralloc_free(shader);
+   
+   return 0;
+}
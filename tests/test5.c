@@ -0,0 +1,96 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Authors:
+ *    Connor Abbott (cwabbott0@gmail.com)
+ *
+ */
+
+/*
+ * Runs a pass on several functions sharing a global register at once.
+ */
+
+#include "nir.h"
+
+#define NUM_FUNCTIONS 6
+
+static bool
+add_global_use(nir_function_impl *impl, nir_pass_worker *worker, void *data)
+{
+   nir_register *global_reg = (nir_register *) data;
+   
+   nir_register *reg = nir_local_reg_create(impl);
+   reg->num_components = 1;
+   
+   nir_load_const_instr *load_const = nir_load_const_instr_create(impl);
+   load_const->dest.reg.reg = reg;
+   load_const->value.u[0] = worker->impl_index;
+   nir_instr_insert_after_cf_list(&impl->body, &load_const->instr);
+   
+   nir_alu_instr *add = nir_alu_instr_create(impl, nir_op_iadd);
+   add->dest.dest.reg.reg = global_reg;
+   add->dest.write_mask = 0x1;
+   add->src[0].src.reg.reg = global_reg;
+   add->src[1].src.reg.reg = reg;
+   nir_instr_insert_after_cf_list(&impl->body, &add->instr);
+   
+   return worker->impl_index == NUM_FUNCTIONS - 1;
+}
+
+int main(void)
+{
+   nir_shader *shader = nir_shader_create(NULL);
+   
+   nir_register *global_reg = nir_global_reg_create(shader);
+   global_reg->num_components = 1;
+   global_reg->name = "sum";
+   
+   static const char *names[NUM_FUNCTIONS] = {
+      "main", "helper0", "helper1", "helper2", "helper3", "helper4"
+   };
+   
+   for (unsigned i = 0; i < NUM_FUNCTIONS; i++) {
+      nir_function *func = nir_function_create(shader, names[i]);
+      nir_function_overload *overload = nir_function_overload_create(func);
+      nir_function_impl_create(overload);
+   }
+   
+   nir_pass_runner *runner = nir_pass_runner_create(4);
+   
+   bool progress = nir_pass_runner_run(runner, shader, add_global_use,
+				       global_reg);
+   printf("progress: %s\n", progress ? "true" : "false");
+   
+   /* validation runs on the default runner, which is serial until set */
+   nir_set_default_pass_runner(runner);
+   nir_validate_shader(shader);
+   nir_set_default_pass_runner(NULL);
+   
+   nir_pass_runner_destroy(runner);
+   
+   nir_validate_shader(shader);
+   nir_print_shader(shader, stdout);
+   
+   ralloc_free(shader);
+   
+   return 0;
+}
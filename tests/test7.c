@@ -0,0 +1,93 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Authors:
+ *    Connor Abbott (cwabbott0@gmail.com)
+ *
+ */
+
+/*
+ * Validates a shader using SSA values with nir_validate_shader_fast(), which
+ * renumbers the values before checking them.
+ */
+
+#include "nir.h"
+
+static nir_load_const_instr *
+ssa_load_const(nir_shader *shader, unsigned index, int value)
+{
+   nir_load_const_instr *load_const = nir_load_const_instr_create(shader);
+   load_const->dest.is_ssa = true;
+   load_const->dest.ssa.index = index;
+   load_const->dest.ssa.num_components = 1;
+   load_const->value.i[0] = value;
+   return load_const;
+}
+
+static nir_alu_instr *
+ssa_mov(nir_shader *shader, unsigned index, nir_ssa_def *src)
+{
+   nir_alu_instr *mov = nir_alu_instr_create(shader, nir_op_mov);
+   mov->src[0].src.is_ssa = true;
+   mov->src[0].src.ssa = src;
+   mov->dest.dest.is_ssa = true;
+   mov->dest.dest.ssa.index = index;
+   mov->dest.dest.ssa.num_components = 1;
+   mov->dest.write_mask = 0x1;
+   return mov;
+}
+
+int main(void)
+{
+   nir_shader *shader = nir_shader_create(NULL);
+   nir_function *func = nir_function_create(shader, "main");
+   nir_function_overload *overload = nir_function_overload_create(func);
+   nir_function_impl *impl = nir_function_impl_create(overload);
+   
+   /* start with indices that are neither dense nor in order */
+   nir_load_const_instr *condition = ssa_load_const(shader, 42, 1);
+   nir_instr_insert_after_cf_list(&impl->body, &condition->instr);
+   
+   nir_if *if_stmt = nir_if_create(shader);
+   if_stmt->condition.is_ssa = true;
+   if_stmt->condition.ssa = &condition->dest.ssa;
+   nir_cf_node_insert_end(&impl->body, &if_stmt->cf_node);
+   
+   nir_alu_instr *then_mov = ssa_mov(shader, 17, &condition->dest.ssa);
+   nir_instr_insert_after_cf_list(&if_stmt->then_list, &then_mov->instr);
+   
+   nir_load_const_instr *else_const = ssa_load_const(shader, 3, 2);
+   nir_instr_insert_after_cf_list(&if_stmt->else_list, &else_const->instr);
+   
+   nir_alu_instr *after_mov = ssa_mov(shader, 99, &condition->dest.ssa);
+   nir_instr_insert_after_cf_list(&impl->body, &after_mov->instr);
+   
+   nir_validate_shader_fast(shader);
+   nir_print_shader(shader, stdout);
+   
+   /* the slow validator accepts the renumbered shader too */
+   nir_validate_shader(shader);
+   
+   ralloc_free(shader);
+   
+   return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Authors:
+ *    Connor Abbott (cwabbott0@gmail.com)
+ *
+ */
+
+/*
+ * Checks which edits mark functions as needing validation, and that
+ * validation clears the flags again.
+ */
+
+#include "nir.h"
+
+static nir_function_impl *
+create_impl(nir_shader *shader, const char *name)
+{
+   nir_function *func = nir_function_create(shader, name);
+   nir_function_overload *overload = nir_function_overload_create(func);
+   return nir_function_impl_create(overload);
+}
+
+static void
+print_dirty(const char *when, nir_shader *shader, nir_function_impl *a,
+	    nir_function_impl *b)
+{
+   printf("%s: globals %d, a %d, b %d\n", when, shader->globals_dirty,
+	  a->dirty, b->dirty);
+}
+
+int main(void)
+{
+   nir_shader *shader = nir_shader_create(NULL);
+   nir_function_impl *a = create_impl(shader, "a");
+   nir_function_impl *b = create_impl(shader, "b");
+   
+   print_dirty("created", shader, a, b);
+   
+   nir_validate_shader(shader);
+   print_dirty("validated", shader, a, b);
+   
+   nir_register *reg = nir_local_reg_create(a);
+   reg->num_components = 1;
+   print_dirty("local register", shader, a, b);
+   
+   nir_validate_shader(shader);
+   
+   /* an instruction inserted into a detached block doesn't mark anything... */
+   nir_loop *loop = nir_loop_create(shader);
+   nir_load_const_instr *load_const = nir_load_const_instr_create(shader);
+   load_const->dest.reg.reg = reg;
+   load_const->value.i[0] = 1;
+   nir_instr_insert_after_cf_list(&loop->body, &load_const->instr);
+   print_dirty("detached instruction", shader, a, b);
+   
+   /* ...until the tree is inserted */
+   nir_cf_node_insert_end(&a->body, &loop->cf_node);
+   print_dirty("loop", shader, a, b);
+   
+   nir_validate_shader(shader);
+   
+   nir_jump_instr *jump = nir_jump_instr_create(shader, nir_jump_break);
+   nir_instr_insert_after_cf_list(&loop->body, &jump->instr);
+   print_dirty("break", shader, a, b);
+   
+   nir_validate_shader(shader);
+   
+   nir_instr_remove(&load_const->instr);
+   print_dirty("removed instruction", shader, a, b);
+   
+   nir_validate_shader_fast(shader);
+   print_dirty("validated fast", shader, a, b);
+   
+   nir_cf_node_remove(&loop->cf_node);
+   print_dirty("removed loop", shader, a, b);
+   
+   nir_register *global = nir_global_reg_create(shader);
+   global->num_components = 1;
+   print_dirty("global register", shader, a, b);
+   
+   nir_validate_shader(shader);
+   print_dirty("validated", shader, a, b);
+   
+   ralloc_free(shader);
+   
+   return 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Authors:
+ *    Connor Abbott (cwabbott0@gmail.com)
+ *
+ */
+
+/*
+ * Prints a shader to a string and checks that nir_print_shader() writes the
+ * same thing, including the hand-formatted constants.
+ */
+
+#include "nir.h"
+#include <string.h>
+
+int main(void)
+{
+   nir_shader *shader = nir_shader_create(NULL);
+   nir_function *func = nir_function_create(shader, "main");
+   nir_function_overload *overload = nir_function_overload_create(func);
+   nir_function_impl *impl = nir_function_impl_create(overload);
+   
+   nir_register *reg = nir_local_reg_create(impl);
+   reg->num_components = 4;
+   reg->name = "value";
+   
+   static const float values[][4] = {
+      { 0.0f, -0.0f, 1.0f, -1.5f },
+      { 0.0000005f, 0.0000015f, 0.9999995f, 123.456f },
+      { 4294967296.0f, -1e-9f, 3.0e38f, 1.0f / 3.0f },
+   };
+   
+   for (unsigned i = 0; i < 3; i++) {
+      nir_load_const_instr *load_const = nir_load_const_instr_create(shader);
+      load_const->dest.reg.reg = reg;
+      for (unsigned j = 0; j < 4; j++)
+	 load_const->value.f[j] = values[i][j];
+      nir_instr_insert_after_cf_list(&impl->body, &load_const->instr);
+   }
+   
+   nir_if *if_stmt = nir_if_create(shader);
+   if_stmt->condition.reg.reg = reg;
+   nir_cf_node_insert_end(&impl->body, &if_stmt->cf_node);
+   
+   char *str = nir_print_shader_to_string(shader, shader);
+   printf("%s", str);
+   
+   FILE *fp = tmpfile();
+   nir_print_shader(shader, fp);
+   
+   long len = ftell(fp);
+   char *file_str = ralloc_size(shader, len + 1);
+   rewind(fp);
+   file_str[fread(file_str, 1, len, fp)] = '\0';
+   fclose(fp);
+   
+   printf("same as nir_print_shader(): %s\n",
+	  strcmp(str, file_str) == 0 ? "yes" : "no");
+   
+   ralloc_free(shader);
+   
+   return 0;
+}